@@ -1,5 +1,11 @@
 #include <iostream>
 #include <opencv4/opencv2/opencv.hpp>
+#include "autotune.hpp"
+#include "display_sink.hpp"
+#include "image_stats.hpp"
+#include "instrumentation.hpp"
+#include "planar_image.hpp"
+#include "specialized_kernels.hpp"
 
 /**
  * Converts color image to grayscale using iterator method
@@ -20,6 +26,9 @@ void first_way(cv::Mat &main_img)
         return;
     }
 
+    INSTRUMENT_SCOPE("grayscale.first_way");
+    INSTRUMENT_COUNT("grayscale.pixels", main_img.total());
+
     // Get begin and end iterators for efficient pixel traversal
     cv::Mat_<cv::Vec3b>::iterator it_begin = main_img.begin<cv::Vec3b>();
     cv::Mat_<cv::Vec3b>::iterator it_end = main_img.end<cv::Vec3b>();
@@ -64,6 +73,9 @@ void second_way(cv::Mat &main_img)
         return;
     }
 
+    INSTRUMENT_SCOPE("grayscale.second_way");
+    INSTRUMENT_COUNT("grayscale.pixels", main_img.total());
+
     // Loop through all pixels using direct coordinate access
     for (int y = 0; y < main_img.rows; y++)
     {
@@ -98,14 +110,69 @@ void third_way_efficient(cv::Mat &main_img)
         return;
     }
 
-    // Most efficient way: Use OpenCV's built-in cvtColor
+    INSTRUMENT_SCOPE("grayscale.third_way_efficient");
+    INSTRUMENT_COUNT("grayscale.pixels", main_img.total());
+
+    // Most efficient way: one cv::transform call computes the luminance into all three channels,
+    // instead of cvtColor to gray followed by a second GRAY2BGR pass
+    // Every output channel gets the same weights: 0.114*B + 0.587*G + 0.299*R
+    cv::Matx33f weights(0.114f, 0.587f, 0.299f,
+                        0.114f, 0.587f, 0.299f,
+                        0.114f, 0.587f, 0.299f);
+    cv::transform(main_img, main_img, weights);
+}
+
+/**
+ * Converts color image to grayscale through a planar (one plane per channel) copy
+ * Each row is then a straight loop over three contiguous arrays, which vectorizes well
+ * @param main_img Reference to the input image (will be modified in-place)
+ */
+void fourth_way_planar(cv::Mat &main_img)
+{
+    if (main_img.empty() || main_img.channels() != 3)
+    {
+        std::cerr << "Error: Invalid input image!" << std::endl;
+        return;
+    }
+
+    INSTRUMENT_SCOPE("grayscale.fourth_way_planar");
+    INSTRUMENT_COUNT("grayscale.pixels", main_img.total());
+
+    PlanarImage planar;
+    deinterleave(main_img, planar);
+
+    cv::Mat gray;
+    planar_to_gray(planar, gray);
+    cv::Mat channels[3] = {gray, gray, gray};
+    cv::merge(channels, 3, main_img); // Back to 3-channel like the other methods
+}
+
+/**
+ * Converts color image to grayscale with a kernel specialized for its depth and channel count
+ * The kernel is picked once from a table, so the pixel loop has no type checks and vectorizes
+ * @param main_img Reference to the input image (will be modified in-place)
+ */
+void fifth_way_specialized(cv::Mat &main_img)
+{
+    if (main_img.empty() || main_img.channels() != 3)
+    {
+        std::cerr << "Error: Invalid input image!" << std::endl;
+        return;
+    }
+
+    INSTRUMENT_SCOPE("grayscale.fifth_way_specialized");
+    INSTRUMENT_COUNT("grayscale.pixels", main_img.total());
+
     cv::Mat gray;
-    cv::cvtColor(main_img, gray, cv::COLOR_BGR2GRAY);
-    cv::cvtColor(gray, main_img, cv::COLOR_GRAY2BGR); // Convert back to 3-channel
+    fast_grayscale(main_img, gray);
+    cv::Mat channels[3] = {gray, gray, gray};
+    cv::merge(channels, 3, main_img); // Back to 3-channel like the other methods
 }
 
 int main(int argc, char const *argv[])
 {
+    // --tuned: also run the autotuned grayscale kernel (tunes on the first run)
+    const bool tuned = argc > 1 && std::string(argv[1]) == "--tuned";
     std::cout << "OpenCV Version: " << CV_VERSION << std::endl;
 
     // Load input image
@@ -119,25 +186,40 @@ int main(int argc, char const *argv[])
     }
 
     // Display original image
-    cv::namedWindow("Original Image", cv::WINDOW_GUI_EXPANDED);
-    cv::imshow("Original Image", img);
+    display_sink().show("Original Image", img);
     std::cout << "Press any key to continue..." << std::endl;
-    cv::waitKey(0);
+    display_sink().wait_key(0);
 
     // Convert to grayscale using OpenCV function
     cv::Mat gray_img;
-    cv::cvtColor(img, gray_img, cv::COLOR_BGR2GRAY);
-    cv::namedWindow("OpenCV Grayscale", cv::WINDOW_GUI_EXPANDED);
-    cv::imshow("OpenCV Grayscale", gray_img);
+    {
+        INSTRUMENT_SCOPE("grayscale.cvtColor");
+        cv::cvtColor(img, gray_img, cv::COLOR_BGR2GRAY);
+    }
+    display_sink().show("OpenCV Grayscale", gray_img);
     std::cout << "Press any key to continue..." << std::endl;
-    cv::waitKey(0);
+    display_sink().wait_key(0);
+
+    // Optional (--tuned): the same conversion through the autotuned tiled kernel
+    // The first run times tile sizes and thread counts on this machine and saves them to cv_lessons.tune
+    cv::Mat tuned_gray;
+    if (tuned)
+    {
+        autotune(); // kernels stay tuned for this run even if the profile cannot be saved
+    }
+    if (tuned && run_tuned("gray", img, tuned_gray))
+    {
+        const TileConfig config = KernelRegistry::instance().find("gray")->config;
+        std::cout << "Tuned grayscale: " << config.tile_rows << " rows per tile (0 = one per thread), "
+                  << config.threads << " threads" << std::endl;
+    }
 
     // Display image information
     std::cout << "Image size: " << img.size()
               << " | Channels: " << img.channels()
               << " | Type: " << img.type() << std::endl;
 
-    cv::destroyAllWindows();
+    display_sink().close_all();
 
     /*
      * Exercise 1: Manual grayscale conversion
@@ -162,12 +244,13 @@ int main(int argc, char const *argv[])
         first_way(manual_gray);
         // second_way(manual_gray);
         // third_way_efficient(manual_gray);
+        // fourth_way_planar(manual_gray);
+        // fifth_way_specialized(manual_gray);
 
-        cv::namedWindow("Manual Grayscale Conversion", cv::WINDOW_GUI_EXPANDED);
-        cv::imshow("Manual Grayscale Conversion", manual_gray);
+        display_sink().show("Manual Grayscale Conversion", manual_gray);
         std::cout << "Press any key to continue..." << std::endl;
-        cv::waitKey(0);
-        cv::destroyAllWindows();
+        display_sink().wait_key(0);
+        display_sink().close_all();
     }
 
     /*
@@ -189,22 +272,22 @@ int main(int argc, char const *argv[])
     std::cout << "\nCheckerboard values (" << cb_image.rows << "x" << cb_image.cols << "):" << std::endl;
     std::cout << "==========================================" << std::endl;
 
-    // Display pixel values in a formatted way
-    for (int y = 0; y < cb_image.rows; y++)
+    // Display pixel values as CSV, one line per row (each row is formatted into one buffer, not value by value)
+    dump_region_csv(cb_image, cv::Rect(0, 0, cb_image.cols, cb_image.rows), std::cout);
+
+    // Summary of all values in one pass: min/max/mean/stddev and how many are pure black or white
+    ImageStats cb_stats;
+    if (image_stats(cb_image, cb_stats))
     {
-        for (int x = 0; x < cb_image.cols; x++)
-        {
-            // Format output for better readability
-            std::cout << std::setw(3) << static_cast<int>(cb_image.at<uchar>(y, x)) << " ";
-        }
-        std::cout << std::endl;
+        cb_stats.print(std::cout, "Checkerboard");
     }
 
     // Optional: Also display the checkerboard image
-    cv::namedWindow("Checkerboard", cv::WINDOW_GUI_EXPANDED);
-    cv::imshow("Checkerboard", cb_image);
-    cv::waitKey(0);
-    cv::destroyAllWindows();
+    display_sink().show("Checkerboard", cb_image);
+    display_sink().wait_key(0);
+    display_sink().close_all();
+
+    INSTRUMENT_REPORT("01_start_opencv_gray_scaling");
 
     return 0;
 }
\ No newline at end of file
@@ -1,5 +1,11 @@
 #include <iostream>
+#include <vector>
 #include <opencv4/opencv2/opencv.hpp>
+#include "batch_ops.hpp"
+#include "display_sink.hpp"
+#include "instrumentation.hpp"
+#include "resize.hpp"
+#include "tiled_image.hpp"
 
 void validate_cropping(cv::Mat &pic, cv::Rect &crop_rect)
 {
@@ -34,13 +40,12 @@ int main(int argc, char const *argv[])
     }
 
     // display original image with window name
-    cv::namedWindow("Original MML Image", cv::WINDOW_GUI_EXPANDED);
-    cv::imshow("Original MML Image", mml);
+    display_sink().show("Original MML Image", mml);
     std::cout << "Original image loaded successfully!" << std::endl;
     std::cout << "Image size: " << mml.cols << "x" << mml.rows
               << " | Channels: " << mml.channels() << std::endl;
     std::cout << "Press any key to continue..." << std::endl;
-    cv::waitKey(0);
+    display_sink().wait_key(0);
 
     /*
      * define cropping region and extract ROI (Region of Interest)
@@ -53,14 +58,17 @@ int main(int argc, char const *argv[])
     validate_cropping(mml, crop_mml_rect);
 
     // extract region of interest - this creates a VIEW (not a copy) of the original
-    cv::Mat crop_mml = mml(crop_mml_rect);
+    cv::Mat crop_mml;
+    {
+        INSTRUMENT_SCOPE("crop.view");
+        crop_mml = mml(crop_mml_rect);
+    }
 
     // Display cropped image
-    cv::namedWindow("Cropped MML Region", cv::WINDOW_GUI_EXPANDED);
-    cv::imshow("Cropped MML Region", crop_mml);
+    display_sink().show("Cropped MML Region", crop_mml);
     std::cout << "Cropped image size: " << crop_mml.cols << "x" << crop_mml.rows << std::endl;
     std::cout << "Press any key to exit..." << std::endl;
-    cv::waitKey(0);
+    display_sink().wait_key(0);
 
     /*
      * Save the cropped image
@@ -78,14 +86,66 @@ int main(int argc, char const *argv[])
     /*
      * Optional: Demonstrate creating an actual copy (not a view)
      */
-    cv::Mat crop_mml_copy = mml(crop_mml_rect).clone();
+    cv::Mat crop_mml_copy;
+    {
+        INSTRUMENT_SCOPE("crop.copy");
+        crop_mml_copy = mml(crop_mml_rect).clone();
+    }
     std::cout << "Created a separate copy of the cropped region." << std::endl;
 
+    /*
+     * Optional: Extract many same-size crops in one call (tiles for a classifier, for example)
+     * All crops end up in one contiguous batch, then one call converts the whole batch to grayscale
+     */
+    std::vector<cv::Rect> tile_rects;
+    for (int y = 0; y + 64 <= mml.rows; y += 64)
+    {
+        for (int x = 0; x + 64 <= mml.cols; x += 64)
+        {
+            tile_rects.push_back(cv::Rect(x, y, 64, 64));
+        }
+    }
+    if (!tile_rects.empty())
+    {
+        ImageBatch tiles;
+        ImageBatch gray_tiles;
+        batch_crop(mml, tile_rects, cv::Size(64, 64), tiles);
+        batch_grayscale(tiles, gray_tiles);
+        std::cout << "Extracted " << tiles.count << " tiles of 64x64 as one batch." << std::endl;
+    }
+
+    /*
+     * Optional: Crop and resize in one step (the usual model input preparation)
+     * Only the rectangle is read from the full image; no cropped copy is made first
+     */
+    cv::Mat crop_mml_input;
+    resize_crop(mml, crop_mml_rect, crop_mml_input, cv::Size(224, 224), RESIZE_AREA);
+    std::cout << "Resized the cropped region to " << crop_mml_input.cols << "x" << crop_mml_input.rows
+              << " without copying it first." << std::endl;
+
+    /*
+     * Optional: Crop from a tiled store instead of a fully loaded image
+     * Huge scans are stored as tiles; only the tiles touching the rectangle are read from disk
+     */
+    if (tile_from_image(mml, "../images/mml-gol.tiles", cv::Size(128, 128)))
+    {
+        TiledImage tiled_mml;
+        if (tiled_mml.open("../images/mml-gol.tiles"))
+        {
+            cv::Mat tiled_crop_mml = tiled_crop(tiled_mml, crop_mml_rect);
+            std::cout << "Cropped " << tiled_crop_mml.cols << "x" << tiled_crop_mml.rows
+                      << " from the tiled store (" << tiled_mml.tiles_x() << "x" << tiled_mml.tiles_y()
+                      << " tiles of 128x128)." << std::endl;
+        }
+    }
+
     /*
      * Cleanup and exit
      */
-    cv::destroyAllWindows();
+    display_sink().close_all();
     std::cout << "Program completed successfully!" << std::endl;
 
+    INSTRUMENT_REPORT("02_cropping");
+
     return 0;
 }
\ No newline at end of file
@@ -1,5 +1,7 @@
 #include <iostream>
 #include <opencv4/opencv2/opencv.hpp>
+#include "bilevel_image.hpp"
+#include "display_sink.hpp"
 
 #define SIZE 300
 
@@ -21,12 +23,10 @@ int main(int argc, char const *argv[])
               << " | type: " << white_square.type() << std::endl;
 
     // Display the original images
-    cv::namedWindow("black Square (All Zeros)", cv::WINDOW_GUI_EXPANDED);
-    cv::imshow("black Square (All Zeros)", black_square);
-    cv::namedWindow("black Square (All Zeros)", cv::WINDOW_GUI_EXPANDED);
-    cv::imshow("White square (All 255)", white_square);
+    display_sink().show("black Square (All Zeros)", black_square);
+    display_sink().show("White square (All 255)", white_square);
     std::cout << "press any key to continue to bitwise operations..." << std::endl;
-    cv::waitKey(0);
+    display_sink().wait_key(0);
 
     /*
      * Bitwise AND Operation
@@ -35,11 +35,10 @@ int main(int argc, char const *argv[])
      */
     cv::Mat bit_and;
     cv::bitwise_and(black_square, white_square, bit_and);
-    cv::namedWindow("bitwise AND (black & white)", cv::WINDOW_GUI_EXPANDED);
-    cv::imshow("bitwise AND (black & white)", bit_and);
+    display_sink().show("bitwise AND (black & white)", bit_and);
     std::cout << "AND Operation: black(0) AND white(255) = black(0)" << std::endl;
     std::cout << "Press any key to continue..." << std::endl;
-    cv::waitKey(0);
+    display_sink().wait_key(0);
 
     /*
      * Bitwise OR Operation
@@ -48,11 +47,10 @@ int main(int argc, char const *argv[])
      */
     cv::Mat bit_or;
     cv::bitwise_or(black_square, white_square, bit_or);
-    cv::namedWindow("bitwise OR (black | White)", cv::WINDOW_GUI_EXPANDED);
-    cv::imshow("bitwise OR (black | White)", bit_or);
+    display_sink().show("bitwise OR (black | White)", bit_or);
     std::cout << "OR Operation: black(0) OR white(255) = White(255)" << std::endl;
     std::cout << "Press any key to continue..." << std::endl;
-    cv::waitKey(0);
+    display_sink().wait_key(0);
 
     /*
      * Additional bitwise operations for better understanding
@@ -63,13 +61,11 @@ int main(int argc, char const *argv[])
     cv::bitwise_not(black_square, bit_not_black); // Black becomes white
     cv::bitwise_not(white_square, bit_not_white); // White becomes black
 
-    cv::namedWindow("NOT Black (Inversion)", cv::WINDOW_GUI_EXPANDED);
-    cv::imshow("NOT Black (Inversion)", bit_not_black);
-    cv::namedWindow("NOT White (Inversion)", cv::WINDOW_GUI_EXPANDED);
-    cv::imshow("NOT White (Inversion)", bit_not_white);
+    display_sink().show("NOT Black (Inversion)", bit_not_black);
+    display_sink().show("NOT White (Inversion)", bit_not_white);
     std::cout << "NOT Operation demonstrated." << std::endl;
     std::cout << "Press any key to continue..." << std::endl;
-    cv::waitKey(0);
+    display_sink().wait_key(0);
 
     /*
      * Bitwise XOR Operation
@@ -78,11 +74,10 @@ int main(int argc, char const *argv[])
      */
     cv::Mat bit_xor;
     cv::bitwise_xor(black_square, white_square, bit_xor);
-    cv::namedWindow("Bitwise XOR (Black ^ White)", cv::WINDOW_GUI_EXPANDED);
-    cv::imshow("Bitwise XOR (Black ^ White)", bit_xor);
+    display_sink().show("Bitwise XOR (Black ^ White)", bit_xor);
     std::cout << "XOR Operation: Black(0) XOR White(255) = White(255)" << std::endl;
     std::cout << "Press any key to continue..." << std::endl;
-    cv::waitKey(0);
+    display_sink().wait_key(0);
 
     /*
      * Demonstrate with gray image for more interesting results
@@ -91,13 +86,11 @@ int main(int argc, char const *argv[])
 
     cv::Mat gray_and_white;
     cv::bitwise_and(gray_square, white_square, gray_and_white);
-    cv::namedWindow("Gray Square (128)", cv::WINDOW_GUI_EXPANDED);
-    cv::imshow("Gray Square (128)", gray_square);
-    cv::namedWindow("AND: Gray & White", cv::WINDOW_GUI_EXPANDED);
-    cv::imshow("AND: Gray & White", gray_and_white);
+    display_sink().show("Gray Square (128)", gray_square);
+    display_sink().show("AND: Gray & White", gray_and_white);
     std::cout << "AND with gray: 128 & 255 = 128" << std::endl;
     std::cout << "Press any key to continue..." << std::endl;
-    cv::waitKey(0);
+    display_sink().wait_key(0);
 
     /*
      * Practical example: Creating a mask and applying operations
@@ -108,13 +101,23 @@ int main(int argc, char const *argv[])
     cv::Mat masked_result;
     cv::bitwise_and(white_square, white_square, masked_result, circle_mask);
 
-    cv::namedWindow("Circle Mask", cv::WINDOW_GUI_EXPANDED);
-    cv::imshow("Circle Mask", circle_mask);
-    cv::namedWindow("Masked White Square", cv::WINDOW_GUI_EXPANDED);
-    cv::imshow("Masked White Square", masked_result);
+    display_sink().show("Circle Mask", circle_mask);
+    display_sink().show("Masked White Square", masked_result);
     std::cout << "Practical example: Using AND with mask to extract region." << std::endl;
+
+    // Masks only hold 0 or 255: store them as bits (a 300x300 mask is a few hundred bytes this way)
+    // and read the file back to check that nothing was lost
+    cv::Mat mask_read_back;
+    if (write_bilevel("circle-mask.bilevel", circle_mask) && read_bilevel("circle-mask.bilevel", mask_read_back))
+    {
+        const bool identical = mask_read_back.size() == circle_mask.size() &&
+                               cv::countNonZero(mask_read_back != circle_mask) == 0;
+        std::cout << "Circle mask saved as 'circle-mask.bilevel' and read back "
+                  << (identical ? "unchanged" : "with differences!") << std::endl;
+        display_sink().show("Circle Mask (read back)", mask_read_back);
+    }
     std::cout << "Press any key to exit..." << std::endl;
-    cv::waitKey(0);
+    display_sink().wait_key(0);
 
     /*
      * Print summary of operations
@@ -126,6 +129,6 @@ int main(int argc, char const *argv[])
     std::cout << "NOT: ~0 = 255, ~255 = 0" << std::endl;
     std::cout << "===================================" << std::endl;
 
-    cv::destroyAllWindows();
+    display_sink().close_all();
     return 0;
 }
\ No newline at end of file
@@ -1,5 +1,13 @@
 #include <iostream>
+#include <string>
+#include <utility>
+#include <vector>
 #include <opencv2/opencv.hpp>
+#include "display_sink.hpp"
+#include "frame_ring.hpp"
+#include "image_expr.hpp"
+#include "image_stats.hpp"
+#include "instrumentation.hpp"
 
 int main(int argc, char const *argv[])
 {
@@ -21,10 +29,9 @@ int main(int argc, char const *argv[])
     std::cout << "Image type: " << cow.type() << " (CV_8UC3 = 16)" << std::endl;
     std::cout << "Image channels: " << cow.channels() << std::endl;
 
-    cv::namedWindow("Original Cow Image", cv::WINDOW_GUI_EXPANDED);
-    cv::imshow("Original Cow Image", cow);
+    display_sink().show("Original Cow Image", cow);
     std::cout << "Press any key to continue..." << std::endl;
-    cv::waitKey(0);
+    display_sink().wait_key(0);
 
     /*
      * Create a matrix with same size as cow image and set all values to 100
@@ -36,43 +43,46 @@ int main(int argc, char const *argv[])
     std::cout << "\nCreated constant matrix with value 100 in all channels" << std::endl;
     std::cout << "Matrix size: " << matrix.size() << " | Type: " << matrix.type() << std::endl;
 
-    cv::namedWindow("Constant Matrix (Value 100)", cv::WINDOW_GUI_EXPANDED);
-    cv::imshow("Constant Matrix (Value 100)", matrix);
+    display_sink().show("Constant Matrix (Value 100)", matrix);
     std::cout << "This appears as dark gray because 100/255 ≈ 0.39 intensity" << std::endl;
     std::cout << "Press any key to continue..." << std::endl;
-    cv::waitKey(0);
+    display_sink().wait_key(0);
 
     /*
      * Add images together - Brightening effect
      * Pixel values are saturated: min(255, cow_pixel + 100)
      */
     cv::Mat out_sum;
-    cv::add(cow, matrix, out_sum);
+    {
+        INSTRUMENT_SCOPE("arith.add");
+        cv::add(cow, matrix, out_sum);
+    }
 
-    cv::namedWindow("Addition: Cow + Matrix", cv::WINDOW_GUI_EXPANDED);
-    cv::imshow("Addition: Cow + Matrix", out_sum);
+    display_sink().show("Addition: Cow + Matrix", out_sum);
     std::cout << "\nAddition Operation (Brightening):" << std::endl;
     std::cout << "Each pixel: cow_pixel + 100" << std::endl;
     std::cout << "Result: Image becomes brighter by adding 100 to all channels" << std::endl;
     std::cout << "Values are saturated at 255 to prevent overflow" << std::endl;
     std::cout << "Press any key to continue..." << std::endl;
-    cv::waitKey(0);
+    display_sink().wait_key(0);
 
     /*
      * Subtract matrix from image - Darkening effect
      * Pixel values are saturated: max(0, cow_pixel - 100)
      */
     cv::Mat out_sub;
-    cv::subtract(cow, matrix, out_sub);
+    {
+        INSTRUMENT_SCOPE("arith.subtract");
+        cv::subtract(cow, matrix, out_sub);
+    }
 
-    cv::namedWindow("Subtraction: Cow - Matrix", cv::WINDOW_GUI_EXPANDED);
-    cv::imshow("Subtraction: Cow - Matrix", out_sub);
+    display_sink().show("Subtraction: Cow - Matrix", out_sub);
     std::cout << "\nSubtraction Operation (Darkening):" << std::endl;
     std::cout << "Each pixel: cow_pixel - 100" << std::endl;
     std::cout << "Result: Image becomes darker by subtracting 100 from all channels" << std::endl;
     std::cout << "Values are saturated at 0 to prevent underflow" << std::endl;
     std::cout << "Press any key to continue..." << std::endl;
-    cv::waitKey(0);
+    display_sink().wait_key(0);
 
     /*
      * Additional operations for better understanding
@@ -81,28 +91,32 @@ int main(int argc, char const *argv[])
     // Multiplication operation - Contrast enhancement
     cv::Mat out_mul;
     cv::Mat matrix_scale = cv::Mat::ones(cow.size(), cow.type()) * 1.5; // Scale factor
-    cv::multiply(cow, matrix_scale, out_mul);
+    {
+        INSTRUMENT_SCOPE("arith.multiply");
+        cv::multiply(cow, matrix_scale, out_mul);
+    }
 
-    cv::namedWindow("Multiplication: Cow × 1.5", cv::WINDOW_GUI_EXPANDED);
-    cv::imshow("Multiplication: Cow × 1.5", out_mul);
+    display_sink().show("Multiplication: Cow × 1.5", out_mul);
     std::cout << "\nMultiplication Operation (Contrast):" << std::endl;
     std::cout << "Each pixel: cow_pixel × 1.5" << std::endl;
     std::cout << "Result: Increases contrast, bright areas become brighter" << std::endl;
     std::cout << "Press any key to continue..." << std::endl;
-    cv::waitKey(0);
+    display_sink().wait_key(0);
 
     // Division operation - Contrast reduction
     cv::Mat out_div;
     cv::Mat matrix_div = cv::Mat::ones(cow.size(), cow.type()) * 2.0; // Division factor
-    cv::divide(cow, matrix_div, out_div);
+    {
+        INSTRUMENT_SCOPE("arith.divide");
+        cv::divide(cow, matrix_div, out_div);
+    }
 
-    cv::namedWindow("Division: Cow ÷ 2.0", cv::WINDOW_GUI_EXPANDED);
-    cv::imshow("Division: Cow ÷ 2.0", out_div);
+    display_sink().show("Division: Cow ÷ 2.0", out_div);
     std::cout << "\nDivision Operation (Reduce Contrast):" << std::endl;
     std::cout << "Each pixel: cow_pixel ÷ 2.0" << std::endl;
     std::cout << "Result: Decreases contrast, image becomes darker and flatter" << std::endl;
     std::cout << "Press any key to continue..." << std::endl;
-    cv::waitKey(0);
+    display_sink().wait_key(0);
 
     /*
      * Demonstrate weighted addition (alpha blending)
@@ -112,48 +126,117 @@ int main(int argc, char const *argv[])
     double beta = 0.3;  // Weight for second image
     double gamma = 0.0; // Scalar added to each sum
 
-    cv::addWeighted(cow, alpha, matrix, beta, gamma, blended);
+    {
+        INSTRUMENT_SCOPE("arith.addWeighted");
+        cv::addWeighted(cow, alpha, matrix, beta, gamma, blended);
+    }
 
-    cv::namedWindow("Weighted Addition: 0.7×Cow + 0.3×Matrix", cv::WINDOW_GUI_EXPANDED);
-    cv::imshow("Weighted Addition: 0.7×Cow + 0.3×Matrix", blended);
+    display_sink().show("Weighted Addition: 0.7×Cow + 0.3×Matrix", blended);
     std::cout << "\nWeighted Addition (Alpha Blending):" << std::endl;
     std::cout << "Formula: dst = alpha×cow + beta×matrix + gamma" << std::endl;
     std::cout << "Used: 0.7×Cow + 0.3×Matrix + 0" << std::endl;
     std::cout << "Result: Creates a blend between original and constant matrix" << std::endl;
     std::cout << "Press any key to continue..." << std::endl;
-    cv::waitKey(0);
+    display_sink().wait_key(0);
+
+    /*
+     * Chained formulas: eager calls write a full temporary per operator, a lazy expression is one pass
+     * 1.5 x cow - matrix / 2 + 30, saturated once at the end
+     */
+    cv::Mat chain_eager;
+    {
+        INSTRUMENT_SCOPE("arith.chain_eager");
+        cv::Mat scaled, halved, diff;
+        cow.convertTo(scaled, CV_32F, 1.5);
+        matrix.convertTo(halved, CV_32F, 0.5);
+        cv::subtract(scaled, halved, diff);
+        diff.convertTo(chain_eager, CV_8U, 1.0, 30.0);
+    }
+    cv::Mat chain_fused;
+    {
+        INSTRUMENT_SCOPE("arith.chain_fused");
+        into(chain_fused) = clamp(1.5 * lazy(cow) - lazy(matrix) / 2 + 30);
+    }
+
+    display_sink().show("Fused: 1.5×Cow - Matrix/2 + 30", chain_fused);
+    std::cout << "\nFused Expression:" << std::endl;
+    std::cout << "Formula: clamp(1.5×cow - matrix/2 + 30), evaluated in one pass" << std::endl;
+    std::cout << "Pixels differing from the eager chain: "
+              << cv::countNonZero(chain_eager.reshape(1) != chain_fused.reshape(1)) << std::endl;
+    std::cout << "Press any key to continue..." << std::endl;
+    display_sink().wait_key(0);
 
     /*
      * Demonstrate saturation behavior
      */
     cv::Mat bright_matrix = cv::Mat::ones(cow.size(), cow.type()) * 200;
     cv::Mat overexposed;
-    cv::add(cow, bright_matrix, overexposed);
+    {
+        INSTRUMENT_SCOPE("arith.add_saturating");
+        cv::add(cow, bright_matrix, overexposed);
+    }
 
-    cv::namedWindow("Saturation Example: Cow + 200", cv::WINDOW_GUI_EXPANDED);
-    cv::imshow("Saturation Example: Cow + 200", overexposed);
+    display_sink().show("Saturation Example: Cow + 200", overexposed);
     std::cout << "\nSaturation Behavior Demonstration:" << std::endl;
     std::cout << "Adding 200 to all pixels causes saturation at 255" << std::endl;
     std::cout << "Many pixels become pure white (255,255,255)" << std::endl;
     std::cout << "This prevents overflow and maintains valid image data" << std::endl;
+    ImageStats overexposed_stats;
+    if (image_stats(overexposed, overexposed_stats))
+    {
+        std::cout << "Channel values clipped at 255: " << 100.0 * overexposed_stats.at_white_fraction() << "%"
+                  << std::endl;
+    }
     std::cout << "Press any key to continue..." << std::endl;
-    cv::waitKey(0);
+    display_sink().wait_key(0);
 
     /*
      * Show pixel value examples for better understanding
      */
     std::cout << "\n=== PIXEL VALUE EXAMPLES ===" << std::endl;
-    std::cout << "Original pixel (sample): " << static_cast<int>(cow.at<cv::Vec3b>(100, 100)[0])
-              << ", " << static_cast<int>(cow.at<cv::Vec3b>(100, 100)[1])
-              << ", " << static_cast<int>(cow.at<cv::Vec3b>(100, 100)[2]) << std::endl;
-    std::cout << "After addition: " << static_cast<int>(out_sum.at<cv::Vec3b>(100, 100)[0])
-              << ", " << static_cast<int>(out_sum.at<cv::Vec3b>(100, 100)[1])
-              << ", " << static_cast<int>(out_sum.at<cv::Vec3b>(100, 100)[2]) << std::endl;
-    std::cout << "After subtraction: " << static_cast<int>(out_sub.at<cv::Vec3b>(100, 100)[0])
-              << ", " << static_cast<int>(out_sub.at<cv::Vec3b>(100, 100)[1])
-              << ", " << static_cast<int>(out_sub.at<cv::Vec3b>(100, 100)[2]) << std::endl;
+    const cv::Rect sample(100, 100, 1, 1);
+    const std::vector<std::pair<std::string, cv::Mat>> examples = {
+        {"Original", cow}, {"After addition", out_sum}, {"After subtraction", out_sub}, {"Cow + 200", overexposed}};
+    for (const auto &[label, image] : examples)
+    {
+        // Pixel (100, 100) as B,G,R, then statistics of the whole image from one pass
+        std::cout << label << " pixel (100, 100): ";
+        dump_region_csv(image, sample, std::cout, false);
+        ImageStats stats;
+        if (image_stats(image, stats))
+        {
+            stats.print(std::cout, label);
+        }
+    }
     std::cout << "=============================" << std::endl;
 
+    /*
+     * Hand the results to another process through a shared-memory frame ring instead of JPEG files:
+     *   ./05_Arithmetic_Operations --ring /cow_results
+     * The consumer reads them with FrameReader::open("/cow_results", true) (see common/frame_ring.hpp)
+     * and removes the ring afterwards with SharedMemory::unlink("/cow_results")
+     */
+    if (argc > 2 && std::string(argv[1]) == "--ring")
+    {
+        const std::vector<cv::Mat> results = {cow, out_sum, out_sub, out_mul, out_div, blended};
+        FrameWriter ring;
+        if (!ring.create(argv[2], static_cast<int>(results.size()), frame_ring_frame_bytes(cow.size(), cow.type())))
+        {
+            return -1;
+        }
+        for (const cv::Mat &result : results)
+        {
+            ring.write(result);
+        }
+        std::cout << "\nAll results published to frame ring '" << argv[2] << "' (" << ring.frames_written()
+                  << " frames: original, brightened, darkened, contrast high, contrast low, blended)" << std::endl;
+        ring.close(true); // the ring outlives this process until the consumer unlinks it
+        std::cout << "\nProgram completed successfully!" << std::endl;
+        INSTRUMENT_REPORT("05_Arithmetic_Operations");
+        display_sink().close_all();
+        return 0;
+    }
+
     /*
      * Save results for comparison
      */
@@ -173,6 +256,7 @@ int main(int argc, char const *argv[])
     std::cout << "- cow_blended.jpg" << std::endl;
 
     std::cout << "\nProgram completed successfully!" << std::endl;
-    cv::destroyAllWindows();
+    INSTRUMENT_REPORT("05_Arithmetic_Operations");
+    display_sink().close_all();
     return 0;
 }
\ No newline at end of file
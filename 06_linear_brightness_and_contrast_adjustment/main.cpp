@@ -1,5 +1,10 @@
 #include <iostream>
+#include <string>
 #include <opencv2/opencv.hpp>
+#include "auto_exposure.hpp"
+#include "contrast.hpp"
+#include "display_sink.hpp"
+#include "pixel_depth.hpp"
 
 // validation function
 void validate_alpha_beta(double alpha, int beta)
@@ -15,8 +20,8 @@ void validate_alpha_beta(double alpha, int beta)
 
 int main(int argc, char const *argv[])
 {
-    // Load image
-    cv::Mat img = cv::imread("../images/input.jpg", cv::IMREAD_COLOR);
+    // Load image (IMREAD_ANYDEPTH keeps 16-bit PNG/TIFF files at 16 bits)
+    cv::Mat img = cv::imread("../images/input.jpg", cv::IMREAD_COLOR | cv::IMREAD_ANYDEPTH);
     if (img.empty())
     {
         std::cerr << "No image found!\n";
@@ -24,9 +29,21 @@ int main(int argc, char const *argv[])
     }
 
     // show original image
-    cv::namedWindow("Original Image", cv::WINDOW_GUI_EXPANDED);
-    cv::imshow("Original Image", img);
-    cv::waitKey();
+    display_sink().show("Original Image", img);
+    display_sink().wait_key();
+
+    // Unattended mode: derive alpha, beta and gamma from the image statistics instead of asking
+    if (argc > 1 && std::string(argv[1]) == "--auto")
+    {
+        cv::Mat auto_out;
+        ExposureParams params = auto_exposure(img, auto_out);
+        std::cout << "Automatic exposure: alpha=" << params.alpha << " beta=" << params.beta
+                  << " gamma=" << params.gamma << std::endl;
+
+        display_sink().show("Auto Adjusted Image", auto_out);
+        display_sink().wait_key();
+        return 0;
+    }
 
     // Get user input for contrast (alpha) and brightness (beta)
     double alpha = 0.1;
@@ -40,15 +57,18 @@ int main(int argc, char const *argv[])
     // Validate input
     validate_alpha_beta(alpha, beta);
 
-    // Apply contrast and brightness adjustment
-    // Formula: output = alpha * input + beta
+    // Apply contrast and brightness adjustment at the image's own bit depth
+    // Formula: output = alpha * input + beta (beta is given in 8-bit units and scaled to the depth)
     cv::Mat out;
-    cv::convertScaleAbs(img, out, alpha, beta);
+    double native_beta = beta * depth_max_value(img.depth()) / 255.0;
+    if (!adjust_contrast_brightness(img, out, alpha, native_beta))
+    {
+        return -1;
+    }
 
     // Show result
-    cv::namedWindow("Adjusted Image", cv::WINDOW_GUI_EXPANDED);
-    cv::imshow("Adjusted Image", out);
-    cv::waitKey();
+    display_sink().show("Adjusted Image", out);
+    display_sink().wait_key();
 
     return 0;
 }
\ No newline at end of file
@@ -1,32 +1,16 @@
 #include <iostream>
 #include <opencv2/opencv.hpp>
-#include <cmath>
-
-/**
- * Applies gamma correction using lookup table (LUT) for better performance
- */
-cv::Mat gammaCorrectionLUT(const cv::Mat &img, double gamma)
-{
-    cv::Mat result;
-
-    // Create lookup table
-    cv::Mat lookup_table(1, 256, CV_8U);
-    uchar *p = lookup_table.ptr();
-    for (int i = 0; i < 256; i++)
-    {
-        // Apply gamma correction: output = 255 * (input/255)^(1/gamma)
-        p[i] = cv::saturate_cast<uchar>(pow(i / 255.0, 1.0 / gamma) * 255.0);
-    }
-
-    // Apply lookup table
-    cv::LUT(img, lookup_table, result);
-
-    return result;
-}
+#include "auto_exposure.hpp"
+#include "display_sink.hpp"
+#include "gamma_correction.hpp"
+#include "instrumentation.hpp"
+#include "parameter_sweep.hpp"
+#include "result_cache.hpp"
 
 int main(int argc, char const *argv[])
 {
-    cv::Mat img = cv::imread("../images/input.jpg");
+    // IMREAD_ANYDEPTH keeps 16-bit images at 16 bits, gammaCorrectionLUT handles every depth
+    cv::Mat img = cv::imread("../images/input.jpg", cv::IMREAD_COLOR | cv::IMREAD_ANYDEPTH);
     if (img.empty())
     {
         std::cerr << "Could not load image!\n";
@@ -38,14 +22,49 @@ int main(int argc, char const *argv[])
     std::vector<std::string> names = {"Gamma 0.5 (Brighten)", "Gamma 1.0 (Original)",
                                       "Gamma 2.0 (Darken)", "Gamma 3.0 (Very Dark)"};
 
+    // Results are cached by image content: re-runs, and other lessons with the same input.jpg, load
+    // them instead of correcting again
+    ResultCache cache;
+    const CacheKey image_key(img);
+    std::vector<cv::Mat> corrected(gammas.size());
+    bool all_cached = true;
     for (size_t i = 0; i < gammas.size(); i++)
     {
-        cv::Mat corrected = gammaCorrectionLUT(img, gammas[i]);
-        cv::namedWindow(names[i], cv::WINDOW_GUI_EXPANDED);
-        cv::imshow(names[i], corrected);
+        all_cached = cache.get(image_key.then("gamma", {gammas[i]}), corrected[i]) && all_cached;
+    }
+    if (!all_cached)
+    {
+        // All gammas in one pass over the image (8-bit images are read once, not once per gamma)
+        corrected.assign(gammas.size(), cv::Mat()); // never write into images shared with the cache
+        sweep_gamma(img, gammas, corrected);
+        for (size_t i = 0; i < corrected.size(); i++)
+        {
+            cache.put(image_key.then("gamma", {gammas[i]}), corrected[i]);
+        }
+    }
+    for (size_t i = 0; i < corrected.size(); i++)
+    {
+        display_sink().show(names[i], corrected[i]);
+    }
+
+    // Mean brightness of each gamma straight from the histogram, without correcting the image
+    std::vector<double> means = gamma_sweep_means(luma_histogram(img, 1), gammas);
+    for (size_t i = 0; i < means.size(); i++)
+    {
+        std::cout << names[i] << ": mean brightness " << means[i] << std::endl;
     }
 
-    cv::waitKey();
+    // Gamma estimated from the image itself (mean luminance targeting, no contrast stretch)
+    AutoExposureOptions gamma_only;
+    gamma_only.stretch_contrast = false;
+    ExposureParams estimated = estimate_exposure(luma_histogram(img), gamma_only);
+    std::string auto_name = "Auto Gamma " + std::to_string(estimated.gamma);
+    display_sink().show(auto_name, gammaCorrectionLUT(img, estimated.gamma));
+
+    display_sink().wait_key();
+
+    cache.report("Result cache");
+    INSTRUMENT_REPORT("07_Gamma_correction");
 
     return 0;
 }
\ No newline at end of file
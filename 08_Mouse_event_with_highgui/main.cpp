@@ -1,6 +1,43 @@
 #include <iostream>
 #include <opencv2/opencv.hpp>
 #include <cmath>
+#include "brush_engine.hpp"
+#include "display_sink.hpp"
+#include "instrumentation.hpp"
+
+// The mouse callbacks only queue points; each frame draws them with BrushEngine::flush()
+#define PAINT_FRAME_MS 15
+#define SCRIPT_STROKE_FRAMES 20 // frames per scripted drag when nobody is at the window
+#define SCRIPT_MOVES_PER_FRAME 4
+
+/**
+ * Stands in for the mouse when the display sink is headless (nobody can click): every
+ * SCRIPT_STROKE_FRAMES frames a button press, a fast wavy drag and a release go to the same callback,
+ * so the demo still draws and can be timed
+ */
+void script_mouse(cv::MouseCallback callback, int frame)
+{
+    const int step = frame % SCRIPT_STROKE_FRAMES;
+    const int stroke = frame / SCRIPT_STROKE_FRAMES;
+    for (int i = 0; i < SCRIPT_MOVES_PER_FRAME; i++)
+    {
+        const double t = step * SCRIPT_MOVES_PER_FRAME + i;
+        const int x = 40 + static_cast<int>(t * 5.5);
+        const int y = 60 + (stroke * 90) % 400 + static_cast<int>(40.0 * std::sin(t * 0.15));
+        if (step == 0 && i == 0)
+        {
+            callback(cv::EVENT_LBUTTONDOWN, x, y, 0, nullptr);
+        }
+        else
+        {
+            callback(cv::EVENT_MOUSEMOVE, x, y, 0, nullptr);
+        }
+    }
+    if (step == SCRIPT_STROKE_FRAMES - 1)
+    {
+        callback(cv::EVENT_LBUTTONUP, 0, 0, 0, nullptr);
+    }
+}
 
 /**
  * Creates an interactive window where users can draw circles by clicking
@@ -12,33 +49,48 @@ void create_circle_dots()
     static cv::Mat img = cv::Mat::zeros(cv::Size(512, 512), CV_8U);
     std::string img_name = "Click to draw circles! (ESC to exit)";
 
+    // Anti-aliased dots of radius 10
+    // Note: In grayscale, only first scalar value is used (134 = light gray)
+    BrushOptions dot;
+    dot.radius = 10;
+    dot.color = cv::Scalar(134);
+    static BrushEngine engine(dot);
+
     // mouse callback function for drawing circles
     auto draw_circle = [](int event, int x, int y, int flags, void *userdata)
     {
-        // draw circle on left mouse click
+        // queue a dot on left mouse click (a stroke without motion)
         if (event == cv::EVENT_LBUTTONDOWN)
         {
-            // draw filled circle at click position
-            // Note: In grayscale, only first scalar value is used (134 = light gray)
-            cv::circle(img, cv::Point(x, y), 10, cv::Scalar(134), -1);
+            engine.begin_stroke(x, y);
+            engine.end_stroke();
         }
     };
 
-    // create window and set mouse callback
-    cv::namedWindow(img_name, cv::WINDOW_GUI_EXPANDED);
-    cv::setMouseCallback(img_name, draw_circle);
+    // create window and set mouse callback (headless runs script the clicks instead)
+    const bool interactive = display_sink().interactive();
+    if (interactive)
+    {
+        cv::namedWindow(img_name, cv::WINDOW_GUI_EXPANDED);
+        cv::setMouseCallback(img_name, draw_circle);
+    }
 
     // Main loop - display image and check for ESC key
-    while (true)
+    for (int frame = 0;; frame++)
     {
-        cv::imshow(img_name, img);
-        if ((cv::waitKey(100) & 0xFF) == 27) // ESC key
+        if (!interactive)
+        {
+            script_mouse(draw_circle, frame);
+        }
+        engine.flush(img);
+        display_sink().show(img_name, img.clone()); // the sink may hold the frame while img keeps changing
+        if ((display_sink().wait_key(PAINT_FRAME_MS) & 0xFF) == 27) // ESC key
         {
             break;
         }
     }
 
-    cv::destroyAllWindows();
+    display_sink().close_all();
 }
 
 /**
@@ -50,53 +102,53 @@ void paint()
     std::string img_name = "Painting App - B:Blue G:Green R:Red C:Clear ESC:Exit";
 
     // static variables maintain state between function calls
-    static int prev_x = 0;                                            // previous X coordinate for smooth drawing
-    static int prev_y = 0;                                            // previous Y coordinate for smooth drawing
     static cv::Mat img = cv::Mat::zeros(cv::Size(512, 512), CV_8UC3); // 3-channel color canvas
-    static cv::Scalar pen_color = cv::Scalar(255, 0, 0);              // Start with blue pen (BGR format)
+    static BrushEngine engine;                                        // radius 5 (10 px wide), blue pen (BGR format)
     static bool drawing = false;                                      // drawing state flag
 
-    // mouse callback for brush functionality
+    // mouse callback for brush functionality: only queues the points, the main loop draws them
     auto brush = [](int event, int x, int y, int flags, void *userdata)
     {
         if (event == cv::EVENT_LBUTTONDOWN)
         {
-            // Start drawing and store initial position
+            // Start a stroke (a click without motion leaves a dot)
             drawing = true;
-            prev_x = x;
-            prev_y = y;
-
-            // draw initial dot at click position
-            cv::circle(img, cv::Point(x, y), 5, pen_color, -1);
+            engine.begin_stroke(x, y);
         }
         else if (event == cv::EVENT_LBUTTONUP)
         {
             // Stop drawing
             drawing = false;
+            engine.end_stroke();
         }
         else if (event == cv::EVENT_MOUSEMOVE)
         {
             if (drawing == true)
             {
-                // draw line from previous position to current position
-                cv::line(img, cv::Point(prev_x, prev_y), cv::Point(x, y), pen_color, 10, cv::LINE_AA);
-
-                // Update previous position for next movement
-                prev_x = x;
-                prev_y = y;
+                // the stroke is a smooth curve through the points, so fast moves leave no corners or gaps
+                engine.add_point(x, y);
             }
         }
     };
 
-    // Setup window and mouse callback
-    cv::namedWindow(img_name, cv::WINDOW_GUI_EXPANDED);
-    cv::setMouseCallback(img_name, brush);
+    // Setup window and mouse callback (headless runs script the strokes instead)
+    const bool interactive = display_sink().interactive();
+    if (interactive)
+    {
+        cv::namedWindow(img_name, cv::WINDOW_GUI_EXPANDED);
+        cv::setMouseCallback(img_name, brush);
+    }
 
     // Main application loop
-    while (true)
+    for (int frame = 0;; frame++)
     {
-        cv::imshow(img_name, img);
-        int key = cv::waitKey(100) & 0xFF; // Non-blocking wait with 100ms delay
+        if (!interactive)
+        {
+            script_mouse(brush, frame);
+        }
+        engine.flush(img); // draw the points queued since the last frame
+        display_sink().show(img_name, img.clone()); // the sink may hold the frame while img keeps changing
+        int key = display_sink().wait_key(PAINT_FRAME_MS) & 0xFF; // Non-blocking wait
 
         if (key == 27) // ESC key - exit
         {
@@ -104,32 +156,33 @@ void paint()
         }
         else if (key == 'b' || key == 'B') // Blue pen
         {
-            pen_color = cv::Scalar(255, 0, 0); // BGR: Blue=255, Green=0, Red=0
+            engine.set_color(cv::Scalar(255, 0, 0)); // BGR: Blue=255, Green=0, Red=0
             std::cout << "Pen color: Blue\n";
         }
         else if (key == 'g' || key == 'G') // Green pen
         {
-            pen_color = cv::Scalar(0, 255, 0); // BGR: Blue=0, Green=255, Red=0
+            engine.set_color(cv::Scalar(0, 255, 0)); // BGR: Blue=0, Green=255, Red=0
             std::cout << "Pen color: Green\n";
         }
         else if (key == 'r' || key == 'R') // Red pen
         {
-            pen_color = cv::Scalar(0, 0, 255); // BGR: Blue=0, Green=0, Red=255
+            engine.set_color(cv::Scalar(0, 0, 255)); // BGR: Blue=0, Green=0, Red=255
             std::cout << "Pen color: Red\n";
         }
         else if (key == 'c' || key == 'C') // Clear canvas
         {
             img = cv::Mat::zeros(cv::Size(512, 512), CV_8UC3);
+            engine.reset_canvas();
             std::cout << "Canvas cleared\n";
         }
         else if (key == 'w' || key == 'W') // White pen (new feature)
         {
-            pen_color = cv::Scalar(255, 255, 255);
+            engine.set_color(cv::Scalar(255, 255, 255));
             std::cout << "Pen color: White\n";
         }
         else if (key == 'k' || key == 'K') // Black pen (new feature)
         {
-            pen_color = cv::Scalar(0, 0, 0);
+            engine.set_color(cv::Scalar(0, 0, 0));
             std::cout << "Pen color: Black\n";
         }
         else if (key == 's' || key == 'S') // Save drawing (new feature)
@@ -138,7 +191,7 @@ void paint()
             std::cout << "Drawing saved as 'my_drawing.png'\n";
         }
     }
-    cv::destroyAllWindows();
+    display_sink().close_all();
 }
 
 // Enum for better code readability and maintainability
@@ -190,6 +243,8 @@ int main(int argc, char const *argv[])
         break;
     }
 
+    display_sink().report(std::cout);
+    INSTRUMENT_REPORT("08_Mouse_event_with_highgui");
     std::cout << "Application finished." << std::endl;
     return 0;
 }
\ No newline at end of file
@@ -1,70 +1,135 @@
+#include <cctype>
+#include <chrono>
 #include <iostream>
+#include <string>
+#include <thread>
 #include <opencv2/opencv.hpp>
+#include "bilevel_image.hpp"
+#include "change_detection.hpp"
+#include "connected_components.hpp"
+#include "display_sink.hpp"
+#include "image_pyramid.hpp"
+#include "instrumentation.hpp"
+#include "live_pipeline.hpp"
+#include "morphology.hpp"
+#include "parameter_sweep.hpp"
+#include "result_cache.hpp"
+#include "specialized_kernels.hpp"
+
+#define PREVIEW_MAX_WIDTH 1280
+#define PREVIEW_MAX_HEIGHT 720
+#define BLOB_MIN_AREA_FRACTION 0.0005
+#define BLOB_CROP_SIZE 64
+#define CLEANUP_KERNEL_SIZE 5
+#define LIVE_BUDGET_MS 33.0 // one frame at 30 fps
+#define LIVE_SYNTHETIC_FPS 30
 
 /**
  * Displays an image in a window with optional waiting
+ * The window belongs to display_sink(): CV_LESSONS_DISPLAY=null or offscreen:DIR runs the lesson headless
  * @param img Image to display
  * @param name Window name
  * @param wait If true, waits for key press before continuing
  */
 void show_img(const cv::Mat &img, const std::string &name, const bool wait = false) {
-    cv::namedWindow(name, cv::WINDOW_GUI_EXPANDED);
-    cv::imshow(name, img);
+    display_sink().show(name, img);
     if (wait) {
         std::cout << "Press any key to continue..." << std::endl;
-        cv::waitKey(0);
+        display_sink().wait_key(0);
     }
 }
 
+/**
+ * Results of this lesson, kept between runs in the disk cache shared by all lessons
+ */
+ResultCache &lesson_cache() {
+    static ResultCache cache;
+    return cache;
+}
+
 /**
  * Demonstrates different thresholding techniques on an image
  * @param img Input image (should be grayscale for proper thresholding)
  */
 void thresholds(const cv::Mat &img) {
-    cv::Mat out_img;
-
     // Convert to grayscale if image is color (important for thresholding)
-    cv::Mat gray_img;
-    if (img.channels() == 3) {
-        cv::cvtColor(img, gray_img, cv::COLOR_BGR2GRAY);
-        std::cout << "Converted color image to grayscale for thresholding" << std::endl;
-    } else {
-        gray_img = img.clone();
-    }
+    // Every result is cached by the content of img, so a re-run on the same image skips the whole chain
+    const CacheKey gray_key = CacheKey(img).then("grayscale");
+    cv::Mat gray_img = lesson_cache().memoize(gray_key, [&]() {
+        cv::Mat gray;
+        if (img.channels() == 3) {
+            cv::cvtColor(img, gray, cv::COLOR_BGR2GRAY);
+            std::cout << "Converted color image to grayscale for thresholding" << std::endl;
+        } else {
+            gray = img.clone();
+        }
+        return gray;
+    });
 
     std::cout << "\n=== THRESHOLDING TECHNIQUES DEMONSTRATION ===" << std::endl;
 
+    // All five types are computed in one pass over gray_img (each row is read once for all of them)
+    const std::vector<ThresholdParams> params = {
+        {127, 255, cv::THRESH_BINARY}, {127, 255, cv::THRESH_BINARY_INV}, {127, 255, cv::THRESH_TRUNC},
+        {127, 255, cv::THRESH_TOZERO}, {127, 255, cv::THRESH_TOZERO_INV}};
+    auto threshold_key = [&](const ThresholdParams &p) {
+        return gray_key.then("threshold", {p.thresh, p.max_value, static_cast<double>(p.type)});
+    };
+    std::vector<cv::Mat> out_imgs(params.size());
+    bool all_cached = true;
+    for (size_t i = 0; i < params.size(); i++) {
+        all_cached = lesson_cache().get(threshold_key(params[i]), out_imgs[i]) && all_cached;
+    }
+    if (!all_cached) {
+        INSTRUMENT_SCOPE("threshold.sweep");
+        out_imgs.assign(params.size(), cv::Mat()); // never write into images shared with the cache
+        sweep_threshold(gray_img, params, out_imgs);
+        for (size_t i = 0; i < out_imgs.size(); i++) {
+            lesson_cache().put(threshold_key(params[i]), out_imgs[i]);
+        }
+    }
+    if (out_imgs.size() != params.size() || out_imgs[0].empty()) {
+        return;
+    }
+
     // 1. Binary Threshold
     // Pixels > 127 become 255 (white), others become 0 (black)
-    cv::threshold(gray_img, out_img, 127, 255, cv::THRESH_BINARY);
-    show_img(out_img, "BINARY: >127=255, <=127=0", true);
+    show_img(out_imgs[0], "BINARY: >127=255, <=127=0", true);
     std::cout << "THRESH_BINARY: Values > 127 = 255, others = 0" << std::endl;
 
     // 2. Binary Inverse Threshold
     // Pixels > 127 become 0 (black), others become 255 (white)
-    cv::threshold(gray_img, out_img, 127, 255, cv::THRESH_BINARY_INV);
-    show_img(out_img, "BINARY_INV: >127=0, <=127=255", true);
+    show_img(out_imgs[1], "BINARY_INV: >127=0, <=127=255", true);
     std::cout << "THRESH_BINARY_INV: Values > 127 = 0, others = 255" << std::endl;
 
     // 3. Truncate Threshold
     // Pixels > 127 are set to 127, others remain unchanged
-    cv::threshold(gray_img, out_img, 127, 255, cv::THRESH_TRUNC);
-    show_img(out_img, "TRUNC: >127=127, <=127=unchanged", true);
+    show_img(out_imgs[2], "TRUNC: >127=127, <=127=unchanged", true);
     std::cout << "THRESH_TRUNC: Values > 127 = 127, others unchanged" << std::endl;
 
     // 4. To Zero Threshold
     // Pixels <= 127 become 0, others remain unchanged
-    cv::threshold(gray_img, out_img, 127, 255, cv::THRESH_TOZERO);
-    show_img(out_img, "TOZERO: <=127=0, >127=unchanged", true);
+    show_img(out_imgs[3], "TOZERO: <=127=0, >127=unchanged", true);
     std::cout << "THRESH_TOZERO: Values <= 127 = 0, others unchanged" << std::endl;
 
     // 5. To Zero Inverse Threshold
     // Pixels > 127 become 0, others remain unchanged
-    cv::threshold(gray_img, out_img, 127, 255, cv::THRESH_TOZERO_INV);
-    show_img(out_img, "TOZERO_INV: >127=0, <=127=unchanged", true);
+    show_img(out_imgs[4], "TOZERO_INV: >127=0, <=127=unchanged", true);
     std::cout << "THRESH_TOZERO_INV: Values > 127 = 0, others unchanged" << std::endl;
 
-    cv::destroyAllWindows();
+    // How much of the image each threshold would keep, for many thresholds from one histogram
+    std::vector<double> sweep_values;
+    for (int t = 0; t < 256; t += 32) {
+        sweep_values.push_back(t);
+    }
+    std::vector<double> fractions = foreground_fractions(gray_img, sweep_values);
+    std::cout << "Foreground fraction per threshold:";
+    for (size_t i = 0; i < fractions.size(); i++) {
+        std::cout << " " << sweep_values[i] << "=" << fractions[i];
+    }
+    std::cout << std::endl;
+
+    display_sink().close_all();
 }
 
 /**
@@ -84,14 +149,20 @@ void adaptive_thresholds(const cv::Mat &img) {
     cv::Mat adaptive_mean, adaptive_gaussian;
 
     // Adaptive thresholding using mean of neighborhood
-    cv::adaptiveThreshold(gray_img, adaptive_mean, 255,
-                         cv::ADAPTIVE_THRESH_MEAN_C, cv::THRESH_BINARY, 11, 2);
+    {
+        INSTRUMENT_SCOPE("threshold.adaptive_mean");
+        cv::adaptiveThreshold(gray_img, adaptive_mean, 255,
+                             cv::ADAPTIVE_THRESH_MEAN_C, cv::THRESH_BINARY, 11, 2);
+    }
     show_img(adaptive_mean, "ADAPTIVE MEAN: Local mean thresholding", true);
     std::cout << "ADAPTIVE_THRESH_MEAN_C: Uses mean of neighborhood" << std::endl;
 
     // Adaptive thresholding using Gaussian weighted mean of neighborhood
-    cv::adaptiveThreshold(gray_img, adaptive_gaussian, 255,
-                         cv::ADAPTIVE_THRESH_GAUSSIAN_C, cv::THRESH_BINARY, 11, 2);
+    {
+        INSTRUMENT_SCOPE("threshold.adaptive_gaussian");
+        cv::adaptiveThreshold(gray_img, adaptive_gaussian, 255,
+                             cv::ADAPTIVE_THRESH_GAUSSIAN_C, cv::THRESH_BINARY, 11, 2);
+    }
     show_img(adaptive_gaussian, "ADAPTIVE GAUSSIAN: Gaussian weighted thresholding", true);
     std::cout << "ADAPTIVE_THRESH_GAUSSIAN_C: Uses Gaussian weighted mean" << std::endl;
 }
@@ -111,12 +182,77 @@ void otsu_threshold(const cv::Mat &img) {
     std::cout << "\n=== OTSU'S THRESHOLDING (AUTOMATIC) ===" << std::endl;
 
     cv::Mat otsu_result;
-    double otsu_thresh = cv::threshold(gray_img, otsu_result, 0, 255,
-                                      cv::THRESH_BINARY | cv::THRESH_OTSU);
+    double otsu_thresh = 0.0;
+    {
+        INSTRUMENT_SCOPE("threshold.otsu");
+        otsu_thresh = cv::threshold(gray_img, otsu_result, 0, 255,
+                                    cv::THRESH_BINARY | cv::THRESH_OTSU);
+    }
 
     show_img(otsu_result, "OTSU: Automatic threshold = " + std::to_string(otsu_thresh), true);
     std::cout << "Otsu's method found optimal threshold: " << otsu_thresh << std::endl;
     std::cout << "Automatically selects the best threshold value" << std::endl;
+
+    // Cleanup: a closing fills small holes and gaps; fused with the threshold in one tiled pass
+    cv::Mat otsu_closed;
+    threshold_close(gray_img, otsu_closed, otsu_thresh, 255, cv::THRESH_BINARY,
+                    cv::Size(CLEANUP_KERNEL_SIZE, CLEANUP_KERNEL_SIZE));
+    show_img(otsu_closed, "OTSU + CLOSE " + std::to_string(CLEANUP_KERNEL_SIZE) + "x" +
+                              std::to_string(CLEANUP_KERNEL_SIZE), true);
+    std::cout << "Closing removes small holes left by the threshold" << std::endl;
+
+    // Binary results are saved bit-packed and run-length coded instead of as 8-bit images
+    if (write_bilevel("../images/otsu-closed.bilevel", otsu_closed)) {
+        BilevelImage saved;
+        cv::Mat top_rows;
+        if (saved.open("../images/otsu-closed.bilevel") &&
+            saved.read_rows(0, std::min(saved.size().height, BILEVEL_STRIP_ROWS), top_rows)) {
+            std::cout << "Saved as ../images/otsu-closed.bilevel, reloaded the first " << top_rows.rows
+                      << " rows without decoding the rest" << std::endl;
+        }
+    }
+}
+
+/**
+ * Labels the blobs of an Otsu thresholded image (characters of a plate, for example)
+ * Dark objects on a light background become foreground, each blob gets a bounding box and
+ * all blobs are cropped into one batch for the next stage
+ * @param img Input image
+ */
+void label_blobs(const cv::Mat &img) {
+    cv::Mat gray_img;
+    if (img.channels() == 3) {
+        cv::cvtColor(img, gray_img, cv::COLOR_BGR2GRAY);
+    } else {
+        gray_img = img.clone();
+    }
+
+    std::cout << "\n=== CONNECTED COMPONENTS (BLOBS) ===" << std::endl;
+
+    cv::Mat binary;
+    cv::threshold(gray_img, binary, 0, 255, cv::THRESH_BINARY_INV | cv::THRESH_OTSU);
+
+    // Ignore specks: anything smaller than a fraction of the image is noise
+    int64_t min_area = static_cast<int64_t>(BLOB_MIN_AREA_FRACTION * static_cast<double>(binary.total()));
+    std::vector<BlobStats> blobs = connected_components(binary, 8, nullptr, min_area);
+
+    cv::Mat display = img.clone();
+    if (display.channels() == 1) {
+        cv::cvtColor(display, display, cv::COLOR_GRAY2BGR);
+    }
+    for (const BlobStats &blob : blobs) {
+        cv::rectangle(display, blob.bbox, cv::Scalar(0, 255, 0), 2);
+        cv::circle(display, cv::Point(cvRound(blob.centroid.x), cvRound(blob.centroid.y)), 2,
+                   cv::Scalar(0, 0, 255), -1);
+    }
+    show_img(display, "BLOBS: " + std::to_string(blobs.size()) + " components", true);
+    std::cout << "Found " << blobs.size() << " blobs with area >= " << min_area << " pixels" << std::endl;
+
+    // Crops come straight from the blob statistics, no second pass over the label image
+    ImageBatch crops;
+    crop_blobs(img, blobs, cv::Size(BLOB_CROP_SIZE, BLOB_CROP_SIZE), crops);
+    std::cout << "Cropped " << crops.count << " blobs into one " << BLOB_CROP_SIZE << "x" << BLOB_CROP_SIZE
+              << " batch" << std::endl;
 }
 
 /**
@@ -135,55 +271,232 @@ void interactive_threshold(const cv::Mat &img) {
     std::cout << "Use trackbar to adjust threshold value in real-time" << std::endl;
     std::cout << "Press ESC to exit interactive mode" << std::endl;
 
+    // Large images are previewed on a smaller pyramid level so the trackbar stays responsive
+    ImagePyramid pyramid(gray_img);
+    int preview_level = pyramid.level_for_size(cv::Size(PREVIEW_MAX_WIDTH, PREVIEW_MAX_HEIGHT));
+    cv::Mat preview_img = pyramid.level(preview_level);
+    if (preview_level > 0) {
+        std::cout << "Previewing at 1/" << ImagePyramid::scale(preview_level) << " resolution ("
+                  << preview_img.cols << "x" << preview_img.rows << ")" << std::endl;
+    }
+
     cv::Mat result;
     int threshold_value = 127;
     int max_value = 255;
 
-    cv::namedWindow("Interactive Thresholding", cv::WINDOW_GUI_EXPANDED);
-
-    // Create trackbar callback function
-    auto on_trackbar = [](int value, void* userdata) {
-        auto data = static_cast<std::pair<cv::Mat*, cv::Mat*>*>(userdata);
-        cv::Mat* src = data->first;
-        cv::Mat* dst = data->second;
-
-        cv::threshold(*src, *dst, value, 255, cv::THRESH_BINARY);
-
-        // Add threshold value text to image
-        cv::Mat display = dst->clone();
-        if (display.channels() == 1) {
-            cv::cvtColor(display, display, cv::COLOR_GRAY2BGR);
+    // The trackbar needs a real window; headless displays show the default threshold once
+    // Frames and keys go through the display sink, only the window and its trackbar are highgui's
+    if (display_sink().interactive()) {
+        cv::namedWindow("Interactive Thresholding", cv::WINDOW_GUI_EXPANDED);
+
+        // Create trackbar callback function
+        auto on_trackbar = [](int value, void* userdata) {
+            auto data = static_cast<std::pair<cv::Mat*, cv::Mat*>*>(userdata);
+            cv::Mat* src = data->first;
+            cv::Mat* dst = data->second;
+
+            {
+                INSTRUMENT_SCOPE("threshold.interactive");
+                fast_threshold(*src, *dst, value, 255, cv::THRESH_BINARY);
+            }
+
+            // Add threshold value text to image
+            cv::Mat display = dst->clone();
+            if (display.channels() == 1) {
+                cv::cvtColor(display, display, cv::COLOR_GRAY2BGR);
+            }
+
+            std::string text = "Threshold: " + std::to_string(value);
+            cv::putText(display, text, cv::Point(10, 30),
+                       cv::FONT_HERSHEY_SIMPLEX, 1, cv::Scalar(0, 255, 0), 2);
+
+            display_sink().show("Interactive Thresholding", display);
+        };
+
+        // Prepare user data for callback
+        std::pair<cv::Mat*, cv::Mat*> user_data(&preview_img, &result);
+
+        // Create trackbar
+        cv::createTrackbar("Threshold", "Interactive Thresholding",
+                          &threshold_value, max_value, on_trackbar, &user_data);
+
+        // Initial call to display image
+        on_trackbar(threshold_value, &user_data);
+
+        // Wait for ESC key
+        while (true) {
+            int key = display_sink().wait_key(100) & 0xFF;
+            if (key == 27) { // ESC key
+                break;
+            }
         }
 
-        std::string text = "Threshold: " + std::to_string(value);
-        cv::putText(display, text, cv::Point(10, 30),
-                   cv::FONT_HERSHEY_SIMPLEX, 1, cv::Scalar(0, 255, 0), 2);
+        display_sink().close("Interactive Thresholding");
+    } else {
+        fast_threshold(preview_img, result, threshold_value, max_value, cv::THRESH_BINARY);
+        show_img(result, "Interactive Thresholding", true);
+        display_sink().close("Interactive Thresholding");
+    }
 
-        cv::imshow("Interactive Thresholding", display);
-    };
+    // Final full resolution result: the chosen threshold is refined near edges only
+    if (preview_level > 0) {
+        cv::Mat full_result;
+        coarse_to_fine_threshold(pyramid, preview_level, threshold_value, 255, cv::THRESH_BINARY, full_result);
+        std::cout << "Applied threshold " << threshold_value << " at full resolution ("
+                  << full_result.cols << "x" << full_result.rows << ")" << std::endl;
+    }
+}
 
-    // Prepare user data for callback
-    std::pair<cv::Mat*, cv::Mat*> user_data(&gray_img, &result);
+/**
+ * Live thresholding of a camera feed (or of a moving synthetic gradient when there is no camera)
+ * The GUI loop only captures, submits and shows the newest result; the stages run on the pipeline's
+ * worker under a per-frame deadline, and the optional cleanup is skipped when it would make a frame late
+ * @param policy LIVE_DROP_OLDEST or LIVE_SKIP_STAGES
+ */
+void live_threshold(int camera, LivePolicy policy) {
+    LivePipeline live(LIVE_BUDGET_MS, policy);
+    live.add_stage("gray", [](const cv::Mat &src, cv::Mat &dst) { fast_grayscale(src, dst); });
+    live.add_stage("threshold", [](const cv::Mat &src, cv::Mat &dst) {
+        fast_threshold(src, dst, 127, 255, cv::THRESH_BINARY);
+    });
+    live.add_stage("cleanup", [](const cv::Mat &src, cv::Mat &dst) {
+        fast_morphology(src, dst, cv::MORPH_CLOSE, cv::Size(CLEANUP_KERNEL_SIZE, CLEANUP_KERNEL_SIZE));
+    }, true);
+
+    cv::VideoCapture cap(camera);
+    const bool synthetic = !cap.isOpened();
+    if (synthetic) {
+        std::cout << "No camera " << camera << ", using a synthetic moving gradient" << std::endl;
+    }
+    std::cout << "Live thresholding, ESC to stop" << std::endl;
+
+    live.start();
+    auto next_tick = std::chrono::steady_clock::now();
+    for (int i = 0;; i++) {
+        cv::Mat frame; // a fresh Mat per frame: the pipeline keeps the pixels until it is done
+        if (synthetic) {
+            frame.create(720, 1280, CV_8UC3);
+            for (int y = 0; y < frame.rows; y++) {
+                frame.row(y).setTo(cv::Scalar::all((y + i * 4) % 256));
+            }
+            next_tick += std::chrono::microseconds(1000000 / LIVE_SYNTHETIC_FPS);
+            std::this_thread::sleep_until(next_tick);
+        } else if (!cap.read(frame) || frame.empty()) {
+            break;
+        }
+        live.submit(frame);
 
-    // Create trackbar
-    cv::createTrackbar("Threshold", "Interactive Thresholding",
-                      &threshold_value, max_value, on_trackbar, &user_data);
+        LiveFrame result, newest;
+        bool have_result = false;
+        while (live.poll_result(result)) {
+            newest = result;
+            have_result = true;
+        }
+        if (have_result) {
+            display_sink().show("Live Threshold", newest.image);
+        }
+        if ((display_sink().wait_key(1) & 0xFF) == 27) {
+            break;
+        }
+    }
+    live.stop();
+    display_sink().close("Live Threshold");
+    live.report("Live threshold");
+}
 
-    // Initial call to display image
-    on_trackbar(threshold_value, &user_data);
+/**
+ * Motion-gated thresholding of a camera feed (or of a static synthetic scene with a moving square)
+ * A ChangeDetector compares every frame with a learned background; grayscale and threshold then run
+ * only on the tiles that changed, and the rest of the output keeps its previous value
+ */
+void motion_threshold(int camera) {
+    cv::VideoCapture cap(camera);
+    const bool synthetic = !cap.isOpened();
+    if (synthetic) {
+        std::cout << "No camera " << camera << ", using a synthetic scene with a moving square" << std::endl;
+    }
+    std::cout << "Motion-gated thresholding, ESC to stop" << std::endl;
+
+    ChangeDetector detector;
+    ChangeMap changes;
+    cv::Mat binary;
+    double processed_fraction = 0.0;
+    int frames = 0;
+    for (int i = 0;; i++) {
+        cv::Mat frame;
+        if (synthetic) {
+            frame.create(720, 1280, CV_8UC3);
+            for (int y = 0; y < frame.rows; y++) {
+                frame.row(y).setTo(cv::Scalar::all(y * 255 / frame.rows));
+            }
+            const int x = (i * 8) % (frame.cols - 100);
+            cv::rectangle(frame, cv::Rect(x, frame.rows / 2 - 50, 100, 100), cv::Scalar::all(255), -1);
+            std::this_thread::sleep_for(std::chrono::microseconds(1000000 / LIVE_SYNTHETIC_FPS));
+        } else if (!cap.read(frame) || frame.empty()) {
+            break;
+        }
+        if (!detector.apply(frame, changes)) {
+            break;
+        }
+        if (binary.size() != frame.size() || detector.frames() == 1) {
+            // The detector's first frame only learns the background and reports no change: threshold it
+            // whole, so regions that never change still get their output
+            INSTRUMENT_SCOPE("motion.threshold_full");
+            cv::Mat gray;
+            fast_grayscale(frame, gray);
+            fast_threshold(gray, binary, 127, 255, cv::THRESH_BINARY);
+        }
 
-    // Wait for ESC key
-    while (true) {
-        int key = cv::waitKey(100) & 0xFF;
-        if (key == 27) { // ESC key
+        // Downstream stages only visit the changed tiles
+        {
+            INSTRUMENT_SCOPE("motion.threshold_tiles");
+            cv::Mat gray_tile;
+            for_each_changed_tile(changes, [&](const cv::Rect &r) {
+                fast_grayscale(frame(r), gray_tile);
+                cv::Mat out = binary(r);
+                fast_threshold(gray_tile, out, 127, 255, cv::THRESH_BINARY);
+            });
+        }
+        processed_fraction += changes.changed_fraction();
+        frames++;
+
+        cv::Mat preview = frame.clone(); // a new Mat per frame: the display may still hold the previous one
+        for_each_changed_tile(changes, [&](const cv::Rect &r) {
+            cv::rectangle(preview, r, cv::Scalar(0, 0, 255), 1);
+        });
+        display_sink().show("Motion", preview);
+        display_sink().show("Motion Threshold", binary.clone());
+        if ((display_sink().wait_key(1) & 0xFF) == 27) {
             break;
         }
     }
-
-    cv::destroyWindow("Interactive Thresholding");
+    display_sink().close("Motion");
+    display_sink().close("Motion Threshold");
+    if (frames > 0) {
+        std::cout << "Processed " << 100.0 * processed_fraction / frames << "% of the tiles on average over "
+                  << frames << " frames" << std::endl;
+    }
 }
 
-int main() {
+int main(int argc, char const *argv[]) {
+    // --live [camera] [--skip-stages]: live thresholding only
+    if (argc > 1 && std::string(argv[1]) == "--live") {
+        int camera = argc > 2 && std::isdigit(static_cast<unsigned char>(argv[2][0])) ? std::stoi(argv[2]) : 0;
+        bool skip = std::string(argv[argc - 1]) == "--skip-stages";
+        live_threshold(camera, skip ? LIVE_SKIP_STAGES : LIVE_DROP_OLDEST);
+        display_sink().report(std::cout);
+        INSTRUMENT_REPORT("09_thresholding_image");
+        return 0;
+    }
+
+    // --motion [camera]: motion-gated thresholding only
+    if (argc > 1 && std::string(argv[1]) == "--motion") {
+        motion_threshold(argc > 2 && std::isdigit(static_cast<unsigned char>(argv[2][0])) ? std::stoi(argv[2]) : 0);
+        display_sink().report(std::cout);
+        INSTRUMENT_REPORT("09_thresholding_image");
+        return 0;
+    }
+
     std::cout << "=== OPENCV THRESHOLDING DEMONSTRATION ===" << std::endl;
 
     // Load and display gradient image
@@ -212,8 +525,13 @@ int main() {
     // Additional demonstrations on plate image
     adaptive_thresholds(plate_img);
     otsu_threshold(plate_img);
+    label_blobs(plate_img);
 
     std::cout << "\n=== PROGRAM COMPLETED ===" << std::endl;
-    cv::destroyAllWindows();
+    display_sink().close_all();
+
+    lesson_cache().report("Result cache");
+    display_sink().report(std::cout);
+    INSTRUMENT_REPORT("09_thresholding_image");
     return 0;
 }
\ No newline at end of file
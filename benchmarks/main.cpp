@@ -0,0 +1,900 @@
+#include <algorithm>
+#include <charconv>
+#include <chrono>
+#include <cmath>
+#include <filesystem>
+#include <fstream>
+#include <functional>
+#include <iomanip>
+#include <iostream>
+#include <map>
+#include <memory>
+#include <sstream>
+#include <string>
+#include <unistd.h>
+#include <vector>
+#include <opencv2/opencv.hpp>
+#include "autotune.hpp"
+#include "batch_ops.hpp"
+#include "brush_engine.hpp"
+#include "change_detection.hpp"
+#include "color_convert.hpp"
+#include "connected_components.hpp"
+#include "contrast.hpp"
+#include "frame_ring.hpp"
+#include "gamma_correction.hpp"
+#include "image_expr.hpp"
+#include "image_pyramid.hpp"
+#include "image_stats.hpp"
+#include "morphology.hpp"
+#include "parameter_sweep.hpp"
+#include "planar_image.hpp"
+#include "resize.hpp"
+#include "result_cache.hpp"
+#include "specialized_kernels.hpp"
+
+/*
+ * Regression benchmark harness for the operations used in lessons 02-09.
+ *
+ *   lesson_benchmarks                          run everything and print a table
+ *   lesson_benchmarks --record FILE            run and store the results as a JSON baseline
+ *                                              (baselines live in benchmarks/baselines/<host>.json)
+ *   lesson_benchmarks --compare FILE           run and compare against a stored baseline
+ *                                              (exit code 1 if any case regressed)
+ *   lesson_benchmarks --tune                   retune the row kernels (common/autotune.hpp) first
+ *   options: --filter SUBSTR  --samples N  --threshold PERCENT  --quick
+ *
+ * Inputs are synthetic and generated from a fixed seed, so runs are comparable across hosts
+ * and OpenCV versions.
+ */
+
+#define DEFAULT_SAMPLES 30
+#define DEFAULT_THRESHOLD_PERCENT 5.0
+#define MIN_SAMPLE_SECONDS 0.002
+#define RNG_SEED 0x5EED
+#define BENCH_CACHE_DIR "/tmp/cv_lessons_bench_cache_" // + pid, removed once the cases ran
+
+struct BenchCase
+{
+    std::string name;
+    std::function<void()> run;
+};
+
+struct BenchResult
+{
+    std::string name;
+    double mean_ns = 0.0;   // mean time per call
+    double stddev_ns = 0.0; // standard deviation of the per-sample means
+    int samples = 0;
+    double median_ns = 0.0;
+};
+
+struct BenchOptions
+{
+    std::string filter;
+    std::string record_path;
+    std::string compare_path;
+    int samples = DEFAULT_SAMPLES;
+    double threshold_percent = DEFAULT_THRESHOLD_PERCENT;
+    bool quick = false;
+    bool tune = false;
+};
+
+/**
+ * Creates a deterministic random image of the given size and channel count
+ */
+cv::Mat synthetic_image(cv::Size size, int channels, uint64_t seed)
+{
+    cv::Mat img(size, CV_8UC(channels));
+    cv::RNG rng(seed);
+    rng.fill(img, cv::RNG::UNIFORM, cv::Scalar::all(0), cv::Scalar::all(256));
+    return img;
+}
+
+/**
+ * Builds the list of benchmark cases for one resolution and channel count
+ * Every case mirrors the call made by the corresponding lesson
+ */
+void add_cases(std::vector<BenchCase> &cases, cv::Size size, int channels)
+{
+    std::string suffix = "/" + std::to_string(size.width) + "x" + std::to_string(size.height) +
+                         "c" + std::to_string(channels);
+
+    // Inputs are shared by the lambdas and stay alive for the whole run
+    cv::Mat src = synthetic_image(size, channels, RNG_SEED);
+    cv::Mat other = synthetic_image(size, channels, RNG_SEED + 1);
+    cv::Mat constant = cv::Mat(size, CV_8UC(channels), cv::Scalar::all(100));
+    cv::Mat scale = cv::Mat(size, CV_8UC(channels), cv::Scalar::all(2));
+    cv::Mat mask = cv::Mat::zeros(size, CV_8UC1);
+    cv::circle(mask, cv::Point(size.width / 2, size.height / 2), std::min(size.width, size.height) / 3,
+               cv::Scalar(255), -1);
+    cv::Mat gray;
+    if (channels == 3)
+    {
+        cv::cvtColor(src, gray, cv::COLOR_BGR2GRAY);
+    }
+    else
+    {
+        gray = src;
+    }
+    auto dst = std::make_shared<cv::Mat>();
+    cv::Rect crop_rect(size.width / 4, size.height / 4, size.width / 2, size.height / 2);
+
+    // 02: cropping
+    cases.push_back({"02.crop_view" + suffix, [=]() { *dst = src(crop_rect); }});
+    cases.push_back({"02.crop_copy" + suffix, [=]() { *dst = src(crop_rect).clone(); }});
+
+    // Resizing: whole image, then many crops to a model input size (crop + resize per crop vs fused batch)
+    const cv::Size half(size.width / 2, size.height / 2);
+    cases.push_back({"resize.cv_area_half" + suffix, [=]() { cv::resize(src, *dst, half, 0, 0, cv::INTER_AREA); }});
+    cases.push_back({"resize.area_half" + suffix, [=]() { fast_resize(src, *dst, half, RESIZE_AREA); }});
+    cases.push_back({"resize.lanczos3_half" + suffix, [=]() { fast_resize(src, *dst, half, RESIZE_LANCZOS3); }});
+    std::vector<cv::Rect> input_rects;
+    for (int i = 0; i < 500 && size.width > 120 && size.height > 120; i++)
+    {
+        input_rects.push_back(cv::Rect((i * 37) % (size.width - 120), (i * 53) % (size.height - 120), 120, 120));
+    }
+    if (!input_rects.empty())
+    {
+        const cv::Size input_size(224, 224);
+        auto inputs = std::make_shared<ImageBatch>();
+        cases.push_back({"resize.cv_crops_500_to_224" + suffix, [=]() {
+                             for (const cv::Rect &r : input_rects)
+                             {
+                                 cv::resize(src(r).clone(), *dst, input_size, 0, 0, cv::INTER_LINEAR);
+                             }
+                         }});
+        cases.push_back({"resize.crops_500_to_224" + suffix,
+                         [=]() { resize_crops(src, input_rects, input_size, RESIZE_BILINEAR, *inputs); }});
+    }
+
+    // 03: bitwise operations and masking
+    cases.push_back({"03.bitwise_and" + suffix, [=]() { cv::bitwise_and(src, other, *dst); }});
+    cases.push_back({"03.bitwise_or" + suffix, [=]() { cv::bitwise_or(src, other, *dst); }});
+    cases.push_back({"03.bitwise_xor" + suffix, [=]() { cv::bitwise_xor(src, other, *dst); }});
+    cases.push_back({"03.bitwise_not" + suffix, [=]() { cv::bitwise_not(src, *dst); }});
+    cases.push_back({"03.masked_and" + suffix, [=]() { cv::bitwise_and(src, src, *dst, mask); }});
+
+    // 04: drawing (on a copy of the source so every call draws the same thing)
+    auto canvas = std::make_shared<cv::Mat>(src.clone());
+    cases.push_back({"04.line" + suffix, [=]() {
+                         cv::line(*canvas, cv::Point(0, 0), cv::Point(size.width - 1, size.height - 1),
+                                  cv::Scalar(255, 127, 0), 5);
+                     }});
+    cases.push_back({"04.rectangle" + suffix, [=]() {
+                         cv::rectangle(*canvas, cv::Point(100, 100), cv::Point(300, 250), cv::Scalar(0, 0, 255), 5);
+                     }});
+    cases.push_back({"04.circle_filled" + suffix, [=]() {
+                         cv::circle(*canvas, cv::Point(400, 100), 50, cv::Scalar(0, 255, 0), -1);
+                     }});
+    cases.push_back({"04.put_text" + suffix, [=]() {
+                         cv::putText(*canvas, "OpenCV Drawing Demo", cv::Point(50, 450), cv::FONT_HERSHEY_SIMPLEX,
+                                     1.0, cv::Scalar(255, 255, 255), 2);
+                     }});
+
+    // 05: arithmetic
+    cases.push_back({"05.add" + suffix, [=]() { cv::add(src, constant, *dst); }});
+    cases.push_back({"05.subtract" + suffix, [=]() { cv::subtract(src, constant, *dst); }});
+    cases.push_back({"05.multiply" + suffix, [=]() { cv::multiply(src, scale, *dst); }});
+    cases.push_back({"05.divide" + suffix, [=]() { cv::divide(src, scale, *dst); }});
+    cases.push_back({"05.add_weighted" + suffix, [=]() { cv::addWeighted(src, 0.7, constant, 0.3, 0.0, *dst); }});
+    cases.push_back({"05.chain_eager" + suffix, [=]() {
+                         cv::Mat scaled, halved, diff;
+                         src.convertTo(scaled, CV_32F, 1.5);
+                         constant.convertTo(halved, CV_32F, 0.5);
+                         cv::subtract(scaled, halved, diff);
+                         diff.convertTo(*dst, CV_8U, 1.0, 30.0);
+                     }});
+    cases.push_back({"05.chain_fused" + suffix,
+                     [=]() { into(*dst) = clamp(1.5 * lazy(src) - lazy(constant) / 2 + 30); }});
+
+    // Per-frame QA statistics: OpenCV calls (one pass each) vs the single-pass inspector
+    cases.push_back({"stats.cv_meanstddev_minmax_hist" + suffix, [=]() {
+                         cv::Scalar mean, stddev;
+                         cv::meanStdDev(src, mean, stddev);
+                         std::vector<cv::Mat> planes;
+                         cv::split(src, planes);
+                         const int bins = 256;
+                         const float range[] = {0, 256};
+                         const float *ranges[] = {range};
+                         for (const cv::Mat &plane : planes)
+                         {
+                             double lo, hi;
+                             cv::Mat hist;
+                             cv::minMaxLoc(plane, &lo, &hi);
+                             cv::calcHist(&plane, 1, nullptr, cv::Mat(), hist, 1, &bins, ranges);
+                         }
+                     }});
+    cases.push_back({"stats.image_stats" + suffix, [=]() {
+                         ImageStats stats;
+                         image_stats(src, stats);
+                     }});
+    cases.push_back({"stats.image_stats_every_4th_row" + suffix, [=]() {
+                         ImageStats stats;
+                         image_stats(src, stats, 4);
+                     }});
+
+    // 06: linear brightness and contrast
+    cases.push_back({"06.convert_scale_abs" + suffix, [=]() { cv::convertScaleAbs(src, *dst, 1.5, 30); }});
+
+    // 07: gamma correction
+    cases.push_back({"07.gamma_lut_0.5" + suffix, [=]() { *dst = gammaCorrectionLUT(src, 0.5); }});
+    cases.push_back({"07.gamma_lut_2.0" + suffix, [=]() { *dst = gammaCorrectionLUT(src, 2.0); }});
+
+    // 06/07 at native HDR depths
+    cv::Mat src16, src32;
+    src.convertTo(src16, CV_16U, 257.0);
+    src.convertTo(src32, CV_32F, 1.0 / 255.0);
+    cases.push_back({"06.contrast_16u" + suffix, [=]() { adjust_contrast_brightness(src16, *dst, 1.5, 3000); }});
+    cases.push_back({"06.contrast_32f" + suffix, [=]() { adjust_contrast_brightness(src32, *dst, 1.5, 0.1); }});
+
+    // Handing a frame to the next process: JPEG encode + decode vs a shared-memory ring (write + acquire)
+    if (channels == 3)
+    {
+        auto encoded = std::make_shared<std::vector<uchar>>();
+        cases.push_back({"ring.jpeg_handoff" + suffix, [=]() {
+                             cv::imencode(".jpg", src, *encoded);
+                             *dst = cv::imdecode(*encoded, cv::IMREAD_COLOR);
+                         }});
+        const std::string ring_name = "/cv_lessons_bench_" + std::to_string(::getpid());
+        auto writer = std::make_shared<FrameWriter>();
+        auto reader = std::make_shared<FrameReader>();
+        if (writer->create(ring_name, 4, frame_ring_frame_bytes(size, src.type())) && reader->open(ring_name))
+        {
+            SharedMemory::unlink(ring_name); // both ends stay mapped
+            cases.push_back({"ring.shm_handoff" + suffix, [=]() {
+                                 FrameView frame;
+                                 writer->write(src);
+                                 reader->acquire(frame, 0);
+                                 *dst = frame.image;
+                                 reader->release();
+                             }});
+        }
+    }
+
+    // Specialized kernels (one dispatch per image) against the generic OpenCV paths
+    cases.push_back({"kernels.cv_threshold_16u" + suffix,
+                     [=]() { cv::threshold(src16, *dst, 30000, 65535, cv::THRESH_TRUNC); }});
+    cases.push_back({"kernels.threshold_16u" + suffix,
+                     [=]() { fast_threshold(src16, *dst, 30000, 65535, cv::THRESH_TRUNC); }});
+    cases.push_back({"kernels.cv_threshold_32f" + suffix,
+                     [=]() { cv::threshold(src32, *dst, 0.5, 1.0, cv::THRESH_BINARY); }});
+    cases.push_back({"kernels.threshold_32f" + suffix,
+                     [=]() { fast_threshold(src32, *dst, 0.5, 1.0, cv::THRESH_BINARY); }});
+    if (channels == 3)
+    {
+        cases.push_back({"kernels.grayscale_8u" + suffix, [=]() { fast_grayscale(src, *dst); }});
+        cases.push_back({"kernels.grayscale_32f" + suffix, [=]() { fast_grayscale(src32, *dst); }});
+    }
+    // Change detection on a static scene: absdiff + threshold + float running average vs the fused detector
+    {
+        auto background = std::make_shared<cv::Mat>();
+        gray.convertTo(*background, CV_32F);
+        auto diff = std::make_shared<cv::Mat>();
+        cases.push_back({"change.cv_absdiff_threshold" + suffix, [=]() {
+                             cv::Mat background_8u;
+                             background->convertTo(background_8u, CV_8U);
+                             cv::absdiff(gray, background_8u, *diff);
+                             cv::threshold(*diff, *dst, CHANGE_THRESHOLD, 255, cv::THRESH_BINARY);
+                             cv::accumulateWeighted(gray, *background, 1.0 / (1 << CHANGE_EMA_SHIFT));
+                         }});
+        auto detector = std::make_shared<ChangeDetector>();
+        auto changes = std::make_shared<ChangeMap>();
+        detector->apply(gray, *changes);
+        cases.push_back({"change.detect" + suffix, [=]() { detector->apply(gray, *changes); }});
+    }
+
+    // Memoized gray -> gamma -> threshold chain: computing it vs hashing the input and hitting the cache
+    if (channels == 3)
+    {
+        auto chain = [=]() {
+            cv::Mat g, corrected, binary;
+            fast_grayscale(src, g);
+            corrected = gammaCorrectionLUT(g, 2.2);
+            cv::threshold(corrected, binary, 127, 255, cv::THRESH_BINARY);
+            return binary;
+        };
+        auto chain_key = [=]() {
+            return CacheKey(src).then("grayscale").then("gamma", {2.2}).then("threshold", {127});
+        };
+        auto memory_cache = std::make_shared<ResultCache>(static_cast<size_t>(RESULT_CACHE_MEMORY_MB) << 20, "");
+        auto disk_cache = std::make_shared<ResultCache>(static_cast<size_t>(RESULT_CACHE_MEMORY_MB) << 20,
+                                                        BENCH_CACHE_DIR + std::to_string(::getpid()));
+        // Hits share the cached pixels: keep them out of *dst, which later cases write into in place
+        auto cached = std::make_shared<cv::Mat>();
+        cases.push_back({"cache.hash" + suffix, [=]() { volatile uint64_t h = content_hash(src); (void)h; }});
+        cases.push_back({"cache.chain_compute" + suffix, [=]() { *dst = chain(); }});
+        cases.push_back({"cache.chain_memory_hit" + suffix,
+                         [=]() { *cached = memory_cache->memoize(chain_key(), chain); }});
+        cases.push_back({"cache.chain_disk_hit" + suffix, [=]() {
+                             disk_cache->clear_memory();
+                             *cached = disk_cache->memoize(chain_key(), chain);
+                         }});
+    }
+    cases.push_back({"07.gamma_16u_2.2" + suffix, [=]() { *dst = gammaCorrectionLUT(src16, 2.2); }});
+    cases.push_back({"07.gamma_32f_2.2" + suffix, [=]() { *dst = gammaCorrectionLUT(src32, 2.2); }});
+
+    // 08: paint tool strokes
+    cases.push_back({"08.brush_line_aa" + suffix, [=]() {
+                         cv::line(*canvas, cv::Point(10, 10), cv::Point(200, 120), cv::Scalar(255, 0, 0), 10,
+                                  cv::LINE_AA);
+                     }});
+    cases.push_back({"08.dot_circle" + suffix, [=]() {
+                         cv::circle(*canvas, cv::Point(60, 60), 10, cv::Scalar(134), -1);
+                     }});
+    {
+        // One drag of 200 mouse events a few pixels apart: per-event cv::line vs. queued spline stamping
+        std::vector<cv::Point> stroke;
+        for (int i = 0; i < 200; i++)
+        {
+            stroke.emplace_back(10 + i * (size.width - 20) / 200,
+                                size.height / 2 + static_cast<int>(size.height / 3 * std::sin(i * 0.05)));
+        }
+        auto engine = std::make_shared<BrushEngine>();
+        cases.push_back({"08.stroke_cv_line" + suffix, [=]() {
+                             for (size_t i = 1; i < stroke.size(); i++)
+                             {
+                                 cv::line(*canvas, stroke[i - 1], stroke[i], cv::Scalar(255, 0, 0), 10, cv::LINE_AA);
+                             }
+                         }});
+        cases.push_back({"08.stroke_brush_engine" + suffix, [=]() {
+                             engine->begin_stroke(stroke[0].x, stroke[0].y);
+                             for (size_t i = 1; i < stroke.size(); i++)
+                             {
+                                 engine->add_point(stroke[i].x, stroke[i].y);
+                             }
+                             engine->end_stroke();
+                             engine->flush(*canvas);
+                         }});
+    }
+
+    // Planar layout variants of the per-channel operations
+    if (channels == 3)
+    {
+        auto planar = std::make_shared<PlanarImage>();
+        auto planar_dst = std::make_shared<PlanarImage>();
+        deinterleave(src, *planar);
+        cv::Mat invert(1, 256, CV_8U);
+        for (int i = 0; i < 256; i++)
+        {
+            invert.at<uchar>(i) = static_cast<uchar>(255 - i);
+        }
+        cases.push_back({"planar.deinterleave" + suffix, [=]() { deinterleave(src, *planar_dst); }});
+        cases.push_back({"planar.interleave" + suffix, [=]() { interleave(*planar, *dst); }});
+        cases.push_back({"planar.to_gray" + suffix, [=]() { planar_to_gray(*planar, *dst); }});
+        cases.push_back({"planar.lut" + suffix, [=]() {
+                             const cv::Mat luts[3] = {invert, invert, invert};
+                             planar_lut(*planar, luts, *planar_dst);
+                         }});
+        cases.push_back({"planar.threshold" + suffix, [=]() {
+                             planar_threshold(*planar, cv::Scalar(100, 127, 150), 255, cv::THRESH_BINARY, *planar_dst);
+                         }});
+    }
+
+    // Color conversions and fused conversion + point operation
+    if (channels == 3)
+    {
+        const cv::Mat lut = threshold_lut(127, 255, cv::THRESH_BINARY);
+        cases.push_back({"color.cv_hsv" + suffix, [=]() { cv::cvtColor(src, *dst, cv::COLOR_BGR2HSV); }});
+        cases.push_back({"color.hsv" + suffix, [=]() { convert_color(src, *dst, cv::COLOR_BGR2HSV); }});
+        cases.push_back({"color.ycrcb" + suffix, [=]() { convert_color(src, *dst, cv::COLOR_BGR2YCrCb); }});
+        cases.push_back({"color.gray_then_threshold" + suffix, [=]() {
+                             cv::Mat g;
+                             cv::cvtColor(src, g, cv::COLOR_BGR2GRAY);
+                             cv::threshold(g, *dst, 127, 255, cv::THRESH_BINARY);
+                         }});
+        cases.push_back({"color.gray_lut_fused" + suffix, [=]() { bgr_to_gray_lut(src, lut, *dst); }});
+
+        // Camera frames: NV12 with the luma plane taken from the gray image
+        cv::Mat nv12_buffer(size.height * 3 / 2, size.width, CV_8UC1, cv::Scalar(128));
+        gray.copyTo(nv12_buffer.rowRange(0, size.height));
+        const Yuv420Frame nv12 = Yuv420Frame::wrap(nv12_buffer, YUV420_NV12);
+        cases.push_back({"color.nv12_bgr_gray_threshold" + suffix, [=]() {
+                             cv::Mat bgr, g;
+                             cv::cvtColor(nv12_buffer, bgr, cv::COLOR_YUV2BGR_NV12);
+                             cv::cvtColor(bgr, g, cv::COLOR_BGR2GRAY);
+                             cv::threshold(g, *dst, 127, 255, cv::THRESH_BINARY);
+                         }});
+        cases.push_back({"color.nv12_to_bgr" + suffix, [=]() { yuv420_to_bgr(nv12, *dst); }});
+        cases.push_back({"color.nv12_threshold_luma" + suffix,
+                         [=]() { yuv420_threshold_luma(nv12, *dst, 127, 255, cv::THRESH_BINARY); }});
+    }
+
+    // 09: thresholding (lessons convert to grayscale first; that conversion is measured separately)
+    if (channels == 3)
+    {
+        cases.push_back({"09.to_gray" + suffix, [=]() { cv::cvtColor(src, *dst, cv::COLOR_BGR2GRAY); }});
+    }
+    const std::vector<std::pair<std::string, int>> types = {
+        {"binary", cv::THRESH_BINARY}, {"binary_inv", cv::THRESH_BINARY_INV}, {"trunc", cv::THRESH_TRUNC},
+        {"tozero", cv::THRESH_TOZERO}, {"tozero_inv", cv::THRESH_TOZERO_INV}};
+    for (const auto &[type_name, type] : types)
+    {
+        cases.push_back({"09.threshold_" + type_name + suffix,
+                         [=]() { cv::threshold(gray, *dst, 127, 255, type); }});
+    }
+
+    // Parameter sweeps: 64 thresholds one call at a time vs one pass, and 1000 foreground fractions
+    std::vector<ThresholdParams> sweep_params;
+    std::vector<double> sweep_thresholds;
+    for (int t = 0; t < 1000; t++)
+    {
+        sweep_thresholds.push_back(t * 0.255);
+    }
+    for (int t = 0; t < 64; t++)
+    {
+        sweep_params.push_back({t * 4.0, 255, cv::THRESH_BINARY});
+    }
+    auto sweep_outputs = std::make_shared<std::vector<cv::Mat>>();
+    cases.push_back({"sweep.cv_threshold_x64" + suffix, [=]() {
+                         sweep_outputs->resize(sweep_params.size());
+                         for (size_t k = 0; k < sweep_params.size(); k++)
+                         {
+                             cv::threshold(gray, (*sweep_outputs)[k], sweep_params[k].thresh, 255, cv::THRESH_BINARY);
+                         }
+                     }});
+    cases.push_back({"sweep.threshold_x64" + suffix, [=]() { sweep_threshold(gray, sweep_params, *sweep_outputs); }});
+    cases.push_back({"sweep.fractions_x1000" + suffix, [=]() { foreground_fractions(gray, sweep_thresholds); }});
+
+    cases.push_back({"09.threshold_otsu" + suffix,
+                     [=]() { cv::threshold(gray, *dst, 0, 255, cv::THRESH_BINARY | cv::THRESH_OTSU); }});
+    cases.push_back({"09.components_otsu" + suffix, [=]() {
+                         cv::threshold(gray, *dst, 0, 255, cv::THRESH_BINARY | cv::THRESH_OTSU);
+                         connected_components(*dst);
+                     }});
+    for (int k : {5, 31})
+    {
+        const cv::Size ksize(k, k);
+        const std::string kname = std::to_string(k) + "x" + std::to_string(k);
+        cases.push_back({"morph.cv_close_" + kname + suffix, [=]() {
+                             cv::morphologyEx(gray, *dst, cv::MORPH_CLOSE,
+                                              cv::getStructuringElement(cv::MORPH_RECT, ksize));
+                         }});
+        cases.push_back({"morph.fast_close_" + kname + suffix,
+                         [=]() { fast_morphology(gray, *dst, cv::MORPH_CLOSE, ksize); }});
+        cases.push_back({"morph.threshold_close_" + kname + suffix,
+                         [=]() { threshold_close(gray, *dst, 127, 255, cv::THRESH_BINARY, ksize); }});
+    }
+    cases.push_back({"pyramid.box_level1" + suffix, [=]() { downsample_box_2x2(src, *dst); }});
+    cases.push_back({"pyramid.otsu_coarse_to_fine_l2" + suffix, [=]() {
+                         ImagePyramid pyramid(gray);
+                         coarse_to_fine_threshold(pyramid, 2, 0, 255, cv::THRESH_BINARY | cv::THRESH_OTSU, *dst);
+                     }});
+    cases.push_back({"09.adaptive_mean" + suffix, [=]() {
+                         cv::adaptiveThreshold(gray, *dst, 255, cv::ADAPTIVE_THRESH_MEAN_C, cv::THRESH_BINARY, 11, 2);
+                     }});
+    cases.push_back({"09.adaptive_gaussian" + suffix, [=]() {
+                         cv::adaptiveThreshold(gray, *dst, 255, cv::ADAPTIVE_THRESH_GAUSSIAN_C, cv::THRESH_BINARY,
+                                               11, 2);
+                     }});
+}
+
+/**
+ * Times one case: calibrates the iteration count so a sample lasts at least MIN_SAMPLE_SECONDS,
+ * then collects the requested number of samples
+ */
+BenchResult run_case(const BenchCase &bench, int samples)
+{
+    using clock = std::chrono::steady_clock;
+
+    // Warm-up (allocations, lazy initialisation inside OpenCV)
+    bench.run();
+
+    int iterations = 1;
+    while (true)
+    {
+        auto start = clock::now();
+        for (int i = 0; i < iterations; i++)
+        {
+            bench.run();
+        }
+        double seconds = std::chrono::duration<double>(clock::now() - start).count();
+        if (seconds >= MIN_SAMPLE_SECONDS || iterations >= (1 << 20))
+        {
+            break;
+        }
+        iterations *= 2;
+    }
+
+    std::vector<double> per_call_ns;
+    per_call_ns.reserve(samples);
+    for (int s = 0; s < samples; s++)
+    {
+        auto start = clock::now();
+        for (int i = 0; i < iterations; i++)
+        {
+            bench.run();
+        }
+        double ns = std::chrono::duration<double, std::nano>(clock::now() - start).count();
+        per_call_ns.push_back(ns / iterations);
+    }
+
+    BenchResult result;
+    result.name = bench.name;
+    result.samples = samples;
+    double sum = 0.0;
+    for (double v : per_call_ns)
+    {
+        sum += v;
+    }
+    result.mean_ns = sum / samples;
+    double var = 0.0;
+    for (double v : per_call_ns)
+    {
+        var += (v - result.mean_ns) * (v - result.mean_ns);
+    }
+    result.stddev_ns = samples > 1 ? std::sqrt(var / (samples - 1)) : 0.0;
+    std::sort(per_call_ns.begin(), per_call_ns.end());
+    result.median_ns = per_call_ns[samples / 2];
+    return result;
+}
+
+/**
+ * Two-sided 95% Student t critical value (Cornish-Fisher expansion around the normal quantile)
+ */
+double t_critical_95(double dof)
+{
+    const double z = 1.959963984540054;
+    if (dof <= 1.0)
+    {
+        return 12.706;
+    }
+    double z3 = z * z * z;
+    double z5 = z3 * z * z;
+    return z + (z3 + z) / (4.0 * dof) + (5.0 * z5 + 16.0 * z3 + 3.0 * z) / (96.0 * dof * dof);
+}
+
+/**
+ * Writes results as a JSON baseline (one result object per line so the file diffs cleanly)
+ */
+bool write_baseline(const std::string &path, const std::vector<BenchResult> &results)
+{
+    std::ofstream out(path);
+    if (!out)
+    {
+        return false;
+    }
+    out << "{\n";
+    out << "  \"opencv_version\": \"" << CV_VERSION << "\",\n";
+    out << "  \"threads\": " << cv::getNumThreads() << ",\n";
+    out << "  \"results\": [\n";
+    for (size_t i = 0; i < results.size(); i++)
+    {
+        const BenchResult &r = results[i];
+        out << "    {\"name\": \"" << r.name << "\", \"mean_ns\": " << std::fixed << std::setprecision(1)
+            << r.mean_ns << ", \"stddev_ns\": " << r.stddev_ns << ", \"median_ns\": " << r.median_ns
+            << ", \"samples\": " << r.samples << "}" << (i + 1 < results.size() ? "," : "") << "\n";
+    }
+    out << "  ]\n}\n";
+    return static_cast<bool>(out);
+}
+
+/**
+ * Parses a number at the start of [begin, end) without throwing
+ * @param whole Also require that nothing follows the number
+ */
+template <typename T>
+bool parse_number(const char *begin, const char *end, T &value, bool whole = true)
+{
+    const std::from_chars_result r = std::from_chars(begin, end, value);
+    return r.ec == std::errc() && (!whole || r.ptr == end);
+}
+
+/**
+ * Extracts a numeric field from a single-line JSON object written by write_baseline
+ * @return false if the field is missing or not a number
+ */
+bool json_number(const std::string &line, const std::string &key, double &value)
+{
+    const size_t pos = line.find("\"" + key + "\":");
+    if (pos == std::string::npos)
+    {
+        return false;
+    }
+    const size_t begin = line.find_first_not_of(' ', pos + key.size() + 3);
+    return begin != std::string::npos &&
+           parse_number(line.data() + begin, line.data() + line.size(), value, false) && std::isfinite(value);
+}
+
+/**
+ * Reads a baseline written by write_baseline
+ */
+std::map<std::string, BenchResult> read_baseline(const std::string &path)
+{
+    std::map<std::string, BenchResult> baseline;
+    std::ifstream in(path);
+    std::string line;
+    while (std::getline(in, line))
+    {
+        size_t pos = line.find("{\"name\": \"");
+        if (pos == std::string::npos)
+        {
+            continue;
+        }
+        size_t begin = pos + 10;
+        size_t end = line.find('"', begin);
+        BenchResult r;
+        r.name = line.substr(begin, end - begin);
+        double samples = 0.0;
+        if (!json_number(line, "mean_ns", r.mean_ns) || !json_number(line, "stddev_ns", r.stddev_ns) ||
+            !json_number(line, "median_ns", r.median_ns) || !json_number(line, "samples", samples))
+        {
+            std::cerr << "Error: Skipping malformed baseline entry '" << r.name << "'!" << std::endl;
+            continue;
+        }
+        r.samples = static_cast<int>(samples);
+        baseline[r.name] = r;
+    }
+    return baseline;
+}
+
+/**
+ * Compares a run with the baseline using Welch's t-interval on the difference of means
+ * A case regresses when the whole 95% interval lies above +threshold percent
+ * @return number of regressed cases
+ */
+int compare_with_baseline(const std::map<std::string, BenchResult> &baseline,
+                          const std::vector<BenchResult> &results, double threshold_percent)
+{
+    int regressions = 0;
+    std::cout << "\n=== COMPARISON AGAINST BASELINE (95% confidence) ===" << std::endl;
+    std::cout << std::left << std::setw(44) << "case" << std::right << std::setw(14) << "baseline us"
+              << std::setw(14) << "current us" << std::setw(24) << "change % [95% CI]" << "  verdict" << std::endl;
+
+    for (const BenchResult &cur : results)
+    {
+        auto it = baseline.find(cur.name);
+        if (it == baseline.end())
+        {
+            std::cout << std::left << std::setw(44) << cur.name << std::right << std::setw(14) << "-"
+                      << std::setw(14) << cur.mean_ns / 1000.0 << std::setw(24) << "-" << "  new" << std::endl;
+            continue;
+        }
+        const BenchResult &base = it->second;
+
+        // Welch's t-interval for (current - baseline), expressed relative to the baseline mean
+        double va = base.stddev_ns * base.stddev_ns / std::max(1, base.samples);
+        double vb = cur.stddev_ns * cur.stddev_ns / std::max(1, cur.samples);
+        double se = std::sqrt(va + vb);
+        double dof = (va + vb) * (va + vb) /
+                     std::max(1e-300, va * va / std::max(1, base.samples - 1) + vb * vb / std::max(1, cur.samples - 1));
+        double half_width = t_critical_95(dof) * se;
+        double diff = cur.mean_ns - base.mean_ns;
+        double change = 100.0 * diff / base.mean_ns;
+        double low = 100.0 * (diff - half_width) / base.mean_ns;
+        double high = 100.0 * (diff + half_width) / base.mean_ns;
+
+        std::string verdict = "ok";
+        if (low > threshold_percent)
+        {
+            verdict = "REGRESSION";
+            regressions++;
+        }
+        else if (high < -threshold_percent)
+        {
+            verdict = "improved";
+        }
+
+        std::ostringstream interval;
+        interval << std::fixed << std::setprecision(1) << std::showpos << change << " [" << low << ", " << high << "]";
+        std::cout << std::left << std::setw(44) << cur.name << std::right << std::fixed << std::setprecision(2)
+                  << std::setw(14) << base.mean_ns / 1000.0 << std::setw(14) << cur.mean_ns / 1000.0
+                  << std::setw(24) << interval.str() << "  " << verdict << std::endl;
+    }
+    return regressions;
+}
+
+/**
+ * Parses command line options, returns false on unknown arguments and malformed numbers
+ */
+bool parse_options(int argc, char const *argv[], BenchOptions &options)
+{
+    for (int i = 1; i < argc; i++)
+    {
+        std::string arg = argv[i];
+        bool has_value = i + 1 < argc;
+        if (arg == "--filter" && has_value)
+        {
+            options.filter = argv[++i];
+        }
+        else if (arg == "--record" && has_value)
+        {
+            options.record_path = argv[++i];
+        }
+        else if (arg == "--compare" && has_value)
+        {
+            options.compare_path = argv[++i];
+        }
+        else if (arg == "--samples" && has_value)
+        {
+            const std::string value = argv[++i];
+            if (!parse_number(value.data(), value.data() + value.size(), options.samples))
+            {
+                return false;
+            }
+            options.samples = std::max(2, options.samples);
+        }
+        else if (arg == "--threshold" && has_value)
+        {
+            const std::string value = argv[++i];
+            if (!parse_number(value.data(), value.data() + value.size(), options.threshold_percent) ||
+                !std::isfinite(options.threshold_percent))
+            {
+                return false;
+            }
+        }
+        else if (arg == "--quick")
+        {
+            options.quick = true;
+        }
+        else if (arg == "--tune")
+        {
+            options.tune = true;
+        }
+        else
+        {
+            return false;
+        }
+    }
+    return true;
+}
+
+/**
+ * Builds the batched cases: many 64x64 crops per call, one-at-a-time loop vs the batch API
+ */
+void add_batch_cases(std::vector<BenchCase> &cases, int count)
+{
+    const cv::Size crop(64, 64);
+    std::string suffix = "/" + std::to_string(count) + "x64x64";
+    auto images = std::make_shared<std::vector<cv::Mat>>();
+    for (int i = 0; i < count; i++)
+    {
+        images->push_back(synthetic_image(crop, 3, RNG_SEED + i));
+    }
+    auto batch = std::make_shared<ImageBatch>(ImageBatch::from_images(*images));
+    auto gray_batch = std::make_shared<ImageBatch>();
+    batch_grayscale(*batch, *gray_batch);
+    auto gray_images = std::make_shared<std::vector<cv::Mat>>();
+    for (int i = 0; i < count; i++)
+    {
+        gray_images->push_back(gray_batch->image(i).clone());
+    }
+    auto outputs = std::make_shared<std::vector<cv::Mat>>(count);
+    auto out_batch = std::make_shared<ImageBatch>();
+
+    cases.push_back({"batch.gray_loop" + suffix, [=]() {
+                         for (int i = 0; i < count; i++)
+                         {
+                             cv::cvtColor((*images)[i], (*outputs)[i], cv::COLOR_BGR2GRAY);
+                         }
+                     }});
+    cases.push_back({"batch.gray_span" + suffix, [=]() { batch_grayscale(*images, *outputs); }});
+    cases.push_back({"batch.gray_contiguous" + suffix, [=]() { batch_grayscale(*batch, *out_batch); }});
+    cases.push_back({"batch.gamma_loop" + suffix, [=]() {
+                         for (int i = 0; i < count; i++)
+                         {
+                             (*outputs)[i] = gammaCorrectionLUT((*images)[i], 2.2);
+                         }
+                     }});
+    cases.push_back({"batch.gamma_contiguous" + suffix, [=]() { batch_gamma(*batch, *out_batch, 2.2); }});
+    cases.push_back({"batch.otsu_loop" + suffix, [=]() {
+                         for (int i = 0; i < count; i++)
+                         {
+                             cv::threshold((*gray_images)[i], (*outputs)[i], 0, 255,
+                                           cv::THRESH_BINARY | cv::THRESH_OTSU);
+                         }
+                     }});
+    cases.push_back({"batch.otsu_span" + suffix, [=]() { batch_otsu(*gray_images, *outputs); }});
+    cases.push_back({"batch.otsu_contiguous" + suffix, [=]() { batch_otsu(*gray_batch, *out_batch); }});
+}
+
+bool selected(const BenchOptions &options, const std::string &name)
+{
+    return options.filter.empty() || name.find(options.filter) != std::string::npos;
+}
+
+/**
+ * Builds the autotuned cases: every registered row kernel with OpenCV's default split and with its tuned split
+ * The profile is loaded (or tuned and written) only when --tune is given or the filter selects one of them
+ */
+void add_tuned_cases(std::vector<BenchCase> &cases, const BenchOptions &options)
+{
+    register_builtin_kernels();
+    const cv::Size size(AUTOTUNE_IMAGE_WIDTH, AUTOTUNE_IMAGE_HEIGHT);
+    std::string suffix = "/" + std::to_string(size.width) + "x" + std::to_string(size.height);
+    bool needed = options.tune;
+    for (const TunableKernel &kernel : KernelRegistry::instance().kernels())
+    {
+        needed = needed || selected(options, "tune.default_" + kernel.name + suffix) ||
+                 selected(options, "tune.tuned_" + kernel.name + suffix);
+    }
+    if (!needed)
+    {
+        return;
+    }
+    autotune(AUTOTUNE_PROFILE_PATH, options.tune);
+    for (const TunableKernel &kernel : KernelRegistry::instance().kernels())
+    {
+        cv::Mat src = synthetic_image(size, CV_MAT_CN(kernel.src_type), RNG_SEED);
+        auto dst = std::make_shared<cv::Mat>();
+        cases.push_back({"tune.default_" + kernel.name + suffix, [=]() { run_tiled(kernel, src, *dst, TileConfig()); }});
+        cases.push_back({"tune.tuned_" + kernel.name + suffix, [=]() { run_tiled(kernel, src, *dst, kernel.config); }});
+    }
+}
+
+int main(int argc, char const *argv[])
+{
+    BenchOptions options;
+    if (!parse_options(argc, argv, options))
+    {
+        std::cerr << "Usage: " << argv[0]
+                  << " [--filter SUBSTR] [--samples N] [--threshold PERCENT] [--quick] [--tune]"
+                  << " [--record FILE | --compare FILE]" << std::endl;
+        return -1;
+    }
+
+    std::cout << "OpenCV Version: " << CV_VERSION << " | Threads: " << cv::getNumThreads() << std::endl;
+
+    // Resolutions and channel counts covered by every case
+    std::vector<cv::Size> sizes = {cv::Size(640, 480), cv::Size(1920, 1080), cv::Size(3840, 2160)};
+    if (options.quick)
+    {
+        sizes = {cv::Size(640, 480)};
+        options.samples = std::min(options.samples, 10);
+    }
+
+    std::vector<BenchCase> cases;
+    for (const cv::Size &size : sizes)
+    {
+        for (int channels : {1, 3})
+        {
+            add_cases(cases, size, channels);
+        }
+    }
+    add_batch_cases(cases, options.quick ? 64 : 1024);
+    add_tuned_cases(cases, options);
+
+    std::vector<BenchResult> results;
+    std::cout << std::left << std::setw(44) << "case" << std::right << std::setw(14) << "mean us"
+              << std::setw(14) << "stddev us" << std::setw(14) << "median us" << std::endl;
+    for (const BenchCase &bench : cases)
+    {
+        if (!selected(options, bench.name))
+        {
+            continue;
+        }
+        BenchResult r = run_case(bench, options.samples);
+        std::cout << std::left << std::setw(44) << r.name << std::right << std::fixed << std::setprecision(2)
+                  << std::setw(14) << r.mean_ns / 1000.0 << std::setw(14) << r.stddev_ns / 1000.0
+                  << std::setw(14) << r.median_ns / 1000.0 << std::endl;
+        results.push_back(r);
+    }
+    cases.clear(); // releases the caches, rings and buffers held by the cases
+    std::error_code ec;
+    std::filesystem::remove_all(BENCH_CACHE_DIR + std::to_string(::getpid()), ec);
+
+    if (!options.record_path.empty())
+    {
+        if (!write_baseline(options.record_path, results))
+        {
+            std::cerr << "Error: Could not write baseline '" << options.record_path << "'" << std::endl;
+            return -1;
+        }
+        std::cout << "\nBaseline saved as '" << options.record_path << "'" << std::endl;
+    }
+
+    if (!options.compare_path.empty())
+    {
+        std::map<std::string, BenchResult> baseline = read_baseline(options.compare_path);
+        if (baseline.empty())
+        {
+            std::cerr << "Error: Could not read baseline '" << options.compare_path << "'" << std::endl;
+            return -1;
+        }
+        int regressions = compare_with_baseline(baseline, results, options.threshold_percent);
+        std::cout << "\n" << regressions << " regression(s) beyond " << options.threshold_percent << "%" << std::endl;
+        return regressions > 0 ? 1 : 0;
+    }
+
+    return 0;
+}
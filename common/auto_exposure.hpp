@@ -0,0 +1,300 @@
+#pragma once
+
+#include <array>
+#include <cmath>
+#include <cstdint>
+#include <iostream>
+#include <opencv2/opencv.hpp>
+#include "contrast.hpp"
+#include "gamma_correction.hpp"
+#include "instrumentation.hpp"
+#include "pixel_depth.hpp"
+
+/*
+ * Automatic brightness/contrast (alpha, beta) and gamma estimation from image statistics.
+ * The statistics come from one subsampled pass that builds a 256-bin luminance histogram;
+ * the result is applied through the same convertScaleAbs/LUT style paths as lessons 06 and 07.
+ */
+
+typedef std::array<uint32_t, 256> LumaHistogram;
+
+struct ExposureParams
+{
+    double alpha = 1.0; // contrast, output = alpha * input + beta (8-bit units)
+    double beta = 0.0;  // brightness offset in 8-bit units
+    double gamma = 1.0; // output = (input / max)^(1/gamma) * max, as in gammaCorrectionLUT
+};
+
+struct AutoExposureOptions
+{
+    double clip_low = 0.005;       // fraction of darkest samples allowed to clip to black
+    double clip_high = 0.995;      // fraction of samples below the white point
+    double target_mean = 0.46;     // mean luminance to reach after correction (0-1, ~18% gray in sRGB)
+    double max_alpha = 4.0;        // limit on contrast stretch for flat images
+    double min_gamma = 0.4;        // gamma search range
+    double max_gamma = 2.5;
+    bool stretch_contrast = true;  // false: estimate gamma only (alpha = 1, beta = 0)
+    int subsample = 4;             // use every n-th row and column for the statistics
+    double smoothing = 0.15;       // temporal mode: weight of the newest estimate (1 = no smoothing)
+};
+
+/**
+ * Adds the luminance of one row to the histogram, taking every `step`-th pixel
+ * Fixed-point BT.601 weights like the planar grayscale kernel; values are scaled to 0-255 bins
+ */
+template <typename T>
+inline void accumulate_luma_row(const T *row, int cols, int channels, int step, double to_bin, LumaHistogram &hist)
+{
+    for (int x = 0; x < cols; x += step)
+    {
+        const T *px = row + x * channels;
+        double v = channels >= 3 ? (px[0] * 29.0 + px[1] * 150.0 + px[2] * 77.0) / 256.0 : px[0];
+        int bin = static_cast<int>(v * to_bin + 0.5);
+        hist[bin < 0 ? 0 : (bin > 255 ? 255 : bin)]++;
+    }
+}
+
+/**
+ * Builds a 256-bin luminance histogram in one subsampled pass (CV_8U, CV_16U or CV_32F, 1 or 3+ channels)
+ * @param subsample Every n-th row and column is visited (4 reads 1/16 of the pixels)
+ */
+inline LumaHistogram luma_histogram(const cv::Mat &img, int subsample = 4)
+{
+    INSTRUMENT_SCOPE("exposure.histogram");
+    LumaHistogram hist{};
+    subsample = std::max(1, subsample);
+    const double to_bin = 255.0 / std::max(1e-12, depth_max_value(img.depth()));
+
+    for (int y = 0; y < img.rows; y += subsample)
+    {
+        switch (img.depth())
+        {
+        case CV_8U:
+            accumulate_luma_row(img.ptr<uchar>(y), img.cols, img.channels(), subsample, to_bin, hist);
+            break;
+        case CV_16U:
+            accumulate_luma_row(img.ptr<ushort>(y), img.cols, img.channels(), subsample, to_bin, hist);
+            break;
+        case CV_32F:
+            accumulate_luma_row(img.ptr<float>(y), img.cols, img.channels(), subsample, to_bin, hist);
+            break;
+        default:
+            std::cerr << "Error: luma_histogram supports CV_8U, CV_16U and CV_32F images!" << std::endl;
+            return hist;
+        }
+    }
+    return hist;
+}
+
+/**
+ * Returns the first bin at which the cumulative histogram reaches the given fraction
+ */
+inline int histogram_percentile(const LumaHistogram &hist, double fraction)
+{
+    uint64_t total = 0;
+    for (uint32_t n : hist)
+    {
+        total += n;
+    }
+    uint64_t target = static_cast<uint64_t>(fraction * static_cast<double>(total));
+    uint64_t seen = 0;
+    for (int i = 0; i < 256; i++)
+    {
+        seen += hist[i];
+        if (seen > target)
+        {
+            return i;
+        }
+    }
+    return 255;
+}
+
+/**
+ * Derives alpha/beta (percentile clipping) and gamma (mean-luminance targeting) from a histogram
+ */
+inline ExposureParams estimate_exposure(const LumaHistogram &hist, const AutoExposureOptions &options = {})
+{
+    ExposureParams params;
+    uint64_t total = 0;
+    for (uint32_t n : hist)
+    {
+        total += n;
+    }
+    if (total == 0)
+    {
+        return params;
+    }
+
+    // 1. Contrast stretch: map [low, high] percentiles onto [0, 255]
+    if (options.stretch_contrast)
+    {
+        int low = histogram_percentile(hist, options.clip_low);
+        int high = histogram_percentile(hist, options.clip_high);
+        if (high > low)
+        {
+            params.alpha = std::min(options.max_alpha, 255.0 / (high - low));
+            params.beta = -params.alpha * low;
+        }
+    }
+
+    // 2. Gamma: bisection on log(gamma) so the mean of the corrected histogram hits the target
+    //    (the mean is monotonic in gamma, 24 iterations are far below one gray level)
+    auto corrected_mean = [&](double gamma) {
+        double sum = 0.0;
+        for (int i = 0; i < 256; i++)
+        {
+            double v = std::clamp(params.alpha * i + params.beta, 0.0, 255.0) / 255.0;
+            sum += hist[i] * std::pow(v, 1.0 / gamma);
+        }
+        return sum / static_cast<double>(total);
+    };
+    double lo = std::log(options.min_gamma);
+    double hi = std::log(options.max_gamma);
+    for (int iter = 0; iter < 24; iter++)
+    {
+        double mid = 0.5 * (lo + hi);
+        if (corrected_mean(std::exp(mid)) < options.target_mean)
+        {
+            lo = mid; // larger gamma brightens
+        }
+        else
+        {
+            hi = mid;
+        }
+    }
+    params.gamma = std::exp(0.5 * (lo + hi));
+    return params;
+}
+
+/**
+ * Builds the 256-entry table doing the saturating alpha/beta stretch followed by gamma
+ */
+inline cv::Mat exposure_lut_8u(const ExposureParams &params)
+{
+    cv::Mat lut(1, 256, CV_8U);
+    uchar *p = lut.ptr();
+    for (int i = 0; i < 256; i++)
+    {
+        double v = std::clamp(params.alpha * i + params.beta, 0.0, 255.0) / 255.0;
+        p[i] = cv::saturate_cast<uchar>(std::pow(v, 1.0 / params.gamma) * 255.0);
+    }
+    return lut;
+}
+
+/**
+ * Applies exposure parameters
+ * CV_8U: one cv::LUT pass with the combined table; CV_16U/CV_32F: contrast then gamma at native depth
+ */
+inline void apply_exposure(const cv::Mat &src, cv::Mat &dst, const ExposureParams &params)
+{
+    INSTRUMENT_SCOPE("exposure.apply");
+    if (src.depth() == CV_8U)
+    {
+        cv::LUT(src, exposure_lut_8u(params), dst);
+        return;
+    }
+    // Same formulas in the native units: beta was estimated in 8-bit units
+    double scale = depth_max_value(src.depth()) / 255.0;
+    cv::Mat stretched;
+    if (adjust_contrast_brightness(src, stretched, params.alpha, params.beta * scale))
+    {
+        if (src.depth() == CV_32F)
+        {
+            // Clamp to the white level before gamma like the 8/16-bit saturation does
+            cv::threshold(stretched, stretched, 1.0, 1.0, cv::THRESH_TRUNC);
+            cv::threshold(stretched, stretched, 0.0, 0.0, cv::THRESH_TOZERO);
+        }
+        dst = gammaCorrectionLUT(stretched, params.gamma);
+    }
+}
+
+/**
+ * One-shot automatic exposure for a still image: subsampled statistics pass, then one apply pass
+ * @return the parameters that were applied
+ */
+inline ExposureParams auto_exposure(const cv::Mat &src, cv::Mat &dst, const AutoExposureOptions &options = {})
+{
+    ExposureParams params = estimate_exposure(luma_histogram(src, options.subsample), options);
+    apply_exposure(src, dst, params);
+    return params;
+}
+
+/**
+ * Automatic exposure for video streams
+ * Each frame is corrected with the smoothed parameters of the previous frames while the statistics of
+ * the current frame are gathered in the same pass over the rows, so there is no second full pass.
+ * The exponential smoothing also removes flicker from frame-to-frame estimate noise.
+ */
+class TemporalAutoExposure
+{
+public:
+    explicit TemporalAutoExposure(const AutoExposureOptions &options = {}) : options_(options) {}
+
+    /**
+     * Corrects a CV_8U frame and updates the running estimate
+     * Other depths fall back to the two-step still image path
+     */
+    ExposureParams process(const cv::Mat &frame, cv::Mat &out)
+    {
+        if (frame.empty())
+        {
+            std::cerr << "Error: Input frame is empty!" << std::endl;
+            return params_;
+        }
+        if (!initialized_)
+        {
+            // First frame: nothing to smooth against yet
+            params_ = estimate_exposure(luma_histogram(frame, options_.subsample), options_);
+            initialized_ = true;
+        }
+        if (frame.depth() != CV_8U)
+        {
+            apply_exposure(frame, out, params_);
+            update(luma_histogram(frame, options_.subsample));
+            return params_;
+        }
+
+        INSTRUMENT_SCOPE("exposure.temporal_frame");
+        cv::Mat lut = exposure_lut_8u(params_);
+        const uchar *table = lut.ptr();
+        out.create(frame.size(), frame.type());
+
+        LumaHistogram hist{};
+        const int row_len = frame.cols * frame.channels();
+        const int step = std::max(1, options_.subsample);
+        for (int y = 0; y < frame.rows; y++)
+        {
+            const uchar *in = frame.ptr<uchar>(y);
+            uchar *dst = out.ptr<uchar>(y);
+            for (int x = 0; x < row_len; x++)
+            {
+                dst[x] = table[in[x]];
+            }
+            if (y % step == 0)
+            {
+                // The row is still in cache: statistics come almost for free
+                accumulate_luma_row(in, frame.cols, frame.channels(), step, 1.0, hist);
+            }
+        }
+        update(hist);
+        return params_;
+    }
+
+    const ExposureParams &params() const { return params_; }
+    void reset() { initialized_ = false; }
+
+private:
+    void update(const LumaHistogram &hist)
+    {
+        ExposureParams latest = estimate_exposure(hist, options_);
+        double w = std::clamp(options_.smoothing, 0.0, 1.0);
+        params_.alpha += w * (latest.alpha - params_.alpha);
+        params_.beta += w * (latest.beta - params_.beta);
+        // gamma is smoothed in log space so brightening and darkening react symmetrically
+        params_.gamma = std::exp(std::log(params_.gamma) + w * (std::log(latest.gamma) - std::log(params_.gamma)));
+    }
+
+    AutoExposureOptions options_;
+    ExposureParams params_;
+    bool initialized_ = false;
+};
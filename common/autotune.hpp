@@ -0,0 +1,391 @@
+#pragma once
+
+#include <algorithm>
+#include <chrono>
+#include <fstream>
+#include <functional>
+#include <iostream>
+#include <sstream>
+#include <string>
+#include <unistd.h>
+#include <vector>
+#include <opencv2/opencv.hpp>
+#include "batch_ops.hpp"
+#include "color_convert.hpp"
+#include "instrumentation.hpp"
+
+/*
+ * Tile-size and thread-count autotuning for the row kernels of the lessons.
+ *
+ * Kernels are registered by name as "process rows [begin, end) of src into dst". The tuner times
+ * every kernel on this machine over a grid of configurations:
+ *   - tile heights derived from the cache sizes (a tile of source + destination rows fills about half
+ *     of L1, L2 or L3), plus one tile per thread
+ *   - thread counts 1, 2, 4... up to the number of CPUs
+ * The winners go to a small text profile. Later runs load it at startup and retune only when the
+ * profile is missing or was written on a host with a different CPU count or cache sizes.
+ *
+ * Profile format (one entry per line, '#' starts a comment):
+ *   host <cpus> <l1d bytes> <l2 bytes> <l3 bytes>
+ *   kernel <name> <tile rows> <threads> <best ns>
+ */
+
+#define AUTOTUNE_PROFILE_PATH "cv_lessons.tune"
+#define AUTOTUNE_IMAGE_WIDTH 1920
+#define AUTOTUNE_IMAGE_HEIGHT 1080
+#define AUTOTUNE_REPEATS 5
+
+/**
+ * How a kernel is split: tile_rows = 0 means one tile per thread, threads = 0 means OpenCV's default
+ */
+struct TileConfig
+{
+    int tile_rows = 0;
+    int threads = 0;
+};
+
+typedef std::function<void(const cv::Mat &src, cv::Mat &dst, int row_begin, int row_end)> RowKernelFn;
+
+struct TunableKernel
+{
+    std::string name;
+    int src_type;
+    int dst_type;
+    RowKernelFn run;
+    TileConfig config; // tuned or loaded configuration
+    double best_ns = 0.0;
+};
+
+struct HostInfo
+{
+    int cpus = 1;
+    long l1d = 0;
+    long l2 = 0;
+    long l3 = 0;
+
+    bool operator==(const HostInfo &other) const
+    {
+        return cpus == other.cpus && l1d == other.l1d && l2 == other.l2 && l3 == other.l3;
+    }
+};
+
+/**
+ * CPU count and data cache sizes of this machine (conservative defaults when sysconf does not know)
+ */
+inline HostInfo host_info()
+{
+    HostInfo host;
+    host.cpus = std::max(1, cv::getNumberOfCPUs());
+#if defined(_SC_LEVEL1_DCACHE_SIZE)
+    host.l1d = ::sysconf(_SC_LEVEL1_DCACHE_SIZE);
+    host.l2 = ::sysconf(_SC_LEVEL2_CACHE_SIZE);
+    host.l3 = ::sysconf(_SC_LEVEL3_CACHE_SIZE);
+#endif
+    host.l1d = host.l1d > 0 ? host.l1d : 32 * 1024;
+    host.l2 = host.l2 > 0 ? host.l2 : 1024 * 1024;
+    host.l3 = host.l3 > 0 ? host.l3 : 8 * 1024 * 1024;
+    return host;
+}
+
+/**
+ * Process-wide list of tunable kernels
+ */
+class KernelRegistry
+{
+public:
+    static KernelRegistry &instance()
+    {
+        static KernelRegistry registry;
+        return registry;
+    }
+
+    /**
+     * Registers a kernel (replaces an existing kernel of the same name, keeping its configuration)
+     */
+    void add(const std::string &name, int src_type, int dst_type, RowKernelFn run)
+    {
+        if (TunableKernel *existing = find(name))
+        {
+            existing->src_type = src_type;
+            existing->dst_type = dst_type;
+            existing->run = std::move(run);
+            return;
+        }
+        kernels_.push_back({name, src_type, dst_type, std::move(run), TileConfig(), 0.0});
+    }
+
+    TunableKernel *find(const std::string &name)
+    {
+        for (TunableKernel &k : kernels_)
+        {
+            if (k.name == name)
+            {
+                return &k;
+            }
+        }
+        return nullptr;
+    }
+
+    std::vector<TunableKernel> &kernels() { return kernels_; }
+
+private:
+    std::vector<TunableKernel> kernels_;
+};
+
+/**
+ * Runs a kernel over the whole image split as described by config
+ * The thread count only limits how many tiles run at once (one parallel_for_ stripe per thread, each
+ * working through its share of the tiles); OpenCV's global thread setting is left alone
+ */
+inline void run_tiled(const TunableKernel &kernel, const cv::Mat &src, cv::Mat &dst, TileConfig config)
+{
+    dst.create(src.size(), kernel.dst_type);
+    const int rows = src.rows;
+    if (rows <= 0)
+    {
+        return;
+    }
+    const int threads = config.threads > 0 ? config.threads : std::max(1, cv::getNumThreads());
+    const int tile_rows = config.tile_rows > 0 ? config.tile_rows : (rows + threads - 1) / threads;
+    const int tiles = (rows + tile_rows - 1) / tile_rows;
+    const int stripes = std::min(threads, tiles);
+    auto run_tiles = [&](int first, int last) {
+        for (int t = first; t < last; t++)
+        {
+            const int y0 = t * tile_rows;
+            kernel.run(src, dst, y0, std::min(rows, y0 + tile_rows));
+        }
+    };
+    if (stripes == 1)
+    {
+        run_tiles(0, tiles);
+        return;
+    }
+    cv::parallel_for_(cv::Range(0, stripes), [&](const cv::Range &range) {
+        for (int s = range.start; s < range.end; s++)
+        {
+            run_tiles(static_cast<int>(static_cast<int64_t>(tiles) * s / stripes),
+                      static_cast<int>(static_cast<int64_t>(tiles) * (s + 1) / stripes));
+        }
+    }, stripes);
+}
+
+/**
+ * Runs a registered kernel with its tuned configuration
+ */
+inline bool run_tuned(const std::string &name, const cv::Mat &src, cv::Mat &dst)
+{
+    TunableKernel *kernel = KernelRegistry::instance().find(name);
+    if (kernel == nullptr)
+    {
+        std::cerr << "Error: No tunable kernel named '" << name << "'!" << std::endl;
+        return false;
+    }
+    if (src.type() != kernel->src_type)
+    {
+        std::cerr << "Error: Kernel '" << name << "' expects another input type!" << std::endl;
+        return false;
+    }
+    run_tiled(*kernel, src, dst, kernel->config);
+    return true;
+}
+
+/**
+ * Candidate tile heights: source + destination rows filling about half of each cache level
+ */
+inline std::vector<int> tile_candidates(const TunableKernel &kernel, int cols, const HostInfo &host)
+{
+    const size_t row_bytes =
+        static_cast<size_t>(cols) * (CV_ELEM_SIZE(kernel.src_type) + CV_ELEM_SIZE(kernel.dst_type));
+    std::vector<int> tiles = {0}; // one tile per thread
+    for (long cache : {host.l1d, host.l2, host.l3 / std::max(1, host.cpus)})
+    {
+        const int rows = static_cast<int>(std::max<size_t>(1, static_cast<size_t>(cache) / 2 / row_bytes));
+        if (std::find(tiles.begin(), tiles.end(), rows) == tiles.end())
+        {
+            tiles.push_back(rows);
+        }
+    }
+    return tiles;
+}
+
+inline std::vector<int> thread_candidates(const HostInfo &host)
+{
+    std::vector<int> threads;
+    for (int t = 1; t < host.cpus; t *= 2)
+    {
+        threads.push_back(t);
+    }
+    threads.push_back(host.cpus);
+    return threads;
+}
+
+/**
+ * Times one configuration: median of AUTOTUNE_REPEATS runs after a warm-up run
+ */
+inline double time_config(const TunableKernel &kernel, const cv::Mat &src, cv::Mat &dst, TileConfig config)
+{
+    using clock = std::chrono::steady_clock;
+    run_tiled(kernel, src, dst, config);
+    std::vector<double> ns;
+    for (int i = 0; i < AUTOTUNE_REPEATS; i++)
+    {
+        auto start = clock::now();
+        run_tiled(kernel, src, dst, config);
+        ns.push_back(std::chrono::duration<double, std::nano>(clock::now() - start).count());
+    }
+    std::nth_element(ns.begin(), ns.begin() + ns.size() / 2, ns.end());
+    return ns[ns.size() / 2];
+}
+
+/**
+ * Finds the fastest configuration of one kernel on a synthetic image of the given size
+ */
+inline void tune_kernel(TunableKernel &kernel, const HostInfo &host,
+                        cv::Size size = cv::Size(AUTOTUNE_IMAGE_WIDTH, AUTOTUNE_IMAGE_HEIGHT))
+{
+    INSTRUMENT_SCOPE("autotune.kernel");
+    cv::Mat src(size, kernel.src_type);
+    cv::randu(src, cv::Scalar::all(0), cv::Scalar::all(256));
+    cv::Mat dst;
+    kernel.best_ns = 0.0;
+    for (int threads : thread_candidates(host))
+    {
+        for (int tile_rows : tile_candidates(kernel, size.width, host))
+        {
+            const TileConfig config{tile_rows, threads};
+            const double ns = time_config(kernel, src, dst, config);
+            if (kernel.best_ns == 0.0 || ns < kernel.best_ns)
+            {
+                kernel.best_ns = ns;
+                kernel.config = config;
+            }
+        }
+    }
+}
+
+inline bool save_tuning_profile(const std::string &path, const HostInfo &host)
+{
+    std::ofstream out(path);
+    out << "# cv lessons autotune profile\n";
+    out << "host " << host.cpus << " " << host.l1d << " " << host.l2 << " " << host.l3 << "\n";
+    for (const TunableKernel &k : KernelRegistry::instance().kernels())
+    {
+        out << "kernel " << k.name << " " << k.config.tile_rows << " " << k.config.threads << " "
+            << static_cast<int64_t>(k.best_ns) << "\n";
+    }
+    if (!out)
+    {
+        std::cerr << "Error: Could not write tuning profile '" << path << "'!" << std::endl;
+        return false;
+    }
+    return true;
+}
+
+/**
+ * Loads a profile written on this host into the registered kernels
+ * @return false if the file is missing, was written on another host, or lacks a registered kernel
+ */
+inline bool load_tuning_profile(const std::string &path, const HostInfo &host)
+{
+    std::ifstream in(path);
+    if (!in)
+    {
+        return false;
+    }
+    KernelRegistry &registry = KernelRegistry::instance();
+    std::vector<std::string> loaded;
+    bool same_host = false;
+    std::string line;
+    while (std::getline(in, line))
+    {
+        std::istringstream fields(line);
+        std::string tag;
+        fields >> tag;
+        if (tag == "host")
+        {
+            HostInfo saved;
+            fields >> saved.cpus >> saved.l1d >> saved.l2 >> saved.l3;
+            same_host = static_cast<bool>(fields) && saved == host;
+        }
+        else if (tag == "kernel")
+        {
+            std::string name;
+            TileConfig config;
+            double ns = 0.0;
+            fields >> name >> config.tile_rows >> config.threads >> ns;
+            TunableKernel *kernel = registry.find(name);
+            if (fields && kernel != nullptr && config.tile_rows >= 0 && config.threads >= 0)
+            {
+                kernel->config = config;
+                kernel->best_ns = ns;
+                loaded.push_back(name);
+            }
+        }
+    }
+    if (!same_host)
+    {
+        return false;
+    }
+    for (const TunableKernel &k : registry.kernels())
+    {
+        if (std::find(loaded.begin(), loaded.end(), k.name) == loaded.end())
+        {
+            return false;
+        }
+    }
+    return true;
+}
+
+/**
+ * Registers the row kernels used across the lessons (grayscale, LUT, threshold, arithmetic, mask ops)
+ */
+inline void register_builtin_kernels()
+{
+    KernelRegistry &registry = KernelRegistry::instance();
+    registry.add("gray", CV_8UC3, CV_8UC1, [](const cv::Mat &src, cv::Mat &dst, int y0, int y1) {
+        for (int y = y0; y < y1; y++)
+        {
+            bgr_to_gray_row(src.ptr<uchar>(y), dst.ptr<uchar>(y), src.cols);
+        }
+    });
+    registry.add("gamma_lut", CV_8UC3, CV_8UC3, [](const cv::Mat &src, cv::Mat &dst, int y0, int y1) {
+        static const cv::Mat table = gamma_table_8u(2.2);
+        cv::Mat out = dst.rowRange(y0, y1);
+        cv::LUT(src.rowRange(y0, y1), table, out);
+    });
+    registry.add("threshold", CV_8UC1, CV_8UC1, [](const cv::Mat &src, cv::Mat &dst, int y0, int y1) {
+        cv::Mat out = dst.rowRange(y0, y1);
+        cv::threshold(src.rowRange(y0, y1), out, 127, 255, cv::THRESH_BINARY);
+    });
+    registry.add("add", CV_8UC3, CV_8UC3, [](const cv::Mat &src, cv::Mat &dst, int y0, int y1) {
+        cv::Mat out = dst.rowRange(y0, y1);
+        cv::add(src.rowRange(y0, y1), cv::Scalar(50, 50, 50), out);
+    });
+    registry.add("mask_and", CV_8UC3, CV_8UC3, [](const cv::Mat &src, cv::Mat &dst, int y0, int y1) {
+        cv::Mat out = dst.rowRange(y0, y1);
+        cv::bitwise_and(src.rowRange(y0, y1), cv::Scalar(0x0F, 0xF0, 0xFF), out);
+    });
+}
+
+/**
+ * Loads the profile for this host, or tunes every registered kernel and writes a new profile
+ * Built-in kernels are registered first; kernels registered before the call are tuned too
+ * @param force Retune even if a matching profile exists
+ */
+inline bool autotune(const std::string &path = AUTOTUNE_PROFILE_PATH, bool force = false)
+{
+    register_builtin_kernels();
+    const HostInfo host = host_info();
+    if (!force && load_tuning_profile(path, host))
+    {
+        return true;
+    }
+    INSTRUMENT_SCOPE("autotune.all");
+    std::cout << "Tuning tile sizes and thread counts for this machine..." << std::endl;
+    for (TunableKernel &kernel : KernelRegistry::instance().kernels())
+    {
+        tune_kernel(kernel, host);
+    }
+    return save_tuning_profile(path, host);
+}
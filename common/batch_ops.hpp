@@ -0,0 +1,361 @@
+#pragma once
+
+#include <array>
+#include <cstdint>
+#include <iostream>
+#include <span>
+#include <vector>
+#include <opencv2/opencv.hpp>
+#include "gamma_correction.hpp"
+#include "instrumentation.hpp"
+
+/*
+ * Batched variants of the lesson operations for many small images of the same shape
+ * (64x64 crops, thumbnails...). Validation, table construction and thread dispatch happen once per
+ * batch instead of once per image.
+ *
+ * ImageBatch keeps the N images stacked in one contiguous N*H x W matrix, so element-wise operations
+ * run as a single OpenCV call over the whole batch.
+ */
+
+/**
+ * N images with the same size and type stored back to back in one allocation
+ */
+struct ImageBatch
+{
+    cv::Mat data; // (count * height) x width, one image every `height` rows
+    int count = 0;
+    cv::Size image_size;
+
+    /**
+     * Allocates (or reuses) storage for count images
+     */
+    void create(int n, cv::Size size, int type)
+    {
+        data.create(n * size.height, size.width, type);
+        count = n;
+        image_size = size;
+    }
+
+    bool empty() const { return count == 0; }
+    int type() const { return data.type(); }
+
+    /**
+     * Returns image i as a view (no copy)
+     */
+    cv::Mat image(int i) const
+    {
+        return data.rowRange(i * image_size.height, (i + 1) * image_size.height);
+    }
+
+    /**
+     * Copies a set of same-shape images into a new batch
+     */
+    static ImageBatch from_images(std::span<const cv::Mat> images)
+    {
+        ImageBatch batch;
+        if (images.empty())
+        {
+            return batch;
+        }
+        batch.create(static_cast<int>(images.size()), images[0].size(), images[0].type());
+        for (size_t i = 0; i < images.size(); i++)
+        {
+            images[i].copyTo(batch.image(static_cast<int>(i)));
+        }
+        return batch;
+    }
+};
+
+/**
+ * Checks once that every image of a span has the same size and type
+ */
+inline bool validate_same_shape(std::span<const cv::Mat> images)
+{
+    if (images.empty() || images[0].empty())
+    {
+        std::cerr << "Error: Batch is empty!" << std::endl;
+        return false;
+    }
+    for (const cv::Mat &img : images)
+    {
+        if (img.size() != images[0].size() || img.type() != images[0].type())
+        {
+            std::cerr << "Error: All images of a batch must have the same size and type!" << std::endl;
+            return false;
+        }
+    }
+    return true;
+}
+
+/**
+ * Makes sure every output Mat of a span has the given size and type (no-op when preallocated)
+ */
+inline bool prepare_outputs(std::span<cv::Mat> outputs, size_t count, cv::Size size, int type)
+{
+    if (outputs.size() < count)
+    {
+        std::cerr << "Error: Output batch is smaller than the input batch!" << std::endl;
+        return false;
+    }
+    for (size_t i = 0; i < count; i++)
+    {
+        outputs[i].create(size, type);
+    }
+    return true;
+}
+
+/**
+ * Grayscale conversion of a whole contiguous batch with one cvtColor call
+ */
+inline void batch_grayscale(const ImageBatch &src, ImageBatch &dst)
+{
+    if (src.empty() || CV_MAT_CN(src.type()) != 3)
+    {
+        std::cerr << "Error: Batch must contain 3-channel images!" << std::endl;
+        return;
+    }
+    INSTRUMENT_SCOPE("batch.grayscale");
+    dst.create(src.count, src.image_size, CV_8UC1);
+    cv::cvtColor(src.data, dst.data, cv::COLOR_BGR2GRAY);
+}
+
+/**
+ * Grayscale conversion of a span of same-shape images into preallocated outputs, one dispatch
+ */
+inline void batch_grayscale(std::span<const cv::Mat> src, std::span<cv::Mat> dst)
+{
+    if (!validate_same_shape(src) || src[0].channels() != 3 ||
+        !prepare_outputs(dst, src.size(), src[0].size(), CV_8UC1))
+    {
+        return;
+    }
+    INSTRUMENT_SCOPE("batch.grayscale_span");
+    cv::parallel_for_(cv::Range(0, static_cast<int>(src.size())), [&](const cv::Range &range) {
+        for (int i = range.start; i < range.end; i++)
+        {
+            cv::cvtColor(src[i], dst[i], cv::COLOR_BGR2GRAY);
+        }
+    });
+}
+
+/**
+ * Gamma correction of a contiguous batch: one table, one cv::LUT call
+ */
+inline void batch_gamma(const ImageBatch &src, ImageBatch &dst, double gamma)
+{
+    if (src.empty() || CV_MAT_DEPTH(src.type()) != CV_8U || gamma <= 0.0)
+    {
+        std::cerr << "Error: batch_gamma needs a non-empty 8-bit batch and gamma > 0!" << std::endl;
+        return;
+    }
+    INSTRUMENT_SCOPE("batch.gamma");
+    dst.create(src.count, src.image_size, src.type());
+    cv::LUT(src.data, gamma_table_8u(gamma), dst.data);
+}
+
+/**
+ * Gamma correction of a span of same-shape 8-bit images into preallocated outputs
+ */
+inline void batch_gamma(std::span<const cv::Mat> src, std::span<cv::Mat> dst, double gamma)
+{
+    if (!validate_same_shape(src) || src[0].depth() != CV_8U || gamma <= 0.0 ||
+        !prepare_outputs(dst, src.size(), src[0].size(), src[0].type()))
+    {
+        return;
+    }
+    INSTRUMENT_SCOPE("batch.gamma_span");
+    cv::Mat table = gamma_table_8u(gamma);
+    cv::parallel_for_(cv::Range(0, static_cast<int>(src.size())), [&](const cv::Range &range) {
+        for (int i = range.start; i < range.end; i++)
+        {
+            cv::LUT(src[i], table, dst[i]);
+        }
+    });
+}
+
+/**
+ * Fixed threshold of a contiguous batch (any lesson 09 type) with one cv::threshold call
+ */
+inline void batch_threshold(const ImageBatch &src, ImageBatch &dst, double thresh, double max_value, int type)
+{
+    if (src.empty() || CV_MAT_CN(src.type()) != 1)
+    {
+        std::cerr << "Error: batch_threshold needs a single-channel batch!" << std::endl;
+        return;
+    }
+    INSTRUMENT_SCOPE("batch.threshold");
+    dst.create(src.count, src.image_size, src.type());
+    cv::threshold(src.data, dst.data, thresh, max_value, type);
+}
+
+/**
+ * Fixed threshold of a span of same-shape images into preallocated outputs
+ */
+inline void batch_threshold(std::span<const cv::Mat> src, std::span<cv::Mat> dst, double thresh, double max_value,
+                            int type)
+{
+    if (!validate_same_shape(src) || !prepare_outputs(dst, src.size(), src[0].size(), src[0].type()))
+    {
+        return;
+    }
+    INSTRUMENT_SCOPE("batch.threshold_span");
+    cv::parallel_for_(cv::Range(0, static_cast<int>(src.size())), [&](const cv::Range &range) {
+        for (int i = range.start; i < range.end; i++)
+        {
+            cv::threshold(src[i], dst[i], thresh, max_value, type);
+        }
+    });
+}
+
+/**
+ * Otsu threshold from a 256-bin histogram (maximizes the between-class variance)
+ */
+inline int otsu_from_histogram(const std::array<uint32_t, 256> &hist, uint64_t total)
+{
+    double sum_all = 0.0;
+    for (int i = 0; i < 256; i++)
+    {
+        sum_all += static_cast<double>(i) * hist[i];
+    }
+    double sum_bg = 0.0;
+    uint64_t weight_bg = 0;
+    double best_var = -1.0;
+    int best = 0;
+    for (int t = 0; t < 256; t++)
+    {
+        weight_bg += hist[t];
+        if (weight_bg == 0)
+        {
+            continue;
+        }
+        uint64_t weight_fg = total - weight_bg;
+        if (weight_fg == 0)
+        {
+            break;
+        }
+        sum_bg += static_cast<double>(t) * hist[t];
+        double mean_bg = sum_bg / weight_bg;
+        double mean_fg = (sum_all - sum_bg) / weight_fg;
+        double var = static_cast<double>(weight_bg) * weight_fg * (mean_bg - mean_fg) * (mean_bg - mean_fg);
+        if (var > best_var)
+        {
+            best_var = var;
+            best = t;
+        }
+    }
+    return best;
+}
+
+/**
+ * Per-image Otsu threshold over a contiguous 8-bit single-channel batch
+ * Each image gets its own threshold; histogram and binarization run in one parallel dispatch
+ * @param thresholds Optional output, receives the threshold chosen for every image
+ */
+inline void batch_otsu(const ImageBatch &src, ImageBatch &dst, std::vector<double> *thresholds = nullptr)
+{
+    if (src.empty() || src.type() != CV_8UC1)
+    {
+        std::cerr << "Error: batch_otsu needs a CV_8UC1 batch!" << std::endl;
+        return;
+    }
+    INSTRUMENT_SCOPE("batch.otsu");
+    dst.create(src.count, src.image_size, CV_8UC1);
+    if (thresholds != nullptr)
+    {
+        thresholds->assign(src.count, 0.0);
+    }
+
+    const int width = src.image_size.width;
+    const int height = src.image_size.height;
+    cv::parallel_for_(cv::Range(0, src.count), [&](const cv::Range &range) {
+        for (int i = range.start; i < range.end; i++)
+        {
+            std::array<uint32_t, 256> hist{};
+            for (int y = 0; y < height; y++)
+            {
+                const uchar *row = src.data.ptr<uchar>(i * height + y);
+                for (int x = 0; x < width; x++)
+                {
+                    hist[row[x]]++;
+                }
+            }
+            int t = otsu_from_histogram(hist, static_cast<uint64_t>(width) * height);
+            if (thresholds != nullptr)
+            {
+                (*thresholds)[i] = t;
+            }
+            for (int y = 0; y < height; y++)
+            {
+                const uchar *in = src.data.ptr<uchar>(i * height + y);
+                uchar *out = dst.data.ptr<uchar>(i * height + y);
+                for (int x = 0; x < width; x++)
+                {
+                    out[x] = in[x] > t ? 255 : 0;
+                }
+            }
+        }
+    });
+}
+
+/**
+ * Per-image Otsu threshold over a span of same-shape images
+ */
+inline void batch_otsu(std::span<const cv::Mat> src, std::span<cv::Mat> dst, std::vector<double> *thresholds = nullptr)
+{
+    if (!validate_same_shape(src) || src[0].type() != CV_8UC1 ||
+        !prepare_outputs(dst, src.size(), src[0].size(), CV_8UC1))
+    {
+        return;
+    }
+    INSTRUMENT_SCOPE("batch.otsu_span");
+    if (thresholds != nullptr)
+    {
+        thresholds->assign(src.size(), 0.0);
+    }
+    cv::parallel_for_(cv::Range(0, static_cast<int>(src.size())), [&](const cv::Range &range) {
+        for (int i = range.start; i < range.end; i++)
+        {
+            double t = cv::threshold(src[i], dst[i], 0, 255, cv::THRESH_BINARY | cv::THRESH_OTSU);
+            if (thresholds != nullptr)
+            {
+                (*thresholds)[i] = t;
+            }
+        }
+    });
+}
+
+/**
+ * Crops many same-size regions of one image straight into a contiguous batch
+ * Rectangles are clipped to the image; clipped parts are filled with zeros
+ * @param rects Regions to extract, all of them must have the size `crop_size`
+ */
+inline void batch_crop(const cv::Mat &src, std::span<const cv::Rect> rects, cv::Size crop_size, ImageBatch &dst)
+{
+    if (src.empty() || rects.empty())
+    {
+        std::cerr << "Error: batch_crop needs an image and at least one rectangle!" << std::endl;
+        return;
+    }
+    INSTRUMENT_SCOPE("batch.crop");
+    dst.create(static_cast<int>(rects.size()), crop_size, src.type());
+    const cv::Rect bounds(0, 0, src.cols, src.rows);
+
+    cv::parallel_for_(cv::Range(0, static_cast<int>(rects.size())), [&](const cv::Range &range) {
+        for (int i = range.start; i < range.end; i++)
+        {
+            cv::Mat out = dst.image(i);
+            cv::Rect wanted(rects[i].x, rects[i].y, crop_size.width, crop_size.height);
+            cv::Rect inside = wanted & bounds;
+            if (inside != wanted)
+            {
+                out.setTo(cv::Scalar::all(0));
+            }
+            if (inside.empty())
+            {
+                continue;
+            }
+            src(inside).copyTo(out(cv::Rect(inside.x - wanted.x, inside.y - wanted.y, inside.width, inside.height)));
+        }
+    });
+}
@@ -0,0 +1,458 @@
+#pragma once
+
+#include <algorithm>
+#include <atomic>
+#include <bit>
+#include <cstdint>
+#include <cstring>
+#include <fcntl.h>
+#include <fstream>
+#include <iostream>
+#include <string>
+#include <sys/mman.h>
+#include <sys/stat.h>
+#include <unistd.h>
+#include <vector>
+#include <opencv2/opencv.hpp>
+#include "instrumentation.hpp"
+#include "morphology.hpp"
+
+/*
+ * Compact file format for bilevel results (thresholded pages, masks).
+ *
+ * Layout (".bilevel" file, native byte order):
+ *   BilevelHeader
+ *   uint64_t offset[strip_count + 1]   start of every strip, the last entry is the file size
+ *   strips                             strip_rows rows each (the last strip may be shorter)
+ *
+ * A strip starts with one encoding byte:
+ *   BILEVEL_STRIP_RLE     per row, a varint h = (run_count << 1) | repeat. repeat = 1 means "same as the
+ *                         previous row of the strip". Otherwise run_count varint run lengths follow,
+ *                         alternating background / foreground and starting with background. The last
+ *                         run is implied (it ends at the row end).
+ *   BILEVEL_STRIP_PACKED  rows x words uint64_t of raw bits (used when runs would be larger)
+ *
+ * Strips are self-contained, so any range of rows is decoded without touching the others, and the
+ * reader maps the file instead of reading it, so opening a page costs nothing until rows are used.
+ */
+
+#define BILEVEL_STRIP_ROWS 64
+#define BILEVEL_STRIP_RLE 0
+#define BILEVEL_STRIP_PACKED 1
+
+struct BilevelHeader
+{
+    char magic[8];
+    int32_t version;
+    int32_t width;
+    int32_t height;
+    int32_t strip_rows;
+    int32_t reserved[2];
+};
+static_assert(sizeof(BilevelHeader) == 32, "BilevelHeader must not contain padding");
+
+inline constexpr char BILEVEL_MAGIC[8] = {'C', 'V', 'B', 'I', 'L', 'V', 'L', '1'};
+
+inline void put_varint(std::vector<uchar> &out, uint32_t v)
+{
+    while (v >= 0x80)
+    {
+        out.push_back(static_cast<uchar>(v | 0x80));
+        v >>= 7;
+    }
+    out.push_back(static_cast<uchar>(v));
+}
+
+/**
+ * Reads one varint; returns false when it runs past the end of the data
+ */
+inline bool get_varint(const uchar *&p, const uchar *end, uint32_t &v)
+{
+    v = 0;
+    for (int shift = 0; shift < 35 && p < end; shift += 7)
+    {
+        const uchar b = *p++;
+        v |= static_cast<uint32_t>(b & 0x7F) << shift;
+        if ((b & 0x80) == 0)
+        {
+            return true;
+        }
+    }
+    return false;
+}
+
+/**
+ * Run lengths of one row of bits, background first; the last run is left out
+ * Runs are found a word at a time: the next change of color is the lowest set bit of (word ^ color)
+ */
+inline void row_runs(const uint64_t *row, int cols, std::vector<uint32_t> &runs)
+{
+    runs.clear();
+    int x = 0;
+    uint64_t color = 0; // 0 or all ones
+    while (true)
+    {
+        int next = cols;
+        for (int w = x >> 6; w * 64 < cols; w++)
+        {
+            uint64_t diff = row[w] ^ color;
+            if (w == (x >> 6))
+            {
+                diff &= ~0ull << (x & 63);
+            }
+            if (diff != 0)
+            {
+                next = std::min(cols, w * 64 + std::countr_zero(diff));
+                break;
+            }
+        }
+        if (next >= cols)
+        {
+            return;
+        }
+        runs.push_back(static_cast<uint32_t>(next - x));
+        x = next;
+        color = ~color;
+    }
+}
+
+/**
+ * Sets bits [begin, end) of a row
+ */
+inline void set_bit_range(uint64_t *row, int begin, int end)
+{
+    if (begin >= end)
+    {
+        return;
+    }
+    const int w0 = begin >> 6;
+    const int w1 = (end - 1) >> 6;
+    const uint64_t first = ~0ull << (begin & 63);
+    const uint64_t last = ~0ull >> (63 - ((end - 1) & 63));
+    if (w0 == w1)
+    {
+        row[w0] |= first & last;
+        return;
+    }
+    row[w0] |= first;
+    std::fill(row + w0 + 1, row + w1, ~0ull);
+    row[w1] |= last;
+}
+
+/**
+ * Encodes rows [y0, y1) of a mask as one strip (runs, or raw bits when those are smaller)
+ */
+inline std::vector<uchar> encode_bilevel_strip(const BitMask &mask, int y0, int y1)
+{
+    std::vector<uchar> out;
+    out.push_back(BILEVEL_STRIP_RLE);
+    std::vector<uint32_t> runs;
+    const size_t packed_bytes = 1 + static_cast<size_t>(y1 - y0) * mask.words * sizeof(uint64_t);
+    for (int y = y0; y < y1; y++)
+    {
+        if (y > y0 && std::equal(mask.row(y), mask.row(y) + mask.words, mask.row(y - 1)))
+        {
+            put_varint(out, 1);
+            continue;
+        }
+        row_runs(mask.row(y), mask.cols, runs);
+        put_varint(out, static_cast<uint32_t>(runs.size()) << 1);
+        for (uint32_t run : runs)
+        {
+            put_varint(out, run);
+        }
+        if (out.size() >= packed_bytes)
+        {
+            break;
+        }
+    }
+    if (out.size() >= packed_bytes)
+    {
+        out.assign(packed_bytes, 0);
+        out[0] = BILEVEL_STRIP_PACKED;
+        std::memcpy(out.data() + 1, mask.row(y0), packed_bytes - 1);
+    }
+    return out;
+}
+
+/**
+ * Decodes one strip into rows [y0, y0 + rows) of a mask (rows must be cleared beforehand)
+ * @return false if the strip data is corrupt
+ */
+inline bool decode_bilevel_strip(const uchar *data, size_t size, BitMask &mask, int y0, int rows)
+{
+    if (size < 1)
+    {
+        return false;
+    }
+    const uchar *p = data + 1;
+    const uchar *end = data + size;
+    if (data[0] == BILEVEL_STRIP_PACKED)
+    {
+        const size_t bytes = static_cast<size_t>(rows) * mask.words * sizeof(uint64_t);
+        if (size != bytes + 1)
+        {
+            return false;
+        }
+        std::memcpy(mask.row(y0), p, bytes);
+        return true;
+    }
+    if (data[0] != BILEVEL_STRIP_RLE)
+    {
+        return false;
+    }
+    for (int y = y0; y < y0 + rows; y++)
+    {
+        uint32_t h;
+        if (!get_varint(p, end, h))
+        {
+            return false;
+        }
+        if (h & 1)
+        {
+            if (y == y0)
+            {
+                return false;
+            }
+            std::copy(mask.row(y - 1), mask.row(y - 1) + mask.words, mask.row(y));
+            continue;
+        }
+        uint64_t *row = mask.row(y);
+        int64_t x = 0;
+        for (uint32_t i = 0; i < (h >> 1); i++)
+        {
+            uint32_t run;
+            if (!get_varint(p, end, run) || x + run > mask.cols)
+            {
+                return false;
+            }
+            if (i & 1)
+            {
+                set_bit_range(row, static_cast<int>(x), static_cast<int>(x + run));
+            }
+            x += run;
+        }
+        if ((h >> 1) & 1) // odd number of runs: the implied last run is foreground
+        {
+            set_bit_range(row, static_cast<int>(x), mask.cols);
+        }
+    }
+    return p == end;
+}
+
+/**
+ * Writes a mask as a bilevel file; strips are encoded in parallel
+ * @param strip_rows Rows per strip, the granularity of random access when reading
+ */
+inline bool write_bilevel(const std::string &path, const BitMask &mask, int strip_rows = BILEVEL_STRIP_ROWS)
+{
+    if (mask.empty() || strip_rows <= 0)
+    {
+        std::cerr << "Error: write_bilevel needs a non-empty mask and strip_rows > 0!" << std::endl;
+        return false;
+    }
+    INSTRUMENT_SCOPE("bilevel.write");
+    const int strip_count = (mask.rows + strip_rows - 1) / strip_rows;
+    std::vector<std::vector<uchar>> strips(strip_count);
+    cv::parallel_for_(cv::Range(0, strip_count), [&](const cv::Range &range) {
+        for (int s = range.start; s < range.end; s++)
+        {
+            strips[s] = encode_bilevel_strip(mask, s * strip_rows, std::min(mask.rows, (s + 1) * strip_rows));
+        }
+    });
+
+    BilevelHeader header{};
+    std::memcpy(header.magic, BILEVEL_MAGIC, sizeof(header.magic));
+    header.version = 1;
+    header.width = mask.cols;
+    header.height = mask.rows;
+    header.strip_rows = strip_rows;
+    std::vector<uint64_t> index(strip_count + 1);
+    index[0] = sizeof(header) + index.size() * sizeof(uint64_t);
+    for (int s = 0; s < strip_count; s++)
+    {
+        index[s + 1] = index[s] + strips[s].size();
+    }
+
+    std::ofstream file(path, std::ios::binary | std::ios::trunc);
+    file.write(reinterpret_cast<const char *>(&header), sizeof(header));
+    file.write(reinterpret_cast<const char *>(index.data()), index.size() * sizeof(uint64_t));
+    for (const std::vector<uchar> &strip : strips)
+    {
+        file.write(reinterpret_cast<const char *>(strip.data()), strip.size());
+    }
+    if (!file)
+    {
+        std::cerr << "Error: Could not write bilevel file '" << path << "'!" << std::endl;
+        return false;
+    }
+    INSTRUMENT_COUNT("bilevel.bytes_written", index[strip_count]);
+    return true;
+}
+
+/**
+ * Writes a binary CV_8UC1 image (any non-zero pixel is foreground) as a bilevel file
+ */
+inline bool write_bilevel(const std::string &path, const cv::Mat &binary, int strip_rows = BILEVEL_STRIP_ROWS)
+{
+    BitMask mask = pack_mask(binary);
+    return !mask.empty() && write_bilevel(path, mask, strip_rows);
+}
+
+/**
+ * Read-only, memory-mapped bilevel file
+ * Decoding only touches the pages of the strips that are asked for; several threads may read at once
+ */
+class BilevelImage
+{
+public:
+    BilevelImage() = default;
+    ~BilevelImage() { close(); }
+    BilevelImage(const BilevelImage &) = delete;
+    BilevelImage &operator=(const BilevelImage &) = delete;
+
+    bool open(const std::string &path)
+    {
+        close();
+        int fd = ::open(path.c_str(), O_RDONLY);
+        if (fd < 0)
+        {
+            std::cerr << "Error: Could not open bilevel file '" << path << "'!" << std::endl;
+            return false;
+        }
+        struct stat st;
+        if (::fstat(fd, &st) == 0 && st.st_size >= static_cast<off_t>(sizeof(BilevelHeader)))
+        {
+            void *p = ::mmap(nullptr, static_cast<size_t>(st.st_size), PROT_READ, MAP_SHARED, fd, 0);
+            if (p != MAP_FAILED)
+            {
+                data_ = static_cast<const uchar *>(p);
+                size_ = static_cast<size_t>(st.st_size);
+            }
+        }
+        ::close(fd); // the mapping stays valid
+        if (data_ == nullptr || !valid())
+        {
+            std::cerr << "Error: '" << path << "' is not a valid bilevel file!" << std::endl;
+            close();
+            return false;
+        }
+        return true;
+    }
+
+    void close()
+    {
+        if (data_ != nullptr)
+        {
+            ::munmap(const_cast<uchar *>(data_), size_);
+            data_ = nullptr;
+            size_ = 0;
+        }
+    }
+
+    bool is_open() const { return data_ != nullptr; }
+    cv::Size size() const { return cv::Size(header().width, header().height); }
+    int strip_rows() const { return header().strip_rows; }
+    int strip_count() const { return (header().height + header().strip_rows - 1) / header().strip_rows; }
+
+    /**
+     * Decodes rows [y0, y1) into a mask of y1 - y0 rows; the strips involved are decoded in parallel
+     */
+    bool read_rows(int y0, int y1, BitMask &dst) const
+    {
+        if (!is_open() || y0 < 0 || y1 > header().height || y0 >= y1)
+        {
+            std::cerr << "Error: Row range is out of the bilevel image!" << std::endl;
+            return false;
+        }
+        INSTRUMENT_SCOPE("bilevel.read");
+        const int sr = strip_rows();
+        const int s0 = y0 / sr;
+        const int s1 = (y1 - 1) / sr + 1;
+        const bool whole_strips = y0 == s0 * sr && y1 == std::min(header().height, s1 * sr);
+        BitMask decoded;
+        BitMask &target = whole_strips ? dst : decoded;
+        target.create(std::min(header().height, s1 * sr) - s0 * sr, header().width);
+        std::atomic<bool> ok = true;
+        cv::parallel_for_(cv::Range(s0, s1), [&](const cv::Range &range) {
+            for (int s = range.start; s < range.end; s++)
+            {
+                const int rows = std::min(header().height, (s + 1) * sr) - s * sr;
+                if (!decode_bilevel_strip(data_ + index()[s], index()[s + 1] - index()[s], target, (s - s0) * sr, rows))
+                {
+                    ok = false;
+                }
+            }
+        });
+        if (!ok)
+        {
+            std::cerr << "Error: Corrupt strip in bilevel file!" << std::endl;
+            return false;
+        }
+        if (!whole_strips)
+        {
+            dst.create(y1 - y0, header().width);
+            std::copy(decoded.row(y0 - s0 * sr), decoded.row(y1 - s0 * sr), dst.bits.begin());
+        }
+        return true;
+    }
+
+    /**
+     * Decodes rows [y0, y1) into a CV_8UC1 image with 0 / value pixels
+     */
+    bool read_rows(int y0, int y1, cv::Mat &dst, uchar value = 255) const
+    {
+        BitMask mask;
+        if (!read_rows(y0, y1, mask))
+        {
+            return false;
+        }
+        unpack_mask(mask, dst, value);
+        return true;
+    }
+
+    bool read(BitMask &dst) const { return is_open() && read_rows(0, header().height, dst); }
+    bool read(cv::Mat &dst, uchar value = 255) const { return is_open() && read_rows(0, header().height, dst, value); }
+
+private:
+    const BilevelHeader &header() const { return *reinterpret_cast<const BilevelHeader *>(data_); }
+    const uint64_t *index() const { return reinterpret_cast<const uint64_t *>(data_ + sizeof(BilevelHeader)); }
+
+    /**
+     * Checks the header and that the strip index stays inside the file
+     */
+    bool valid() const
+    {
+        const BilevelHeader &h = header();
+        if (std::memcmp(h.magic, BILEVEL_MAGIC, sizeof(h.magic)) != 0 || h.version != 1 || h.width <= 0 ||
+            h.height <= 0 || h.strip_rows <= 0)
+        {
+            return false;
+        }
+        const size_t index_end = sizeof(BilevelHeader) + (static_cast<size_t>(strip_count()) + 1) * sizeof(uint64_t);
+        if (index_end > size_ || index()[0] != index_end || index()[strip_count()] != size_)
+        {
+            return false;
+        }
+        for (int s = 0; s < strip_count(); s++)
+        {
+            if (index()[s + 1] <= index()[s])
+            {
+                return false;
+            }
+        }
+        return true;
+    }
+
+    const uchar *data_ = nullptr;
+    size_t size_ = 0;
+};
+
+/**
+ * Reads a whole bilevel file into a CV_8UC1 image with 0 / value pixels
+ */
+inline bool read_bilevel(const std::string &path, cv::Mat &dst, uchar value = 255)
+{
+    BilevelImage image;
+    return image.open(path) && image.read(dst, value);
+}
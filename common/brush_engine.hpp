@@ -0,0 +1,453 @@
+#pragma once
+
+#include <algorithm>
+#include <array>
+#include <cmath>
+#include <cstdint>
+#include <iostream>
+#include <mutex>
+#include <unordered_map>
+#include <vector>
+#include <opencv2/opencv.hpp>
+#include "instrumentation.hpp"
+
+/*
+ * Brush strokes for the paint tool (lesson 08) that keep up with fast mouse motion on large canvases.
+ *
+ *   mouse callback:  begin_stroke / add_point / end_stroke only queue the event (no drawing)
+ *   GUI loop:        flush(canvas) once per frame draws everything queued since the last frame
+ *
+ * flush() coalesces the queued points (points closer than BRUSH_MIN_MOVE to the previous one are merged),
+ * runs a Catmull-Rom spline through them and stamps the brush along it every `spacing` pixels of arc
+ * length, so fast strokes are smooth curves without gaps instead of a chain of straight segments.
+ *
+ * Stamps come from precomputed anti-aliased masks (one per quarter-pixel offset, so stamps sit at their
+ * exact sub-pixel position). They do not blend into the canvas one after the other, which would darken
+ * the overlaps of a soft brush; instead each stroke keeps, per touched canvas tile, a coverage mask
+ * (the max of all stamp alphas) and a copy of the tile as it was before the stroke. A flush recomposites
+ * only its dirty rectangle: canvas = before + (color - before) * coverage, in an integer loop the compiler
+ * vectorizes. Memory and work are proportional to the tiles the stroke crosses, not to the canvas.
+ */
+
+#define BRUSH_TILE 64
+#define BRUSH_SUBPIXEL 4
+#define BRUSH_MIN_MOVE 0.5
+#define BRUSH_MAX_RADIUS 256.0
+
+struct BrushOptions
+{
+    double radius = 5.0;
+    double hardness = 1.0; // fraction of the radius at full opacity; 1 = hard disc with an anti-aliased edge
+    double spacing = 0.25; // distance between stamps as a fraction of the radius
+    double opacity = 1.0;
+    cv::Scalar color = cv::Scalar(255, 0, 0);
+};
+
+struct BrushStats
+{
+    long events = 0;    // stroke points queued by the mouse callback
+    long coalesced = 0; // points merged into their predecessor
+    long stamps = 0;
+    long flushes = 0;
+};
+
+/**
+ * Anti-aliased stamp masks of one brush, one per sub-pixel offset
+ */
+class BrushMask
+{
+public:
+    void build(double radius, double hardness, double opacity)
+    {
+        radius = std::clamp(radius, 0.5, BRUSH_MAX_RADIUS);
+        hardness = std::clamp(hardness, 0.0, 1.0);
+        reach_ = static_cast<int>(std::ceil(radius)) + 1;
+        const int size = 2 * reach_ + 1;
+        // Alpha falls from 1 at radius * hardness to 0 at the radius, with at least one pixel of edge
+        const double ramp = radius * (1.0 - hardness) + 1.0;
+        for (int fy = 0; fy < BRUSH_SUBPIXEL; fy++)
+        {
+            for (int fx = 0; fx < BRUSH_SUBPIXEL; fx++)
+            {
+                cv::Mat &mask = masks_[fy * BRUSH_SUBPIXEL + fx];
+                mask.create(size, size, CV_8UC1);
+                const double cx = reach_ + static_cast<double>(fx) / BRUSH_SUBPIXEL;
+                const double cy = reach_ + static_cast<double>(fy) / BRUSH_SUBPIXEL;
+                for (int y = 0; y < size; y++)
+                {
+                    uchar *m = mask.ptr<uchar>(y);
+                    for (int x = 0; x < size; x++)
+                    {
+                        const double d = std::hypot(x - cx, y - cy);
+                        const double alpha = std::clamp((radius + 0.5 - d) / ramp, 0.0, 1.0) * opacity;
+                        m[x] = static_cast<uchar>(std::lround(alpha * 255.0));
+                    }
+                }
+            }
+        }
+    }
+
+    /**
+     * Mask for a stamp centered at (x, y); its top-left pixel lands on the canvas at origin
+     */
+    const cv::Mat &at(double x, double y, cv::Point &origin) const
+    {
+        // Nearest quarter pixel, split into whole pixel and offset (floor, so negative positions work too)
+        const long qx = std::lround(x * BRUSH_SUBPIXEL), qy = std::lround(y * BRUSH_SUBPIXEL);
+        const long ix = static_cast<long>(std::floor(static_cast<double>(qx) / BRUSH_SUBPIXEL));
+        const long iy = static_cast<long>(std::floor(static_cast<double>(qy) / BRUSH_SUBPIXEL));
+        origin = cv::Point(static_cast<int>(ix) - reach_, static_cast<int>(iy) - reach_);
+        return masks_[(qy - iy * BRUSH_SUBPIXEL) * BRUSH_SUBPIXEL + (qx - ix * BRUSH_SUBPIXEL)];
+    }
+
+private:
+    std::array<cv::Mat, BRUSH_SUBPIXEL * BRUSH_SUBPIXEL> masks_;
+    int reach_ = 0;
+};
+
+/**
+ * Queued, spline-interpolated brush strokes on an 8-bit canvas (1 to 4 channels)
+ */
+class BrushEngine
+{
+public:
+    explicit BrushEngine(const BrushOptions &options = BrushOptions()) { set_options(options); }
+
+    BrushEngine(const BrushEngine &) = delete;
+    BrushEngine &operator=(const BrushEngine &) = delete;
+
+    /**
+     * Takes effect at the next stroke (the current one keeps its brush)
+     */
+    void set_options(const BrushOptions &options)
+    {
+        std::lock_guard<std::mutex> lock(queue_mutex_);
+        next_options_ = options;
+        options_changed_ = true;
+    }
+
+    void set_color(const cv::Scalar &color)
+    {
+        std::lock_guard<std::mutex> lock(queue_mutex_);
+        next_options_.color = color;
+        options_changed_ = true;
+    }
+
+    /**
+     * Called from the mouse callback: only queue the point
+     */
+    void begin_stroke(double x, double y) { queue(BEGIN, x, y); }
+    void add_point(double x, double y) { queue(MOVE, x, y); }
+    void end_stroke() { queue(END, 0.0, 0.0); }
+
+    /**
+     * Draws every queued event onto canvas
+     * @return Rectangle of the canvas that changed (empty if nothing did)
+     */
+    cv::Rect flush(cv::Mat &canvas)
+    {
+        if (canvas.empty() || canvas.depth() != CV_8U || canvas.channels() > 4)
+        {
+            std::cerr << "Error: BrushEngine needs a non-empty 8-bit canvas with 1-4 channels!" << std::endl;
+            return cv::Rect();
+        }
+        std::vector<Event> events;
+        {
+            std::lock_guard<std::mutex> lock(queue_mutex_);
+            events.swap(queue_);
+        }
+        if (events.empty())
+        {
+            return cv::Rect();
+        }
+        INSTRUMENT_SCOPE("brush.flush");
+        stats_.flushes++;
+
+        // A replaced or cleared canvas invalidates the "before" copies of the current stroke
+        if (canvas.data != canvas_data_ || canvas.size() != canvas_size_ || canvas.type() != canvas_type_)
+        {
+            tiles_.clear();
+            canvas_data_ = canvas.data;
+            canvas_size_ = canvas.size();
+            canvas_type_ = canvas.type();
+        }
+
+        dirty_ = cv::Rect();
+        for (const Event &e : events)
+        {
+            if (e.type == BEGIN)
+            {
+                finish_stroke(canvas);
+                start_stroke(canvas, e.point);
+            }
+            else if (e.type == MOVE && in_stroke_)
+            {
+                stats_.events++;
+                if (std::hypot(e.point.x - points_.back().x, e.point.y - points_.back().y) < BRUSH_MIN_MOVE)
+                {
+                    stats_.coalesced++;
+                    continue;
+                }
+                points_.push_back(e.point);
+                if (points_.size() == 4)
+                {
+                    // Segment points_[1] -> points_[2] is final once the point after it is known
+                    stamp_segment(canvas, points_[0], points_[1], points_[2], points_[3]);
+                    points_.erase(points_.begin());
+                }
+                else if (points_.size() == 3)
+                {
+                    stamp_segment(canvas, points_[0], points_[0], points_[1], points_[2]);
+                }
+            }
+            else if (e.type == END)
+            {
+                finish_stroke(canvas);
+            }
+        }
+        composite(canvas, dirty_);
+        return dirty_;
+    }
+
+    /**
+     * Call after clearing or replacing the canvas while a stroke may be in progress: the stroke continues
+     * on the new contents instead of restoring the old ones
+     */
+    void reset_canvas()
+    {
+        tiles_.clear();
+        canvas_data_ = nullptr;
+    }
+
+    const BrushStats &stats() const { return stats_; }
+
+private:
+    enum EventType
+    {
+        BEGIN,
+        MOVE,
+        END
+    };
+
+    struct Event
+    {
+        EventType type;
+        cv::Point2d point;
+    };
+
+    /**
+     * Canvas tile as it was before the stroke, and the stroke's coverage of it
+     */
+    struct Tile
+    {
+        cv::Rect rect;
+        cv::Mat before;
+        cv::Mat coverage;
+    };
+
+    void queue(EventType type, double x, double y)
+    {
+        std::lock_guard<std::mutex> lock(queue_mutex_);
+        queue_.push_back({type, cv::Point2d(x, y)});
+    }
+
+    void start_stroke(cv::Mat &canvas, const cv::Point2d &p)
+    {
+        {
+            std::lock_guard<std::mutex> lock(queue_mutex_);
+            if (options_changed_)
+            {
+                options_ = next_options_;
+                mask_.build(options_.radius, options_.hardness, std::clamp(options_.opacity, 0.0, 1.0));
+                options_changed_ = false;
+            }
+        }
+        for (int c = 0; c < 4; c++)
+        {
+            color_[c] = cv::saturate_cast<uchar>(options_.color[c]);
+        }
+        spacing_ = std::max(1.0, options_.radius * options_.spacing);
+        tiles_.clear();
+        points_.assign(1, p);
+        in_stroke_ = true;
+        stamp(canvas, p.x, p.y); // a click without motion leaves a dot
+        to_next_stamp_ = spacing_;
+    }
+
+    void finish_stroke(cv::Mat &canvas)
+    {
+        if (!in_stroke_)
+        {
+            return;
+        }
+        // The last segment has no point after it: repeat its end point
+        if (points_.size() == 2)
+        {
+            stamp_segment(canvas, points_[0], points_[0], points_[1], points_[1]);
+        }
+        else if (points_.size() == 3)
+        {
+            stamp_segment(canvas, points_[0], points_[1], points_[2], points_[2]);
+        }
+        composite(canvas, dirty_);
+        in_stroke_ = false;
+        points_.clear();
+        tiles_.clear();
+    }
+
+    /**
+     * Stamps along the Catmull-Rom segment p1 -> p2 every spacing_ pixels of arc length
+     */
+    void stamp_segment(cv::Mat &canvas, const cv::Point2d &p0, const cv::Point2d &p1, const cv::Point2d &p2,
+                       const cv::Point2d &p3)
+    {
+        const double chord = std::hypot(p2.x - p1.x, p2.y - p1.y);
+        const int pieces = std::clamp(static_cast<int>(std::ceil(chord)), 1, 1024);
+        cv::Point2d prev = p1;
+        for (int i = 1; i <= pieces; i++)
+        {
+            const double t = static_cast<double>(i) / pieces;
+            const double t2 = t * t, t3 = t2 * t;
+            const cv::Point2d next = 0.5 * (2.0 * p1 + (p2 - p0) * t + (2.0 * p0 - 5.0 * p1 + 4.0 * p2 - p3) * t2 +
+                                             (3.0 * p1 - p0 - 3.0 * p2 + p3) * t3);
+            const double length = std::hypot(next.x - prev.x, next.y - prev.y);
+            double along = 0.0;
+            while (length - along >= to_next_stamp_)
+            {
+                along += to_next_stamp_;
+                const double k = along / length;
+                stamp(canvas, prev.x + (next.x - prev.x) * k, prev.y + (next.y - prev.y) * k);
+                to_next_stamp_ = spacing_;
+            }
+            to_next_stamp_ -= length - along;
+            prev = next;
+        }
+    }
+
+    /**
+     * Raises the stroke coverage under one stamp (max of alphas)
+     */
+    void stamp(cv::Mat &canvas, double x, double y)
+    {
+        cv::Point origin;
+        const cv::Mat &mask = mask_.at(x, y, origin);
+        const cv::Rect area = cv::Rect(origin, mask.size()) & cv::Rect(0, 0, canvas.cols, canvas.rows);
+        if (area.empty())
+        {
+            return;
+        }
+        stats_.stamps++;
+        dirty_ |= area;
+        for (int ty = area.y / BRUSH_TILE; ty <= (area.br().y - 1) / BRUSH_TILE; ty++)
+        {
+            for (int tx = area.x / BRUSH_TILE; tx <= (area.br().x - 1) / BRUSH_TILE; tx++)
+            {
+                Tile &tile = touch_tile(canvas, tx, ty);
+                const cv::Rect part = area & tile.rect;
+                for (int y = part.y; y < part.br().y; y++)
+                {
+                    const uchar *m = mask.ptr<uchar>(y - origin.y) + (part.x - origin.x);
+                    uchar *cov = tile.coverage.ptr<uchar>(y - tile.rect.y) + (part.x - tile.rect.x);
+                    for (int x = 0; x < part.width; x++)
+                    {
+                        cov[x] = std::max(cov[x], m[x]);
+                    }
+                }
+            }
+        }
+    }
+
+    Tile &touch_tile(const cv::Mat &canvas, int tx, int ty)
+    {
+        const int key = ty * ((canvas.cols + BRUSH_TILE - 1) / BRUSH_TILE) + tx;
+        auto it = tiles_.find(key);
+        if (it != tiles_.end())
+        {
+            return it->second;
+        }
+        Tile &tile = tiles_[key];
+        tile.rect = cv::Rect(tx * BRUSH_TILE, ty * BRUSH_TILE, BRUSH_TILE, BRUSH_TILE) &
+                    cv::Rect(0, 0, canvas.cols, canvas.rows);
+        canvas(tile.rect).copyTo(tile.before);
+        tile.coverage = cv::Mat::zeros(tile.rect.size(), CV_8UC1);
+        return tile;
+    }
+
+    /**
+     * canvas = before + (color - before) * coverage inside area, for the tiles of the stroke
+     */
+    void composite(cv::Mat &canvas, const cv::Rect &area)
+    {
+        if (area.empty())
+        {
+            return;
+        }
+        INSTRUMENT_SCOPE("brush.composite");
+        const int cn = canvas.channels();
+        const int row_len = BRUSH_TILE * cn;
+        if (static_cast<int>(alpha_row_.size()) != row_len)
+        {
+            alpha_row_.resize(row_len);
+            color_row_.resize(row_len);
+        }
+        for (int i = 0; i < row_len; i++)
+        {
+            color_row_[i] = color_[i % cn];
+        }
+        for (auto &entry : tiles_)
+        {
+            Tile &tile = entry.second;
+            const cv::Rect part = area & tile.rect;
+            if (part.empty())
+            {
+                continue;
+            }
+            const int n = part.width * cn;
+            for (int y = part.y; y < part.br().y; y++)
+            {
+                const int x0 = part.x - tile.rect.x;
+                const uchar *a = tile.coverage.ptr<uchar>(y - tile.rect.y) + x0;
+                const uchar *b = tile.before.ptr<uchar>(y - tile.rect.y) + x0 * cn;
+                uchar *d = canvas.ptr<uchar>(y) + part.x * cn;
+                // Coverage repeated per channel, so the blend is one flat loop the compiler vectorizes
+                for (int x = 0; x < part.width; x++)
+                {
+                    for (int c = 0; c < cn; c++)
+                    {
+                        alpha_row_[x * cn + c] = a[x];
+                    }
+                }
+                const uchar *alpha = alpha_row_.data();
+                const uchar *color = color_row_.data();
+                for (int i = 0; i < n; i++)
+                {
+                    // Exact rounded division by 255 of a value up to 255 * 255
+                    const uint32_t v = b[i] * (255u - alpha[i]) + color[i] * static_cast<uint32_t>(alpha[i]) + 128u;
+                    d[i] = static_cast<uchar>((v + (v >> 8)) >> 8);
+                }
+            }
+        }
+    }
+
+    BrushOptions options_;
+    BrushOptions next_options_;
+    bool options_changed_ = true;
+    BrushMask mask_;
+    uchar color_[4] = {};
+    double spacing_ = 1.0;
+    double to_next_stamp_ = 0.0;
+
+    std::vector<Event> queue_;
+    std::mutex queue_mutex_;
+
+    bool in_stroke_ = false;
+    std::vector<cv::Point2d> points_; // last control points of the stroke (at most 4)
+    std::unordered_map<int, Tile> tiles_;
+    std::vector<uchar> alpha_row_; // scratch rows of composite()
+    std::vector<uchar> color_row_;
+    cv::Rect dirty_;
+    const uchar *canvas_data_ = nullptr;
+    cv::Size canvas_size_;
+    int canvas_type_ = -1;
+    BrushStats stats_;
+};
@@ -0,0 +1,257 @@
+#pragma once
+
+#include <algorithm>
+#include <cstdint>
+#include <cstdlib>
+#include <iostream>
+#include <vector>
+#include <opencv2/opencv.hpp>
+#include "instrumentation.hpp"
+
+/*
+ * Temporal change detection: lesson 05's subtraction and lesson 09's threshold, run against a background
+ * model that is learned over time.
+ *
+ * The background is kept per pixel and channel in 8.8 fixed point (CV_16U, value * 256) and follows
+ * the scene with one of two integer update rules:
+ *   BACKGROUND_EMA     bg += (frame - bg) / 2^ema_shift       (exponential moving average)
+ *   BACKGROUND_MEDIAN  bg += sign(frame - bg) * median_step   (approximate running median, ignores
+ *                                                              short outliers such as passing objects)
+ *
+ * One pass per frame does everything for a pixel while it is in registers: |frame - background|
+ * (largest channel), threshold, mask write, changed-pixel count of its tile and the background update.
+ * The image is split into tiles; a tile with fewer than min_changed_pixels changed pixels reports
+ * "no change" (its mask is cleared, so isolated noise does not wake anything up), and later stages
+ * visit only the changed tiles with for_each_changed_tile(). On a static scene that is a few percent
+ * of the image.
+ */
+
+#define CHANGE_TILE_SIZE 32
+#define CHANGE_THRESHOLD 25
+#define CHANGE_MIN_PIXELS 8
+#define CHANGE_EMA_SHIFT 5    // a new frame weighs 1/32
+#define CHANGE_MEDIAN_STEP 64 // 1/4 gray level per frame
+
+enum BackgroundModel
+{
+    BACKGROUND_EMA,
+    BACKGROUND_MEDIAN
+};
+
+struct ChangeDetectorOptions
+{
+    int tile_size = CHANGE_TILE_SIZE;
+    int threshold = CHANGE_THRESHOLD;       // a pixel changed when |frame - background| > threshold
+    int min_changed_pixels = CHANGE_MIN_PIXELS;
+    BackgroundModel model = BACKGROUND_EMA;
+    int ema_shift = CHANGE_EMA_SHIFT;       // 0..8
+    int median_step = CHANGE_MEDIAN_STEP;   // in 1/256 gray levels
+};
+
+/**
+ * Result of one frame
+ */
+struct ChangeMap
+{
+    cv::Mat mask;                  // CV_8UC1, 255 where the pixel changed, all zero in unchanged tiles
+    std::vector<uchar> changed;    // per tile, row-major
+    std::vector<int> pixel_counts; // changed pixels per tile
+    int tile_size = CHANGE_TILE_SIZE;
+    int tiles_x = 0;
+    int tiles_y = 0;
+    int changed_tiles = 0;
+
+    cv::Rect tile_rect(int tx, int ty) const
+    {
+        const int x = tx * tile_size;
+        const int y = ty * tile_size;
+        return cv::Rect(x, y, std::min(tile_size, mask.cols - x), std::min(tile_size, mask.rows - y));
+    }
+
+    bool tile_changed(int tx, int ty) const { return changed[static_cast<size_t>(ty) * tiles_x + tx] != 0; }
+
+    /**
+     * Fraction of the tiles that changed (what later stages still have to look at)
+     */
+    double changed_fraction() const
+    {
+        return changed.empty() ? 0.0 : static_cast<double>(changed_tiles) / static_cast<double>(changed.size());
+    }
+};
+
+/**
+ * Calls fn(cv::Rect) for every changed tile
+ */
+template <class Fn>
+inline void for_each_changed_tile(const ChangeMap &map, Fn fn)
+{
+    for (int ty = 0; ty < map.tiles_y; ty++)
+    {
+        for (int tx = 0; tx < map.tiles_x; tx++)
+        {
+            if (map.tile_changed(tx, ty))
+            {
+                fn(map.tile_rect(tx, ty));
+            }
+        }
+    }
+}
+
+/**
+ * Background model and detector for one stream of frames of a fixed size
+ */
+class ChangeDetector
+{
+public:
+    explicit ChangeDetector(const ChangeDetectorOptions &options = ChangeDetectorOptions()) : options_(options)
+    {
+        options_.tile_size = std::max(8, options_.tile_size);
+        options_.ema_shift = std::clamp(options_.ema_shift, 0, 8);
+        options_.median_step = std::clamp(options_.median_step, 1, 256 * 255);
+    }
+
+    /**
+     * Compares a frame with the background and updates the background
+     * The first frame (and the first one after a change of size or type) only initializes the model
+     * and reports no change
+     * @param frame CV_8UC1 or CV_8UC3
+     * @return false if the frame is not supported
+     */
+    bool apply(const cv::Mat &frame, ChangeMap &map)
+    {
+        if (frame.empty() || (frame.type() != CV_8UC1 && frame.type() != CV_8UC3))
+        {
+            std::cerr << "Error: ChangeDetector needs a non-empty CV_8UC1 or CV_8UC3 frame!" << std::endl;
+            return false;
+        }
+        INSTRUMENT_SCOPE("change.detect");
+        map.tile_size = options_.tile_size;
+        map.tiles_x = (frame.cols + options_.tile_size - 1) / options_.tile_size;
+        map.tiles_y = (frame.rows + options_.tile_size - 1) / options_.tile_size;
+        const size_t tiles = static_cast<size_t>(map.tiles_x) * map.tiles_y;
+        map.changed.assign(tiles, 0);
+        map.pixel_counts.assign(tiles, 0);
+        map.changed_tiles = 0;
+        map.mask.create(frame.size(), CV_8UC1);
+
+        if (background_.size() != frame.size() || background_.channels() != frame.channels())
+        {
+            frame.convertTo(background_, CV_16U, 256.0);
+            map.mask.setTo(cv::Scalar::all(0));
+            frames_ = 1;
+            return true;
+        }
+
+        cv::parallel_for_(cv::Range(0, map.tiles_y), [&](const cv::Range &range) {
+            for (int ty = range.start; ty < range.end; ty++)
+            {
+                if (frame.channels() == 1)
+                {
+                    detect_band<1>(frame, map, ty);
+                }
+                else
+                {
+                    detect_band<3>(frame, map, ty);
+                }
+            }
+        });
+        for (uchar c : map.changed)
+        {
+            map.changed_tiles += c;
+        }
+        frames_++;
+        INSTRUMENT_COUNT("change.changed_tiles", map.changed_tiles);
+        INSTRUMENT_COUNT("change.tiles", tiles);
+        return true;
+    }
+
+    /**
+     * Forgets the background; the next frame initializes it again
+     */
+    void reset()
+    {
+        background_.release();
+        frames_ = 0;
+    }
+
+    /**
+     * Current background as an 8-bit image
+     */
+    cv::Mat background() const
+    {
+        cv::Mat out;
+        if (!background_.empty())
+        {
+            background_.convertTo(out, CV_8U, 1.0 / 256.0);
+        }
+        return out;
+    }
+
+    const ChangeDetectorOptions &options() const { return options_; }
+    long frames() const { return frames_; }
+
+private:
+    /**
+     * Fused difference, threshold, mask, count and background update for one row of tiles
+     */
+    template <int CN>
+    void detect_band(const cv::Mat &frame, ChangeMap &map, int ty)
+    {
+        const int tile = options_.tile_size;
+        const int threshold = options_.threshold;
+        const int shift = options_.ema_shift;
+        const int step = options_.median_step;
+        const bool ema = options_.model == BACKGROUND_EMA;
+        int *counts = map.pixel_counts.data() + static_cast<size_t>(ty) * map.tiles_x;
+        const int y_end = std::min(frame.rows, (ty + 1) * tile);
+        for (int y = ty * tile; y < y_end; y++)
+        {
+            const uchar *f = frame.ptr<uchar>(y);
+            uint16_t *b = background_.ptr<uint16_t>(y);
+            uchar *m = map.mask.ptr<uchar>(y);
+            for (int tx = 0; tx < map.tiles_x; tx++)
+            {
+                const int x_end = std::min(frame.cols, (tx + 1) * tile);
+                int count = 0;
+                for (int x = tx * tile; x < x_end; x++)
+                {
+                    int diff = 0;
+                    for (int c = 0; c < CN; c++)
+                    {
+                        const int target = f[x * CN + c] << 8;
+                        int bg = b[x * CN + c];
+                        diff = std::max(diff, std::abs(f[x * CN + c] - ((bg + 128) >> 8)));
+                        if (ema)
+                        {
+                            bg += (target - bg) >> shift;
+                        }
+                        else
+                        {
+                            bg = target > bg ? std::min(bg + step, target) : std::max(bg - step, target);
+                        }
+                        b[x * CN + c] = static_cast<uint16_t>(bg);
+                    }
+                    const int on = diff > threshold;
+                    m[x] = static_cast<uchar>(-on);
+                    count += on;
+                }
+                counts[tx] += count;
+            }
+        }
+
+        // Tiles below the pixel count report no change; their few noisy mask pixels are cleared
+        for (int tx = 0; tx < map.tiles_x; tx++)
+        {
+            const size_t t = static_cast<size_t>(ty) * map.tiles_x + tx;
+            map.changed[t] = counts[tx] >= options_.min_changed_pixels;
+            if (!map.changed[t] && counts[tx] > 0)
+            {
+                map.mask(map.tile_rect(tx, ty)).setTo(cv::Scalar::all(0));
+            }
+        }
+    }
+
+    ChangeDetectorOptions options_;
+    cv::Mat background_; // CV_16UC(cn), 8.8 fixed point
+    long frames_ = 0;
+};
@@ -0,0 +1,382 @@
+#pragma once
+
+#include <algorithm>
+#include <array>
+#include <cmath>
+#include <cstdint>
+#include <iostream>
+#include <opencv2/opencv.hpp>
+#include "instrumentation.hpp"
+
+/*
+ * Color-space conversions with fixed-point row kernels, plus fused paths that apply the next point
+ * operation (threshold, gamma, contrast... as a 256-entry table) while converting, so the intermediate
+ * image is never written.
+ *
+ * The 8-bit kernels use the same integer coefficients and rounding as OpenCV's cvtColor, so results
+ * are interchangeable. Conversions without a dedicated kernel here (Lab, HSV to BGR) go through
+ * cv::cvtColor with the same API.
+ *
+ * YUV 4:2:0 camera frames are wrapped without copying (Yuv420Frame), and their luma plane is the
+ * grayscale image: luma-only processing never needs a BGR conversion.
+ */
+
+#define COLOR_SHIFT 14 // BGR <-> gray/YCrCb fixed point (same as OpenCV's yuv_shift)
+#define HSV_SHIFT 12
+#define YUV420_SHIFT 20 // BT.601 limited range YUV 4:2:0 to BGR
+
+// BT.601 weights scaled by 2^14
+#define COLOR_B2Y 1868
+#define COLOR_G2Y 9617
+#define COLOR_R2Y 4899
+#define COLOR_CR 11682  // 0.713 * 2^14
+#define COLOR_CB 9241   // 0.564 * 2^14
+#define COLOR_CR2R 22987
+#define COLOR_CR2G -11698
+#define COLOR_CB2G -5636
+#define COLOR_CB2B 29049
+
+// BT.601 limited range YUV to RGB, scaled by 2^20
+#define YUV_CY 1220542
+#define YUV_CUB 2116026
+#define YUV_CUG -409993
+#define YUV_CVG -852492
+#define YUV_CVR 1673527
+
+/**
+ * Fixed-point BT.601 luma of one BGR pixel (matches cv::cvtColor COLOR_BGR2GRAY)
+ */
+inline int bgr_luma(int b, int g, int r)
+{
+    return (b * COLOR_B2Y + g * COLOR_G2Y + r * COLOR_R2Y + (1 << (COLOR_SHIFT - 1))) >> COLOR_SHIFT;
+}
+
+/**
+ * Clamps an int to 0-255 without branches
+ */
+inline uchar clamp_u8(int v)
+{
+    return static_cast<uchar>(std::clamp(v, 0, 255));
+}
+
+inline void bgr_to_gray_row(const uchar *src, uchar *dst, int cols)
+{
+    for (int x = 0; x < cols; x++)
+    {
+        dst[x] = static_cast<uchar>(bgr_luma(src[3 * x], src[3 * x + 1], src[3 * x + 2]));
+    }
+}
+
+inline void bgr_to_ycrcb_row(const uchar *src, uchar *dst, int cols)
+{
+    const int delta = 128 << COLOR_SHIFT;
+    const int half = 1 << (COLOR_SHIFT - 1);
+    for (int x = 0; x < cols; x++)
+    {
+        const int b = src[3 * x], g = src[3 * x + 1], r = src[3 * x + 2];
+        const int y = bgr_luma(b, g, r);
+        dst[3 * x] = static_cast<uchar>(y);
+        dst[3 * x + 1] = clamp_u8(((r - y) * COLOR_CR + delta + half) >> COLOR_SHIFT);
+        dst[3 * x + 2] = clamp_u8(((b - y) * COLOR_CB + delta + half) >> COLOR_SHIFT);
+    }
+}
+
+inline void ycrcb_to_bgr_row(const uchar *src, uchar *dst, int cols)
+{
+    const int half = 1 << (COLOR_SHIFT - 1);
+    for (int x = 0; x < cols; x++)
+    {
+        const int y = src[3 * x], cr = src[3 * x + 1] - 128, cb = src[3 * x + 2] - 128;
+        dst[3 * x] = clamp_u8(y + ((cb * COLOR_CB2B + half) >> COLOR_SHIFT));
+        dst[3 * x + 1] = clamp_u8(y + ((cb * COLOR_CB2G + cr * COLOR_CR2G + half) >> COLOR_SHIFT));
+        dst[3 * x + 2] = clamp_u8(y + ((cr * COLOR_CR2R + half) >> COLOR_SHIFT));
+    }
+}
+
+/**
+ * Reciprocal tables of the 8-bit HSV conversion (same as OpenCV: H in 0-180, S and V in 0-255)
+ */
+struct HsvTables
+{
+    std::array<int, 256> sdiv{};
+    std::array<int, 256> hdiv{};
+
+    HsvTables()
+    {
+        for (int i = 1; i < 256; i++)
+        {
+            sdiv[i] = cvRound((255 << HSV_SHIFT) / static_cast<double>(i));
+            hdiv[i] = cvRound((180 << HSV_SHIFT) / (6.0 * i));
+        }
+    }
+
+    static const HsvTables &get()
+    {
+        static const HsvTables tables;
+        return tables;
+    }
+};
+
+inline void bgr_to_hsv_row(const uchar *src, uchar *dst, int cols)
+{
+    const HsvTables &t = HsvTables::get();
+    const int half = 1 << (HSV_SHIFT - 1);
+    for (int x = 0; x < cols; x++)
+    {
+        const int b = src[3 * x], g = src[3 * x + 1], r = src[3 * x + 2];
+        const int v = std::max(b, std::max(g, r));
+        const int diff = v - std::min(b, std::min(g, r));
+        // Masks instead of branches: -1 when the maximum is red (green)
+        const int vr = -static_cast<int>(v == r);
+        const int vg = -static_cast<int>(v == g);
+        const int s = (diff * t.sdiv[v] + half) >> HSV_SHIFT;
+        int h = (vr & (g - b)) + (~vr & ((vg & (b - r + 2 * diff)) + (~vg & (r - g + 4 * diff))));
+        h = (h * t.hdiv[diff] + half) >> HSV_SHIFT;
+        h += 180 & -static_cast<int>(h < 0);
+        dst[3 * x] = static_cast<uchar>(h);
+        dst[3 * x + 1] = static_cast<uchar>(s);
+        dst[3 * x + 2] = static_cast<uchar>(v);
+    }
+}
+
+/**
+ * Runs a row kernel over a whole image in parallel
+ */
+template <typename RowKernel>
+inline void convert_rows(const cv::Mat &src, cv::Mat &dst, int dst_type, RowKernel kernel)
+{
+    dst.create(src.size(), dst_type);
+    cv::parallel_for_(cv::Range(0, src.rows), [&](const cv::Range &range) {
+        for (int y = range.start; y < range.end; y++)
+        {
+            kernel(src.ptr<uchar>(y), dst.ptr<uchar>(y), src.cols);
+        }
+    });
+}
+
+/**
+ * Color conversion with the cv::cvtColor codes
+ * COLOR_BGR2GRAY, COLOR_BGR2YCrCb, COLOR_YCrCb2BGR and COLOR_BGR2HSV on CV_8UC3 use the kernels above,
+ * everything else (Lab, HSV2BGR, other depths...) is forwarded to cv::cvtColor
+ */
+inline void convert_color(const cv::Mat &src, cv::Mat &dst, int code)
+{
+    if (src.empty())
+    {
+        std::cerr << "Error: Input image is empty!" << std::endl;
+        return;
+    }
+    INSTRUMENT_SCOPE("color.convert");
+    if (src.type() == CV_8UC3 && src.data != dst.data)
+    {
+        switch (code)
+        {
+        case cv::COLOR_BGR2GRAY:
+            convert_rows(src, dst, CV_8UC1, bgr_to_gray_row);
+            return;
+        case cv::COLOR_BGR2YCrCb:
+            convert_rows(src, dst, CV_8UC3, bgr_to_ycrcb_row);
+            return;
+        case cv::COLOR_YCrCb2BGR:
+            convert_rows(src, dst, CV_8UC3, ycrcb_to_bgr_row);
+            return;
+        case cv::COLOR_BGR2HSV:
+            convert_rows(src, dst, CV_8UC3, bgr_to_hsv_row);
+            return;
+        default:
+            break;
+        }
+    }
+    cv::cvtColor(src, dst, code);
+}
+
+/**
+ * Builds the 256-entry table equivalent to cv::threshold on 8-bit data (any of the five basic types)
+ */
+inline cv::Mat threshold_lut(double thresh, double max_value, int type)
+{
+    cv::Mat lut(1, 256, CV_8U);
+    uchar *p = lut.ptr();
+    const int t = static_cast<int>(std::floor(thresh));
+    const uchar m = cv::saturate_cast<uchar>(max_value);
+    for (int i = 0; i < 256; i++)
+    {
+        const bool above = i > t;
+        switch (type)
+        {
+        case cv::THRESH_BINARY:
+            p[i] = above ? m : 0;
+            break;
+        case cv::THRESH_BINARY_INV:
+            p[i] = above ? 0 : m;
+            break;
+        case cv::THRESH_TRUNC:
+            p[i] = above ? clamp_u8(t) : static_cast<uchar>(i);
+            break;
+        case cv::THRESH_TOZERO:
+            p[i] = above ? static_cast<uchar>(i) : 0;
+            break;
+        default: // THRESH_TOZERO_INV
+            p[i] = above ? 0 : static_cast<uchar>(i);
+            break;
+        }
+    }
+    return lut;
+}
+
+/**
+ * BGR to grayscale fused with a point operation: dst = lut[gray(src)], one pass, no gray image
+ * @param lut 1x256 CV_8U table (threshold_lut, gamma table, contrast table...)
+ */
+inline void bgr_to_gray_lut(const cv::Mat &src, const cv::Mat &lut, cv::Mat &dst)
+{
+    if (src.empty() || src.type() != CV_8UC3 || lut.total() != 256 || lut.type() != CV_8U)
+    {
+        std::cerr << "Error: bgr_to_gray_lut needs a CV_8UC3 image and a 256-entry CV_8U table!" << std::endl;
+        return;
+    }
+    INSTRUMENT_SCOPE("color.gray_lut");
+    const cv::Mat table = lut.isContinuous() ? lut : lut.clone();
+    const uchar *t = table.ptr<uchar>();
+    convert_rows(src, dst, CV_8UC1, [t](const uchar *in, uchar *out, int cols) {
+        for (int x = 0; x < cols; x++)
+        {
+            out[x] = t[bgr_luma(in[3 * x], in[3 * x + 1], in[3 * x + 2])];
+        }
+    });
+}
+
+enum Yuv420Layout
+{
+    YUV420_NV12, // Y plane, then one plane of interleaved U, V
+    YUV420_I420  // Y plane, then a U plane, then a V plane
+};
+
+/**
+ * Views into a YUV 4:2:0 frame stored as a (height * 3 / 2) x width CV_8UC1 buffer, as delivered by
+ * cameras and decoders (the layout cv::cvtColor expects for COLOR_YUV2BGR_NV12 / _I420)
+ */
+struct Yuv420Frame
+{
+    cv::Mat y;  // height x width luma (this is the grayscale image)
+    cv::Mat uv; // NV12: height/2 x width/2 CV_8UC2 (U, V)
+    cv::Mat u;  // I420: height/2 x width/2
+    cv::Mat v;  // I420: height/2 x width/2
+    Yuv420Layout layout = YUV420_NV12;
+
+    /**
+     * Wraps a frame buffer without copying
+     * @param buffer Continuous CV_8UC1 buffer of (height * 3 / 2) rows, even width and height
+     */
+    static Yuv420Frame wrap(const cv::Mat &buffer, Yuv420Layout layout)
+    {
+        Yuv420Frame frame;
+        if (buffer.empty() || buffer.type() != CV_8UC1 || !buffer.isContinuous() || buffer.rows % 3 != 0 ||
+            buffer.cols % 2 != 0)
+        {
+            std::cerr << "Error: A YUV 4:2:0 frame must be a continuous CV_8UC1 buffer of height * 3 / 2 rows!"
+                      << std::endl;
+            return frame;
+        }
+        const int height = buffer.rows * 2 / 3;
+        const int width = buffer.cols;
+        uchar *base = const_cast<uchar *>(buffer.ptr<uchar>());
+        frame.layout = layout;
+        frame.y = buffer.rowRange(0, height);
+        if (layout == YUV420_NV12)
+        {
+            frame.uv = cv::Mat(height / 2, width / 2, CV_8UC2, base + static_cast<size_t>(width) * height);
+        }
+        else
+        {
+            const size_t chroma = static_cast<size_t>(width / 2) * (height / 2);
+            frame.u = cv::Mat(height / 2, width / 2, CV_8UC1, base + static_cast<size_t>(width) * height);
+            frame.v = cv::Mat(height / 2, width / 2, CV_8UC1, base + static_cast<size_t>(width) * height + chroma);
+        }
+        return frame;
+    }
+
+    bool empty() const { return y.empty(); }
+    cv::Size size() const { return y.size(); }
+};
+
+/**
+ * BT.601 limited range YUV to one BGR pixel (matches cv::cvtColor COLOR_YUV2BGR_NV12)
+ */
+inline void yuv_to_bgr_pixel(int y, int ruv, int guv, int buv, uchar *dst)
+{
+    const int yy = std::max(0, y - 16) * YUV_CY;
+    dst[0] = clamp_u8((yy + buv) >> YUV420_SHIFT);
+    dst[1] = clamp_u8((yy + guv) >> YUV420_SHIFT);
+    dst[2] = clamp_u8((yy + ruv) >> YUV420_SHIFT);
+}
+
+/**
+ * YUV 4:2:0 (NV12 or I420) to BGR, two luma rows per chroma row
+ */
+inline void yuv420_to_bgr(const Yuv420Frame &frame, cv::Mat &dst)
+{
+    if (frame.empty())
+    {
+        std::cerr << "Error: YUV frame is empty!" << std::endl;
+        return;
+    }
+    INSTRUMENT_SCOPE("color.yuv420_to_bgr");
+    dst.create(frame.size(), CV_8UC3);
+    const int half = 1 << (YUV420_SHIFT - 1);
+    cv::parallel_for_(cv::Range(0, frame.y.rows / 2), [&](const cv::Range &range) {
+        for (int cy = range.start; cy < range.end; cy++)
+        {
+            const uchar *y0 = frame.y.ptr<uchar>(2 * cy);
+            const uchar *y1 = frame.y.ptr<uchar>(2 * cy + 1);
+            uchar *d0 = dst.ptr<uchar>(2 * cy);
+            uchar *d1 = dst.ptr<uchar>(2 * cy + 1);
+            // NV12 chroma is interleaved (step 2), I420 chroma has its own planes (step 1)
+            const bool nv12 = frame.layout == YUV420_NV12;
+            const uchar *pu = nv12 ? frame.uv.ptr<uchar>(cy) : frame.u.ptr<uchar>(cy);
+            const uchar *pv = nv12 ? frame.uv.ptr<uchar>(cy) + 1 : frame.v.ptr<uchar>(cy);
+            const int step = nv12 ? 2 : 1;
+            for (int cx = 0; cx < frame.y.cols / 2; cx++)
+            {
+                const int u = pu[step * cx] - 128;
+                const int v = pv[step * cx] - 128;
+                const int ruv = half + YUV_CVR * v;
+                const int guv = half + YUV_CVG * v + YUV_CUG * u;
+                const int buv = half + YUV_CUB * u;
+                yuv_to_bgr_pixel(y0[2 * cx], ruv, guv, buv, d0 + 6 * cx);
+                yuv_to_bgr_pixel(y0[2 * cx + 1], ruv, guv, buv, d0 + 6 * cx + 3);
+                yuv_to_bgr_pixel(y1[2 * cx], ruv, guv, buv, d1 + 6 * cx);
+                yuv_to_bgr_pixel(y1[2 * cx + 1], ruv, guv, buv, d1 + 6 * cx + 3);
+            }
+        }
+    });
+}
+
+/**
+ * Point operation straight on the luma plane of a YUV 4:2:0 frame: dst = lut[Y]
+ * Thresholded, gamma corrected or contrast adjusted grayscale from a camera frame without any BGR image
+ */
+inline void yuv420_luma_lut(const Yuv420Frame &frame, const cv::Mat &lut, cv::Mat &dst)
+{
+    if (frame.empty())
+    {
+        std::cerr << "Error: YUV frame is empty!" << std::endl;
+        return;
+    }
+    INSTRUMENT_SCOPE("color.yuv420_luma_lut");
+    cv::LUT(frame.y, lut, dst);
+}
+
+/**
+ * Thresholded luma of a YUV 4:2:0 frame (same types as cv::threshold, one pass over the Y plane)
+ */
+inline void yuv420_threshold_luma(const Yuv420Frame &frame, cv::Mat &dst, double thresh, double max_value, int type)
+{
+    if (frame.empty())
+    {
+        std::cerr << "Error: YUV frame is empty!" << std::endl;
+        return;
+    }
+    INSTRUMENT_SCOPE("color.yuv420_threshold_luma");
+    cv::threshold(frame.y, dst, thresh, max_value, type);
+}
@@ -0,0 +1,303 @@
+#pragma once
+
+#include <algorithm>
+#include <cstdint>
+#include <iostream>
+#include <vector>
+#include <opencv2/opencv.hpp>
+#include "batch_ops.hpp"
+#include "instrumentation.hpp"
+
+/*
+ * Connected components of a binary image (any non-zero pixel is foreground).
+ *
+ * Labeling works on horizontal runs instead of pixels: every row is turned into [start, end) runs,
+ * overlapping runs of consecutive rows are merged with union-find, and the blob statistics are summed
+ * from the runs. Strips of rows are labeled in parallel and joined at the strip borders, and no second
+ * pass over the pixels is needed unless a label image is requested.
+ */
+
+struct BlobStats
+{
+    int label = 0;           // 1..N in raster order of the first pixel
+    int64_t area = 0;        // number of pixels
+    cv::Rect bbox;           // bounding box
+    cv::Point2d centroid;    // mean pixel position
+};
+
+struct PixelRun
+{
+    int row;
+    int start; // first pixel
+    int end;   // one past the last pixel
+};
+
+/**
+ * Union-find root lookup with path halving
+ */
+inline int find_root(std::vector<int> &parent, int i)
+{
+    while (parent[i] != i)
+    {
+        parent[i] = parent[parent[i]];
+        i = parent[i];
+    }
+    return i;
+}
+
+/**
+ * Joins two sets, the smaller index becomes the root so labels follow raster order
+ */
+inline void union_runs(std::vector<int> &parent, int a, int b)
+{
+    a = find_root(parent, a);
+    b = find_root(parent, b);
+    if (a < b)
+    {
+        parent[b] = a;
+    }
+    else if (b < a)
+    {
+        parent[a] = b;
+    }
+}
+
+/**
+ * Unions the touching runs of two consecutive rows
+ * Both ranges are sorted by start, so one merge-like sweep visits every overlapping pair
+ * @param slack 1 for 8-connectivity (diagonal neighbours touch), 0 for 4-connectivity
+ */
+inline void link_rows(const std::vector<PixelRun> &runs, int prev_begin, int prev_end, int cur_begin, int cur_end,
+                      int slack, std::vector<int> &parent)
+{
+    int i = prev_begin;
+    int j = cur_begin;
+    while (i < prev_end && j < cur_end)
+    {
+        const PixelRun &a = runs[i];
+        const PixelRun &b = runs[j];
+        if (a.start < b.end + slack && b.start < a.end + slack)
+        {
+            union_runs(parent, i, j);
+        }
+        // Advance the run that finishes first, the other one may still touch the next run
+        if (a.end < b.end)
+        {
+            i++;
+        }
+        else
+        {
+            j++;
+        }
+    }
+}
+
+/**
+ * Labels the connected components of a binary CV_8UC1 image and returns their statistics
+ * @param connectivity 8 (default) or 4
+ * @param labels Optional CV_32S label image (0 = background), painted from the runs
+ * @param min_area Blobs smaller than this are dropped from the result (and left out of the label image)
+ */
+inline std::vector<BlobStats> connected_components(const cv::Mat &binary, int connectivity = 8,
+                                                   cv::Mat *labels = nullptr, int64_t min_area = 0)
+{
+    std::vector<BlobStats> blobs;
+    if (binary.empty() || binary.type() != CV_8UC1)
+    {
+        std::cerr << "Error: connected_components expects a CV_8UC1 binary image!" << std::endl;
+        return blobs;
+    }
+    if (connectivity != 4 && connectivity != 8)
+    {
+        std::cerr << "Error: Connectivity must be 4 or 8!" << std::endl;
+        return blobs;
+    }
+    INSTRUMENT_SCOPE("components.label");
+    const int slack = connectivity == 8 ? 1 : 0;
+    const int rows = binary.rows;
+    const int cols = binary.cols;
+
+    // 1. Runs and local unions per strip of rows, in parallel
+    const int strip_count = std::max(1, std::min(rows / 16, cv::getNumThreads() * 4));
+    struct Strip
+    {
+        std::vector<PixelRun> runs;
+        std::vector<int> row_begin; // index of the first run of every row, plus one end entry
+        std::vector<int> parent;
+    };
+    std::vector<Strip> strips(strip_count);
+    auto strip_first_row = [&](int s) { return static_cast<int>(static_cast<int64_t>(rows) * s / strip_count); };
+
+    cv::parallel_for_(cv::Range(0, strip_count), [&](const cv::Range &range) {
+        for (int s = range.start; s < range.end; s++)
+        {
+            Strip &strip = strips[s];
+            const int r0 = strip_first_row(s);
+            const int r1 = strip_first_row(s + 1);
+            for (int y = r0; y < r1; y++)
+            {
+                strip.row_begin.push_back(static_cast<int>(strip.runs.size()));
+                const uchar *p = binary.ptr<uchar>(y);
+                int x = 0;
+                while (x < cols)
+                {
+                    while (x < cols && p[x] == 0)
+                    {
+                        x++;
+                    }
+                    if (x == cols)
+                    {
+                        break;
+                    }
+                    int start = x;
+                    while (x < cols && p[x] != 0)
+                    {
+                        x++;
+                    }
+                    strip.runs.push_back({y, start, x});
+                }
+            }
+            strip.row_begin.push_back(static_cast<int>(strip.runs.size()));
+
+            strip.parent.resize(strip.runs.size());
+            for (size_t i = 0; i < strip.parent.size(); i++)
+            {
+                strip.parent[i] = static_cast<int>(i);
+            }
+            for (int r = 1; r < r1 - r0; r++)
+            {
+                link_rows(strip.runs, strip.row_begin[r - 1], strip.row_begin[r], strip.row_begin[r],
+                          strip.row_begin[r + 1], slack, strip.parent);
+            }
+        }
+    });
+
+    // 2. Concatenate the strips and join them at their borders
+    std::vector<PixelRun> runs;
+    std::vector<int> parent;
+    std::vector<int> strip_offset(strip_count + 1, 0);
+    for (int s = 0; s < strip_count; s++)
+    {
+        strip_offset[s + 1] = strip_offset[s] + static_cast<int>(strips[s].runs.size());
+    }
+    runs.reserve(strip_offset[strip_count]);
+    parent.reserve(strip_offset[strip_count]);
+    for (int s = 0; s < strip_count; s++)
+    {
+        runs.insert(runs.end(), strips[s].runs.begin(), strips[s].runs.end());
+        for (int p : strips[s].parent)
+        {
+            parent.push_back(p + strip_offset[s]);
+        }
+    }
+    for (int s = 1; s < strip_count; s++)
+    {
+        const Strip &above = strips[s - 1];
+        const Strip &below = strips[s];
+        if (above.row_begin.size() < 2 || below.row_begin.size() < 2)
+        {
+            continue;
+        }
+        const int last_row = static_cast<int>(above.row_begin.size()) - 2;
+        link_rows(runs, strip_offset[s - 1] + above.row_begin[last_row], strip_offset[s - 1] + above.row_begin[last_row + 1],
+                  strip_offset[s] + below.row_begin[0], strip_offset[s] + below.row_begin[1], slack, parent);
+    }
+
+    // 3. Statistics from the runs; roots are met in raster order so labels come out sorted
+    struct Accumulator
+    {
+        int64_t area = 0;
+        double sum_x = 0.0;
+        double sum_y = 0.0;
+        int x0 = 0, y0 = 0, x1 = 0, y1 = 0;
+    };
+    std::vector<int> root_slot(runs.size(), -1);
+    std::vector<int> run_slot(runs.size());
+    std::vector<Accumulator> acc;
+    for (size_t i = 0; i < runs.size(); i++)
+    {
+        int root = find_root(parent, static_cast<int>(i));
+        if (root_slot[root] < 0)
+        {
+            root_slot[root] = static_cast<int>(acc.size());
+            acc.push_back({0, 0.0, 0.0, runs[i].start, runs[i].row, runs[i].end, runs[i].row});
+        }
+        const PixelRun &run = runs[i];
+        Accumulator &a = acc[root_slot[root]];
+        const int len = run.end - run.start;
+        a.area += len;
+        a.sum_x += (run.start + run.end - 1) * 0.5 * len; // sum of start..end-1
+        a.sum_y += static_cast<double>(run.row) * len;
+        a.x0 = std::min(a.x0, run.start);
+        a.x1 = std::max(a.x1, run.end);
+        a.y1 = std::max(a.y1, run.row);
+        run_slot[i] = root_slot[root];
+    }
+
+    std::vector<int> slot_label(acc.size(), 0);
+    for (size_t k = 0; k < acc.size(); k++)
+    {
+        const Accumulator &a = acc[k];
+        if (a.area < min_area)
+        {
+            continue;
+        }
+        BlobStats blob;
+        blob.label = static_cast<int>(blobs.size()) + 1;
+        blob.area = a.area;
+        blob.bbox = cv::Rect(a.x0, a.y0, a.x1 - a.x0, a.y1 - a.y0 + 1);
+        blob.centroid = cv::Point2d(a.sum_x / a.area, a.sum_y / a.area);
+        slot_label[k] = blob.label;
+        blobs.push_back(blob);
+    }
+    INSTRUMENT_COUNT("components.blobs", blobs.size());
+
+    // 4. Optional label image, painted run by run
+    if (labels != nullptr)
+    {
+        INSTRUMENT_SCOPE("components.paint_labels");
+        labels->create(binary.size(), CV_32S);
+        labels->setTo(cv::Scalar(0));
+        cv::parallel_for_(cv::Range(0, strip_count), [&](const cv::Range &range) {
+            for (int s = range.start; s < range.end; s++)
+            {
+                for (int i = strip_offset[s]; i < strip_offset[s + 1]; i++)
+                {
+                    int *row = labels->ptr<int>(runs[i].row);
+                    std::fill(row + runs[i].start, row + runs[i].end, slot_label[run_slot[i]]);
+                }
+            }
+        });
+    }
+    return blobs;
+}
+
+/**
+ * Fixed-size crop rectangles centred on the blob centroids, ready for batch_crop
+ */
+inline std::vector<cv::Rect> blob_crop_rects(const std::vector<BlobStats> &blobs, cv::Size crop_size)
+{
+    std::vector<cv::Rect> rects;
+    rects.reserve(blobs.size());
+    for (const BlobStats &blob : blobs)
+    {
+        rects.push_back(cv::Rect(cvRound(blob.centroid.x) - crop_size.width / 2,
+                                 cvRound(blob.centroid.y) - crop_size.height / 2, crop_size.width, crop_size.height));
+    }
+    return rects;
+}
+
+/**
+ * Crops every blob of an image into one contiguous batch (parts outside the image are zero)
+ * @param src Image to crop from, usually the color or grayscale image that was thresholded
+ */
+inline void crop_blobs(const cv::Mat &src, const std::vector<BlobStats> &blobs, cv::Size crop_size, ImageBatch &dst)
+{
+    if (blobs.empty())
+    {
+        dst = ImageBatch();
+        return;
+    }
+    std::vector<cv::Rect> rects = blob_crop_rects(blobs, crop_size);
+    batch_crop(src, rects, crop_size, dst);
+}
@@ -0,0 +1,37 @@
+#pragma once
+
+#include <iostream>
+#include <opencv2/opencv.hpp>
+#include "instrumentation.hpp"
+
+/**
+ * Linear contrast and brightness at the image's native depth: output = alpha * input + beta
+ * CV_8U keeps lesson 06 behaviour (cv::convertScaleAbs), CV_16U saturates at 65535 and CV_32F is
+ * left unclamped, so 12/16-bit and HDR data never go through an 8-bit conversion
+ * @param beta Offset in the units of the image (0-255 for CV_8U, 0-65535 for CV_16U, 0-1 for CV_32F)
+ * @return false if the depth is not supported
+ */
+inline bool adjust_contrast_brightness(const cv::Mat &src, cv::Mat &dst, double alpha, double beta)
+{
+    if (src.empty())
+    {
+        std::cerr << "Error: Input image is empty!" << std::endl;
+        return false;
+    }
+
+    INSTRUMENT_SCOPE("contrast.adjust");
+    switch (src.depth())
+    {
+    case CV_8U:
+        cv::convertScaleAbs(src, dst, alpha, beta);
+        return true;
+    case CV_16U:
+    case CV_32F:
+        // convertTo runs the same vectorized scale+offset kernel, saturating to the target depth
+        src.convertTo(dst, src.depth(), alpha, beta);
+        return true;
+    default:
+        std::cerr << "Error: Contrast adjustment supports CV_8U, CV_16U and CV_32F images!" << std::endl;
+        return false;
+    }
+}
@@ -0,0 +1,477 @@
+#pragma once
+
+#include <cctype>
+#include <chrono>
+#include <condition_variable>
+#include <cstdio>
+#include <cstdlib>
+#include <deque>
+#include <filesystem>
+#include <iostream>
+#include <map>
+#include <memory>
+#include <mutex>
+#include <string>
+#include <thread>
+#include <opencv2/opencv.hpp>
+#include "instrumentation.hpp"
+
+/*
+ * Where the lessons show their images, so interactive code paths can run and be timed without a display.
+ *
+ *   HighguiSink    cv::namedWindow / cv::imshow / cv::waitKey, as before
+ *   OffscreenSink  a writer thread saves every presented frame, as an image sequence
+ *                  (DIR/<window>_000001.png...) or one MJPG video per window (DIR/<window>.avi)
+ *   NullSink       discards frames (pure compute cost of a demo)
+ *
+ * The sink is picked once per process from CV_LESSONS_DISPLAY:
+ *   highgui | null | offscreen:DIR | video:DIR      (default: highgui, or null when there is no display)
+ * CV_LESSONS_MAX_FPS=N limits presents per window to N per second. A frame that comes in sooner replaces
+ * the pending one instead of being shown; the pending frame is shown once its slot comes up or when
+ * the program waits for a key, so the last image of a window is never lost.
+ *
+ * Headless sinks have nobody to press keys: wait_key() returns -1, and ESC (27) once it has been called
+ * CV_LESSONS_HEADLESS_WAITS times (default DISPLAY_HEADLESS_WAITS), so "until ESC" loops end.
+ */
+
+#define DISPLAY_HEADLESS_WAITS 300
+#define DISPLAY_QUEUE_FRAMES 16
+#define DISPLAY_VIDEO_FPS 30.0
+#define DISPLAY_KEY_ESC 27
+
+/**
+ * Drops presents that come in faster than max_fps per window
+ */
+class FrameRateLimiter
+{
+public:
+    explicit FrameRateLimiter(double max_fps = 0.0) { set_max_fps(max_fps); }
+
+    /**
+     * @param max_fps Presents per second per window, 0 = no limit
+     */
+    void set_max_fps(double max_fps)
+    {
+        interval_ = Clock::duration::zero();
+        if (max_fps > 0.0)
+        {
+            interval_ = std::chrono::duration_cast<Clock::duration>(std::chrono::duration<double>(1.0 / max_fps));
+        }
+    }
+
+    /**
+     * True if a frame for window may be presented now (and starts its next interval)
+     */
+    bool admit(const std::string &window)
+    {
+        if (interval_ == Clock::duration::zero())
+        {
+            return true;
+        }
+        const Clock::time_point now = Clock::now();
+        auto it = last_.find(window);
+        if (it != last_.end() && now - it->second < interval_)
+        {
+            return false;
+        }
+        last_[window] = now;
+        return true;
+    }
+
+    bool limited() const { return interval_ != Clock::duration::zero(); }
+
+private:
+    typedef std::chrono::steady_clock Clock;
+
+    Clock::duration interval_ = Clock::duration::zero();
+    std::map<std::string, Clock::time_point> last_;
+};
+
+/**
+ * Display backend; show() and wait_key() replace cv::imshow and cv::waitKey
+ */
+class DisplaySink
+{
+public:
+    DisplaySink() = default;
+    virtual ~DisplaySink() = default;
+    DisplaySink(const DisplaySink &) = delete;
+    DisplaySink &operator=(const DisplaySink &) = delete;
+
+    /**
+     * Shows img in window (created on first use). The frame may be held until it is presented,
+     * so pass a Mat that is not written to afterwards (a new Mat per frame, or a clone)
+     */
+    void show(const std::string &window, const cv::Mat &img)
+    {
+        if (img.empty())
+        {
+            return;
+        }
+        if (!limiter_.admit(window))
+        {
+            pending_[window] = img;
+            dropped_++;
+            INSTRUMENT_COUNT("display.dropped", 1);
+            return;
+        }
+        pending_.erase(window);
+        present(window, img);
+    }
+
+    /**
+     * Waits for a key like cv::waitKey (delay <= 0 waits forever on a real display)
+     * Pending frames are presented first: all of them before a blocking wait, otherwise those whose
+     * interval has passed
+     */
+    int wait_key(int delay_ms = 0)
+    {
+        for (auto it = pending_.begin(); it != pending_.end();)
+        {
+            if (delay_ms <= 0 || limiter_.admit(it->first))
+            {
+                present(it->first, it->second);
+                dropped_--;
+                it = pending_.erase(it);
+            }
+            else
+            {
+                ++it;
+            }
+        }
+        return key(delay_ms);
+    }
+
+    virtual void close(const std::string &window) { pending_.erase(window); }
+    virtual void close_all() { pending_.clear(); }
+
+    /**
+     * True when a person can interact with the windows (trackbars, mouse callbacks)
+     */
+    virtual bool interactive() const { return false; }
+
+    virtual const char *name() const = 0;
+
+    void set_max_fps(double max_fps) { limiter_.set_max_fps(max_fps); }
+
+    void report(std::ostream &out) const
+    {
+        out << "Display (" << name() << "): " << presented_ << " frames presented, " << dropped_
+            << " dropped by the frame-rate limit" << std::endl;
+    }
+
+    long presented() const { return presented_; }
+    long dropped() const { return dropped_; }
+
+protected:
+    virtual void present_frame(const std::string &window, const cv::Mat &img) = 0;
+    virtual int key(int delay_ms) = 0;
+
+private:
+    void present(const std::string &window, const cv::Mat &img)
+    {
+        INSTRUMENT_SCOPE("display.present");
+        present_frame(window, img);
+        presented_++;
+    }
+
+    FrameRateLimiter limiter_;
+    std::map<std::string, cv::Mat> pending_; // newest dropped frame per window
+    long presented_ = 0;
+    long dropped_ = 0;
+};
+
+class HighguiSink : public DisplaySink
+{
+public:
+    void close(const std::string &window) override
+    {
+        DisplaySink::close(window);
+        cv::destroyWindow(window);
+    }
+
+    void close_all() override
+    {
+        DisplaySink::close_all();
+        cv::destroyAllWindows();
+    }
+
+    bool interactive() const override { return true; }
+    const char *name() const override { return "highgui"; }
+
+protected:
+    void present_frame(const std::string &window, const cv::Mat &img) override
+    {
+        cv::namedWindow(window, cv::WINDOW_GUI_EXPANDED);
+        cv::imshow(window, img);
+    }
+
+    int key(int delay_ms) override { return cv::waitKey(delay_ms); }
+};
+
+/**
+ * Base of the sinks without a display: ESC after a number of waits
+ */
+class HeadlessSink : public DisplaySink
+{
+public:
+    explicit HeadlessSink(long max_waits) : max_waits_(max_waits) {}
+
+protected:
+    int key(int) override { return max_waits_ > 0 && ++waits_ >= max_waits_ ? DISPLAY_KEY_ESC : -1; }
+
+private:
+    long max_waits_;
+    long waits_ = 0;
+};
+
+class NullSink : public HeadlessSink
+{
+public:
+    explicit NullSink(long max_waits = DISPLAY_HEADLESS_WAITS) : HeadlessSink(max_waits) {}
+
+    const char *name() const override { return "null"; }
+
+protected:
+    void present_frame(const std::string &, const cv::Mat &) override {}
+};
+
+/**
+ * Records presented frames on a writer thread (encoding never runs on the caller's thread)
+ */
+class OffscreenSink : public HeadlessSink
+{
+public:
+    /**
+     * @param dir Output directory, created if needed
+     * @param video true: one MJPG .avi per window, false: one PNG per frame
+     */
+    OffscreenSink(const std::string &dir, bool video, long max_waits = DISPLAY_HEADLESS_WAITS)
+        : HeadlessSink(max_waits), dir_(dir), video_(video)
+    {
+        std::error_code ec;
+        std::filesystem::create_directories(dir_, ec);
+        if (ec)
+        {
+            std::cerr << "Error: Could not create display output directory '" << dir_ << "'!" << std::endl;
+        }
+        writer_ = std::thread([this]() { write_frames(); });
+    }
+
+    /**
+     * Writes the frames still queued, then closes the files
+     */
+    ~OffscreenSink() override
+    {
+        {
+            std::lock_guard<std::mutex> lock(mutex_);
+            stopping_ = true;
+        }
+        ready_.notify_all();
+        writer_.join();
+    }
+
+    const char *name() const override { return video_ ? "video" : "offscreen"; }
+
+protected:
+    /**
+     * Queues a copy of the frame; waits when the writer is DISPLAY_QUEUE_FRAMES behind, so memory stays bounded
+     */
+    void present_frame(const std::string &window, const cv::Mat &img) override
+    {
+        cv::Mat copy = img.clone();
+        std::unique_lock<std::mutex> lock(mutex_);
+        space_.wait(lock, [&]() { return queue_.size() < DISPLAY_QUEUE_FRAMES; });
+        queue_.push_back({window, std::move(copy)});
+        ready_.notify_one();
+    }
+
+private:
+    struct QueuedFrame
+    {
+        std::string window;
+        cv::Mat image;
+    };
+
+    struct Output
+    {
+        cv::VideoWriter video;
+        cv::Size size;
+        long frames = 0;
+        bool failed = false; // the video could not be opened: the window is no longer recorded
+    };
+
+    /**
+     * Window title as a file name: letters and digits kept, every other run of characters becomes '_'
+     */
+    static std::string file_stem(const std::string &window)
+    {
+        std::string stem;
+        for (char c : window)
+        {
+            if (std::isalnum(static_cast<unsigned char>(c)))
+            {
+                stem += c;
+            }
+            else if (!stem.empty() && stem.back() != '_')
+            {
+                stem += '_';
+            }
+        }
+        while (!stem.empty() && stem.back() == '_')
+        {
+            stem.pop_back();
+        }
+        return stem.empty() ? "window" : stem;
+    }
+
+    void write_frames()
+    {
+        std::map<std::string, Output> outputs;
+        for (;;)
+        {
+            QueuedFrame frame;
+            {
+                std::unique_lock<std::mutex> lock(mutex_);
+                ready_.wait(lock, [&]() { return stopping_ || !queue_.empty(); });
+                if (queue_.empty())
+                {
+                    break;
+                }
+                frame = std::move(queue_.front());
+                queue_.pop_front();
+            }
+            space_.notify_one();
+
+            Output &out = outputs[frame.window];
+            if (out.failed)
+            {
+                continue;
+            }
+            const std::string stem = dir_ + "/" + file_stem(frame.window);
+            cv::Mat image = frame.image;
+            if (image.depth() != CV_8U)
+            {
+                // Same display mapping as imshow: 16-bit / 256, float * 255
+                image.convertTo(image, CV_8U, image.depth() == CV_16U ? 1.0 / 256.0 : 255.0);
+            }
+            if (video_)
+            {
+                if (!out.video.isOpened())
+                {
+                    out.size = image.size();
+                    out.video.open(stem + ".avi", cv::VideoWriter::fourcc('M', 'J', 'P', 'G'), DISPLAY_VIDEO_FPS,
+                                   out.size, true);
+                    if (!out.video.isOpened())
+                    {
+                        std::cerr << "Error: Could not open video '" << stem << ".avi', not recording window '"
+                                  << frame.window << "'!" << std::endl;
+                        out.failed = true;
+                        continue;
+                    }
+                }
+                if (image.size() != out.size)
+                {
+                    cv::resize(image, image, out.size);
+                }
+                if (image.channels() == 1)
+                {
+                    cv::cvtColor(image, image, cv::COLOR_GRAY2BGR);
+                }
+                out.video.write(image);
+            }
+            else
+            {
+                char index[16];
+                std::snprintf(index, sizeof(index), "_%06ld.png", out.frames + 1);
+                if (!cv::imwrite(stem + index, image))
+                {
+                    std::cerr << "Error: Could not write '" << stem + index << "'!" << std::endl;
+                }
+            }
+            out.frames++;
+        }
+    }
+
+    std::string dir_;
+    bool video_;
+    std::deque<QueuedFrame> queue_;
+    std::mutex mutex_;
+    std::condition_variable ready_;
+    std::condition_variable space_;
+    bool stopping_ = false;
+    std::thread writer_;
+};
+
+/**
+ * Builds a sink from a spec: "highgui", "null", "offscreen:DIR" or "video:DIR" (nullptr if unknown)
+ */
+inline std::unique_ptr<DisplaySink> make_display_sink(const std::string &spec)
+{
+    long max_waits = DISPLAY_HEADLESS_WAITS;
+    if (const char *waits = std::getenv("CV_LESSONS_HEADLESS_WAITS"))
+    {
+        max_waits = std::atol(waits);
+    }
+    const size_t colon = spec.find(':');
+    const std::string kind = spec.substr(0, colon);
+    const std::string dir = colon == std::string::npos ? "display_output" : spec.substr(colon + 1);
+    if (kind == "highgui")
+    {
+        return std::make_unique<HighguiSink>();
+    }
+    if (kind == "null")
+    {
+        return std::make_unique<NullSink>(max_waits);
+    }
+    if (kind == "offscreen" || kind == "video")
+    {
+        return std::make_unique<OffscreenSink>(dir, kind == "video", max_waits);
+    }
+    std::cerr << "Error: Unknown display '" << spec << "' (highgui, null, offscreen:DIR or video:DIR)!" << std::endl;
+    return nullptr;
+}
+
+inline std::unique_ptr<DisplaySink> &display_sink_slot()
+{
+    static std::unique_ptr<DisplaySink> sink;
+    return sink;
+}
+
+/**
+ * Replaces the process-wide sink (e.g. a NullSink in a benchmark)
+ */
+inline void set_display_sink(std::unique_ptr<DisplaySink> sink)
+{
+    display_sink_slot() = std::move(sink);
+}
+
+/**
+ * Process-wide sink, created from CV_LESSONS_DISPLAY and CV_LESSONS_MAX_FPS on first use
+ */
+inline DisplaySink &display_sink()
+{
+    std::unique_ptr<DisplaySink> &sink = display_sink_slot();
+    if (!sink)
+    {
+        const char *spec = std::getenv("CV_LESSONS_DISPLAY");
+        if (spec != nullptr && spec[0] != '\0')
+        {
+            sink = make_display_sink(spec);
+        }
+        if (!sink)
+        {
+#if defined(__linux__)
+            const bool has_display = std::getenv("DISPLAY") != nullptr || std::getenv("WAYLAND_DISPLAY") != nullptr;
+#else
+            const bool has_display = true;
+#endif
+            sink = has_display ? make_display_sink("highgui") : make_display_sink("null");
+        }
+        if (const char *fps = std::getenv("CV_LESSONS_MAX_FPS"))
+        {
+            sink->set_max_fps(std::atof(fps));
+        }
+    }
+    return *sink;
+}
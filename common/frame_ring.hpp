@@ -0,0 +1,547 @@
+#pragma once
+
+#include <algorithm>
+#include <atomic>
+#include <cerrno>
+#include <chrono>
+#include <climits>
+#include <csignal>
+#include <cstdint>
+#include <iostream>
+#include <string>
+#include <thread>
+#include <unistd.h>
+#include <opencv2/opencv.hpp>
+#include "instrumentation.hpp"
+#include "shared_memory.hpp"
+
+#ifdef __linux__
+#include <linux/futex.h>
+#include <sys/syscall.h>
+#endif
+
+/*
+ * Shared-memory ring of frames between processes: one writer (e.g. the capture process) and up to
+ * FRAME_RING_MAX_READERS readers, without encoding or copying the pixels.
+ *
+ *   writer                                      every reader
+ *   FrameWriter w; w.create("/cam", 4, bytes)   FrameReader r; r.open("/cam")
+ *   cv::Mat slot = w.begin(size, CV_8UC3)       FrameView f;
+ *   cv::cvtColor(src, slot, ...)  // in place   while (r.acquire(f, 100)) { use f.image; r.release(); }
+ *   w.commit()
+ *
+ * Layout: FrameRingHeader, then slot_count slots of (FrameSlotHeader + pixels). begin() returns a cv::Mat
+ * over the next slot, acquire() a cv::Mat over the oldest unread one.
+ * The writer owns the segment and unlinks it when it is closed or destroyed, unless close(true) hands it
+ * over to the readers for frames published by a writer that exits first.
+ *
+ * Sequence protocol: frame n goes to slot n % slot_count. The slot sequence is 2n + 1 while the writer
+ * fills it and 2n + 2 once published, so a reader can tell whether the frame it holds is still the frame
+ * it acquired (seqlock). Every reader has its own cursor in the header, so every reader sees every frame.
+ *   - block_when_full: the writer waits until the slowest reader released the frame it would overwrite
+ *     (readers whose process died are detached)
+ *   - otherwise the writer never waits and a slow reader skips to the oldest frame still in the ring;
+ *     release() then reports whether the frame was overwritten while it was in use
+ *
+ * Waiting uses a futex on Linux (woken only when someone actually waits) and short sleeps elsewhere.
+ */
+
+#define FRAME_RING_MAGIC 0x474E4952u // "RING"
+#define FRAME_RING_MAX_READERS 8
+#define FRAME_RING_POLL_US 200 // sleep between checks where futexes are not available
+
+// Reader slot states: a reader claims a free slot, fills in pid and cursor, then marks it active.
+// The writer only looks at active slots, so it never sees a half-attached reader
+#define RING_READER_FREE 0u
+#define RING_READER_CLAIMED 1u
+#define RING_READER_ACTIVE 2u
+
+static_assert(std::atomic<uint64_t>::is_always_lock_free && sizeof(std::atomic<uint32_t>) == sizeof(uint32_t),
+              "the ring needs address-free atomics in shared memory");
+
+struct alignas(64) RingReaderSlot
+{
+    std::atomic<uint32_t> active; // RING_READER_FREE, RING_READER_CLAIMED or RING_READER_ACTIVE
+    std::atomic<int32_t> pid;
+    std::atomic<uint64_t> next; // next frame this reader will acquire
+};
+
+struct FrameRingHeader
+{
+    std::atomic<uint32_t> magic; // set last by the writer, once the ring is initialized
+    uint32_t slot_count;
+    uint32_t block_when_full;
+    uint64_t slot_bytes;  // pixel capacity of a slot
+    uint64_t slot_stride; // FrameSlotHeader + pixels
+    alignas(64) std::atomic<uint64_t> written; // frames published so far
+    std::atomic<uint32_t> published;           // bumped on every publish (futex word of the readers)
+    std::atomic<uint32_t> reader_waiters;
+    alignas(64) std::atomic<uint32_t> released; // bumped on every release (futex word of the writer)
+    std::atomic<uint32_t> writer_waiters;
+    RingReaderSlot readers[FRAME_RING_MAX_READERS];
+};
+
+struct alignas(64) FrameSlotHeader
+{
+    std::atomic<uint64_t> seq; // 2n + 1 while frame n is written, 2n + 2 once published
+    int32_t rows;
+    int32_t cols;
+    int32_t type;
+    uint64_t step;
+    int64_t timestamp_ns; // steady clock of the writer at commit
+};
+
+struct FrameView
+{
+    cv::Mat image; // view over the slot: read only, valid until release()
+    uint64_t frame = 0;
+    int64_t timestamp_ns = 0;
+};
+
+/**
+ * Waits until word != seen, or for timeout_ms (< 0: no limit); spurious returns are fine
+ */
+inline void ring_wait(std::atomic<uint32_t> &word, uint32_t seen, int timeout_ms)
+{
+#ifdef __linux__
+    timespec ts{timeout_ms / 1000, (timeout_ms % 1000) * 1000000L};
+    ::syscall(SYS_futex, reinterpret_cast<uint32_t *>(&word), FUTEX_WAIT, seen, timeout_ms < 0 ? nullptr : &ts,
+              nullptr, 0);
+#else
+    (void)timeout_ms;
+    if (word.load() == seen)
+    {
+        std::this_thread::sleep_for(std::chrono::microseconds(FRAME_RING_POLL_US));
+    }
+#endif
+}
+
+inline void ring_wake(std::atomic<uint32_t> &word)
+{
+#ifdef __linux__
+    ::syscall(SYS_futex, reinterpret_cast<uint32_t *>(&word), FUTEX_WAKE, INT_MAX, nullptr, nullptr, 0);
+#else
+    (void)word;
+#endif
+}
+
+/**
+ * Bumps a futex word and wakes its waiters, skipping the system call when nobody waits
+ * (both sides use sequentially consistent operations, so a waiter that registered sees the bump)
+ */
+inline void ring_signal(std::atomic<uint32_t> &word, const std::atomic<uint32_t> &waiters)
+{
+    word.fetch_add(1);
+    if (waiters.load() > 0)
+    {
+        ring_wake(word);
+    }
+}
+
+inline int64_t ring_now_ns()
+{
+    return std::chrono::duration_cast<std::chrono::nanoseconds>(std::chrono::steady_clock::now().time_since_epoch())
+        .count();
+}
+
+/**
+ * Pixel bytes of a frame in a slot (rows padded like shared image segments)
+ */
+inline size_t frame_ring_frame_bytes(cv::Size size, int type, size_t *step = nullptr)
+{
+    return shared_image_bytes(size, type, step) - SHARED_IMAGE_ALIGN;
+}
+
+/**
+ * Bytes before the first slot (the ring header, padded)
+ */
+inline size_t frame_ring_header_bytes()
+{
+    return (sizeof(FrameRingHeader) + SHARED_IMAGE_ALIGN - 1) / SHARED_IMAGE_ALIGN * SHARED_IMAGE_ALIGN;
+}
+
+/**
+ * True if slot_count slots of slot_stride bytes, each holding a FrameSlotHeader and slot_bytes pixels,
+ * fit in a segment of size bytes (checked without multiplying, so huge values cannot wrap around)
+ */
+inline bool valid_ring_geometry(uint32_t slot_count, uint64_t slot_bytes, uint64_t slot_stride, size_t size)
+{
+    if (slot_count < 2 || slot_stride < sizeof(FrameSlotHeader) || slot_stride % alignof(FrameSlotHeader) != 0 ||
+        slot_bytes > slot_stride - sizeof(FrameSlotHeader) || size < frame_ring_header_bytes())
+    {
+        return false;
+    }
+    return slot_count <= (size - frame_ring_header_bytes()) / slot_stride;
+}
+
+inline FrameSlotHeader *ring_slot(const SharedMemory &shm, uint32_t slot_count, uint64_t slot_stride, uint64_t frame)
+{
+    uchar *slots = shm.data() + frame_ring_header_bytes();
+    return reinterpret_cast<FrameSlotHeader *>(slots + (frame % slot_count) * slot_stride);
+}
+
+inline FrameSlotHeader *ring_slot(const SharedMemory &shm, uint64_t frame)
+{
+    const FrameRingHeader *h = reinterpret_cast<const FrameRingHeader *>(shm.data());
+    return ring_slot(shm, h->slot_count, h->slot_stride, frame);
+}
+
+class FrameWriter
+{
+public:
+    FrameWriter() = default;
+    ~FrameWriter() { close(); }
+    FrameWriter(const FrameWriter &) = delete;
+    FrameWriter &operator=(const FrameWriter &) = delete;
+
+    /**
+     * Creates a fresh ring (an old segment with the same name is replaced; its readers stay on the old one)
+     * @param max_frame_bytes Largest frame, see frame_ring_frame_bytes()
+     */
+    bool create(const std::string &name, int slot_count, size_t max_frame_bytes, bool block_when_full = false)
+    {
+        if (slot_count < 2 || max_frame_bytes == 0)
+        {
+            std::cerr << "Error: A frame ring needs at least 2 slots and a frame size!" << std::endl;
+            return false;
+        }
+        const size_t header = frame_ring_header_bytes();
+        const size_t payload = (max_frame_bytes + SHARED_IMAGE_ALIGN - 1) / SHARED_IMAGE_ALIGN * SHARED_IMAGE_ALIGN;
+        const size_t stride = sizeof(FrameSlotHeader) + payload;
+        SharedMemory::unlink(name);
+        if (!shm_.create(name, header + stride * static_cast<size_t>(slot_count)))
+        {
+            return false;
+        }
+        // A new segment is zero-filled, which is a valid state for every atomic
+        FrameRingHeader *h = header_();
+        h->slot_count = static_cast<uint32_t>(slot_count);
+        h->block_when_full = block_when_full ? 1 : 0;
+        h->slot_bytes = payload;
+        h->slot_stride = stride;
+        h->magic.store(FRAME_RING_MAGIC, std::memory_order_release);
+        open_ = false;
+        return true;
+    }
+
+    /**
+     * Unmaps the ring and, unless keep_segment, unlinks its name (only if the name still refers to this
+     * ring). The writer owns the segment: attached readers keep their mapping, new readers can no longer
+     * open it. With keep_segment the segment outlives the writer, and whoever reads it last unlinks it
+     */
+    void close(bool keep_segment = false)
+    {
+        if (shm_.is_open() && !keep_segment && shm_.is_current())
+        {
+            SharedMemory::unlink(shm_.name());
+        }
+        shm_.close();
+        open_ = false;
+    }
+
+    /**
+     * Lays out the next frame and returns the view to write it into (empty if the frame does not fit,
+     * or if the ring is full in blocking mode and timeout_ms passed)
+     */
+    cv::Mat begin(cv::Size size, int type, int timeout_ms = -1)
+    {
+        size_t step = 0;
+        if (!shm_.is_open() || frame_ring_frame_bytes(size, type, &step) > header_()->slot_bytes || size.empty())
+        {
+            std::cerr << "Error: Frame does not fit in the ring slots!" << std::endl;
+            return cv::Mat();
+        }
+        FrameRingHeader *h = header_();
+        const uint64_t n = h->written.load(std::memory_order_relaxed);
+        if (h->block_when_full && !wait_for_readers(n, timeout_ms))
+        {
+            return cv::Mat();
+        }
+        FrameSlotHeader *slot = ring_slot(shm_, n);
+        slot->seq.store(2 * n + 1, std::memory_order_relaxed);
+        std::atomic_thread_fence(std::memory_order_release); // readers see the odd sequence before new pixels
+        slot->rows = size.height;
+        slot->cols = size.width;
+        slot->type = type;
+        slot->step = step;
+        open_ = true;
+        return cv::Mat(size, type, reinterpret_cast<uchar *>(slot) + sizeof(FrameSlotHeader), step);
+    }
+
+    /**
+     * Publishes the frame laid out by begin()
+     */
+    void commit()
+    {
+        if (!open_)
+        {
+            return;
+        }
+        FrameRingHeader *h = header_();
+        const uint64_t n = h->written.load(std::memory_order_relaxed);
+        FrameSlotHeader *slot = ring_slot(shm_, n);
+        slot->timestamp_ns = ring_now_ns();
+        slot->seq.store(2 * n + 2, std::memory_order_release);
+        h->written.store(n + 1, std::memory_order_release);
+        ring_signal(h->published, h->reader_waiters);
+        open_ = false;
+        INSTRUMENT_COUNT("ring.frames_written", 1);
+    }
+
+    /**
+     * Copies a frame into the ring (begin + copyTo + commit) for frames that already exist
+     */
+    bool write(const cv::Mat &frame, int timeout_ms = -1)
+    {
+        cv::Mat slot = begin(frame.size(), frame.type(), timeout_ms);
+        if (slot.empty())
+        {
+            return false;
+        }
+        frame.copyTo(slot);
+        commit();
+        return true;
+    }
+
+    uint64_t frames_written() const { return shm_.is_open() ? header_()->written.load() : 0; }
+    const std::string &name() const { return shm_.name(); }
+
+private:
+    FrameRingHeader *header_() const { return reinterpret_cast<FrameRingHeader *>(shm_.data()); }
+
+    /**
+     * Blocking mode: waits until every attached reader is past frame n - slot_count (the one n overwrites)
+     */
+    bool wait_for_readers(uint64_t n, int timeout_ms)
+    {
+        FrameRingHeader *h = header_();
+        const auto deadline = std::chrono::steady_clock::now() + std::chrono::milliseconds(timeout_ms);
+        while (true)
+        {
+            const uint32_t seen = h->released.load();
+            bool room = true;
+            for (RingReaderSlot &reader : h->readers)
+            {
+                if (reader.active.load() == RING_READER_ACTIVE && reader.next.load() + h->slot_count <= n)
+                {
+                    if (::kill(reader.pid.load(), 0) != 0 && errno == ESRCH)
+                    {
+                        // The reader's process died without detaching (the slot is left alone if it was
+                        // detached and claimed again in the meantime)
+                        uint32_t expected = RING_READER_ACTIVE;
+                        reader.active.compare_exchange_strong(expected, RING_READER_FREE);
+                        continue;
+                    }
+                    room = false;
+                }
+            }
+            if (room)
+            {
+                return true;
+            }
+            int wait_ms = 10; // wake up now and then to notice dead readers
+            if (timeout_ms >= 0)
+            {
+                const auto left = std::chrono::duration_cast<std::chrono::milliseconds>(deadline - std::chrono::steady_clock::now());
+                if (left.count() <= 0)
+                {
+                    return false;
+                }
+                wait_ms = std::min<int>(wait_ms, static_cast<int>(left.count()));
+            }
+            INSTRUMENT_SCOPE("ring.writer_wait");
+            h->writer_waiters.fetch_add(1);
+            ring_wait(h->released, seen, wait_ms);
+            h->writer_waiters.fetch_sub(1);
+        }
+    }
+
+    SharedMemory shm_;
+    bool open_ = false;
+};
+
+class FrameReader
+{
+public:
+    FrameReader() = default;
+    ~FrameReader() { close(); }
+    FrameReader(const FrameReader &) = delete;
+    FrameReader &operator=(const FrameReader &) = delete;
+
+    /**
+     * Attaches to a ring; the first frame acquired is the next one published, or with from_oldest the
+     * oldest frame still in the ring (for a writer that published before the reader started)
+     * The slot layout is checked against the segment size once and kept here, so a header rewritten
+     * later cannot move the reader outside the mapping
+     * @return false if the ring does not exist (yet), is malformed, or all reader slots are taken
+     */
+    bool open(const std::string &name, bool from_oldest = false)
+    {
+        close();
+        if (!shm_.open(name, true) || shm_.size() < sizeof(FrameRingHeader) ||
+            header_()->magic.load(std::memory_order_acquire) != FRAME_RING_MAGIC)
+        {
+            shm_.close();
+            return false;
+        }
+        FrameRingHeader *h = header_();
+        slot_count_ = h->slot_count;
+        slot_bytes_ = h->slot_bytes;
+        slot_stride_ = h->slot_stride;
+        if (!valid_ring_geometry(slot_count_, slot_bytes_, slot_stride_, shm_.size()))
+        {
+            std::cerr << "Error: '" << name << "' is not a valid frame ring!" << std::endl;
+            shm_.close();
+            return false;
+        }
+        for (int i = 0; i < FRAME_RING_MAX_READERS; i++)
+        {
+            uint32_t expected = RING_READER_FREE;
+            if (h->readers[i].active.compare_exchange_strong(expected, RING_READER_CLAIMED))
+            {
+                reader_ = &h->readers[i];
+                reader_->pid.store(static_cast<int32_t>(::getpid()));
+                const uint64_t written = h->written.load();
+                const uint64_t oldest = written >= slot_count_ ? written - slot_count_ : 0;
+                reader_->next.store(from_oldest ? oldest : written);
+                reader_->active.store(RING_READER_ACTIVE); // publishes pid and cursor to the writer
+                dropped_ = 0;
+                return true;
+            }
+        }
+        std::cerr << "Error: Frame ring '" << name << "' already has " << FRAME_RING_MAX_READERS << " readers!"
+                  << std::endl;
+        shm_.close();
+        return false;
+    }
+
+    void close()
+    {
+        if (reader_ != nullptr)
+        {
+            reader_->active.store(RING_READER_FREE);
+            ring_signal(header_()->released, header_()->writer_waiters); // a blocked writer may go on
+            reader_ = nullptr;
+        }
+        shm_.close();
+    }
+
+    /**
+     * Acquires the oldest unread frame, waiting up to timeout_ms (< 0: no limit) for one to be published
+     * Frames overwritten before they could be read are skipped and counted in dropped()
+     */
+    bool acquire(FrameView &view, int timeout_ms = -1)
+    {
+        if (reader_ == nullptr)
+        {
+            return false;
+        }
+        FrameRingHeader *h = header_();
+        const auto deadline = std::chrono::steady_clock::now() + std::chrono::milliseconds(timeout_ms);
+        uint64_t next = reader_->next.load(std::memory_order_relaxed);
+        while (true)
+        {
+            const uint32_t seen = h->published.load();
+            const uint64_t written = h->written.load(std::memory_order_acquire);
+            if (next < written)
+            {
+                // Older frames are gone; the sequence check below catches a slot that is being refilled
+                if (written - next > slot_count_)
+                {
+                    const uint64_t oldest = written - slot_count_;
+                    dropped_ += oldest - next;
+                    INSTRUMENT_COUNT("ring.frames_dropped", oldest - next);
+                    next = oldest;
+                }
+                FrameSlotHeader *slot = ring_slot(shm_, slot_count_, slot_stride_, next);
+                if (slot->seq.load(std::memory_order_acquire) == 2 * next + 2)
+                {
+                    // The fields may be rewritten under us: copy them, and use them only once the sequence
+                    // is confirmed unchanged and they describe a frame that fits the slot
+                    const int rows = slot->rows;
+                    const int cols = slot->cols;
+                    const int type = slot->type;
+                    const uint64_t step = slot->step;
+                    const int64_t timestamp_ns = slot->timestamp_ns;
+                    std::atomic_thread_fence(std::memory_order_acquire);
+                    if (slot->seq.load(std::memory_order_relaxed) == 2 * next + 2 &&
+                        valid_layout(rows, cols, type, step, slot_bytes_))
+                    {
+                        uchar *pixels = reinterpret_cast<uchar *>(slot) + sizeof(FrameSlotHeader);
+                        view.image = cv::Mat(rows, cols, type, pixels, static_cast<size_t>(step));
+                        view.frame = next;
+                        view.timestamp_ns = timestamp_ns;
+                        current_ = next;
+                        holding_ = true;
+                        reader_->next.store(next, std::memory_order_relaxed);
+                        return true;
+                    }
+                }
+                next++; // overwritten in the meantime: look again from the newer frames
+                dropped_++;
+                continue;
+            }
+            int wait_ms = -1;
+            if (timeout_ms >= 0)
+            {
+                const auto left = std::chrono::duration_cast<std::chrono::milliseconds>(deadline - std::chrono::steady_clock::now());
+                if (left.count() <= 0)
+                {
+                    reader_->next.store(next, std::memory_order_relaxed);
+                    return false;
+                }
+                wait_ms = static_cast<int>(left.count());
+            }
+            h->reader_waiters.fetch_add(1);
+            ring_wait(h->published, seen, wait_ms);
+            h->reader_waiters.fetch_sub(1);
+        }
+    }
+
+    /**
+     * Releases the acquired frame
+     * @return false if the writer overwrote it while it was in use (never happens in blocking mode)
+     */
+    bool release()
+    {
+        if (!holding_)
+        {
+            return false;
+        }
+        std::atomic_thread_fence(std::memory_order_acquire); // pixel reads happen before the check
+        const FrameSlotHeader *slot = ring_slot(shm_, slot_count_, slot_stride_, current_);
+        const bool intact = slot->seq.load(std::memory_order_relaxed) == 2 * current_ + 2;
+        holding_ = false;
+        reader_->next.store(current_ + 1, std::memory_order_release);
+        ring_signal(header_()->released, header_()->writer_waiters);
+        return intact;
+    }
+
+    bool is_open() const { return reader_ != nullptr; }
+    uint64_t dropped() const { return dropped_; }
+
+private:
+    FrameRingHeader *header_() const { return reinterpret_cast<FrameRingHeader *>(shm_.data()); }
+
+    /**
+     * True if a slot header describes a frame that lies inside the slot's pixel capacity
+     */
+    static bool valid_layout(int rows, int cols, int type, uint64_t step, uint64_t slot_bytes)
+    {
+        if (rows <= 0 || cols <= 0 || type < 0 || CV_MAT_TYPE(type) != type)
+        {
+            return false;
+        }
+        const uint64_t row_bytes = static_cast<uint64_t>(cols) * CV_ELEM_SIZE(type);
+        return step >= row_bytes && step <= slot_bytes && static_cast<uint64_t>(rows) <= slot_bytes / step;
+    }
+
+    SharedMemory shm_;
+    RingReaderSlot *reader_ = nullptr;
+    uint32_t slot_count_ = 0; // geometry validated in open()
+    uint64_t slot_bytes_ = 0;
+    uint64_t slot_stride_ = 0;
+    uint64_t current_ = 0;
+    uint64_t dropped_ = 0;
+    bool holding_ = false;
+};
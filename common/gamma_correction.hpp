@@ -0,0 +1,207 @@
+#pragma once
+
+#include <bit>
+#include <cmath>
+#include <cstdint>
+#include <iostream>
+#include <vector>
+#include <opencv2/opencv.hpp>
+#include "instrumentation.hpp"
+#include "pixel_depth.hpp"
+
+/**
+ * Fast log2 for positive normal floats
+ * Exponent from the float bits, mantissa through a short atanh series on [sqrt(0.5), sqrt(2))
+ * Absolute error below 4e-6 over the whole float range (mostly rounding of the float result)
+ */
+inline float fast_log2(float x)
+{
+    uint32_t bits = std::bit_cast<uint32_t>(x);
+    int exponent = static_cast<int>((bits >> 23) & 0xFF) - 127;
+    float m = std::bit_cast<float>((bits & 0x007FFFFFu) | 0x3F800000u); // mantissa in [1, 2)
+
+    // Center the mantissa around 1 so the series converges fast
+    int big = m > 1.41421356f;
+    m *= 1.0f - 0.5f * static_cast<float>(big);
+    exponent += big;
+
+    // log2(m) = 2/ln(2) * atanh(s), s = (m - 1) / (m + 1), |s| < 0.172
+    float s = (m - 1.0f) / (m + 1.0f);
+    float s2 = s * s;
+    float p = s * (2.88539008f + s2 * (0.961796694f + s2 * (0.577078016f + s2 * 0.412198583f)));
+    return static_cast<float>(exponent) + p;
+}
+
+/**
+ * Fast 2^y for y in [-126, 128)
+ * Integer part goes into the float exponent, fractional part in [-0.5, 0.5] through a degree 6 polynomial
+ * Relative error below 3e-7
+ */
+inline float fast_exp2(float y)
+{
+    // Clamp without selects: float ternaries keep GCC from vectorizing the calling loop
+    y += static_cast<float>(y < -126.0f) * (-126.0f - y);
+    y += static_cast<float>(y > 127.99f) * (127.99f - y);
+    int n = static_cast<int>(y + 128.5f) - 128; // round to nearest; truncation is floor since y + 128.5 > 0
+    float f = y - static_cast<float>(n);
+    float p = 1.0f + f * (0.693147182f + f * (0.240226507f + f * (0.0555041087f +
+                      f * (0.00961812911f + f * (0.00133335581f + f * 0.000154035304f)))));
+    float scale = std::bit_cast<float>(static_cast<uint32_t>(n + 127) << 23);
+    return p * scale;
+}
+
+/**
+ * Fast x^p for x >= 0, built on fast_log2/fast_exp2 (branch free, vectorizes)
+ * Relative error below 5e-6 for p in [0.1, 4] and x up to 8 (HDR headroom above white)
+ */
+inline float fast_pow(float x, float p)
+{
+    float r = fast_exp2(p * fast_log2(x));
+
+    // Zero, negatives and denormals map to 0 (integer test on the bits, masked without a branch)
+    uint32_t keep = 0u - static_cast<uint32_t>(std::bit_cast<int32_t>(x) >= 0x00800000);
+    return std::bit_cast<float>(std::bit_cast<uint32_t>(r) & keep);
+}
+
+/**
+ * Builds the 256-entry table for 8-bit gamma correction (cv::LUT), shared by gammaCorrectionLUT, the batch
+ * operations, the parameter sweeps and the processing service
+ * @param gamma Gamma value, output = max * (input / max)^(1/gamma)
+ * @param max_value White level (255 for full range)
+ */
+inline cv::Mat gamma_table_8u(double gamma, double max_value = 255.0)
+{
+    cv::Mat lookup_table(1, 256, CV_8U);
+    uchar *p = lookup_table.ptr();
+    for (int i = 0; i < 256; i++)
+    {
+        p[i] = cv::saturate_cast<uchar>(std::pow(std::min(i / max_value, 1.0), 1.0 / gamma) * max_value);
+    }
+    return lookup_table;
+}
+
+/**
+ * Builds (and caches) the 65536-entry table for 16-bit gamma correction
+ * @param gamma Gamma value, output = max * (input / max)^(1/gamma)
+ * @param max_value White level (65535 for full range, 4095 for 12-bit raw...)
+ */
+inline const std::vector<ushort> &gamma_table_16u(double gamma, double max_value)
+{
+    // One cached table per thread: re-applying the same gamma (video, sweeps) skips 65536 pow calls
+    thread_local double cached_gamma = 0.0;
+    thread_local double cached_max = 0.0;
+    thread_local std::vector<ushort> table(65536);
+
+    if (cached_gamma != gamma || cached_max != max_value)
+    {
+        INSTRUMENT_SCOPE("lut.gamma_table_16u");
+        double inv_gamma = 1.0 / gamma;
+        for (int i = 0; i < 65536; i++)
+        {
+            double v = std::min(static_cast<double>(i), max_value) / max_value;
+            table[i] = cv::saturate_cast<ushort>(std::pow(v, inv_gamma) * max_value);
+        }
+        cached_gamma = gamma;
+        cached_max = max_value;
+    }
+    return table;
+}
+
+/**
+ * Gamma correction for CV_16U images through a 65536-entry table
+ */
+inline cv::Mat gamma_correction_16u(const cv::Mat &img, double gamma, double max_value)
+{
+    INSTRUMENT_SCOPE("lut.gamma_correction_16u");
+    const std::vector<ushort> &table = gamma_table_16u(gamma, max_value);
+    const ushort *lut = table.data();
+
+    cv::Mat result(img.size(), img.type());
+    const int row_len = img.cols * img.channels();
+    cv::parallel_for_(cv::Range(0, img.rows), [&](const cv::Range &range) {
+        for (int y = range.start; y < range.end; y++)
+        {
+            const ushort *in = img.ptr<ushort>(y);
+            ushort *out = result.ptr<ushort>(y);
+            for (int x = 0; x < row_len; x++)
+            {
+                out[x] = lut[in[x]];
+            }
+        }
+    });
+    return result;
+}
+
+/**
+ * Gamma correction for CV_32F images with the vectorizable fast_pow
+ * Values are treated relative to max_value (1.0 for normalized float images), values above it are kept (HDR)
+ */
+inline cv::Mat gamma_correction_32f(const cv::Mat &img, double gamma, double max_value)
+{
+    INSTRUMENT_SCOPE("lut.gamma_correction_32f");
+    const float inv_gamma = static_cast<float>(1.0 / gamma);
+    const float inv_max = static_cast<float>(1.0 / max_value);
+    const float max_f = static_cast<float>(max_value);
+
+    cv::Mat result(img.size(), img.type());
+    const int row_len = img.cols * img.channels();
+    cv::parallel_for_(cv::Range(0, img.rows), [&](const cv::Range &range) {
+        for (int y = range.start; y < range.end; y++)
+        {
+            const float *in = img.ptr<float>(y);
+            float *out = result.ptr<float>(y);
+            for (int x = 0; x < row_len; x++)
+            {
+                out[x] = fast_pow(in[x] * inv_max, inv_gamma) * max_f;
+            }
+        }
+    });
+    return result;
+}
+
+/**
+ * Applies gamma correction using lookup table (LUT) for better performance
+ * CV_8U uses a 256-entry table, CV_16U a cached 65536-entry table and CV_32F a fast pow approximation,
+ * so 12/16-bit and float images are processed at their native depth
+ * @param max_value White level, 0 means the full range of the depth (255, 65535 or 1.0)
+ */
+inline cv::Mat gammaCorrectionLUT(const cv::Mat &img, double gamma, double max_value = 0.0)
+{
+    if (img.empty() || gamma <= 0.0)
+    {
+        std::cerr << "Error: gammaCorrectionLUT needs a non-empty image and gamma > 0!" << std::endl;
+        return cv::Mat();
+    }
+    if (max_value <= 0.0)
+    {
+        max_value = depth_max_value(img.depth());
+    }
+
+    if (img.depth() == CV_16U)
+    {
+        return gamma_correction_16u(img, gamma, max_value);
+    }
+    if (img.depth() == CV_32F)
+    {
+        return gamma_correction_32f(img, gamma, max_value);
+    }
+    if (img.depth() != CV_8U)
+    {
+        std::cerr << "Error: gammaCorrectionLUT supports CV_8U, CV_16U and CV_32F images!" << std::endl;
+        return cv::Mat();
+    }
+
+    INSTRUMENT_SCOPE("lut.gamma_correction");
+    cv::Mat result;
+
+    // Create lookup table: output = 255 * (input/255)^(1/gamma)
+    cv::Mat lookup_table = gamma_table_8u(gamma, max_value);
+
+    // Apply lookup table
+    {
+        INSTRUMENT_SCOPE("lut.apply");
+        cv::LUT(img, lookup_table, result);
+    }
+
+    return result;
+}
@@ -0,0 +1,299 @@
+#pragma once
+
+#include <algorithm>
+#include <concepts>
+#include <iostream>
+#include <type_traits>
+#include <opencv2/opencv.hpp>
+#include "instrumentation.hpp"
+
+/*
+ * Lazy per-pixel arithmetic on 8-bit images.
+ *
+ *   into(dst) = clamp(1.5 * lazy(a) - lazy(b) / 2 + 30);
+ *
+ * lazy() wraps a cv::Mat, and the operators build an expression type instead of computing anything.
+ * The assignment then runs one parallel loop over chunks of each row: every element goes through the
+ * whole (inlined) expression in float and is stored once, so a chain of N operators costs one pass
+ * instead of N passes with N full-image temporaries.
+ *
+ * Semantics: scalars apply to every channel, image / image gives 0 where the divisor is 0 (like
+ * cv::divide), and the stored value is rounded half to even and saturated (like saturate_cast<uchar>).
+ * Intermediate results are not saturated: wrap a sub-expression in sat() where the eager cv::add /
+ * cv::subtract chain would have clipped.
+ * Images are referenced, not copied, so they must outlive the evaluation (true within one statement).
+ */
+
+#define IMAGE_EXPR_CHUNK 4096
+
+struct ImageExprBase
+{
+};
+
+template <class T>
+concept ImageExpr = std::is_base_of_v<ImageExprBase, T>;
+
+template <class T>
+concept ImageOperand = ImageExpr<T> || std::is_arithmetic_v<T>;
+
+/**
+ * Leaf: one CV_8U image, read through a row pointer set by bind()
+ */
+struct ImageTerm : ImageExprBase
+{
+    const cv::Mat *mat;
+    const uchar *p = nullptr;
+
+    explicit ImageTerm(const cv::Mat &m) : mat(&m) {}
+    void bind(int y, int x0) { p = mat->ptr<uchar>(y) + x0; }
+    float at(int i) const { return p[i]; }
+    bool shape(cv::Size &size, int &channels) const
+    {
+        size = mat->size();
+        channels = mat->channels();
+        return true;
+    }
+    bool check(cv::Size size, int channels) const
+    {
+        return mat->depth() == CV_8U && mat->size() == size && mat->channels() == channels;
+    }
+};
+
+/**
+ * Leaf: a constant
+ */
+struct ConstTerm : ImageExprBase
+{
+    float value;
+
+    explicit ConstTerm(double v) : value(static_cast<float>(v)) {}
+    void bind(int, int) {}
+    float at(int) const { return value; }
+    bool shape(cv::Size &, int &) const { return false; }
+    bool check(cv::Size, int) const { return true; }
+};
+
+template <class Op, ImageExpr L, ImageExpr R>
+struct BinaryExpr : ImageExprBase
+{
+    L l;
+    R r;
+
+    BinaryExpr(const L &left, const R &right) : l(left), r(right) {}
+    void bind(int y, int x0)
+    {
+        l.bind(y, x0);
+        r.bind(y, x0);
+    }
+    float at(int i) const { return Op::apply(l.at(i), r.at(i)); }
+    bool shape(cv::Size &size, int &channels) const { return l.shape(size, channels) || r.shape(size, channels); }
+    bool check(cv::Size size, int channels) const { return l.check(size, channels) && r.check(size, channels); }
+};
+
+template <class Op, ImageExpr E>
+struct UnaryExpr : ImageExprBase
+{
+    E e;
+    Op op;
+
+    UnaryExpr(const E &inner, Op o) : e(inner), op(o) {}
+    void bind(int y, int x0) { e.bind(y, x0); }
+    float at(int i) const { return op(e.at(i)); }
+    bool shape(cv::Size &size, int &channels) const { return e.shape(size, channels); }
+    bool check(cv::Size size, int channels) const { return e.check(size, channels); }
+};
+
+// Float ternaries and std::min/max keep GCC from vectorizing the pixel loop, so selections use
+// comparison results as 0/1 multipliers
+struct AddOp
+{
+    static float apply(float a, float b) { return a + b; }
+};
+struct SubOp
+{
+    static float apply(float a, float b) { return a - b; }
+};
+struct MulOp
+{
+    static float apply(float a, float b) { return a * b; }
+};
+struct DivOp
+{
+    static float apply(float a, float b)
+    {
+        const float zero = static_cast<float>(b == 0.0f);
+        return a / (b + zero) * (1.0f - zero);
+    }
+};
+struct NegOp
+{
+    float operator()(float v) const { return -v; }
+};
+struct AbsOp
+{
+    float operator()(float v) const { return v - 2.0f * v * static_cast<float>(v < 0.0f); }
+};
+struct ClampOp
+{
+    float lo;
+    float hi;
+    float operator()(float v) const
+    {
+        v += static_cast<float>(v < lo) * (lo - v);
+        v += static_cast<float>(v > hi) * (hi - v);
+        return v;
+    }
+};
+
+inline ImageTerm lazy(const cv::Mat &m)
+{
+    return ImageTerm(m);
+}
+
+template <ImageOperand T>
+auto as_expr(const T &v)
+{
+    if constexpr (ImageExpr<T>)
+    {
+        return v;
+    }
+    else
+    {
+        return ConstTerm(static_cast<double>(v));
+    }
+}
+
+template <ImageOperand L, ImageOperand R>
+    requires(ImageExpr<L> || ImageExpr<R>)
+auto operator+(const L &l, const R &r)
+{
+    return BinaryExpr<AddOp, decltype(as_expr(l)), decltype(as_expr(r))>(as_expr(l), as_expr(r));
+}
+
+template <ImageOperand L, ImageOperand R>
+    requires(ImageExpr<L> || ImageExpr<R>)
+auto operator-(const L &l, const R &r)
+{
+    return BinaryExpr<SubOp, decltype(as_expr(l)), decltype(as_expr(r))>(as_expr(l), as_expr(r));
+}
+
+template <ImageOperand L, ImageOperand R>
+    requires(ImageExpr<L> || ImageExpr<R>)
+auto operator*(const L &l, const R &r)
+{
+    return BinaryExpr<MulOp, decltype(as_expr(l)), decltype(as_expr(r))>(as_expr(l), as_expr(r));
+}
+
+template <ImageOperand L, ImageOperand R>
+    requires(ImageExpr<L> || ImageExpr<R>)
+auto operator/(const L &l, const R &r)
+{
+    return BinaryExpr<DivOp, decltype(as_expr(l)), decltype(as_expr(r))>(as_expr(l), as_expr(r));
+}
+
+template <ImageExpr E>
+auto operator-(const E &e)
+{
+    return UnaryExpr<NegOp, E>(e, NegOp());
+}
+
+template <ImageExpr E>
+auto abs(const E &e)
+{
+    return UnaryExpr<AbsOp, E>(e, AbsOp());
+}
+
+template <ImageExpr E>
+auto clamp(const E &e, double lo = 0.0, double hi = 255.0)
+{
+    return UnaryExpr<ClampOp, E>(e, ClampOp{static_cast<float>(lo), static_cast<float>(hi)});
+}
+
+/**
+ * Saturates an intermediate result to [0, 255], like storing it in a CV_8U temporary
+ * (without the rounding: sat(a + 0.4) keeps the .4)
+ */
+template <ImageExpr E>
+auto sat(const E &e)
+{
+    return clamp(e, 0.0, 255.0);
+}
+
+/**
+ * saturate_cast<uchar> without branches: clamp, then round half to even by adding 1.5 * 2^23
+ */
+inline uchar store_u8(float v)
+{
+    v += static_cast<float>(v < 0.0f) * (0.0f - v);
+    v += static_cast<float>(v > 255.0f) * (255.0f - v);
+    v = (v + 12582912.0f) - 12582912.0f;
+    return static_cast<uchar>(static_cast<int>(v));
+}
+
+/**
+ * Evaluates an expression into dst (CV_8U with the size and channels of the images in the expression)
+ * dst may be one of the inputs: every element is read before it is written
+ */
+template <ImageExpr E>
+void evaluate(const E &expr, cv::Mat &dst)
+{
+    cv::Size size;
+    int channels = 0;
+    if (!expr.shape(size, channels) || size.width <= 0 || size.height <= 0)
+    {
+        std::cerr << "Error: Image expression needs at least one non-empty image!" << std::endl;
+        return;
+    }
+    if (!expr.check(size, channels))
+    {
+        std::cerr << "Error: Images in an expression must be CV_8U with the same size and channels!" << std::endl;
+        return;
+    }
+    INSTRUMENT_SCOPE("expr.evaluate");
+    dst.create(size, CV_8UC(channels));
+    const int row_len = size.width * channels;
+    const int chunks = (row_len + IMAGE_EXPR_CHUNK - 1) / IMAGE_EXPR_CHUNK;
+    cv::parallel_for_(cv::Range(0, size.height * chunks), [&](const cv::Range &range) {
+        E local = expr; // every thread binds its own row pointers
+        for (int t = range.start; t < range.end; t++)
+        {
+            const int y = t / chunks;
+            const int x0 = (t % chunks) * IMAGE_EXPR_CHUNK;
+            const int n = std::min(IMAGE_EXPR_CHUNK, row_len - x0);
+            local.bind(y, x0);
+            uchar *d = dst.ptr<uchar>(y) + x0;
+            for (int i = 0; i < n; i++)
+            {
+                d[i] = store_u8(local.at(i));
+            }
+        }
+    });
+}
+
+template <ImageExpr E>
+cv::Mat evaluate(const E &expr)
+{
+    cv::Mat dst;
+    evaluate(expr, dst);
+    return dst;
+}
+
+/**
+ * Assignment target: into(dst) = expression;
+ */
+struct ImageTarget
+{
+    cv::Mat &dst;
+
+    template <ImageExpr E>
+    ImageTarget &operator=(const E &expr)
+    {
+        evaluate(expr, dst);
+        return *this;
+    }
+};
+
+inline ImageTarget into(cv::Mat &dst)
+{
+    return ImageTarget{dst};
+}
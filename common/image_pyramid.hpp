@@ -0,0 +1,301 @@
+#pragma once
+
+#include <algorithm>
+#include <iostream>
+#include <vector>
+#include <opencv2/opencv.hpp>
+#include "instrumentation.hpp"
+
+/*
+ * Multi-resolution image pyramid: level 0 is the full image, level i is 2^i times smaller.
+ * Levels are built on first use and kept, so previews and parameter tuning can work on a small level
+ * and only the final result has to touch the full resolution data.
+ */
+
+#define PYRAMID_MAX_LEVELS 10
+#define PYRAMID_MIN_SIZE 8
+
+enum PyramidFilter
+{
+    PYRAMID_BOX,     // 2x2 average, exact for thresholds on flat regions and cheapest
+    PYRAMID_GAUSSIAN // 5x5 Gaussian (cv::pyrDown), smoother previews
+};
+
+/**
+ * Halves an image with a 2x2 box filter (odd last row/column is dropped)
+ * CV_8U has a dedicated rounded integer kernel, other depths go through cv::resize INTER_AREA
+ */
+inline void downsample_box_2x2(const cv::Mat &src, cv::Mat &dst)
+{
+    const cv::Size half(src.cols / 2, src.rows / 2);
+    if (src.depth() != CV_8U)
+    {
+        cv::resize(src, dst, half, 0, 0, cv::INTER_AREA);
+        return;
+    }
+    dst.create(half, src.type());
+    const int cn = src.channels();
+    const int row_len = half.width * cn;
+
+    cv::parallel_for_(cv::Range(0, half.height), [&](const cv::Range &range) {
+        for (int y = range.start; y < range.end; y++)
+        {
+            const uchar *r0 = src.ptr<uchar>(2 * y);
+            const uchar *r1 = src.ptr<uchar>(2 * y + 1);
+            uchar *out = dst.ptr<uchar>(y);
+            if (cn == 1)
+            {
+                // Simple stride-2 loop: the compiler turns it into pairwise adds on vectors
+                for (int x = 0; x < row_len; x++)
+                {
+                    out[x] = static_cast<uchar>((r0[2 * x] + r0[2 * x + 1] + r1[2 * x] + r1[2 * x + 1] + 2) >> 2);
+                }
+            }
+            else
+            {
+                for (int x = 0; x < row_len; x++)
+                {
+                    int i = (x / cn) * 2 * cn + x % cn;
+                    out[x] = static_cast<uchar>((r0[i] + r0[i + cn] + r1[i] + r1[i + cn] + 2) >> 2);
+                }
+            }
+        }
+    });
+}
+
+/**
+ * Lazily built and cached image pyramid
+ * Not thread safe: build the levels you need before sharing the pyramid between threads
+ */
+class ImagePyramid
+{
+public:
+    ImagePyramid() = default;
+
+    /**
+     * @param base Full resolution image (shared, not copied)
+     * @param filter Downsampling filter used for every level
+     */
+    explicit ImagePyramid(const cv::Mat &base, PyramidFilter filter = PYRAMID_BOX) { reset(base, filter); }
+
+    void reset(const cv::Mat &base, PyramidFilter filter = PYRAMID_BOX)
+    {
+        levels_.assign(1, base);
+        filter_ = filter;
+    }
+
+    bool empty() const { return levels_.empty() || levels_[0].empty(); }
+
+    /**
+     * Number of levels available (the smallest one is still at least PYRAMID_MIN_SIZE pixels wide and high)
+     */
+    int level_count() const
+    {
+        if (empty())
+        {
+            return 0;
+        }
+        int count = 1;
+        cv::Size s = levels_[0].size();
+        while (count < PYRAMID_MAX_LEVELS && s.width / 2 >= PYRAMID_MIN_SIZE && s.height / 2 >= PYRAMID_MIN_SIZE)
+        {
+            s = cv::Size(s.width / 2, s.height / 2);
+            count++;
+        }
+        return count;
+    }
+
+    /**
+     * Returns level i, building the missing levels from the closest cached one
+     */
+    const cv::Mat &level(int i)
+    {
+        if (empty())
+        {
+            std::cerr << "Error: Image pyramid is empty!" << std::endl;
+            static const cv::Mat none;
+            return none;
+        }
+        i = std::clamp(i, 0, level_count() - 1);
+        while (static_cast<int>(levels_.size()) <= i)
+        {
+            INSTRUMENT_SCOPE("pyramid.build_level");
+            const cv::Mat &prev = levels_.back();
+            cv::Mat next;
+            if (filter_ == PYRAMID_GAUSSIAN)
+            {
+                cv::pyrDown(prev, next, cv::Size(prev.cols / 2, prev.rows / 2));
+            }
+            else
+            {
+                downsample_box_2x2(prev, next);
+            }
+            levels_.push_back(next);
+        }
+        return levels_[i];
+    }
+
+    /**
+     * Finest level that fits into the given size (for previews in a window of that size)
+     */
+    int level_for_size(cv::Size max_size) const
+    {
+        int count = level_count();
+        cv::Size s = empty() ? cv::Size() : levels_[0].size();
+        int i = 0;
+        while (i + 1 < count && (s.width > max_size.width || s.height > max_size.height))
+        {
+            s = cv::Size(s.width / 2, s.height / 2);
+            i++;
+        }
+        return i;
+    }
+
+    /**
+     * Size factor between level 0 and level i
+     */
+    static int scale(int i) { return 1 << i; }
+
+private:
+    std::vector<cv::Mat> levels_;
+    PyramidFilter filter_ = PYRAMID_BOX;
+};
+
+/**
+ * Upsamples a coarse binary result to full resolution, then re-decides at full resolution only the pixels
+ * under coarse pixels lying on a foreground/background boundary
+ * Interior regions keep the coarse decision, which is exact unless a feature is thinner than one coarse pixel.
+ * @param full Full resolution CV_8UC1 image
+ * @param coarse_binary Coarse decision (0 or max_value) at pyramid level `level`
+ * @param coarse_thresh Threshold of every coarse pixel (CV_32F, same size as coarse_binary)
+ */
+inline void refine_near_edges(const cv::Mat &full, const cv::Mat &coarse_binary, const cv::Mat &coarse_thresh,
+                              int level, double max_value, bool inverse, cv::Mat &dst)
+{
+    INSTRUMENT_SCOPE("pyramid.refine");
+    if (level == 0)
+    {
+        coarse_binary.copyTo(dst);
+        return;
+    }
+    const int s = ImagePyramid::scale(level);
+
+    // Nearest upsampling with the exact pyramid mapping (full pixel x lies under coarse pixel x >> level)
+    dst.create(full.size(), CV_8UC1);
+    for (int y = 0; y < full.rows; y++)
+    {
+        const uchar *c = coarse_binary.ptr<uchar>(std::min(y >> level, coarse_binary.rows - 1));
+        uchar *out = dst.ptr<uchar>(y);
+        for (int x = 0; x < full.cols; x++)
+        {
+            out[x] = c[std::min(x >> level, coarse_binary.cols - 1)];
+        }
+    }
+
+    // Boundary coarse pixels: those whose 3x3 neighbourhood holds both decisions
+    cv::Mat edges;
+    cv::morphologyEx(coarse_binary, edges, cv::MORPH_GRADIENT, cv::Mat());
+    const uchar hi = cv::saturate_cast<uchar>(max_value);
+    const uchar fg = inverse ? 0 : hi;
+    const uchar bg = inverse ? hi : 0;
+
+    cv::parallel_for_(cv::Range(0, edges.rows), [&](const cv::Range &range) {
+        for (int cy = range.start; cy < range.end; cy++)
+        {
+            const uchar *e = edges.ptr<uchar>(cy);
+            const float *t = coarse_thresh.ptr<float>(cy);
+            // The last coarse row/column also covers the odd rows/columns dropped by the downsampling
+            const int y_end = cy == edges.rows - 1 ? full.rows : std::min(full.rows, (cy + 1) * s);
+            for (int cx = 0; cx < edges.cols; cx++)
+            {
+                if (e[cx] == 0)
+                {
+                    continue;
+                }
+                const int x0 = cx * s;
+                const int x_end = cx == edges.cols - 1 ? full.cols : std::min(full.cols, x0 + s);
+                for (int y = cy * s; y < y_end; y++)
+                {
+                    const uchar *in = full.ptr<uchar>(y);
+                    uchar *out = dst.ptr<uchar>(y);
+                    for (int x = x0; x < x_end; x++)
+                    {
+                        out[x] = in[x] > t[cx] ? fg : bg;
+                    }
+                }
+            }
+        }
+    });
+}
+
+/**
+ * Fixed or Otsu threshold computed on a coarse level and refined at full resolution near edges
+ * @param pyr Pyramid of a CV_8UC1 image
+ * @param level Level used for the coarse pass (0 = plain full resolution threshold)
+ * @param type THRESH_BINARY or THRESH_BINARY_INV, optionally combined with THRESH_OTSU
+ * @return The threshold used (the Otsu value found on the coarse level for THRESH_OTSU)
+ */
+inline double coarse_to_fine_threshold(ImagePyramid &pyr, int level, double thresh, double max_value, int type,
+                                       cv::Mat &dst)
+{
+    const int base_type = type & ~cv::THRESH_OTSU;
+    if (pyr.empty() || pyr.level(0).type() != CV_8UC1 ||
+        (base_type != cv::THRESH_BINARY && base_type != cv::THRESH_BINARY_INV))
+    {
+        std::cerr << "Error: coarse_to_fine_threshold needs a CV_8UC1 pyramid and a binary threshold type!"
+                  << std::endl;
+        return -1.0;
+    }
+    INSTRUMENT_SCOPE("pyramid.coarse_to_fine_threshold");
+    const cv::Mat &coarse = pyr.level(level);
+    cv::Mat coarse_binary;
+    double used = cv::threshold(coarse, coarse_binary, thresh, max_value, type);
+    cv::Mat coarse_thresh(coarse.size(), CV_32F, cv::Scalar(used));
+    refine_near_edges(pyr.level(0), coarse_binary, coarse_thresh, level, max_value,
+                      base_type == cv::THRESH_BINARY_INV, dst);
+    return used;
+}
+
+/**
+ * Adaptive threshold with the local means computed on a coarse level
+ * The neighbourhood of an adaptive threshold is large and smooth, so its mean is nearly the same when
+ * computed 2^level times smaller; only pixels near edges are then compared at full resolution.
+ * @param block_size Neighbourhood size at full resolution (odd, as for cv::adaptiveThreshold)
+ */
+inline void coarse_to_fine_adaptive(ImagePyramid &pyr, int level, double max_value, int method, int type,
+                                    int block_size, double C, cv::Mat &dst)
+{
+    if (pyr.empty() || pyr.level(0).type() != CV_8UC1 ||
+        (type != cv::THRESH_BINARY && type != cv::THRESH_BINARY_INV))
+    {
+        std::cerr << "Error: coarse_to_fine_adaptive needs a CV_8UC1 pyramid and a binary threshold type!"
+                  << std::endl;
+        return;
+    }
+    INSTRUMENT_SCOPE("pyramid.coarse_to_fine_adaptive");
+    const cv::Mat &coarse = pyr.level(level);
+    const int coarse_block = std::max(3, (block_size >> level) | 1);
+
+    cv::Mat coarse_f, mean;
+    coarse.convertTo(coarse_f, CV_32F);
+    if (method == cv::ADAPTIVE_THRESH_GAUSSIAN_C)
+    {
+        cv::GaussianBlur(coarse_f, mean, cv::Size(coarse_block, coarse_block), 0, 0, cv::BORDER_REPLICATE);
+    }
+    else
+    {
+        cv::boxFilter(coarse_f, mean, CV_32F, cv::Size(coarse_block, coarse_block), cv::Point(-1, -1), true,
+                      cv::BORDER_REPLICATE);
+    }
+    cv::Mat coarse_thresh = mean - C;
+
+    // Coarse decision with the same rule as the refinement: pixel > local mean - C
+    cv::Mat coarse_binary = coarse_f > coarse_thresh;
+    if (type == cv::THRESH_BINARY_INV)
+    {
+        cv::bitwise_not(coarse_binary, coarse_binary);
+    }
+    coarse_binary.setTo(cv::Scalar(max_value), coarse_binary);
+    refine_near_edges(pyr.level(0), coarse_binary, coarse_thresh, level, max_value, type == cv::THRESH_BINARY_INV,
+                      dst);
+}
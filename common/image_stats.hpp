@@ -0,0 +1,452 @@
+#pragma once
+
+#include <algorithm>
+#include <array>
+#include <charconv>
+#include <cmath>
+#include <cstdint>
+#include <cstring>
+#include <fstream>
+#include <iomanip>
+#include <iostream>
+#include <limits>
+#include <string>
+#include <vector>
+#include <opencv2/opencv.hpp>
+#include "instrumentation.hpp"
+#include "pixel_depth.hpp"
+
+/*
+ * Image inspection for QA checks on every output frame, instead of printing pixels with cout.
+ *
+ * image_stats() reads the image once and returns, per channel: min, max, mean, standard deviation,
+ * a 256-bin histogram and how many values sit at the black and white levels (clipping, e.g. lesson 05's
+ * "cow + 200"). For 8-bit images the pass only builds histograms and everything else is derived from
+ * the 256 bins, so the inner loop is one table increment per value (single-channel images alternate
+ * between four tables, so repeated values do not wait on each other's store). 16-bit and float images
+ * accumulate min/max/sums directly. Row bands run in parallel, and row_step > 1 samples every n-th row
+ * when an estimate is enough.
+ *
+ * Regions are dumped as CSV (one line per row, for eyes and spreadsheets) or as a small binary file
+ * (header + raw rows, for tools).
+ */
+
+#define STATS_BAND_ROWS 64
+#define STATS_MAX_CHANNELS 4
+#define STATS_BINS 256
+
+inline constexpr char REGION_DUMP_MAGIC[8] = {'C', 'V', 'R', 'E', 'G', 'I', 'O', 'N'};
+
+struct ChannelStats
+{
+    double min = 0.0;
+    double max = 0.0;
+    double mean = 0.0;
+    double stddev = 0.0;
+    uint64_t at_black = 0; // values <= 0
+    uint64_t at_white = 0; // values >= depth_max_value (255, 65535 or 1.0)
+    std::array<uint64_t, STATS_BINS> histogram = {}; // 8-bit values, or the depth's range in 256 bins
+};
+
+struct ImageStats
+{
+    int rows = 0;
+    int cols = 0;
+    int depth = CV_8U;
+    int channels = 0;
+    uint64_t samples = 0; // values per channel that were inspected (fewer than pixels when rows were skipped)
+    std::array<ChannelStats, STATS_MAX_CHANNELS> channel;
+
+    /**
+     * Fraction of inspected values (all channels) at the black or white level
+     */
+    double clipped_fraction() const
+    {
+        uint64_t clipped = 0;
+        for (int c = 0; c < channels; c++)
+        {
+            clipped += channel[c].at_black + channel[c].at_white;
+        }
+        return samples == 0 ? 0.0 : static_cast<double>(clipped) / (static_cast<double>(samples) * channels);
+    }
+
+    /**
+     * Fraction of inspected values (all channels) at the white level only (overexposure)
+     */
+    double at_white_fraction() const
+    {
+        uint64_t white = 0;
+        for (int c = 0; c < channels; c++)
+        {
+            white += channel[c].at_white;
+        }
+        return samples == 0 ? 0.0 : static_cast<double>(white) / (static_cast<double>(samples) * channels);
+    }
+
+    /**
+     * One line per channel, e.g. "  c0: min 0 max 255 mean 131.2 std 48.7 | black 0.1% white 23.4%"
+     */
+    void print(std::ostream &out, const std::string &label) const
+    {
+        out << label << ": " << cols << "x" << rows << ", " << channels << " channel(s), " << samples
+            << " samples per channel" << std::endl;
+        const double to_percent = samples == 0 ? 0.0 : 100.0 / static_cast<double>(samples);
+        for (int c = 0; c < channels; c++)
+        {
+            const ChannelStats &s = channel[c];
+            out << "  c" << c << ": min " << s.min << " max " << s.max << std::fixed << std::setprecision(1)
+                << " mean " << s.mean << " std " << s.stddev << std::setprecision(2) << " | black "
+                << s.at_black * to_percent << "% white " << s.at_white * to_percent << "%" << std::defaultfloat
+                << std::setprecision(6) << std::endl;
+        }
+    }
+};
+
+namespace stats_detail
+{
+struct BandStats
+{
+    std::array<std::array<uint64_t, STATS_BINS>, STATS_MAX_CHANNELS> histogram;
+    std::array<double, STATS_MAX_CHANNELS> min;
+    std::array<double, STATS_MAX_CHANNELS> max;
+    std::array<double, STATS_MAX_CHANNELS> sum;
+    std::array<double, STATS_MAX_CHANNELS> sum_sq;
+    std::array<uint64_t, STATS_MAX_CHANNELS> at_black;
+    std::array<uint64_t, STATS_MAX_CHANNELS> at_white;
+    uint64_t samples;
+};
+
+inline void clear(BandStats &b)
+{
+    std::memset(&b, 0, sizeof(b));
+    b.min.fill(std::numeric_limits<double>::max());
+    b.max.fill(std::numeric_limits<double>::lowest());
+}
+
+/**
+ * 8-bit rows: histograms only
+ */
+inline void histogram_rows_8u(const cv::Mat &img, int y_begin, int y_end, int row_step, BandStats &b)
+{
+    const int cn = img.channels();
+    const int n = img.cols * cn;
+    if (cn == 1)
+    {
+        // Four tables in turn: a run of equal values does not serialize on one counter
+        std::vector<uint32_t> tables(4 * STATS_BINS, 0);
+        uint32_t *t0 = tables.data();
+        uint32_t *t1 = t0 + STATS_BINS;
+        uint32_t *t2 = t1 + STATS_BINS;
+        uint32_t *t3 = t2 + STATS_BINS;
+        for (int y = y_begin; y < y_end; y += row_step)
+        {
+            const uchar *p = img.ptr<uchar>(y);
+            int x = 0;
+            for (; x + 4 <= n; x += 4)
+            {
+                t0[p[x]]++;
+                t1[p[x + 1]]++;
+                t2[p[x + 2]]++;
+                t3[p[x + 3]]++;
+            }
+            for (; x < n; x++)
+            {
+                t0[p[x]]++;
+            }
+            b.samples += img.cols;
+        }
+        for (int v = 0; v < STATS_BINS; v++)
+        {
+            b.histogram[0][v] += static_cast<uint64_t>(t0[v]) + t1[v] + t2[v] + t3[v];
+        }
+        return;
+    }
+
+    std::vector<uint32_t> tables(static_cast<size_t>(cn) * STATS_BINS, 0);
+    for (int y = y_begin; y < y_end; y += row_step)
+    {
+        const uchar *p = img.ptr<uchar>(y);
+        for (int x = 0; x < n; x += cn)
+        {
+            for (int c = 0; c < cn; c++)
+            {
+                tables[c * STATS_BINS + p[x + c]]++;
+            }
+        }
+        b.samples += img.cols;
+    }
+    for (int c = 0; c < cn; c++)
+    {
+        for (int v = 0; v < STATS_BINS; v++)
+        {
+            b.histogram[c][v] += tables[c * STATS_BINS + v];
+        }
+    }
+}
+
+/**
+ * 16-bit and float rows: running min/max/sums, histogram over the depth's range
+ */
+template <typename T>
+inline void accumulate_rows(const cv::Mat &img, int y_begin, int y_end, int row_step, BandStats &b)
+{
+    const int cn = img.channels();
+    const double white = depth_max_value(img.depth());
+    const double to_bin = STATS_BINS / white;
+    for (int y = y_begin; y < y_end; y += row_step)
+    {
+        const T *p = img.ptr<T>(y);
+        for (int c = 0; c < cn; c++)
+        {
+            double lo = b.min[c], hi = b.max[c], sum = 0.0, sum_sq = 0.0;
+            uint64_t black = 0, clipped = 0;
+            for (int x = c; x < img.cols * cn; x += cn)
+            {
+                const double v = p[x];
+                lo = std::min(lo, v);
+                hi = std::max(hi, v);
+                sum += v;
+                sum_sq += v * v;
+                black += v <= 0.0;
+                clipped += v >= white;
+                // Clamp before the conversion: NaN, inf and out-of-range floats have no int value
+                const double bin = std::isnan(v) ? 0.0 : std::clamp(v * to_bin, 0.0, STATS_BINS - 1.0);
+                b.histogram[c][static_cast<int>(bin)]++;
+            }
+            b.min[c] = lo;
+            b.max[c] = hi;
+            b.sum[c] += sum;
+            b.sum_sq[c] += sum_sq;
+            b.at_black[c] += black;
+            b.at_white[c] += clipped;
+        }
+        b.samples += img.cols;
+    }
+}
+} // namespace stats_detail
+
+/**
+ * Per-channel statistics of an image (or of a region: pass img(rect))
+ * @param img CV_8U, CV_16U or CV_32F, 1 to 4 channels
+ * @param row_step Inspect every row_step-th row only (1 = every row)
+ * @return false if the image is empty or not supported
+ */
+inline bool image_stats(const cv::Mat &img, ImageStats &stats, int row_step = 1)
+{
+    const int depth = img.depth();
+    if (img.empty() || img.channels() > STATS_MAX_CHANNELS || (depth != CV_8U && depth != CV_16U && depth != CV_32F))
+    {
+        std::cerr << "Error: image_stats needs a non-empty 8-bit, 16-bit or float image with 1-4 channels!"
+                  << std::endl;
+        return false;
+    }
+    INSTRUMENT_SCOPE("stats.image");
+    row_step = std::max(1, row_step);
+
+    // Bands start on a multiple of row_step, so sampling gives the same rows however the image is split
+    const int band_rows = (STATS_BAND_ROWS + row_step - 1) / row_step * row_step;
+    const int bands = (img.rows + band_rows - 1) / band_rows;
+    std::vector<stats_detail::BandStats> partial(bands);
+    cv::parallel_for_(cv::Range(0, bands), [&](const cv::Range &range) {
+        for (int band = range.start; band < range.end; band++)
+        {
+            stats_detail::BandStats &b = partial[band];
+            stats_detail::clear(b);
+            const int y_begin = band * band_rows;
+            const int y_end = std::min(img.rows, y_begin + band_rows);
+            if (depth == CV_8U)
+            {
+                stats_detail::histogram_rows_8u(img, y_begin, y_end, row_step, b);
+            }
+            else if (depth == CV_16U)
+            {
+                stats_detail::accumulate_rows<ushort>(img, y_begin, y_end, row_step, b);
+            }
+            else
+            {
+                stats_detail::accumulate_rows<float>(img, y_begin, y_end, row_step, b);
+            }
+        }
+    });
+
+    stats = ImageStats();
+    stats.rows = img.rows;
+    stats.cols = img.cols;
+    stats.depth = depth;
+    stats.channels = img.channels();
+    for (const stats_detail::BandStats &b : partial)
+    {
+        stats.samples += b.samples;
+    }
+    for (int c = 0; c < stats.channels; c++)
+    {
+        ChannelStats &s = stats.channel[c];
+        double lo = std::numeric_limits<double>::max(), hi = std::numeric_limits<double>::lowest();
+        double sum = 0.0, sum_sq = 0.0;
+        for (const stats_detail::BandStats &b : partial)
+        {
+            for (int v = 0; v < STATS_BINS; v++)
+            {
+                s.histogram[v] += b.histogram[c][v];
+            }
+            lo = std::min(lo, b.min[c]);
+            hi = std::max(hi, b.max[c]);
+            sum += b.sum[c];
+            sum_sq += b.sum_sq[c];
+            s.at_black += b.at_black[c];
+            s.at_white += b.at_white[c];
+        }
+        if (depth == CV_8U)
+        {
+            // Everything from the 256 bins
+            for (int v = 0; v < STATS_BINS; v++)
+            {
+                const double count = static_cast<double>(s.histogram[v]);
+                sum += count * v;
+                sum_sq += count * v * v;
+                if (s.histogram[v] != 0)
+                {
+                    lo = std::min(lo, static_cast<double>(v));
+                    hi = v;
+                }
+            }
+            s.at_black = s.histogram[0];
+            s.at_white = s.histogram[STATS_BINS - 1];
+        }
+        const double n = static_cast<double>(std::max<uint64_t>(1, stats.samples));
+        s.min = stats.samples == 0 ? 0.0 : lo;
+        s.max = stats.samples == 0 ? 0.0 : hi;
+        s.mean = sum / n;
+        s.stddev = std::sqrt(std::max(0.0, sum_sq / n - s.mean * s.mean));
+    }
+    INSTRUMENT_COUNT("stats.samples", stats.samples * stats.channels);
+    return true;
+}
+
+/**
+ * Writes a region as CSV: a "# cols x rows" comment line (unless header is false), then one line per
+ * row with the channel values of each pixel in order (B,G,R,B,G,R... for color images)
+ */
+inline bool dump_region_csv(const cv::Mat &img, const cv::Rect &region, std::ostream &out, bool header = true)
+{
+    const cv::Rect rect = region & cv::Rect(0, 0, img.cols, img.rows);
+    const int depth = img.depth();
+    if (rect.empty() || (depth != CV_8U && depth != CV_16U && depth != CV_32F))
+    {
+        std::cerr << "Error: Region is empty or the image depth is not 8-bit, 16-bit or float!" << std::endl;
+        return false;
+    }
+    if (header)
+    {
+        out << "# " << rect.width << "x" << rect.height << " at (" << rect.x << "," << rect.y << "), "
+            << img.channels() << " channel(s)\n";
+    }
+
+    // Formatted with to_chars into one buffer per row: no stream formatting per value
+    const int n = rect.width * img.channels();
+    std::vector<char> line(static_cast<size_t>(n) * 16 + 1);
+    for (int y = rect.y; y < rect.y + rect.height; y++)
+    {
+        char *p = line.data();
+        char *end = line.data() + line.size();
+        const uchar *row = img.ptr(y) + static_cast<size_t>(rect.x) * img.elemSize();
+        for (int i = 0; i < n; i++)
+        {
+            if (i > 0)
+            {
+                *p++ = ',';
+            }
+            if (depth == CV_8U)
+            {
+                p = std::to_chars(p, end, row[i]).ptr;
+            }
+            else if (depth == CV_16U)
+            {
+                p = std::to_chars(p, end, reinterpret_cast<const ushort *>(row)[i]).ptr;
+            }
+            else
+            {
+                p = std::to_chars(p, end, reinterpret_cast<const float *>(row)[i]).ptr;
+            }
+        }
+        *p++ = '\n';
+        out.write(line.data(), p - line.data());
+    }
+    return static_cast<bool>(out);
+}
+
+/**
+ * Header of a binary region dump, followed by rows x cols x elemSize bytes (no padding)
+ */
+struct RegionDumpHeader
+{
+    char magic[8];
+    int32_t x;
+    int32_t y;
+    int32_t rows;
+    int32_t cols;
+    int32_t type;
+    int32_t reserved;
+};
+static_assert(sizeof(RegionDumpHeader) == 32, "RegionDumpHeader must not contain padding");
+
+/**
+ * Writes a region to a binary file (RegionDumpHeader + raw rows)
+ */
+inline bool dump_region_binary(const cv::Mat &img, const cv::Rect &region, const std::string &path)
+{
+    const cv::Rect rect = region & cv::Rect(0, 0, img.cols, img.rows);
+    if (rect.empty())
+    {
+        std::cerr << "Error: Region is outside of the image!" << std::endl;
+        return false;
+    }
+    RegionDumpHeader h;
+    std::memcpy(h.magic, REGION_DUMP_MAGIC, sizeof(h.magic));
+    h.x = rect.x;
+    h.y = rect.y;
+    h.rows = rect.height;
+    h.cols = rect.width;
+    h.type = img.type();
+    h.reserved = 0;
+    std::ofstream file(path, std::ios::binary | std::ios::trunc);
+    file.write(reinterpret_cast<const char *>(&h), sizeof(h));
+    const cv::Mat roi = img(rect);
+    const size_t row_bytes = static_cast<size_t>(rect.width) * img.elemSize();
+    for (int y = 0; y < roi.rows; y++)
+    {
+        file.write(reinterpret_cast<const char *>(roi.ptr(y)), static_cast<std::streamsize>(row_bytes));
+    }
+    if (!file)
+    {
+        std::cerr << "Error: Could not write region dump '" << path << "'!" << std::endl;
+        return false;
+    }
+    return true;
+}
+
+/**
+ * Reads a binary region dump back (the header's x and y are returned through origin when it is not null)
+ */
+inline cv::Mat load_region_binary(const std::string &path, cv::Point *origin = nullptr)
+{
+    std::ifstream file(path, std::ios::binary);
+    RegionDumpHeader h;
+    if (!file.read(reinterpret_cast<char *>(&h), sizeof(h)) ||
+        std::memcmp(h.magic, REGION_DUMP_MAGIC, sizeof(h.magic)) != 0 || h.rows <= 0 || h.cols <= 0)
+    {
+        std::cerr << "Error: '" << path << "' is not a region dump!" << std::endl;
+        return cv::Mat();
+    }
+    cv::Mat img(h.rows, h.cols, h.type);
+    if (!file.read(reinterpret_cast<char *>(img.data), static_cast<std::streamsize>(img.total() * img.elemSize())))
+    {
+        std::cerr << "Error: Region dump '" << path << "' is truncated!" << std::endl;
+        return cv::Mat();
+    }
+    if (origin != nullptr)
+    {
+        *origin = cv::Point(h.x, h.y);
+    }
+    return img;
+}
@@ -0,0 +1,517 @@
+#pragma once
+
+#include <algorithm>
+#include <array>
+#include <atomic>
+#include <chrono>
+#include <cstdint>
+#include <cstring>
+#include <fstream>
+#include <iomanip>
+#include <iostream>
+#include <memory>
+#include <mutex>
+#include <string>
+#include <thread>
+#include <vector>
+
+#if defined(__x86_64__) || defined(_M_X64)
+#include <x86intrin.h>
+#endif
+
+/*
+ * Lightweight scoped instrumentation for the lesson operations.
+ *
+ * Usage:
+ *   INSTRUMENT_SCOPE("threshold.binary");   // times until end of the enclosing block
+ *   INSTRUMENT_COUNT("pixels", img.total()); // adds to a named counter
+ *   INSTRUMENT_REPORT("09_thresholding_image"); // writes <name>.trace.json and <name>.prom
+ *
+ * Call sites that use the same name share one region or counter and are reported once.
+ *
+ * All macros expand to nothing unless CV_LESSONS_INSTRUMENTATION is defined
+ * (configure with -DENABLE_INSTRUMENTATION=ON).
+ */
+namespace instrumentation
+{
+
+// Histogram layout: 4 sub-buckets per power of two, covering the whole uint64 tick range
+constexpr int SUB_BUCKET_BITS = 2;
+constexpr int SUB_BUCKETS = 1 << SUB_BUCKET_BITS;
+constexpr int BUCKET_COUNT = 64 * SUB_BUCKETS;
+
+// Events are buffered per thread and folded into the shared histograms in chunks, so the
+// hot path only reads the tick counter twice and appends to a thread-local array
+constexpr size_t EVENT_CHUNK = 4096;
+
+// Upper bound on retained trace events per thread (keeps memory bounded on long runs)
+constexpr size_t MAX_EVENTS_PER_THREAD = 1 << 20;
+
+/**
+ * Reads a cheap monotonic tick counter (TSC on x86-64, steady_clock elsewhere)
+ */
+inline uint64_t read_ticks()
+{
+#if defined(__x86_64__) || defined(_M_X64)
+    return __rdtsc();
+#else
+    return static_cast<uint64_t>(std::chrono::steady_clock::now().time_since_epoch().count());
+#endif
+}
+
+/**
+ * Maps a tick duration to its histogram bucket index
+ */
+inline int bucket_index(uint64_t ticks)
+{
+    if (ticks < SUB_BUCKETS)
+    {
+        return static_cast<int>(ticks);
+    }
+    int msb = 63 - __builtin_clzll(ticks);
+    int sub = static_cast<int>((ticks >> (msb - SUB_BUCKET_BITS)) & (SUB_BUCKETS - 1));
+    return (msb - SUB_BUCKET_BITS + 1) * SUB_BUCKETS + sub;
+}
+
+/**
+ * Returns the smallest tick value that falls into the given bucket
+ */
+inline uint64_t bucket_lower_bound(int index)
+{
+    if (index < SUB_BUCKETS)
+    {
+        return static_cast<uint64_t>(index);
+    }
+    int msb = index / SUB_BUCKETS + SUB_BUCKET_BITS - 1;
+    uint64_t sub = static_cast<uint64_t>(index % SUB_BUCKETS);
+    return (uint64_t(1) << msb) | (sub << (msb - SUB_BUCKET_BITS));
+}
+
+/**
+ * Per name statistics: latency histogram and accumulated time
+ * One instance lives in a function-local static created by INSTRUMENT_SCOPE; call sites that use the
+ * same name share the statistics of the first one registered
+ * Only touched by the registry while it holds its mutex
+ */
+struct Region
+{
+    const char *name;
+    Region *shared = this; // region that records the samples of this call site
+    uint64_t total_ticks = 0;
+    std::array<uint64_t, BUCKET_COUNT> buckets{};
+
+    explicit Region(const char *region_name);
+
+    void record(uint64_t ticks)
+    {
+        total_ticks += ticks;
+        buckets[bucket_index(ticks)]++;
+    }
+
+    uint64_t count() const
+    {
+        uint64_t n = 0;
+        for (uint64_t b : buckets)
+        {
+            n += b;
+        }
+        return n;
+    }
+
+    /**
+     * Approximate quantile in ticks (midpoint of the bucket holding the q-th sample)
+     */
+    double quantile_ticks(double q) const
+    {
+        uint64_t n = count();
+        if (n == 0)
+        {
+            return 0.0;
+        }
+        uint64_t target = static_cast<uint64_t>(q * static_cast<double>(n - 1)) + 1;
+        uint64_t seen = 0;
+        for (int i = 0; i < BUCKET_COUNT; i++)
+        {
+            seen += buckets[i];
+            if (seen >= target)
+            {
+                double lo = static_cast<double>(bucket_lower_bound(i));
+                double hi = (i + 1 < BUCKET_COUNT) ? static_cast<double>(bucket_lower_bound(i + 1)) : lo;
+                return (lo + hi) / 2.0;
+            }
+        }
+        return 0.0;
+    }
+};
+
+/**
+ * Named monotonically increasing counter (pixels processed, calls, bytes...)
+ */
+struct Counter
+{
+    const char *name;
+    Counter *shared = this; // counter of the first call site with this name
+    std::atomic<uint64_t> value{0};
+
+    explicit Counter(const char *counter_name);
+
+    void add(uint64_t n) { shared->value.fetch_add(n, std::memory_order_relaxed); }
+};
+
+/**
+ * Single completed region used for the Chrome trace export
+ */
+struct TraceEvent
+{
+    Region *region;
+    uint64_t start;
+    uint64_t end;
+};
+
+/**
+ * Events recorded by one thread; owned by the registry so they survive thread exit
+ * pending: not yet folded into the histograms, retained: kept for the trace export
+ */
+struct ThreadBuffer
+{
+    uint32_t thread_id;
+    std::vector<TraceEvent> pending;
+    std::vector<std::vector<TraceEvent>> retained;
+    size_t retained_events = 0;
+};
+
+/**
+ * Process-wide registry of regions, counters and per-thread trace buffers
+ */
+class Registry
+{
+public:
+    static Registry &instance()
+    {
+        static Registry registry;
+        return registry;
+    }
+
+    /**
+     * Registers a call site; one with a name already in use records into the existing region, so every
+     * name is reported once
+     */
+    void add_region(Region *region)
+    {
+        std::lock_guard<std::mutex> lock(mutex_);
+        region->shared = find_by_name(regions_, region->name);
+        if (region->shared == nullptr)
+        {
+            region->shared = region;
+            regions_.push_back(region);
+        }
+    }
+
+    void add_counter(Counter *counter)
+    {
+        std::lock_guard<std::mutex> lock(mutex_);
+        counter->shared = find_by_name(counters_, counter->name);
+        if (counter->shared == nullptr)
+        {
+            counter->shared = counter;
+            counters_.push_back(counter);
+        }
+    }
+
+    /**
+     * Returns the calling thread's event buffer, registering it on first use
+     */
+    ThreadBuffer &thread_buffer()
+    {
+        thread_local ThreadBuffer *buffer = nullptr;
+        if (buffer == nullptr)
+        {
+            std::lock_guard<std::mutex> lock(mutex_);
+            auto owned = std::make_unique<ThreadBuffer>();
+            owned->thread_id = static_cast<uint32_t>(buffers_.size() + 1);
+            owned->pending.reserve(EVENT_CHUNK);
+            buffer = owned.get();
+            buffers_.push_back(std::move(owned));
+        }
+        return *buffer;
+    }
+
+    /**
+     * Folds pending events of a buffer into the region histograms and the retained trace
+     */
+    void flush(ThreadBuffer &buffer)
+    {
+        std::lock_guard<std::mutex> lock(mutex_);
+        flush_locked(buffer);
+    }
+
+    /**
+     * Nanoseconds per tick, calibrated against steady_clock since registry creation
+     */
+    double ns_per_tick() const
+    {
+#if defined(__x86_64__) || defined(_M_X64)
+        auto now_time = std::chrono::steady_clock::now();
+        uint64_t now_ticks = read_ticks();
+        double elapsed_ns = std::chrono::duration<double, std::nano>(now_time - start_time_).count();
+        if (elapsed_ns < 1e6)
+        {
+            // Too short to calibrate reliably: wait a little
+            std::this_thread::sleep_for(std::chrono::milliseconds(2));
+            now_time = std::chrono::steady_clock::now();
+            now_ticks = read_ticks();
+            elapsed_ns = std::chrono::duration<double, std::nano>(now_time - start_time_).count();
+        }
+        return elapsed_ns / static_cast<double>(now_ticks - start_ticks_);
+#else
+        return 1.0;
+#endif
+    }
+
+    /**
+     * Prints count, mean, p50 and p99 for every region that was hit
+     */
+    void print_summary(std::ostream &out)
+    {
+        std::lock_guard<std::mutex> lock(mutex_);
+        flush_all_locked();
+        double scale_us = ns_per_tick() / 1000.0;
+
+        out << "\n=== INSTRUMENTATION SUMMARY (microseconds) ===" << std::endl;
+        out << std::left << std::setw(32) << "region" << std::right
+            << std::setw(10) << "calls" << std::setw(12) << "mean"
+            << std::setw(12) << "p50" << std::setw(12) << "p99" << std::endl;
+        for (const Region *r : regions_)
+        {
+            uint64_t n = r->count();
+            if (n == 0)
+            {
+                continue;
+            }
+            double mean = static_cast<double>(r->total_ticks) / static_cast<double>(n) * scale_us;
+            out << std::left << std::setw(32) << r->name << std::right << std::fixed << std::setprecision(2)
+                << std::setw(10) << n << std::setw(12) << mean
+                << std::setw(12) << r->quantile_ticks(0.50) * scale_us
+                << std::setw(12) << r->quantile_ticks(0.99) * scale_us << std::endl;
+        }
+        for (const Counter *c : counters_)
+        {
+            out << std::left << std::setw(32) << c->name << std::right
+                << std::setw(10) << c->value.load() << std::endl;
+        }
+        out << std::defaultfloat;
+    }
+
+    /**
+     * Writes all buffered events in Chrome trace format (open in chrome://tracing or Perfetto)
+     */
+    bool write_chrome_trace(const std::string &path)
+    {
+        std::lock_guard<std::mutex> lock(mutex_);
+        flush_all_locked();
+        std::ofstream out(path);
+        if (!out)
+        {
+            return false;
+        }
+        double scale_us = ns_per_tick() / 1000.0;
+
+        out << "{\"traceEvents\":[";
+        bool first = true;
+        for (const auto &buffer : buffers_)
+        {
+            for (const auto &chunk : buffer->retained)
+            {
+                for (const TraceEvent &e : chunk)
+                {
+                    out << (first ? "\n" : ",\n");
+                    first = false;
+                    out << "{\"name\":\"" << e.region->name << "\",\"ph\":\"X\",\"pid\":1"
+                        << ",\"tid\":" << buffer->thread_id << std::fixed << std::setprecision(3)
+                        << ",\"ts\":" << static_cast<double>(e.start - start_ticks_) * scale_us
+                        << ",\"dur\":" << static_cast<double>(e.end - e.start) * scale_us << "}";
+                }
+            }
+        }
+        out << "\n],\"displayTimeUnit\":\"ns\"}\n";
+        return static_cast<bool>(out);
+    }
+
+    /**
+     * Writes regions as Prometheus histograms and counters in text exposition format
+     */
+    bool write_prometheus(const std::string &path)
+    {
+        std::lock_guard<std::mutex> lock(mutex_);
+        flush_all_locked();
+        std::ofstream out(path);
+        if (!out)
+        {
+            return false;
+        }
+        double scale_s = ns_per_tick() / 1e9;
+
+        out << "# HELP cv_lesson_region_seconds Latency of instrumented lesson operations.\n";
+        out << "# TYPE cv_lesson_region_seconds histogram\n";
+        for (const Region *r : regions_)
+        {
+            uint64_t cumulative = 0;
+            for (int i = 0; i < BUCKET_COUNT; i++)
+            {
+                uint64_t n = r->buckets[i];
+                if (n == 0)
+                {
+                    continue;
+                }
+                cumulative += n;
+                double le = (i + 1 < BUCKET_COUNT) ? static_cast<double>(bucket_lower_bound(i + 1)) * scale_s
+                                                   : static_cast<double>(bucket_lower_bound(i)) * scale_s;
+                out << "cv_lesson_region_seconds_bucket{region=\"" << r->name << "\",le=\""
+                    << std::setprecision(9) << le << "\"} " << cumulative << "\n";
+            }
+            out << "cv_lesson_region_seconds_bucket{region=\"" << r->name << "\",le=\"+Inf\"} " << cumulative << "\n";
+            out << "cv_lesson_region_seconds_sum{region=\"" << r->name << "\"} "
+                << std::setprecision(9) << static_cast<double>(r->total_ticks) * scale_s << "\n";
+            out << "cv_lesson_region_seconds_count{region=\"" << r->name << "\"} " << cumulative << "\n";
+        }
+
+        out << "# HELP cv_lesson_counter_total Counters recorded by the lessons.\n";
+        out << "# TYPE cv_lesson_counter_total counter\n";
+        for (const Counter *c : counters_)
+        {
+            out << "cv_lesson_counter_total{name=\"" << c->name << "\"} " << c->value.load() << "\n";
+        }
+        return static_cast<bool>(out);
+    }
+
+    /**
+     * Prints the summary and writes <prefix>.trace.json and <prefix>.prom into the working directory
+     * Call once worker threads are idle: their pending events are folded in here
+     */
+    void report(const std::string &prefix)
+    {
+        print_summary(std::cout);
+        if (write_chrome_trace(prefix + ".trace.json") && write_prometheus(prefix + ".prom"))
+        {
+            std::cout << "Instrumentation written to '" << prefix << ".trace.json' and '"
+                      << prefix << ".prom'" << std::endl;
+        }
+        else
+        {
+            std::cerr << "Warning: Could not write instrumentation files for " << prefix << std::endl;
+        }
+    }
+
+private:
+    Registry() : start_time_(std::chrono::steady_clock::now()), start_ticks_(read_ticks()) {}
+
+    template <class T>
+    static T *find_by_name(const std::vector<T *> &entries, const char *name)
+    {
+        for (T *entry : entries)
+        {
+            if (std::strcmp(entry->name, name) == 0)
+            {
+                return entry;
+            }
+        }
+        return nullptr;
+    }
+
+    void flush_locked(ThreadBuffer &buffer)
+    {
+        for (const TraceEvent &e : buffer.pending)
+        {
+            e.region->shared->record(e.end - e.start);
+        }
+        if (buffer.retained_events + buffer.pending.size() <= MAX_EVENTS_PER_THREAD)
+        {
+            // Hand the whole chunk over instead of copying it
+            buffer.retained_events += buffer.pending.size();
+            buffer.retained.push_back(std::move(buffer.pending));
+            buffer.pending = std::vector<TraceEvent>();
+            buffer.pending.reserve(EVENT_CHUNK);
+        }
+        else
+        {
+            buffer.pending.clear();
+        }
+    }
+
+    void flush_all_locked()
+    {
+        for (auto &buffer : buffers_)
+        {
+            flush_locked(*buffer);
+        }
+    }
+
+    mutable std::mutex mutex_;
+    std::vector<Region *> regions_;
+    std::vector<Counter *> counters_;
+    std::vector<std::unique_ptr<ThreadBuffer>> buffers_;
+    std::chrono::steady_clock::time_point start_time_;
+    uint64_t start_ticks_;
+};
+
+inline Region::Region(const char *region_name) : name(region_name)
+{
+    Registry::instance().add_region(this);
+}
+
+inline Counter::Counter(const char *counter_name) : name(counter_name)
+{
+    Registry::instance().add_counter(this);
+}
+
+/**
+ * RAII timer: measures from construction to destruction and records into a region
+ */
+class ScopedTimer
+{
+public:
+    explicit ScopedTimer(Region &region)
+        : region_(region), buffer_(Registry::instance().thread_buffer()), start_(read_ticks()) {}
+
+    ~ScopedTimer()
+    {
+        buffer_.pending.push_back({&region_, start_, read_ticks()});
+        if (buffer_.pending.size() >= EVENT_CHUNK)
+        {
+            Registry::instance().flush(buffer_);
+        }
+    }
+
+    ScopedTimer(const ScopedTimer &) = delete;
+    ScopedTimer &operator=(const ScopedTimer &) = delete;
+
+private:
+    Region &region_;
+    ThreadBuffer &buffer_;
+    uint64_t start_;
+};
+
+} // namespace instrumentation
+
+#define INSTRUMENT_CONCAT_INNER(a, b) a##b
+#define INSTRUMENT_CONCAT(a, b) INSTRUMENT_CONCAT_INNER(a, b)
+
+#ifdef CV_LESSONS_INSTRUMENTATION
+#define INSTRUMENT_SCOPE(name)                                                              \
+    static instrumentation::Region INSTRUMENT_CONCAT(instrument_region_, __LINE__){name};   \
+    instrumentation::ScopedTimer INSTRUMENT_CONCAT(instrument_timer_, __LINE__)             \
+    {                                                                                       \
+        INSTRUMENT_CONCAT(instrument_region_, __LINE__)                                     \
+    }
+#define INSTRUMENT_COUNT(name, n)                                                           \
+    do                                                                                      \
+    {                                                                                       \
+        static instrumentation::Counter instrument_counter{name};                           \
+        instrument_counter.add(static_cast<uint64_t>(n));                                   \
+    } while (0)
+#define INSTRUMENT_REPORT(prefix) instrumentation::Registry::instance().report(prefix)
+#else
+#define INSTRUMENT_SCOPE(name) ((void)0)
+#define INSTRUMENT_COUNT(name, n) ((void)0)
+#define INSTRUMENT_REPORT(prefix) ((void)0)
+#endif
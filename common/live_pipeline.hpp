@@ -0,0 +1,410 @@
+#pragma once
+
+#include <algorithm>
+#include <atomic>
+#include <bit>
+#include <chrono>
+#include <cstdint>
+#include <functional>
+#include <iomanip>
+#include <iostream>
+#include <mutex>
+#include <string>
+#include <thread>
+#include <vector>
+#include <opencv2/opencv.hpp>
+#include "instrumentation.hpp"
+
+/*
+ * Live mode: frames go through a chain of stages on a worker thread under a per-frame deadline.
+ *
+ *   LivePipeline live(33.0, LIVE_DROP_OLDEST);
+ *   live.add_stage("gray", gray_fn);
+ *   live.add_stage("cleanup", close_fn, true);   // optional: may be skipped under LIVE_SKIP_STAGES
+ *   live.start();
+ *   loop: live.submit(frame); while (live.poll_result(result)) show(result.image);
+ *   live.stop(); live.report();
+ *
+ * Submitting never blocks on processing. Each frame gets deadline = capture time + budget, and the
+ * policy decides what happens when processing falls behind:
+ *   - LIVE_DROP_OLDEST: frames go through a one-frame mailbox (an atomic pointer exchange), so a new
+ *     frame replaces the one still waiting and the worker always starts on the newest frame. A frame
+ *     whose deadline passed before the worker got to it is dropped instead of processed
+ *   - LIVE_SKIP_STAGES: frames go through a lock-free single-producer/single-consumer queue and every
+ *     frame is processed in order, but an optional stage is skipped when its average cost does not fit
+ *     in the time left before the deadline. A full queue drops the incoming frame
+ * Results come back through a second SPSC queue. Missed deadlines, drops, skipped stages and end-to-end
+ * latency percentiles are reported at the end.
+ */
+
+#define LIVE_QUEUE_CAPACITY 8
+#define LIVE_LATENCY_WINDOW 8192 // latencies kept for the percentiles (most recent frames)
+#define LIVE_STAGE_EMA 0.125     // weight of the newest run in a stage's average cost
+#define LIVE_STAGE_RETRY 64      // an optional stage skipped this many times is run again to re-measure it
+
+/**
+ * Bounded lock-free queue for exactly one producer thread and one consumer thread
+ * Each side caches the other side's index and only reloads it when the queue looks full / empty
+ */
+template <typename T>
+class SpscQueue
+{
+public:
+    explicit SpscQueue(size_t capacity) : slots_(std::bit_ceil(std::max<size_t>(capacity, 2))), mask_(slots_.size() - 1) {}
+
+    /**
+     * Producer only
+     * @return false if the queue is full (the value is not moved from)
+     */
+    bool try_push(T &value)
+    {
+        const size_t tail = tail_.load(std::memory_order_relaxed);
+        if (tail - head_cache_ == slots_.size())
+        {
+            head_cache_ = head_.load(std::memory_order_acquire);
+            if (tail - head_cache_ == slots_.size())
+            {
+                return false;
+            }
+        }
+        slots_[tail & mask_] = std::move(value);
+        tail_.store(tail + 1, std::memory_order_release);
+        return true;
+    }
+
+    /**
+     * Consumer only
+     */
+    bool try_pop(T &value)
+    {
+        const size_t head = head_.load(std::memory_order_relaxed);
+        if (head == tail_cache_)
+        {
+            tail_cache_ = tail_.load(std::memory_order_acquire);
+            if (head == tail_cache_)
+            {
+                return false;
+            }
+        }
+        value = std::move(slots_[head & mask_]);
+        slots_[head & mask_] = T(); // the consumer releases what the slot held (e.g. the frame's pixels)
+        head_.store(head + 1, std::memory_order_release);
+        return true;
+    }
+
+    size_t capacity() const { return slots_.size(); }
+
+private:
+    std::vector<T> slots_;
+    size_t mask_;
+    alignas(64) std::atomic<size_t> head_{0}; // written by the consumer
+    size_t tail_cache_ = 0;                   // consumer's copy of tail_
+    alignas(64) std::atomic<size_t> tail_{0}; // written by the producer
+    size_t head_cache_ = 0;                   // producer's copy of head_
+};
+
+enum LivePolicy
+{
+    LIVE_DROP_OLDEST, // process the newest frame, drop older and already late ones
+    LIVE_SKIP_STAGES  // process every frame, skip optional stages that do not fit before the deadline
+};
+
+struct LiveFrame
+{
+    cv::Mat image;
+    uint64_t index = 0;
+    int64_t capture_ns = 0;  // steady clock
+    int64_t deadline_ns = 0; // capture_ns + budget
+    int64_t done_ns = 0;     // set on results
+};
+
+typedef std::function<void(const cv::Mat &src, cv::Mat &dst)> LiveStageFn;
+
+struct LiveStage
+{
+    std::string name;
+    LiveStageFn run;
+    bool optional = false;
+    double average_ns = 0.0; // moving average of the stage's cost
+    uint64_t skipped = 0;
+};
+
+struct LiveStats
+{
+    uint64_t submitted = 0;
+    uint64_t processed = 0;
+    uint64_t dropped_full = 0;  // queue full at submit
+    uint64_t dropped_stale = 0; // dropped by the worker (older than a newer frame, or already late)
+    uint64_t deadline_misses = 0; // finished late, or dropped because already late
+    uint64_t stages_skipped = 0;
+    uint64_t results_dropped = 0; // nobody polled the results fast enough
+    double p50_ms = 0.0;
+    double p90_ms = 0.0;
+    double p99_ms = 0.0;
+    double p999_ms = 0.0;
+    double max_ms = 0.0;
+};
+
+inline int64_t live_now_ns()
+{
+    return std::chrono::duration_cast<std::chrono::nanoseconds>(std::chrono::steady_clock::now().time_since_epoch())
+        .count();
+}
+
+class LivePipeline
+{
+public:
+    /**
+     * @param budget_ms Time allowed between capture and result for every frame
+     */
+    LivePipeline(double budget_ms, LivePolicy policy, size_t queue_capacity = LIVE_QUEUE_CAPACITY)
+        : budget_ns_(static_cast<int64_t>(budget_ms * 1e6)), policy_(policy), input_(queue_capacity),
+          output_(queue_capacity)
+    {
+        latencies_.reserve(LIVE_LATENCY_WINDOW);
+    }
+
+    ~LivePipeline()
+    {
+        stop();
+        delete latest_.exchange(nullptr);
+    }
+    LivePipeline(const LivePipeline &) = delete;
+    LivePipeline &operator=(const LivePipeline &) = delete;
+
+    /**
+     * Appends a stage (before start() only)
+     */
+    void add_stage(const std::string &name, LiveStageFn run, bool optional = false)
+    {
+        stages_.push_back(LiveStage{name, std::move(run), optional});
+    }
+
+    void start()
+    {
+        if (worker_.joinable())
+        {
+            return;
+        }
+        running_.store(true);
+        worker_ = std::thread([this]() { work(); });
+    }
+
+    void stop()
+    {
+        if (!worker_.joinable())
+        {
+            return;
+        }
+        running_.store(false);
+        wake_.fetch_add(1);
+        wake_.notify_one();
+        worker_.join();
+    }
+
+    /**
+     * Queues a frame (capture thread only); the pipeline owns the pixels from now on, so pass a Mat
+     * that the caller does not reuse (VideoCapture::read into a fresh cv::Mat every time)
+     * @param capture_ns When the frame was captured (steady clock), default now
+     * @return false if the queue was full and the frame was dropped (LIVE_SKIP_STAGES)
+     */
+    bool submit(cv::Mat image, int64_t capture_ns = 0)
+    {
+        LiveFrame frame;
+        frame.image = std::move(image);
+        frame.index = submitted_.fetch_add(1);
+        frame.capture_ns = capture_ns > 0 ? capture_ns : live_now_ns();
+        frame.deadline_ns = frame.capture_ns + budget_ns_;
+        if (policy_ == LIVE_DROP_OLDEST)
+        {
+            LiveFrame *waiting = latest_.exchange(new LiveFrame(std::move(frame)));
+            if (waiting != nullptr)
+            {
+                delete waiting; // never started: the worker only ever takes frames out of the mailbox
+                dropped_stale_.fetch_add(1);
+            }
+        }
+        else if (!input_.try_push(frame))
+        {
+            dropped_full_.fetch_add(1);
+            return false;
+        }
+        wake_.fetch_add(1);
+        wake_.notify_one();
+        return true;
+    }
+
+    /**
+     * Next processed frame, if any (one consumer thread, e.g. the GUI loop)
+     */
+    bool poll_result(LiveFrame &result) { return output_.try_pop(result); }
+
+    LiveStats stats() const
+    {
+        LiveStats s;
+        s.submitted = submitted_.load();
+        s.processed = processed_.load();
+        s.dropped_full = dropped_full_.load();
+        s.dropped_stale = dropped_stale_.load();
+        s.deadline_misses = deadline_misses_.load();
+        s.stages_skipped = stages_skipped_.load();
+        s.results_dropped = results_dropped_.load();
+        std::vector<int64_t> sorted;
+        {
+            std::lock_guard<std::mutex> lock(latency_mutex_);
+            sorted = latencies_;
+        }
+        if (!sorted.empty())
+        {
+            std::sort(sorted.begin(), sorted.end());
+            auto at = [&](double q) {
+                const size_t i = std::min(sorted.size() - 1, static_cast<size_t>(q * static_cast<double>(sorted.size())));
+                return sorted[i] / 1e6;
+            };
+            s.p50_ms = at(0.50);
+            s.p90_ms = at(0.90);
+            s.p99_ms = at(0.99);
+            s.p999_ms = at(0.999);
+            s.max_ms = sorted.back() / 1e6;
+        }
+        return s;
+    }
+
+    /**
+     * Prints the counters, the stage costs and the latency percentiles (after stop())
+     */
+    void report(const std::string &title = "Live mode") const
+    {
+        const LiveStats s = stats();
+        std::cout << "\n=== " << title << " (budget " << std::fixed << std::setprecision(1) << budget_ns_ / 1e6 << " ms, "
+                  << (policy_ == LIVE_DROP_OLDEST ? "drop oldest" : "skip stages") << ") ===" << std::endl;
+        std::cout << "Frames: " << s.submitted << " submitted, " << s.processed << " processed, " << s.dropped_stale
+                  << " dropped (stale), " << s.dropped_full << " dropped (queue full), " << s.results_dropped
+                  << " results not collected" << std::endl;
+        std::cout << "Deadline misses: " << s.deadline_misses << " | Stages skipped: " << s.stages_skipped << std::endl;
+        for (const LiveStage &stage : stages_)
+        {
+            std::cout << "  " << std::left << std::setw(16) << stage.name << std::right << std::fixed
+                      << std::setprecision(2) << stage.average_ns / 1e6 << " ms avg"
+                      << (stage.optional ? ", skipped " + std::to_string(stage.skipped) : "") << std::endl;
+        }
+        std::cout << std::fixed << std::setprecision(2) << "Latency ms: p50 " << s.p50_ms << " | p90 " << s.p90_ms
+                  << " | p99 " << s.p99_ms << " | p99.9 " << s.p999_ms << " | max " << s.max_ms << std::endl;
+    }
+
+private:
+    /**
+     * Next frame to process, or false when stopping
+     */
+    bool next_frame(LiveFrame &frame)
+    {
+        while (true)
+        {
+            const uint32_t seen = wake_.load();
+            if (policy_ == LIVE_DROP_OLDEST)
+            {
+                LiveFrame *newest = latest_.exchange(nullptr);
+                if (newest != nullptr)
+                {
+                    frame = std::move(*newest);
+                    delete newest;
+                    if (live_now_ns() < frame.deadline_ns)
+                    {
+                        return true;
+                    }
+                    // Late before it even started: the next frame is a better use of the time
+                    dropped_stale_.fetch_add(1);
+                    deadline_misses_.fetch_add(1);
+                    continue;
+                }
+            }
+            else if (input_.try_pop(frame))
+            {
+                return true;
+            }
+            if (!running_.load())
+            {
+                return false;
+            }
+            wake_.wait(seen);
+        }
+    }
+
+    void work()
+    {
+        LiveFrame frame;
+        while (next_frame(frame))
+        {
+            INSTRUMENT_SCOPE("live.frame");
+            cv::Mat current = frame.image;
+            for (LiveStage &stage : stages_)
+            {
+                const int64_t start = live_now_ns();
+                if (stage.optional && policy_ == LIVE_SKIP_STAGES && start + stage.average_ns > frame.deadline_ns)
+                {
+                    stage.skipped++;
+                    stages_skipped_.fetch_add(1);
+                    if (stage.skipped % LIVE_STAGE_RETRY == 0)
+                    {
+                        stage.average_ns = 0.0; // measure again next frame: one slow run must not disable it for good
+                    }
+                    continue;
+                }
+                cv::Mat next;
+                stage.run(current, next);
+                current = next;
+                const double ns = static_cast<double>(live_now_ns() - start);
+                stage.average_ns = stage.average_ns == 0.0 ? ns : stage.average_ns + LIVE_STAGE_EMA * (ns - stage.average_ns);
+            }
+
+            frame.image = current;
+            frame.done_ns = live_now_ns();
+            processed_.fetch_add(1);
+            if (frame.done_ns > frame.deadline_ns)
+            {
+                deadline_misses_.fetch_add(1);
+            }
+            record_latency(frame.done_ns - frame.capture_ns);
+            if (!output_.try_push(frame))
+            {
+                results_dropped_.fetch_add(1);
+            }
+            frame = LiveFrame();
+        }
+    }
+
+    void record_latency(int64_t ns)
+    {
+        std::lock_guard<std::mutex> lock(latency_mutex_);
+        if (latencies_.size() < LIVE_LATENCY_WINDOW)
+        {
+            latencies_.push_back(ns);
+        }
+        else
+        {
+            latencies_[latency_next_] = ns;
+        }
+        latency_next_ = (latency_next_ + 1) % LIVE_LATENCY_WINDOW;
+    }
+
+    int64_t budget_ns_;
+    LivePolicy policy_;
+    std::vector<LiveStage> stages_;
+    SpscQueue<LiveFrame> input_;              // LIVE_SKIP_STAGES
+    std::atomic<LiveFrame *> latest_{nullptr}; // LIVE_DROP_OLDEST mailbox
+    SpscQueue<LiveFrame> output_;
+    std::thread worker_;
+    std::atomic<bool> running_{false};
+    std::atomic<uint32_t> wake_{0}; // bumped on submit and stop, the idle worker waits on it
+
+    std::atomic<uint64_t> submitted_{0};
+    std::atomic<uint64_t> processed_{0};
+    std::atomic<uint64_t> dropped_full_{0};
+    std::atomic<uint64_t> dropped_stale_{0};
+    std::atomic<uint64_t> deadline_misses_{0};
+    std::atomic<uint64_t> stages_skipped_{0};
+    std::atomic<uint64_t> results_dropped_{0};
+    mutable std::mutex latency_mutex_;
+    std::vector<int64_t> latencies_;
+    size_t latency_next_ = 0;
+};
@@ -0,0 +1,221 @@
+#pragma once
+
+#include <algorithm>
+#include <array>
+#include <cmath>
+#include <cstdint>
+#include <iostream>
+#include <span>
+#include <vector>
+#include <opencv2/opencv.hpp>
+#include "auto_exposure.hpp"
+#include "batch_ops.hpp"
+#include "color_convert.hpp"
+#include "gamma_correction.hpp"
+#include "instrumentation.hpp"
+
+/*
+ * Parameter sweeps over one image: many thresholds or gammas evaluated in a single read of the source.
+ *
+ * Every 8-bit point operation is a 256-entry table, so a sweep is a list of tables. Each source row is
+ * loaded once and run through all the tables while it sits in L1, instead of streaming the whole image
+ * from memory once per setting. When only statistics are needed (foreground fraction per threshold,
+ * mean brightness per gamma) they come from one histogram and no output image is written at all.
+ */
+
+#define SWEEP_BAND_ROWS 16
+
+struct ThresholdParams
+{
+    double thresh = 127.0;
+    double max_value = 255.0;
+    int type = cv::THRESH_BINARY; // one of the five basic types (no OTSU/TRIANGLE flags)
+};
+
+/**
+ * Applies every table to the source in one pass: outputs[k] = luts[k][src]
+ * @param src CV_8U image, any number of channels
+ * @param luts 1x256 CV_8U tables
+ * @param outputs Resized to luts.size(), each image gets the size and type of src
+ */
+inline void sweep_luts(const cv::Mat &src, const std::vector<cv::Mat> &luts, std::vector<cv::Mat> &outputs)
+{
+    if (src.empty() || src.depth() != CV_8U)
+    {
+        std::cerr << "Error: sweep_luts needs a non-empty 8-bit image!" << std::endl;
+        return;
+    }
+    INSTRUMENT_SCOPE("sweep.luts");
+    INSTRUMENT_COUNT("sweep.settings", luts.size());
+    outputs.resize(luts.size());
+    for (cv::Mat &out : outputs)
+    {
+        out.create(src.size(), src.type());
+    }
+    const int row_len = src.cols * src.channels();
+    const int bands = (src.rows + SWEEP_BAND_ROWS - 1) / SWEEP_BAND_ROWS;
+    cv::parallel_for_(cv::Range(0, bands), [&](const cv::Range &range) {
+        for (int y = range.start * SWEEP_BAND_ROWS; y < std::min(src.rows, range.end * SWEEP_BAND_ROWS); y++)
+        {
+            const uchar *s = src.ptr<uchar>(y);
+            for (size_t k = 0; k < luts.size(); k++)
+            {
+                const uchar *lut = luts[k].ptr<uchar>();
+                uchar *d = outputs[k].ptr<uchar>(y);
+                for (int x = 0; x < row_len; x++)
+                {
+                    d[x] = lut[s[x]];
+                }
+            }
+        }
+    });
+}
+
+/**
+ * Thresholds an 8-bit image with many parameter sets in one pass over the source
+ * Same results as calling cv::threshold once per parameter set
+ */
+inline void sweep_threshold(const cv::Mat &gray, std::span<const ThresholdParams> params, std::vector<cv::Mat> &outputs)
+{
+    std::vector<cv::Mat> luts;
+    luts.reserve(params.size());
+    for (const ThresholdParams &p : params)
+    {
+        if (p.type < cv::THRESH_BINARY || p.type > cv::THRESH_TOZERO_INV)
+        {
+            std::cerr << "Error: sweep_threshold supports the five basic threshold types only!" << std::endl;
+            return;
+        }
+        luts.push_back(threshold_lut(p.thresh, p.max_value, p.type));
+    }
+    sweep_luts(gray, luts, outputs);
+}
+
+/**
+ * Gamma corrects an image with many gammas
+ * 8-bit images are read once for all gammas; 16-bit and float images fall back to one gammaCorrectionLUT call
+ * per gamma (their tables or fast_pow do not fit the shared-row scheme)
+ */
+inline void sweep_gamma(const cv::Mat &src, std::span<const double> gammas, std::vector<cv::Mat> &outputs)
+{
+    for (double gamma : gammas)
+    {
+        if (gamma <= 0.0)
+        {
+            std::cerr << "Error: sweep_gamma needs gammas > 0!" << std::endl;
+            return;
+        }
+    }
+    if (src.depth() != CV_8U)
+    {
+        outputs.resize(gammas.size());
+        for (size_t k = 0; k < gammas.size(); k++)
+        {
+            outputs[k] = gammaCorrectionLUT(src, gammas[k]);
+        }
+        return;
+    }
+    std::vector<cv::Mat> luts;
+    luts.reserve(gammas.size());
+    for (double gamma : gammas)
+    {
+        luts.push_back(gamma_table_8u(gamma));
+    }
+    sweep_luts(src, luts, outputs);
+}
+
+/**
+ * Full-resolution 256-bin histogram of an 8-bit single-channel image
+ * Bands are counted in parallel into private histograms and summed
+ */
+inline LumaHistogram gray_histogram(const cv::Mat &gray)
+{
+    LumaHistogram hist{};
+    if (gray.empty() || gray.type() != CV_8UC1)
+    {
+        std::cerr << "Error: gray_histogram needs a CV_8UC1 image!" << std::endl;
+        return hist;
+    }
+    INSTRUMENT_SCOPE("sweep.histogram");
+    const int bands = std::max(1, std::min(gray.rows, cv::getNumThreads() * 4));
+    std::vector<LumaHistogram> partial(bands, LumaHistogram{});
+    cv::parallel_for_(cv::Range(0, bands), [&](const cv::Range &range) {
+        for (int b = range.start; b < range.end; b++)
+        {
+            LumaHistogram &h = partial[b];
+            const int y0 = static_cast<int>(static_cast<int64_t>(gray.rows) * b / bands);
+            const int y1 = static_cast<int>(static_cast<int64_t>(gray.rows) * (b + 1) / bands);
+            for (int y = y0; y < y1; y++)
+            {
+                const uchar *row = gray.ptr<uchar>(y);
+                for (int x = 0; x < gray.cols; x++)
+                {
+                    h[row[x]]++;
+                }
+            }
+        }
+    });
+    for (const LumaHistogram &h : partial)
+    {
+        for (int i = 0; i < 256; i++)
+        {
+            hist[i] += h[i];
+        }
+    }
+    return hist;
+}
+
+/**
+ * Fraction of pixels above every threshold (what THRESH_BINARY turns white), from one histogram
+ * Costs 256 additions plus one lookup per threshold, so thousands of thresholds are free
+ */
+inline std::vector<double> foreground_fractions(const LumaHistogram &hist, std::span<const double> thresholds)
+{
+    // above[i] = number of pixels with a value > i - 1, i.e. >= i
+    std::array<uint64_t, 257> above{};
+    for (int i = 255; i >= 0; i--)
+    {
+        above[i] = above[i + 1] + hist[i];
+    }
+    std::vector<double> fractions;
+    fractions.reserve(thresholds.size());
+    const double total = static_cast<double>(std::max<uint64_t>(1, above[0]));
+    for (double t : thresholds)
+    {
+        // value > t  <=>  value >= floor(t) + 1 for integer values
+        const int first = static_cast<int>(std::clamp(std::floor(t) + 1.0, 0.0, 256.0));
+        fractions.push_back(above[first] / total);
+    }
+    return fractions;
+}
+
+inline std::vector<double> foreground_fractions(const cv::Mat &gray, std::span<const double> thresholds)
+{
+    return foreground_fractions(gray_histogram(gray), thresholds);
+}
+
+/**
+ * Mean output value of every gamma, from one histogram (no corrected image is produced)
+ */
+inline std::vector<double> gamma_sweep_means(const LumaHistogram &hist, std::span<const double> gammas)
+{
+    uint64_t total = 0;
+    for (uint32_t n : hist)
+    {
+        total += n;
+    }
+    std::vector<double> means;
+    means.reserve(gammas.size());
+    for (double gamma : gammas)
+    {
+        const cv::Mat table = gamma_table_8u(gamma);
+        const uchar *p = table.ptr<uchar>();
+        double sum = 0.0;
+        for (int i = 0; i < 256; i++)
+        {
+            sum += static_cast<double>(hist[i]) * p[i];
+        }
+        means.push_back(total > 0 ? sum / static_cast<double>(total) : 0.0);
+    }
+    return means;
+}
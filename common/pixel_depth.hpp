@@ -0,0 +1,23 @@
+#pragma once
+
+#include <opencv2/opencv.hpp>
+
+/**
+ * Returns the white level of a depth: 255 for CV_8U, 65535 for CV_16U, 1.0 for float images
+ * @param depth OpenCV depth (img.depth())
+ */
+inline double depth_max_value(int depth)
+{
+    switch (depth)
+    {
+    case CV_8U:
+        return 255.0;
+    case CV_16U:
+        return 65535.0;
+    case CV_32F:
+    case CV_64F:
+        return 1.0;
+    default:
+        return 0.0;
+    }
+}
@@ -0,0 +1,245 @@
+#pragma once
+
+#include <cstdint>
+#include <iostream>
+#include <opencv2/opencv.hpp>
+#include "instrumentation.hpp"
+
+/*
+ * Planar (structure-of-arrays) BGR image: three separate 8-bit planes instead of interleaved
+ * cv::Vec3b pixels. Per-channel work (gamma, normalization, thresholds) becomes a plain loop
+ * over one contiguous row, with no shuffles between channels.
+ */
+
+#define PLANAR_DEFAULT_ALIGNMENT 64
+
+/**
+ * Three B/G/R planes backed by a single allocation
+ * Every plane row starts at a multiple of the row stride (aligned to `alignment` bytes)
+ */
+struct PlanarImage
+{
+    cv::Mat buffer;    // 3*rows x stride, owns the pixels
+    cv::Mat planes[3]; // B, G, R views into buffer (CV_8UC1, step == stride)
+
+    /**
+     * Allocates an uninitialised planar image
+     * @param size Image size
+     * @param alignment Row stride alignment in bytes (1 = tightly packed)
+     */
+    static PlanarImage create(cv::Size size, int alignment = PLANAR_DEFAULT_ALIGNMENT)
+    {
+        PlanarImage img;
+        int stride = size.width;
+        if (alignment > 1)
+        {
+            stride = (size.width + alignment - 1) / alignment * alignment;
+        }
+        img.buffer.create(3 * size.height, stride, CV_8UC1);
+        for (int c = 0; c < 3; c++)
+        {
+            img.planes[c] = img.buffer(cv::Rect(0, c * size.height, size.width, size.height));
+        }
+        return img;
+    }
+
+    bool empty() const { return buffer.empty(); }
+    cv::Size size() const { return planes[0].size(); }
+    int rows() const { return planes[0].rows; }
+    int cols() const { return planes[0].cols; }
+    size_t stride() const { return buffer.step; }
+    cv::Mat &blue() { return planes[0]; }
+    cv::Mat &green() { return planes[1]; }
+    cv::Mat &red() { return planes[2]; }
+};
+
+/**
+ * Makes sure dst is a planar image of the given size (reuses its buffer when possible)
+ */
+inline void ensure_planar(PlanarImage &dst, cv::Size size, int alignment = PLANAR_DEFAULT_ALIGNMENT)
+{
+    if (dst.empty() || dst.size() != size)
+    {
+        dst = PlanarImage::create(size, alignment);
+    }
+}
+
+/**
+ * Splits an interleaved BGR image into planes (uses OpenCV's SIMD deinterleave)
+ * @param bgr Input CV_8UC3 image
+ * @param dst Output planar image, allocated if needed
+ */
+inline void deinterleave(const cv::Mat &bgr, PlanarImage &dst)
+{
+    if (bgr.empty() || bgr.type() != CV_8UC3)
+    {
+        std::cerr << "Error: deinterleave expects a CV_8UC3 image!" << std::endl;
+        return;
+    }
+    INSTRUMENT_SCOPE("planar.deinterleave");
+    ensure_planar(dst, bgr.size());
+
+    // split writes straight into the existing plane views because size and type already match
+    cv::split(bgr, dst.planes);
+}
+
+/**
+ * Merges planes back into an interleaved BGR image (uses OpenCV's SIMD interleave)
+ * @param src Input planar image
+ * @param bgr Output CV_8UC3 image
+ */
+inline void interleave(const PlanarImage &src, cv::Mat &bgr)
+{
+    if (src.empty())
+    {
+        std::cerr << "Error: interleave got an empty planar image!" << std::endl;
+        return;
+    }
+    INSTRUMENT_SCOPE("planar.interleave");
+    cv::merge(src.planes, 3, bgr);
+}
+
+/**
+ * Converts planar BGR to a single-channel grayscale image
+ * Fixed-point version of 0.299*R + 0.587*G + 0.114*B (weights scaled by 256)
+ * @param src Input planar image
+ * @param gray Output CV_8UC1 image
+ */
+inline void planar_to_gray(const PlanarImage &src, cv::Mat &gray)
+{
+    if (src.empty())
+    {
+        std::cerr << "Error: planar_to_gray got an empty planar image!" << std::endl;
+        return;
+    }
+    INSTRUMENT_SCOPE("planar.to_gray");
+    gray.create(src.size(), CV_8UC1);
+
+    const int cols = src.cols();
+    for (int y = 0; y < src.rows(); y++)
+    {
+        const uchar *b = src.planes[0].ptr<uchar>(y);
+        const uchar *g = src.planes[1].ptr<uchar>(y);
+        const uchar *r = src.planes[2].ptr<uchar>(y);
+        uchar *out = gray.ptr<uchar>(y);
+
+        // Straight loop over three contiguous rows: the compiler vectorizes it
+        for (int x = 0; x < cols; x++)
+        {
+            out[x] = static_cast<uchar>((b[x] * 29 + g[x] * 150 + r[x] * 77 + 128) >> 8);
+        }
+    }
+}
+
+/**
+ * Applies one lookup table per plane (per-channel gamma, color grading...)
+ * @param luts Three 1x256 CV_8U tables for B, G, R; pass the same table three times for a global LUT
+ */
+inline void planar_lut(const PlanarImage &src, const cv::Mat luts[3], PlanarImage &dst)
+{
+    if (src.empty())
+    {
+        std::cerr << "Error: planar_lut got an empty planar image!" << std::endl;
+        return;
+    }
+    INSTRUMENT_SCOPE("planar.lut");
+    ensure_planar(dst, src.size());
+    for (int c = 0; c < 3; c++)
+    {
+        cv::LUT(src.planes[c], luts[c], dst.planes[c]);
+    }
+}
+
+/**
+ * Per-channel linear transform with saturation: dst_c = alpha_c * src_c + beta_c
+ * Covers per-channel normalization as well as the brightness/contrast of lesson 06
+ */
+inline void planar_scale_add(const PlanarImage &src, const cv::Scalar &alpha, const cv::Scalar &beta,
+                             PlanarImage &dst)
+{
+    if (src.empty())
+    {
+        std::cerr << "Error: planar_scale_add got an empty planar image!" << std::endl;
+        return;
+    }
+    INSTRUMENT_SCOPE("planar.scale_add");
+    ensure_planar(dst, src.size());
+    for (int c = 0; c < 3; c++)
+    {
+        src.planes[c].convertTo(dst.planes[c], CV_8U, alpha[c], beta[c]);
+    }
+}
+
+/**
+ * Saturating per-plane addition of two planar images (lesson 05 cv::add)
+ */
+inline void planar_add(const PlanarImage &a, const PlanarImage &b, PlanarImage &dst)
+{
+    if (a.empty() || a.size() != b.size())
+    {
+        std::cerr << "Error: planar_add needs two planar images of the same size!" << std::endl;
+        return;
+    }
+    INSTRUMENT_SCOPE("planar.add");
+    ensure_planar(dst, a.size());
+    for (int c = 0; c < 3; c++)
+    {
+        cv::add(a.planes[c], b.planes[c], dst.planes[c]);
+    }
+}
+
+/**
+ * Saturating per-plane subtraction of two planar images (lesson 05 cv::subtract)
+ */
+inline void planar_subtract(const PlanarImage &a, const PlanarImage &b, PlanarImage &dst)
+{
+    if (a.empty() || a.size() != b.size())
+    {
+        std::cerr << "Error: planar_subtract needs two planar images of the same size!" << std::endl;
+        return;
+    }
+    INSTRUMENT_SCOPE("planar.subtract");
+    ensure_planar(dst, a.size());
+    for (int c = 0; c < 3; c++)
+    {
+        cv::subtract(a.planes[c], b.planes[c], dst.planes[c]);
+    }
+}
+
+/**
+ * Per-plane weighted sum (lesson 05 cv::addWeighted)
+ */
+inline void planar_add_weighted(const PlanarImage &a, double alpha, const PlanarImage &b, double beta,
+                                double gamma, PlanarImage &dst)
+{
+    if (a.empty() || a.size() != b.size())
+    {
+        std::cerr << "Error: planar_add_weighted needs two planar images of the same size!" << std::endl;
+        return;
+    }
+    INSTRUMENT_SCOPE("planar.add_weighted");
+    ensure_planar(dst, a.size());
+    for (int c = 0; c < 3; c++)
+    {
+        cv::addWeighted(a.planes[c], alpha, b.planes[c], beta, gamma, dst.planes[c]);
+    }
+}
+
+/**
+ * Thresholds every plane with its own threshold value (lesson 09 types: THRESH_BINARY, ...)
+ */
+inline void planar_threshold(const PlanarImage &src, const cv::Scalar &thresh, double max_value, int type,
+                             PlanarImage &dst)
+{
+    if (src.empty())
+    {
+        std::cerr << "Error: planar_threshold got an empty planar image!" << std::endl;
+        return;
+    }
+    INSTRUMENT_SCOPE("planar.threshold");
+    ensure_planar(dst, src.size());
+    for (int c = 0; c < 3; c++)
+    {
+        cv::threshold(src.planes[c], dst.planes[c], thresh[c], max_value, type);
+    }
+}
@@ -0,0 +1,248 @@
+#pragma once
+
+#include <cerrno>
+#include <cstdint>
+#include <cstring>
+#include <iostream>
+#include <string>
+#include <sys/socket.h>
+#include <sys/un.h>
+#include <unistd.h>
+#include "shared_memory.hpp"
+
+/*
+ * Protocol and client of the processing service (service/main.cpp).
+ *
+ * The service is a long-running process that runs the lesson operations for other processes, so a
+ * tiny job does not pay process startup, OpenCV initialization and image decoding every time.
+ * Clients talk to it over a Unix domain stream socket with fixed-size binary messages:
+ *
+ *   client                                         service
+ *   write_shared_image(in, "/job_in", img)
+ *   ServiceRequest{op, input "/job_in",     --->   maps /job_in (mapping kept between requests),
+ *                  output "/job_out"}              writes the result into /job_out (created or grown)
+ *                                          <---   ServiceResponse{id, status}
+ *   out.open("/job_out"), shared_image_view(out)
+ *
+ * Requests may be pipelined: send several, then read the responses (they come back in order).
+ * The input can also be an image file, which the service decodes once and keeps in memory.
+ */
+
+#define SERVICE_SOCKET_PATH "/tmp/cv_lessons.sock"
+#define SERVICE_MAGIC 0x31564353u // "SCV1"
+#define SERVICE_NAME_LEN 256
+
+// A peer that went away must not kill the process with SIGPIPE
+#ifdef MSG_NOSIGNAL
+#define SERVICE_SEND_FLAGS MSG_NOSIGNAL
+#else
+#define SERVICE_SEND_FLAGS 0
+#endif
+
+enum ServiceOp : int32_t
+{
+    SERVICE_PING = 0,
+    SERVICE_GRAYSCALE,  // BGR/BGRA to one channel
+    SERVICE_CROP,       // rect = x, y, width, height
+    SERVICE_ADD,        // input + second, or input + params[0] when there is no second image
+    SERVICE_SUBTRACT,   // input - second, or input - params[0]
+    SERVICE_MULTIPLY,   // input * second, or input * params[0]
+    SERVICE_DIVIDE,     // input / second, or input / params[0]
+    SERVICE_GAMMA,      // params[0] = gamma
+    SERVICE_CONTRAST,   // params[0] = alpha, params[1] = beta
+    SERVICE_THRESHOLD,  // params[0] = thresh, params[1] = max value, params[2] = cv::THRESH_* type
+    SERVICE_OP_COUNT
+};
+
+enum ServiceSource : int32_t
+{
+    SOURCE_SHARED = 0, // input is a shared image segment name
+    SOURCE_FILE = 1    // input is an image path, decoded by the service and cached
+};
+
+enum ServiceStatus : int32_t
+{
+    STATUS_OK = 0,
+    STATUS_BAD_REQUEST = 1,
+    STATUS_NO_INPUT = 2,
+    STATUS_FAILED = 3
+};
+
+struct ServiceRequest
+{
+    uint32_t magic = SERVICE_MAGIC;
+    int32_t op = SERVICE_PING;
+    uint64_t id = 0; // echoed in the response
+    int32_t source = SOURCE_SHARED;
+    int32_t rect[4] = {};
+    double params[3] = {};
+    char input[SERVICE_NAME_LEN] = {};
+    char second[SERVICE_NAME_LEN] = {}; // optional second image segment for arithmetic
+    char output[SERVICE_NAME_LEN] = {}; // segment the result is written to
+};
+
+struct ServiceResponse
+{
+    uint32_t magic = SERVICE_MAGIC;
+    int32_t status = STATUS_OK;
+    uint64_t id = 0;
+    double value = 0.0;      // threshold that was used (SERVICE_THRESHOLD)
+    uint32_t batch_size = 0; // requests that were run together with this one
+    uint64_t service_ns = 0; // time spent in the service for the whole batch
+    char message[128] = {};
+};
+
+/**
+ * Copies a name into a fixed-size message field
+ * @return false if it does not fit
+ */
+inline bool set_service_name(char (&field)[SERVICE_NAME_LEN], const std::string &name)
+{
+    if (name.size() >= SERVICE_NAME_LEN)
+    {
+        std::cerr << "Error: Name '" << name << "' is too long for a service request!" << std::endl;
+        return false;
+    }
+    std::memset(field, 0, SERVICE_NAME_LEN);
+    std::memcpy(field, name.data(), name.size());
+    return true;
+}
+
+inline ServiceRequest service_request(ServiceOp op, const std::string &input, const std::string &output,
+                                      ServiceSource source = SOURCE_SHARED)
+{
+    ServiceRequest req;
+    req.op = op;
+    req.source = source;
+    set_service_name(req.input, input);
+    set_service_name(req.output, output);
+    return req;
+}
+
+/**
+ * Writes or reads exactly n bytes on a blocking socket
+ */
+inline bool send_all(int fd, const void *data, size_t n)
+{
+    const char *p = static_cast<const char *>(data);
+    while (n > 0)
+    {
+        const ssize_t k = ::send(fd, p, n, SERVICE_SEND_FLAGS);
+        if (k < 0 && errno == EINTR)
+        {
+            continue;
+        }
+        if (k <= 0)
+        {
+            return false;
+        }
+        p += k;
+        n -= static_cast<size_t>(k);
+    }
+    return true;
+}
+
+inline bool recv_all(int fd, void *data, size_t n)
+{
+    char *p = static_cast<char *>(data);
+    while (n > 0)
+    {
+        const ssize_t k = ::read(fd, p, n);
+        if (k < 0 && errno == EINTR)
+        {
+            continue;
+        }
+        if (k <= 0)
+        {
+            return false;
+        }
+        p += k;
+        n -= static_cast<size_t>(k);
+    }
+    return true;
+}
+
+/**
+ * Opens a connected Unix stream socket, -1 on failure
+ */
+inline int connect_unix_socket(const std::string &path)
+{
+    sockaddr_un addr{};
+    if (path.size() >= sizeof(addr.sun_path))
+    {
+        return -1;
+    }
+    addr.sun_family = AF_UNIX;
+    std::memcpy(addr.sun_path, path.c_str(), path.size() + 1);
+    int fd = ::socket(AF_UNIX, SOCK_STREAM, 0);
+    if (fd < 0)
+    {
+        return -1;
+    }
+    if (::connect(fd, reinterpret_cast<const sockaddr *>(&addr), sizeof(addr)) != 0)
+    {
+        ::close(fd);
+        return -1;
+    }
+    return fd;
+}
+
+class ServiceClient
+{
+public:
+    ServiceClient() = default;
+    ~ServiceClient() { close(); }
+    ServiceClient(const ServiceClient &) = delete;
+    ServiceClient &operator=(const ServiceClient &) = delete;
+
+    bool connect(const std::string &path = SERVICE_SOCKET_PATH)
+    {
+        close();
+        fd_ = connect_unix_socket(path);
+        if (fd_ < 0)
+        {
+            std::cerr << "Error: Could not connect to the processing service at '" << path << "'!" << std::endl;
+            return false;
+        }
+        return true;
+    }
+
+    void close()
+    {
+        if (fd_ >= 0)
+        {
+            ::close(fd_);
+            fd_ = -1;
+        }
+    }
+
+    bool is_connected() const { return fd_ >= 0; }
+
+    /**
+     * Sends one request without waiting (responses come back in the order of the requests)
+     */
+    bool send(const ServiceRequest &req) { return fd_ >= 0 && send_all(fd_, &req, sizeof(req)); }
+
+    bool receive(ServiceResponse &resp)
+    {
+        if (fd_ < 0 || !recv_all(fd_, &resp, sizeof(resp)) || resp.magic != SERVICE_MAGIC)
+        {
+            std::cerr << "Error: Lost the connection to the processing service!" << std::endl;
+            close();
+            return false;
+        }
+        return true;
+    }
+
+    /**
+     * Sends a request and waits for its response
+     * @return true if the request succeeded (resp.message explains a failure)
+     */
+    bool call(const ServiceRequest &req, ServiceResponse &resp)
+    {
+        return send(req) && receive(resp) && resp.status == STATUS_OK;
+    }
+
+private:
+    int fd_ = -1;
+};
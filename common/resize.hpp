@@ -0,0 +1,380 @@
+#pragma once
+
+#include <algorithm>
+#include <cmath>
+#include <iostream>
+#include <map>
+#include <memory>
+#include <mutex>
+#include <span>
+#include <tuple>
+#include <vector>
+#include <opencv2/opencv.hpp>
+#include "batch_ops.hpp"
+#include "instrumentation.hpp"
+
+/*
+ * Separable resize for 8-bit images with cached coefficient tables.
+ *
+ * A resize plan holds, for each axis, the first source sample and the weights of every output
+ * sample. Plans depend only on (source size, destination size, filter), so they are built once and
+ * shared by every later call with the same geometry (video frames, hundreds of same-size crops).
+ * The kernel runs a horizontal pass into a small ring of float rows, then a vertical pass that
+ * combines whole rows (both loops vectorize).
+ *
+ * Pixel centers follow cv::resize (source = (dst + 0.5) * scale - 0.5) and borders are replicated.
+ */
+
+#define RESIZE_PLAN_CACHE_SIZE 256
+#define RESIZE_LANCZOS_LOBES 3
+
+enum ResizeFilter
+{
+    RESIZE_BILINEAR, // 2 taps
+    RESIZE_AREA,     // box average over the covered source pixels (bilinear when enlarging)
+    RESIZE_LANCZOS3  // windowed sinc, widened when shrinking so it also anti-aliases
+};
+
+/**
+ * Coefficients of one axis: output i = sum over t of weights[i * taps + t] * source[start[i] + t]
+ */
+struct ResizeAxis
+{
+    int taps = 0;
+    std::vector<int> start;
+    std::vector<float> weights;
+};
+
+struct ResizePlan
+{
+    ResizeAxis x;
+    ResizeAxis y;
+};
+
+inline double lanczos_weight(double x)
+{
+    x = std::abs(x);
+    if (x < 1e-9)
+    {
+        return 1.0;
+    }
+    if (x >= RESIZE_LANCZOS_LOBES)
+    {
+        return 0.0;
+    }
+    const double px = CV_PI * x;
+    return RESIZE_LANCZOS_LOBES * std::sin(px) * std::sin(px / RESIZE_LANCZOS_LOBES) / (px * px);
+}
+
+/**
+ * Builds the coefficient table of one axis
+ * Taps that fall outside the source are folded onto the edge sample (replicated border)
+ */
+inline ResizeAxis build_resize_axis(int src_len, int dst_len, ResizeFilter filter)
+{
+    const double scale = static_cast<double>(src_len) / dst_len;
+    if (filter == RESIZE_AREA && scale <= 1.0)
+    {
+        filter = RESIZE_BILINEAR;
+    }
+
+    // Raw (index, weight) pairs of every output sample
+    std::vector<std::vector<std::pair<int, double>>> raw(dst_len);
+    for (int d = 0; d < dst_len; d++)
+    {
+        auto &taps = raw[d];
+        if (filter == RESIZE_BILINEAR)
+        {
+            const double s = (d + 0.5) * scale - 0.5;
+            const int i = static_cast<int>(std::floor(s));
+            const double f = s - i;
+            taps = {{i, 1.0 - f}, {i + 1, f}};
+        }
+        else if (filter == RESIZE_AREA)
+        {
+            // Output pixel d covers [d * scale, (d + 1) * scale) of the source
+            const double lo = d * scale;
+            const double hi = (d + 1) * scale;
+            for (int i = static_cast<int>(std::floor(lo)); i < hi; i++)
+            {
+                const double overlap = std::min<double>(i + 1, hi) - std::max<double>(i, lo);
+                if (overlap > 1e-12)
+                {
+                    taps.push_back({i, overlap / scale});
+                }
+            }
+        }
+        else
+        {
+            const double support = RESIZE_LANCZOS_LOBES * std::max(1.0, scale);
+            const double stretch = std::max(1.0, scale);
+            const double center = (d + 0.5) * scale - 0.5;
+            double sum = 0.0;
+            for (int i = static_cast<int>(std::ceil(center - support)); i <= static_cast<int>(std::floor(center + support)); i++)
+            {
+                const double w = lanczos_weight((i - center) / stretch);
+                if (w != 0.0)
+                {
+                    taps.push_back({i, w});
+                    sum += w;
+                }
+            }
+            for (auto &tap : taps)
+            {
+                tap.second /= sum;
+            }
+        }
+    }
+
+    // Fold the border and lay the taps out as contiguous windows of a common length
+    ResizeAxis axis;
+    for (auto &taps : raw)
+    {
+        int lo = src_len, hi = -1;
+        for (auto &tap : taps)
+        {
+            tap.first = std::clamp(tap.first, 0, src_len - 1);
+            lo = std::min(lo, tap.first);
+            hi = std::max(hi, tap.first);
+        }
+        axis.taps = std::max(axis.taps, hi - lo + 1);
+    }
+    axis.taps = std::min(axis.taps, src_len);
+    axis.start.resize(dst_len);
+    axis.weights.assign(static_cast<size_t>(dst_len) * axis.taps, 0.0f);
+    for (int d = 0; d < dst_len; d++)
+    {
+        int lo = src_len;
+        for (const auto &tap : raw[d])
+        {
+            lo = std::min(lo, tap.first);
+        }
+        lo = std::min(lo, src_len - axis.taps);
+        axis.start[d] = lo;
+        for (const auto &tap : raw[d])
+        {
+            axis.weights[static_cast<size_t>(d) * axis.taps + (tap.first - lo)] += static_cast<float>(tap.second);
+        }
+    }
+    return axis;
+}
+
+/**
+ * Returns the (cached) plan for a geometry; safe to call from several threads
+ */
+inline std::shared_ptr<const ResizePlan> resize_plan(cv::Size src, cv::Size dst, ResizeFilter filter)
+{
+    typedef std::tuple<int, int, int, int, int> Key;
+    static std::mutex mutex;
+    static std::map<Key, std::shared_ptr<const ResizePlan>> cache;
+
+    const Key key(src.width, src.height, dst.width, dst.height, filter);
+    {
+        std::lock_guard<std::mutex> lock(mutex);
+        auto it = cache.find(key);
+        if (it != cache.end())
+        {
+            return it->second;
+        }
+    }
+
+    INSTRUMENT_SCOPE("resize.build_plan");
+    auto plan = std::make_shared<ResizePlan>();
+    plan->x = build_resize_axis(src.width, dst.width, filter);
+    plan->y = build_resize_axis(src.height, dst.height, filter);
+
+    std::lock_guard<std::mutex> lock(mutex);
+    if (cache.size() >= RESIZE_PLAN_CACHE_SIZE)
+    {
+        cache.clear(); // geometry changed a lot (many different crop sizes): start over
+    }
+    cache[key] = plan;
+    return plan;
+}
+
+/**
+ * Horizontal pass of one (widened) source row into a float row of dst_cols * CN values
+ * @tparam TAPS Taps per output sample, or 0 when only known at run time
+ */
+template <int CN, int TAPS>
+inline void resize_row_horizontal(const float *src, float *out, const ResizeAxis &ax, int dst_cols)
+{
+    const int taps = TAPS > 0 ? TAPS : ax.taps;
+    for (int dx = 0; dx < dst_cols; dx++)
+    {
+        const float *s = src + ax.start[dx] * CN;
+        const float *w = &ax.weights[static_cast<size_t>(dx) * taps];
+        float acc[CN] = {};
+        for (int t = 0; t < taps; t++)
+        {
+            for (int c = 0; c < CN; c++)
+            {
+                acc[c] += w[t] * s[t * CN + c];
+            }
+        }
+        for (int c = 0; c < CN; c++)
+        {
+            out[dx * CN + c] = acc[c];
+        }
+    }
+}
+
+/**
+ * Resizes rows [y_begin, y_end) of dst
+ * Horizontally filtered source rows are kept in a ring of `taps` rows: every source row is filtered once
+ */
+template <int CN>
+inline void resize_rows(const cv::Mat &src, cv::Mat &dst, const ResizePlan &plan, int y_begin, int y_end)
+{
+    const int row_len = dst.cols * CN;
+    const int ring = plan.y.taps;
+    std::vector<float> rows(static_cast<size_t>(ring) * row_len);
+    std::vector<int> tag(ring, -1);
+    std::vector<float> acc(row_len);
+    std::vector<float> wide(static_cast<size_t>(src.cols) * CN);
+
+    for (int y = y_begin; y < y_end; y++)
+    {
+        const int s0 = plan.y.start[y];
+        const float *wy = &plan.y.weights[static_cast<size_t>(y) * ring];
+        std::fill(acc.begin(), acc.end(), 0.0f);
+        for (int t = 0; t < ring; t++)
+        {
+            const int sy = s0 + t;
+            const int slot = sy % ring;
+            float *row = &rows[static_cast<size_t>(slot) * row_len];
+            if (tag[slot] != sy)
+            {
+                // Widening the row once (vectorized) keeps int to float conversions out of the tap loop
+                const uchar *s = src.ptr<uchar>(sy);
+                for (size_t i = 0; i < wide.size(); i++)
+                {
+                    wide[i] = s[i];
+                }
+                if (plan.x.taps == 2)
+                {
+                    resize_row_horizontal<CN, 2>(wide.data(), row, plan.x, dst.cols);
+                }
+                else
+                {
+                    resize_row_horizontal<CN, 0>(wide.data(), row, plan.x, dst.cols);
+                }
+                tag[slot] = sy;
+            }
+            const float w = wy[t];
+            for (int x = 0; x < row_len; x++)
+            {
+                acc[x] += w * row[x];
+            }
+        }
+        uchar *out = dst.ptr<uchar>(y);
+        for (int x = 0; x < row_len; x++)
+        {
+            // + 0.5 then truncation rounds; clamping first keeps the conversion branch free
+            out[x] = static_cast<uchar>(std::min(255.0f, std::max(0.0f, acc[x])) + 0.5f);
+        }
+    }
+}
+
+/**
+ * Runs the kernel matching the channel count; returns false for layouts it does not handle
+ */
+inline bool resize_with_plan(const cv::Mat &src, cv::Mat &dst, const ResizePlan &plan, int y_begin, int y_end)
+{
+    switch (src.channels())
+    {
+    case 1:
+        resize_rows<1>(src, dst, plan, y_begin, y_end);
+        return true;
+    case 3:
+        resize_rows<3>(src, dst, plan, y_begin, y_end);
+        return true;
+    case 4:
+        resize_rows<4>(src, dst, plan, y_begin, y_end);
+        return true;
+    default:
+        return false;
+    }
+}
+
+/**
+ * Maps the filters to cv::resize interpolation codes (fallback for unsupported types)
+ */
+inline int resize_filter_to_cv(ResizeFilter filter)
+{
+    return filter == RESIZE_AREA ? cv::INTER_AREA : (filter == RESIZE_LANCZOS3 ? cv::INTER_LANCZOS4 : cv::INTER_LINEAR);
+}
+
+/**
+ * Resizes an 8-bit image with 1, 3 or 4 channels (other types go through cv::resize)
+ * Output rows are split across threads; each thread keeps its own small ring of filtered rows
+ */
+inline void fast_resize(const cv::Mat &src, cv::Mat &dst, cv::Size dsize, ResizeFilter filter = RESIZE_BILINEAR)
+{
+    if (src.empty() || dsize.width <= 0 || dsize.height <= 0)
+    {
+        std::cerr << "Error: fast_resize needs a non-empty image and a positive output size!" << std::endl;
+        return;
+    }
+    INSTRUMENT_SCOPE("resize.image");
+    if (src.depth() != CV_8U || (src.channels() != 1 && src.channels() != 3 && src.channels() != 4) ||
+        src.data == dst.data)
+    {
+        cv::resize(src, dst, dsize, 0, 0, resize_filter_to_cv(filter));
+        return;
+    }
+    std::shared_ptr<const ResizePlan> plan = resize_plan(src.size(), dsize, filter);
+    dst.create(dsize, src.type());
+    cv::parallel_for_(cv::Range(0, dsize.height), [&](const cv::Range &range) {
+        resize_with_plan(src, dst, *plan, range.start, range.end);
+    });
+}
+
+/**
+ * Crop + resize in one step: only the rows and columns of the rectangle are read, straight from the
+ * source image (no cropped copy), and the result is the same as resizing the crop
+ */
+inline void resize_crop(const cv::Mat &src, cv::Rect roi, cv::Mat &dst, cv::Size dsize,
+                        ResizeFilter filter = RESIZE_BILINEAR)
+{
+    if (roi.empty() || (roi & cv::Rect(0, 0, src.cols, src.rows)) != roi)
+    {
+        std::cerr << "Error: Cropping rectangle is out of image bounds!" << std::endl;
+        return;
+    }
+    fast_resize(src(roi), dst, dsize, filter);
+}
+
+/**
+ * Resizes many crops of one image into a contiguous batch of same-size images (model inputs)
+ * Crops of the same size share one cached plan; crops run in parallel, each on a single thread
+ */
+inline void resize_crops(const cv::Mat &src, std::span<const cv::Rect> rects, cv::Size dsize, ResizeFilter filter,
+                         ImageBatch &dst)
+{
+    if (src.empty() || rects.empty() || src.depth() != CV_8U ||
+        (src.channels() != 1 && src.channels() != 3 && src.channels() != 4))
+    {
+        std::cerr << "Error: resize_crops needs an 8-bit image with 1, 3 or 4 channels and rectangles!" << std::endl;
+        return;
+    }
+    const cv::Rect bounds(0, 0, src.cols, src.rows);
+    for (const cv::Rect &r : rects)
+    {
+        if (r.empty() || (r & bounds) != r)
+        {
+            std::cerr << "Error: Cropping rectangle is out of image bounds!" << std::endl;
+            return;
+        }
+    }
+    INSTRUMENT_SCOPE("resize.crops");
+    dst.create(static_cast<int>(rects.size()), dsize, src.type());
+    cv::parallel_for_(cv::Range(0, static_cast<int>(rects.size())), [&](const cv::Range &range) {
+        for (int i = range.start; i < range.end; i++)
+        {
+            std::shared_ptr<const ResizePlan> plan = resize_plan(rects[i].size(), dsize, filter);
+            cv::Mat out = dst.image(i);
+            resize_with_plan(src(rects[i]), out, *plan, 0, dsize.height);
+        }
+    });
+}
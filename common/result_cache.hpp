@@ -0,0 +1,707 @@
+#pragma once
+
+#include <algorithm>
+#include <atomic>
+#include <chrono>
+#include <cstdint>
+#include <cstdio>
+#include <cstdlib>
+#include <cstring>
+#include <filesystem>
+#include <fstream>
+#include <initializer_list>
+#include <iomanip>
+#include <iostream>
+#include <list>
+#include <mutex>
+#include <sstream>
+#include <string>
+#include <unistd.h>
+#include <unordered_map>
+#include <vector>
+#include <opencv2/opencv.hpp>
+#include "instrumentation.hpp"
+
+/*
+ * Memoization of operation results, keyed by the content of the input.
+ *
+ * A CacheKey starts from a 64-bit content hash of the input (the decoded pixels, or the bytes of an image
+ * file, which also skips decoding) and appends every operation applied to it with its parameters:
+ *
+ *   CacheKey key = CacheKey(img).then("grayscale").then("gamma", {0.5}).then("threshold", {127, 255, 0});
+ *   cv::Mat out = cache.memoize(key, [&]() { ... the whole chain ... });
+ *
+ * ResultCache keeps results in two tiers, both bounded in bytes with the least recently used result
+ * evicted first:
+ *   - memory: results shared with the caller (no copy on a hit)
+ *   - disk:   one raw file per result in a directory shared by all processes, so re-runs and other
+ *             lessons with a byte-identical input skip the chain too. Files are written under a temporary
+ *             name and renamed, so a reader never sees a partial result.
+ * Every entry stores the full key description, so a hash collision is detected instead of returning
+ * the wrong image.
+ *
+ * The hash is XXH64 (same output as the reference implementation): four independent 64-bit lanes, a few
+ * GB/s per core, well below the cost of any chain worth caching.
+ */
+
+#define RESULT_CACHE_MEMORY_MB 256
+#define RESULT_CACHE_DISK_MB 2048
+#define RESULT_CACHE_EXTENSION ".cvr"
+#define RESULT_CACHE_READ_CHUNK (1 << 20)
+
+inline constexpr char RESULT_CACHE_MAGIC[8] = {'C', 'V', 'R', 'E', 'S', 'U', 'L', '1'};
+
+/**
+ * Streaming XXH64 hash
+ */
+class ContentHasher
+{
+public:
+    explicit ContentHasher(uint64_t seed = 0) { reset(seed); }
+
+    void reset(uint64_t seed = 0)
+    {
+        seed_ = seed;
+        v_[0] = seed + P1 + P2;
+        v_[1] = seed + P2;
+        v_[2] = seed;
+        v_[3] = seed - P1;
+        total_ = 0;
+        buffered_ = 0;
+    }
+
+    void update(const void *data, size_t n)
+    {
+        const uchar *p = static_cast<const uchar *>(data);
+        const uchar *end = p + n;
+        total_ += n;
+        if (buffered_ + n < 32)
+        {
+            std::memcpy(buffer_ + buffered_, p, n);
+            buffered_ += n;
+            return;
+        }
+        if (buffered_ > 0)
+        {
+            const size_t fill = 32 - buffered_;
+            std::memcpy(buffer_ + buffered_, p, fill);
+            stripe(buffer_);
+            p += fill;
+            buffered_ = 0;
+        }
+        // The four lanes do not depend on each other, so their multiplies overlap in the pipeline
+        uint64_t v0 = v_[0], v1 = v_[1], v2 = v_[2], v3 = v_[3];
+        for (; p + 32 <= end; p += 32)
+        {
+            v0 = round(v0, read64(p));
+            v1 = round(v1, read64(p + 8));
+            v2 = round(v2, read64(p + 16));
+            v3 = round(v3, read64(p + 24));
+        }
+        v_[0] = v0;
+        v_[1] = v1;
+        v_[2] = v2;
+        v_[3] = v3;
+        buffered_ = static_cast<size_t>(end - p);
+        std::memcpy(buffer_, p, buffered_);
+    }
+
+    uint64_t digest() const
+    {
+        uint64_t h;
+        if (total_ >= 32)
+        {
+            h = rotl(v_[0], 1) + rotl(v_[1], 7) + rotl(v_[2], 12) + rotl(v_[3], 18);
+            for (int i = 0; i < 4; i++)
+            {
+                h = (h ^ round(0, v_[i])) * P1 + P4;
+            }
+        }
+        else
+        {
+            h = seed_ + P5;
+        }
+        h += total_;
+
+        const uchar *p = buffer_;
+        const uchar *end = buffer_ + buffered_;
+        for (; p + 8 <= end; p += 8)
+        {
+            h ^= round(0, read64(p));
+            h = rotl(h, 27) * P1 + P4;
+        }
+        if (p + 4 <= end)
+        {
+            uint32_t k;
+            std::memcpy(&k, p, 4);
+            h ^= static_cast<uint64_t>(k) * P1;
+            h = rotl(h, 23) * P2 + P3;
+            p += 4;
+        }
+        for (; p < end; p++)
+        {
+            h ^= *p * P5;
+            h = rotl(h, 11) * P1;
+        }
+
+        h ^= h >> 33;
+        h *= P2;
+        h ^= h >> 29;
+        h *= P3;
+        h ^= h >> 32;
+        return h;
+    }
+
+private:
+    static constexpr uint64_t P1 = 0x9E3779B185EBCA87ull;
+    static constexpr uint64_t P2 = 0xC2B2AE3D27D4EB4Full;
+    static constexpr uint64_t P3 = 0x165667B19E3779F9ull;
+    static constexpr uint64_t P4 = 0x85EBCA77C2B2AE63ull;
+    static constexpr uint64_t P5 = 0x27D4EB2F165667C5ull;
+
+    static uint64_t rotl(uint64_t x, int r) { return (x << r) | (x >> (64 - r)); }
+
+    static uint64_t read64(const uchar *p)
+    {
+        uint64_t v;
+        std::memcpy(&v, p, 8);
+        return v;
+    }
+
+    static uint64_t round(uint64_t acc, uint64_t input)
+    {
+        acc += input * P2;
+        return rotl(acc, 31) * P1;
+    }
+
+    void stripe(const uchar *p)
+    {
+        for (int i = 0; i < 4; i++)
+        {
+            v_[i] = round(v_[i], read64(p + 8 * i));
+        }
+    }
+
+    uint64_t seed_ = 0;
+    uint64_t v_[4] = {};
+    uint64_t total_ = 0;
+    uchar buffer_[32] = {};
+    size_t buffered_ = 0;
+};
+
+inline uint64_t hash_bytes(const void *data, size_t n, uint64_t seed = 0)
+{
+    ContentHasher hasher(seed);
+    hasher.update(data, n);
+    return hasher.digest();
+}
+
+/**
+ * Hash of the pixels of an image (row by row, so ROIs and padded rows hash like a continuous copy)
+ * Size and type are part of the hash: the same bytes read as a different shape give a different key
+ */
+inline uint64_t content_hash(const cv::Mat &img)
+{
+    INSTRUMENT_SCOPE("cache.hash");
+    ContentHasher hasher;
+    const int32_t shape[3] = {img.rows, img.cols, img.type()};
+    hasher.update(shape, sizeof(shape));
+    if (img.empty())
+    {
+        return hasher.digest();
+    }
+    const size_t row_bytes = static_cast<size_t>(img.cols) * img.elemSize();
+    if (img.isContinuous())
+    {
+        hasher.update(img.data, row_bytes * img.rows);
+    }
+    else
+    {
+        for (int y = 0; y < img.rows; y++)
+        {
+            hasher.update(img.ptr(y), row_bytes);
+        }
+    }
+    INSTRUMENT_COUNT("cache.hashed_bytes", row_bytes * img.rows);
+    return hasher.digest();
+}
+
+/**
+ * Hash of the bytes of a file, false if it cannot be read
+ */
+inline bool file_content_hash(const std::string &path, uint64_t &hash)
+{
+    INSTRUMENT_SCOPE("cache.hash_file");
+    std::ifstream file(path, std::ios::binary);
+    if (!file)
+    {
+        return false;
+    }
+    ContentHasher hasher;
+    std::vector<char> chunk(RESULT_CACHE_READ_CHUNK);
+    while (file)
+    {
+        file.read(chunk.data(), static_cast<std::streamsize>(chunk.size()));
+        hasher.update(chunk.data(), static_cast<size_t>(file.gcount()));
+    }
+    if (file.bad())
+    {
+        return false;
+    }
+    hash = hasher.digest();
+    return true;
+}
+
+/**
+ * Identity of a result: content hash of the input followed by the operations applied to it
+ */
+class CacheKey
+{
+public:
+    CacheKey() = default;
+
+    /**
+     * Key of an image's pixels
+     */
+    explicit CacheKey(const cv::Mat &input) : CacheKey("pixels", content_hash(input)) {}
+
+    /**
+     * Key of an image file's bytes (valid() is false when the file cannot be read)
+     * The file does not need to be decoded, so a hit skips imread as well
+     */
+    static CacheKey from_file(const std::string &path)
+    {
+        uint64_t hash = 0;
+        return file_content_hash(path, hash) ? CacheKey("file", hash) : CacheKey();
+    }
+
+    /**
+     * Key of this result with one more operation applied, e.g. key.then("gamma", {0.5})
+     * Parameters are written with full precision, so two values only share a key when they are equal
+     */
+    CacheKey then(const std::string &op, std::initializer_list<double> params = {}) const
+    {
+        std::ostringstream text;
+        text << std::setprecision(17) << description_ << '|' << op;
+        if (params.size() > 0)
+        {
+            text << '(';
+            for (auto it = params.begin(); it != params.end(); ++it)
+            {
+                text << (it == params.begin() ? "" : ",") << *it;
+            }
+            text << ')';
+        }
+        CacheKey next;
+        next.description_ = text.str();
+        next.digest_ = hash_bytes(next.description_.data(), next.description_.size());
+        return next;
+    }
+
+    bool valid() const { return !description_.empty(); }
+    uint64_t digest() const { return digest_; }
+    const std::string &description() const { return description_; }
+
+    /**
+     * 16 hex digits of the digest (the file name of the result in the disk tier)
+     */
+    std::string hex() const
+    {
+        std::ostringstream text;
+        text << std::hex << std::setw(16) << std::setfill('0') << digest_;
+        return text.str();
+    }
+
+private:
+    CacheKey(const char *kind, uint64_t hash)
+    {
+        std::ostringstream text;
+        text << kind << ':' << std::hex << std::setw(16) << std::setfill('0') << hash;
+        description_ = text.str();
+        digest_ = hash_bytes(description_.data(), description_.size());
+    }
+
+    std::string description_;
+    uint64_t digest_ = 0;
+};
+
+struct ResultCacheStats
+{
+    uint64_t memory_hits = 0;
+    uint64_t disk_hits = 0;
+    uint64_t misses = 0;
+    uint64_t memory_evictions = 0;
+    uint64_t disk_evictions = 0;
+    uint64_t disk_writes = 0;
+};
+
+/**
+ * Header of a result file, followed by the key description and the pixels (rows x cols x elemSize, no padding)
+ */
+struct ResultFileHeader
+{
+    char magic[8];
+    int32_t rows;
+    int32_t cols;
+    int32_t type;
+    uint32_t description_len;
+    uint64_t data_bytes;
+};
+static_assert(sizeof(ResultFileHeader) == 32, "ResultFileHeader must not contain padding");
+
+/**
+ * Directory of the disk tier shared by all lessons: $XDG_CACHE_HOME/cv_lessons, ~/.cache/cv_lessons,
+ * or /tmp/cv_lessons_cache when neither is set
+ */
+inline std::string default_result_cache_dir()
+{
+    if (const char *xdg = std::getenv("XDG_CACHE_HOME"); xdg != nullptr && xdg[0] != '\0')
+    {
+        return std::string(xdg) + "/cv_lessons";
+    }
+    if (const char *home = std::getenv("HOME"); home != nullptr && home[0] != '\0')
+    {
+        return std::string(home) + "/.cache/cv_lessons";
+    }
+    return "/tmp/cv_lessons_cache";
+}
+
+/**
+ * Two-tier (memory, disk) cache of operation results, safe to use from several threads
+ */
+class ResultCache
+{
+public:
+    /**
+     * @param memory_bytes Budget of the memory tier
+     * @param dir Directory of the disk tier, "" for a memory-only cache
+     * @param disk_bytes Budget of the disk tier (only the files of this cache's directory count)
+     */
+    explicit ResultCache(size_t memory_bytes = static_cast<size_t>(RESULT_CACHE_MEMORY_MB) << 20,
+                         const std::string &dir = default_result_cache_dir(),
+                         size_t disk_bytes = static_cast<size_t>(RESULT_CACHE_DISK_MB) << 20)
+        : memory_capacity_(memory_bytes), disk_capacity_(disk_bytes), dir_(dir)
+    {
+        if (!dir_.empty())
+        {
+            std::error_code ec;
+            std::filesystem::create_directories(dir_, ec);
+            if (ec)
+            {
+                std::cerr << "Error: Could not create result cache directory '" << dir_ << "', caching in memory only!"
+                          << std::endl;
+                dir_.clear();
+            }
+            else
+            {
+                disk_bytes_ = scan_disk(nullptr);
+            }
+        }
+    }
+
+    ResultCache(const ResultCache &) = delete;
+    ResultCache &operator=(const ResultCache &) = delete;
+
+    /**
+     * Looks a result up in memory, then on disk (a disk hit is kept in memory for the next lookup)
+     * @param out Set to the cached result, shared with the cache: clone it before writing to it
+     */
+    bool get(const CacheKey &key, cv::Mat &out)
+    {
+        if (!key.valid())
+        {
+            return false;
+        }
+        {
+            std::lock_guard<std::mutex> lock(mutex_);
+            auto it = index_.find(key.digest());
+            if (it != index_.end() && it->second->description == key.description())
+            {
+                lru_.splice(lru_.begin(), lru_, it->second);
+                out = it->second->image;
+                stats_.memory_hits++;
+                INSTRUMENT_COUNT("cache.memory_hits", 1);
+                return true;
+            }
+        }
+
+        cv::Mat loaded;
+        if (!dir_.empty() && read_file(key, loaded))
+        {
+            std::lock_guard<std::mutex> lock(mutex_);
+            stats_.disk_hits++;
+            INSTRUMENT_COUNT("cache.disk_hits", 1);
+            insert_memory(key, loaded);
+            out = loaded;
+            return true;
+        }
+
+        std::lock_guard<std::mutex> lock(mutex_);
+        stats_.misses++;
+        INSTRUMENT_COUNT("cache.misses", 1);
+        return false;
+    }
+
+    /**
+     * Stores a result in both tiers. The cache keeps a reference to result's pixels, so the caller
+     * must not write to it afterwards (pass a clone if it will be modified)
+     */
+    void put(const CacheKey &key, const cv::Mat &result)
+    {
+        if (!key.valid() || result.empty())
+        {
+            return;
+        }
+        {
+            std::lock_guard<std::mutex> lock(mutex_);
+            insert_memory(key, result);
+        }
+        if (!dir_.empty())
+        {
+            write_file(key, result);
+        }
+    }
+
+    /**
+     * Result of key from the cache, or compute() stored under key
+     * @param compute Callable returning the result as a cv::Mat
+     */
+    template <class Compute>
+    cv::Mat memoize(const CacheKey &key, Compute compute)
+    {
+        cv::Mat out;
+        if (get(key, out))
+        {
+            return out;
+        }
+        out = compute();
+        put(key, out);
+        return out;
+    }
+
+    /**
+     * Drops the memory tier (the disk tier is kept, remove the directory to clear it)
+     */
+    void clear_memory()
+    {
+        std::lock_guard<std::mutex> lock(mutex_);
+        lru_.clear();
+        index_.clear();
+        memory_bytes_ = 0;
+    }
+
+    ResultCacheStats stats() const
+    {
+        std::lock_guard<std::mutex> lock(mutex_);
+        return stats_;
+    }
+
+    const std::string &directory() const { return dir_; }
+
+    void report(const std::string &label) const
+    {
+        const ResultCacheStats s = stats();
+        std::lock_guard<std::mutex> lock(mutex_);
+        std::cout << label << ": " << s.memory_hits << " memory hits, " << s.disk_hits << " disk hits, " << s.misses
+                  << " misses | memory " << (memory_bytes_ >> 10) << " KiB (" << s.memory_evictions
+                  << " evicted), disk " << (disk_bytes_ >> 10) << " KiB (" << s.disk_writes << " written, "
+                  << s.disk_evictions << " evicted)";
+        if (!dir_.empty())
+        {
+            std::cout << " in " << dir_;
+        }
+        std::cout << std::endl;
+    }
+
+private:
+    struct Entry
+    {
+        uint64_t digest;
+        std::string description;
+        cv::Mat image;
+        size_t bytes;
+    };
+
+    /**
+     * Adds or replaces an entry and evicts down to the budget (mutex_ held)
+     */
+    void insert_memory(const CacheKey &key, const cv::Mat &image)
+    {
+        auto it = index_.find(key.digest());
+        if (it != index_.end())
+        {
+            memory_bytes_ -= it->second->bytes;
+            lru_.erase(it->second);
+        }
+        lru_.push_front(Entry{key.digest(), key.description(), image, image.total() * image.elemSize()});
+        index_[key.digest()] = lru_.begin();
+        memory_bytes_ += lru_.front().bytes;
+        while (memory_bytes_ > memory_capacity_ && !lru_.empty())
+        {
+            memory_bytes_ -= lru_.back().bytes;
+            index_.erase(lru_.back().digest);
+            lru_.pop_back();
+            stats_.memory_evictions++;
+        }
+    }
+
+    std::string file_path(const CacheKey &key) const { return dir_ + "/" + key.hex() + RESULT_CACHE_EXTENSION; }
+
+    bool read_file(const CacheKey &key, cv::Mat &out)
+    {
+        INSTRUMENT_SCOPE("cache.disk_read");
+        const std::string path = file_path(key);
+        std::ifstream file(path, std::ios::binary);
+        if (!file)
+        {
+            return false;
+        }
+        ResultFileHeader h;
+        if (!file.read(reinterpret_cast<char *>(&h), sizeof(h)) ||
+            std::memcmp(h.magic, RESULT_CACHE_MAGIC, sizeof(h.magic)) != 0 || h.rows <= 0 || h.cols <= 0 ||
+            h.description_len != key.description().size() ||
+            h.data_bytes != static_cast<uint64_t>(h.rows) * h.cols * CV_ELEM_SIZE(h.type))
+        {
+            return false;
+        }
+        std::string description(h.description_len, '\0');
+        if (!file.read(description.data(), h.description_len) || description != key.description())
+        {
+            return false; // another input or chain with the same digest
+        }
+        cv::Mat img(h.rows, h.cols, h.type);
+        if (!file.read(reinterpret_cast<char *>(img.data), static_cast<std::streamsize>(h.data_bytes)))
+        {
+            return false;
+        }
+        // Recently used files survive the eviction of the disk tier
+        std::error_code ec;
+        std::filesystem::last_write_time(path, std::filesystem::file_time_type::clock::now(), ec);
+        out = img;
+        return true;
+    }
+
+    void write_file(const CacheKey &key, const cv::Mat &img)
+    {
+        INSTRUMENT_SCOPE("cache.disk_write");
+        const std::string path = file_path(key);
+        // Unique per process and per write, so threads storing the same key do not share a temp file
+        static std::atomic<uint64_t> writes{0};
+        const std::string temp = path + ".tmp" + std::to_string(::getpid()) + "." + std::to_string(writes++);
+        const size_t row_bytes = static_cast<size_t>(img.cols) * img.elemSize();
+        ResultFileHeader h;
+        std::memcpy(h.magic, RESULT_CACHE_MAGIC, sizeof(h.magic));
+        h.rows = img.rows;
+        h.cols = img.cols;
+        h.type = img.type();
+        h.description_len = static_cast<uint32_t>(key.description().size());
+        h.data_bytes = row_bytes * img.rows;
+        {
+            std::ofstream file(temp, std::ios::binary | std::ios::trunc);
+            file.write(reinterpret_cast<const char *>(&h), sizeof(h));
+            file.write(key.description().data(), static_cast<std::streamsize>(key.description().size()));
+            for (int y = 0; y < img.rows; y++)
+            {
+                file.write(reinterpret_cast<const char *>(img.ptr(y)), static_cast<std::streamsize>(row_bytes));
+            }
+            if (!file)
+            {
+                std::cerr << "Error: Could not write result cache file '" << temp << "'!" << std::endl;
+                file.close();
+                std::remove(temp.c_str());
+                return;
+            }
+        }
+        if (std::rename(temp.c_str(), path.c_str()) != 0)
+        {
+            std::remove(temp.c_str());
+            return;
+        }
+
+        bool over_budget;
+        {
+            std::lock_guard<std::mutex> lock(mutex_);
+            stats_.disk_writes++;
+            disk_bytes_ += sizeof(h) + h.description_len + h.data_bytes;
+            over_budget = disk_bytes_ > disk_capacity_;
+        }
+        if (over_budget)
+        {
+            evict_disk();
+        }
+    }
+
+    struct DiskFile
+    {
+        std::filesystem::file_time_type time;
+        uintmax_t size;
+        std::filesystem::path path;
+    };
+
+    /**
+     * Total size of the result files; collects each one into files when it is not null
+     */
+    size_t scan_disk(std::vector<DiskFile> *files) const
+    {
+        size_t total = 0;
+        std::error_code ec;
+        for (const auto &entry : std::filesystem::directory_iterator(dir_, ec))
+        {
+            std::error_code entry_ec;
+            if (entry.path().extension() != RESULT_CACHE_EXTENSION || !entry.is_regular_file(entry_ec))
+            {
+                continue;
+            }
+            const uintmax_t size = entry.file_size(entry_ec);
+            if (entry_ec)
+            {
+                continue; // removed by another process meanwhile
+            }
+            total += size;
+            if (files != nullptr)
+            {
+                files->push_back({entry.last_write_time(entry_ec), size, entry.path()});
+            }
+        }
+        return total;
+    }
+
+    /**
+     * Removes the least recently used files until the directory is down to 3/4 of its budget
+     * The directory is scanned again, so files written by other processes are counted as well
+     */
+    void evict_disk()
+    {
+        INSTRUMENT_SCOPE("cache.disk_evict");
+        std::vector<DiskFile> files;
+        size_t total = scan_disk(&files);
+        std::sort(files.begin(), files.end(), [](const DiskFile &a, const DiskFile &b) { return a.time < b.time; });
+        size_t evicted = 0;
+        for (const DiskFile &f : files)
+        {
+            if (total <= disk_capacity_ / 4 * 3)
+            {
+                break;
+            }
+            std::error_code ec;
+            if (std::filesystem::remove(f.path, ec))
+            {
+                total -= static_cast<size_t>(f.size);
+                evicted++;
+            }
+        }
+        std::lock_guard<std::mutex> lock(mutex_);
+        disk_bytes_ = total;
+        stats_.disk_evictions += evicted;
+    }
+
+    std::list<Entry> lru_;
+    std::unordered_map<uint64_t, std::list<Entry>::iterator> index_;
+    size_t memory_bytes_ = 0;
+    size_t memory_capacity_;
+    size_t disk_bytes_ = 0;
+    size_t disk_capacity_;
+    std::string dir_;
+    ResultCacheStats stats_;
+    mutable std::mutex mutex_;
+};
@@ -0,0 +1,269 @@
+#pragma once
+
+#include <cstdint>
+#include <cstring>
+#include <fcntl.h>
+#include <iostream>
+#include <string>
+#include <sys/mman.h>
+#include <sys/stat.h>
+#include <unistd.h>
+#include <opencv2/opencv.hpp>
+
+/*
+ * Images in named POSIX shared-memory segments (shm_open), so processes exchange pixels without
+ * copying them through a pipe or encoding them to a file.
+ *
+ * A segment holds a SharedImageHeader followed by the pixels, rows padded to SHARED_IMAGE_ALIGN bytes.
+ * The segment name (e.g. "/cv_input") is the only handle another process needs: the header carries the
+ * size and type, and SharedImage::mat() is a cv::Mat view over the mapped pixels.
+ */
+
+#define SHARED_IMAGE_MAGIC 0x474D4953u // "SIMG"
+#define SHARED_IMAGE_ALIGN 64
+
+struct SharedImageHeader
+{
+    uint32_t magic;
+    int32_t rows;
+    int32_t cols;
+    int32_t type;
+    uint64_t step;        // bytes per row
+    uint64_t data_offset; // from the start of the segment
+};
+
+/**
+ * Bytes needed for an image of the given size and type, header included
+ */
+inline size_t shared_image_bytes(cv::Size size, int type, size_t *step = nullptr)
+{
+    const size_t row = static_cast<size_t>(size.width) * CV_ELEM_SIZE(type);
+    const size_t padded = (row + SHARED_IMAGE_ALIGN - 1) / SHARED_IMAGE_ALIGN * SHARED_IMAGE_ALIGN;
+    if (step != nullptr)
+    {
+        *step = padded;
+    }
+    return SHARED_IMAGE_ALIGN + padded * static_cast<size_t>(size.height);
+}
+
+/**
+ * One mapping of a shared-memory segment
+ */
+class SharedMemory
+{
+public:
+    SharedMemory() = default;
+    ~SharedMemory() { close(); }
+    SharedMemory(const SharedMemory &) = delete;
+    SharedMemory &operator=(const SharedMemory &) = delete;
+
+    /**
+     * Opens (and creates if needed) a segment of at least size bytes; a larger segment keeps its size
+     */
+    bool create(const std::string &name, size_t size)
+    {
+        close();
+        int fd = ::shm_open(name.c_str(), O_RDWR | O_CREAT, 0600);
+        if (fd < 0)
+        {
+            std::cerr << "Error: Could not create shared memory '" << name << "'!" << std::endl;
+            return false;
+        }
+        struct stat st;
+        bool ok = ::fstat(fd, &st) == 0;
+        if (ok && static_cast<size_t>(st.st_size) < size)
+        {
+            ok = ::ftruncate(fd, static_cast<off_t>(size)) == 0 && ::fstat(fd, &st) == 0;
+        }
+        ok = ok && map(fd, st, true);
+        ::close(fd);
+        if (!ok)
+        {
+            std::cerr << "Error: Could not map shared memory '" << name << "'!" << std::endl;
+            return false;
+        }
+        name_ = name;
+        return true;
+    }
+
+    /**
+     * Maps an existing segment
+     */
+    bool open(const std::string &name, bool writable)
+    {
+        close();
+        int fd = ::shm_open(name.c_str(), writable ? O_RDWR : O_RDONLY, 0);
+        if (fd < 0)
+        {
+            return false;
+        }
+        struct stat st;
+        const bool ok = ::fstat(fd, &st) == 0 && map(fd, st, writable);
+        ::close(fd);
+        if (ok)
+        {
+            name_ = name;
+        }
+        return ok;
+    }
+
+    void close()
+    {
+        if (data_ != nullptr)
+        {
+            ::munmap(data_, size_);
+            data_ = nullptr;
+            size_ = 0;
+            inode_ = 0;
+        }
+    }
+
+    /**
+     * True if name still refers to the segment that is mapped here with the same size
+     * (false once it was unlinked and recreated, or resized)
+     */
+    bool is_current() const
+    {
+        struct stat st;
+        int fd = ::shm_open(name_.c_str(), O_RDONLY, 0);
+        if (fd < 0)
+        {
+            return false;
+        }
+        const bool same = ::fstat(fd, &st) == 0 && st.st_ino == inode_ && static_cast<size_t>(st.st_size) == size_;
+        ::close(fd);
+        return same;
+    }
+
+    static void unlink(const std::string &name) { ::shm_unlink(name.c_str()); }
+
+    bool is_open() const { return data_ != nullptr; }
+    uchar *data() const { return data_; }
+    size_t size() const { return size_; }
+    bool writable() const { return writable_; }
+    const std::string &name() const { return name_; }
+
+private:
+    bool map(int fd, const struct stat &st, bool writable)
+    {
+        if (st.st_size <= 0)
+        {
+            return false;
+        }
+        void *p = ::mmap(nullptr, static_cast<size_t>(st.st_size), writable ? PROT_READ | PROT_WRITE : PROT_READ,
+                         MAP_SHARED, fd, 0);
+        if (p == MAP_FAILED)
+        {
+            return false;
+        }
+        data_ = static_cast<uchar *>(p);
+        size_ = static_cast<size_t>(st.st_size);
+        inode_ = st.st_ino;
+        writable_ = writable;
+        return true;
+    }
+
+    uchar *data_ = nullptr;
+    size_t size_ = 0;
+    ino_t inode_ = 0;
+    bool writable_ = false;
+    std::string name_;
+};
+
+/**
+ * True if a header describes an image that lies inside a segment of size bytes
+ * Headers come from other processes: every field is checked, and the bounds without overflow
+ */
+inline bool valid_shared_image_header(const SharedImageHeader &h, size_t size)
+{
+    if (h.magic != SHARED_IMAGE_MAGIC || h.rows <= 0 || h.cols <= 0 || h.type < 0 || CV_MAT_TYPE(h.type) != h.type ||
+        CV_MAT_DEPTH(h.type) > CV_64F || CV_MAT_CN(h.type) > 4)
+    {
+        return false;
+    }
+    if (h.data_offset < sizeof(SharedImageHeader) || h.data_offset > size)
+    {
+        return false;
+    }
+    const uint64_t elem_size = CV_ELEM_SIZE(h.type);
+    const uint64_t row_bytes = static_cast<uint64_t>(h.cols) * elem_size;
+    return h.step >= row_bytes && h.step % (elem_size / CV_MAT_CN(h.type)) == 0 &&
+           h.step <= (size - h.data_offset) / static_cast<uint64_t>(h.rows);
+}
+
+/**
+ * Header of a mapped image segment, nullptr if the segment does not hold a valid image
+ */
+inline const SharedImageHeader *shared_image_header(const SharedMemory &shm)
+{
+    if (!shm.is_open() || shm.size() < sizeof(SharedImageHeader))
+    {
+        return nullptr;
+    }
+    const SharedImageHeader *h = reinterpret_cast<const SharedImageHeader *>(shm.data());
+    return valid_shared_image_header(*h, shm.size()) ? h : nullptr;
+}
+
+/**
+ * cv::Mat view over the pixels of an image segment (empty if the segment is not a valid image)
+ * The view is only valid while the mapping is open
+ */
+inline cv::Mat shared_image_view(const SharedMemory &shm)
+{
+    if (!shm.is_open() || shm.size() < sizeof(SharedImageHeader))
+    {
+        return cv::Mat();
+    }
+    // Another process may rewrite the header at any time: check and use one copy of it
+    SharedImageHeader h;
+    std::memcpy(&h, shm.data(), sizeof(h));
+    if (!valid_shared_image_header(h, shm.size()))
+    {
+        return cv::Mat();
+    }
+    return cv::Mat(h.rows, h.cols, h.type, shm.data() + h.data_offset, static_cast<size_t>(h.step));
+}
+
+/**
+ * Lays out an image of the given size and type in a mapped segment (grown if needed) and returns
+ * the view to write the pixels into
+ */
+inline cv::Mat format_shared_image(SharedMemory &shm, const std::string &name, cv::Size size, int type)
+{
+    size_t step = 0;
+    const size_t bytes = shared_image_bytes(size, type, &step);
+    if (!shm.is_open() || shm.name() != name || shm.size() < bytes || !shm.writable())
+    {
+        if (!shm.create(name, bytes))
+        {
+            return cv::Mat();
+        }
+    }
+    SharedImageHeader *h = reinterpret_cast<SharedImageHeader *>(shm.data());
+    h->rows = size.height;
+    h->cols = size.width;
+    h->type = type;
+    h->step = step;
+    h->data_offset = SHARED_IMAGE_ALIGN;
+    h->magic = SHARED_IMAGE_MAGIC;
+    return shared_image_view(shm);
+}
+
+/**
+ * Copies an image into a named segment, e.g. write_shared_image(shm, "/cv_input", img)
+ */
+inline bool write_shared_image(SharedMemory &shm, const std::string &name, const cv::Mat &img)
+{
+    if (img.empty())
+    {
+        std::cerr << "Error: Input image is empty!" << std::endl;
+        return false;
+    }
+    cv::Mat view = format_shared_image(shm, name, img.size(), img.type());
+    if (view.empty())
+    {
+        return false;
+    }
+    img.copyTo(view);
+    return true;
+}
@@ -0,0 +1,209 @@
+#pragma once
+
+#include <algorithm>
+#include <array>
+#include <climits>
+#include <cmath>
+#include <iostream>
+#include <type_traits>
+#include <opencv2/opencv.hpp>
+#include "color_convert.hpp"
+#include "instrumentation.hpp"
+
+/*
+ * Row kernels specialized at compile time on depth, channel count and operation variant.
+ *
+ * Every combination is instantiated here and stored in a constexpr dispatch table indexed by
+ * (depth, variant) or (depth, channels). A call does one table lookup per image, then runs a row loop
+ * that contains no switch and no per-pixel test on the type, which GCC/Clang vectorize fully.
+ * Combinations without an entry fall back to the OpenCV function.
+ */
+
+typedef void (*ThresholdRowFn)(const void *src, void *dst, int n, double thresh, double max_value);
+typedef void (*GrayRowFn)(const void *src, void *dst, int cols);
+
+/**
+ * One row of cv::threshold for a basic type (n = cols * channels, channels do not matter)
+ * Integer depths compare in int against floor(thresh) like OpenCV; float depths compare in T
+ */
+template <typename T, int TYPE>
+void threshold_row(const void *src_row, void *dst_row, int n, double thresh, double max_value)
+{
+    const T *s = static_cast<const T *>(src_row);
+    T *d = static_cast<T *>(dst_row);
+    if constexpr (std::is_floating_point_v<T>)
+    {
+        // Plain selects (compiled to vector compare + blend): 0/1 multipliers would turn an infinite input
+        // into NaN (0 * inf), where cv::threshold passes it through
+        const T t = static_cast<T>(thresh);
+        const T m = static_cast<T>(max_value);
+        for (int i = 0; i < n; i++)
+        {
+            const T x = s[i];
+            const bool above = x > t;
+            if constexpr (TYPE == cv::THRESH_BINARY)
+            {
+                d[i] = above ? m : T(0);
+            }
+            else if constexpr (TYPE == cv::THRESH_BINARY_INV)
+            {
+                d[i] = above ? T(0) : m;
+            }
+            else if constexpr (TYPE == cv::THRESH_TRUNC)
+            {
+                d[i] = above ? t : x;
+            }
+            else if constexpr (TYPE == cv::THRESH_TOZERO)
+            {
+                d[i] = above ? x : T(0);
+            }
+            else
+            {
+                d[i] = above ? T(0) : x;
+            }
+        }
+    }
+    else
+    {
+        const int t = static_cast<int>(std::clamp(std::floor(thresh), static_cast<double>(INT_MIN / 2),
+                                                  static_cast<double>(INT_MAX / 2)));
+        const T m = cv::saturate_cast<T>(max_value);
+        const T truncated = cv::saturate_cast<T>(t);
+        for (int i = 0; i < n; i++)
+        {
+            const int x = s[i];
+            const bool above = x > t;
+            if constexpr (TYPE == cv::THRESH_BINARY)
+            {
+                d[i] = above ? m : T(0);
+            }
+            else if constexpr (TYPE == cv::THRESH_BINARY_INV)
+            {
+                d[i] = above ? T(0) : m;
+            }
+            else if constexpr (TYPE == cv::THRESH_TRUNC)
+            {
+                d[i] = above ? truncated : s[i];
+            }
+            else if constexpr (TYPE == cv::THRESH_TOZERO)
+            {
+                d[i] = above ? s[i] : T(0);
+            }
+            else
+            {
+                d[i] = above ? T(0) : s[i];
+            }
+        }
+    }
+}
+
+template <typename T>
+constexpr std::array<ThresholdRowFn, 5> threshold_rows_for()
+{
+    return {&threshold_row<T, cv::THRESH_BINARY>, &threshold_row<T, cv::THRESH_BINARY_INV>,
+            &threshold_row<T, cv::THRESH_TRUNC>, &threshold_row<T, cv::THRESH_TOZERO>,
+            &threshold_row<T, cv::THRESH_TOZERO_INV>};
+}
+
+/**
+ * Threshold kernel for a depth and basic type, nullptr if not specialized
+ */
+inline ThresholdRowFn threshold_kernel(int depth, int type)
+{
+    // Indexed by CV_8U..CV_16F; CV_8S, CV_32S and CV_16F are left to OpenCV
+    static constexpr std::array<std::array<ThresholdRowFn, 5>, 8> table = {
+        threshold_rows_for<uchar>(), std::array<ThresholdRowFn, 5>{}, threshold_rows_for<ushort>(),
+        threshold_rows_for<short>(), std::array<ThresholdRowFn, 5>{}, threshold_rows_for<float>(),
+        threshold_rows_for<double>(), std::array<ThresholdRowFn, 5>{}};
+    if (depth < 0 || depth >= static_cast<int>(table.size()) || type < 0 || type >= 5)
+    {
+        return nullptr;
+    }
+    return table[depth][type];
+}
+
+/**
+ * BT.601 luma of one row of BGR (CN = 3) or BGRA (CN = 4) pixels
+ * 8-bit and 16-bit use the 14-bit fixed-point weights of cvtColor, float uses float weights
+ */
+template <typename T, int CN>
+void gray_row(const void *src_row, void *dst_row, int cols)
+{
+    const T *s = static_cast<const T *>(src_row);
+    T *d = static_cast<T *>(dst_row);
+    for (int x = 0; x < cols; x++)
+    {
+        const T *p = s + x * CN;
+        if constexpr (std::is_floating_point_v<T>)
+        {
+            d[x] = static_cast<T>(0.114f * p[0] + 0.587f * p[1] + 0.299f * p[2]);
+        }
+        else
+        {
+            // 65535 * 2^14 still fits in an int
+            d[x] = static_cast<T>(bgr_luma(p[0], p[1], p[2]));
+        }
+    }
+}
+
+/**
+ * Grayscale kernel for a depth and channel count (3 or 4), nullptr if not specialized
+ */
+inline GrayRowFn gray_kernel(int depth, int channels)
+{
+    static constexpr std::array<std::array<GrayRowFn, 2>, 8> table = {
+        std::array<GrayRowFn, 2>{&gray_row<uchar, 3>, &gray_row<uchar, 4>}, std::array<GrayRowFn, 2>{},
+        std::array<GrayRowFn, 2>{&gray_row<ushort, 3>, &gray_row<ushort, 4>}, std::array<GrayRowFn, 2>{},
+        std::array<GrayRowFn, 2>{}, std::array<GrayRowFn, 2>{&gray_row<float, 3>, &gray_row<float, 4>},
+        std::array<GrayRowFn, 2>{}, std::array<GrayRowFn, 2>{}};
+    if (depth < 0 || depth >= static_cast<int>(table.size()) || channels < 3 || channels > 4)
+    {
+        return nullptr;
+    }
+    return table[depth][channels - 3];
+}
+
+/**
+ * cv::threshold through the specialized kernels (OTSU/TRIANGLE and unsupported depths use OpenCV)
+ * @return the threshold that was used, like cv::threshold
+ */
+inline double fast_threshold(const cv::Mat &src, cv::Mat &dst, double thresh, double max_value, int type)
+{
+    ThresholdRowFn kernel = threshold_kernel(src.depth(), type);
+    if (src.empty() || kernel == nullptr)
+    {
+        return cv::threshold(src, dst, thresh, max_value, type);
+    }
+    INSTRUMENT_SCOPE("kernels.threshold");
+    dst.create(src.size(), src.type());
+    const int n = src.cols * src.channels();
+    cv::parallel_for_(cv::Range(0, src.rows), [&](const cv::Range &range) {
+        for (int y = range.start; y < range.end; y++)
+        {
+            kernel(src.ptr(y), dst.ptr(y), n, thresh, max_value);
+        }
+    });
+    return src.depth() == CV_32F || src.depth() == CV_64F ? thresh : std::floor(thresh);
+}
+
+/**
+ * BGR/BGRA to grayscale through the specialized kernels (other layouts use cv::cvtColor)
+ * dst may not be src: the output has one channel
+ */
+inline void fast_grayscale(const cv::Mat &src, cv::Mat &dst)
+{
+    GrayRowFn kernel = gray_kernel(src.depth(), src.channels());
+    if (src.empty() || kernel == nullptr || src.data == dst.data)
+    {
+        cv::cvtColor(src, dst, src.channels() == 4 ? cv::COLOR_BGRA2GRAY : cv::COLOR_BGR2GRAY);
+        return;
+    }
+    INSTRUMENT_SCOPE("kernels.grayscale");
+    dst.create(src.size(), CV_MAKETYPE(src.depth(), 1));
+    cv::parallel_for_(cv::Range(0, src.rows), [&](const cv::Range &range) {
+        for (int y = range.start; y < range.end; y++)
+        {
+            kernel(src.ptr(y), dst.ptr(y), src.cols);
+        }
+    });
+}
@@ -0,0 +1,547 @@
+#pragma once
+
+#include <algorithm>
+#include <cstdint>
+#include <cstring>
+#include <fcntl.h>
+#include <iostream>
+#include <list>
+#include <mutex>
+#include <string>
+#include <sys/stat.h>
+#include <unistd.h>
+#include <unordered_map>
+#include <vector>
+#include <opencv2/opencv.hpp>
+#include "contrast.hpp"
+#include "gamma_correction.hpp"
+#include "instrumentation.hpp"
+
+/*
+ * Tiled out-of-core images for inputs that do not fit in memory (aerial photos, slide scans).
+ *
+ * Tile store layout (".tiles" file, native byte order):
+ *   TileStoreHeader
+ *   uint64_t offset[tiles_x * tiles_y]   row-major tile index
+ *   tile data                            every tile is tile_height x tile_width pixels,
+ *                                        edge tiles are padded to the full tile size
+ *
+ * Operations read a small window of tiles at a time (in parallel) and write the result to a new store,
+ * so memory stays at a few tiles whatever the image size.
+ */
+
+#define TILE_DEFAULT_SIZE 512
+#define TILE_PREFETCH_DEPTH 2
+#define TILE_CACHE_DEFAULT_BYTES (256u << 20)
+
+struct TileStoreHeader
+{
+    char magic[8];
+    int32_t version;
+    int32_t width;
+    int32_t height;
+    int32_t type;
+    int32_t tile_width;
+    int32_t tile_height;
+};
+static_assert(sizeof(TileStoreHeader) == 32, "TileStoreHeader must not contain padding");
+
+inline constexpr char TILE_STORE_MAGIC[8] = {'C', 'V', 'T', 'I', 'L', 'E', 'S', '1'};
+
+/**
+ * Handle on a tile store file
+ * read_tile/write_tile use pread/pwrite, so several threads can read tiles at the same time
+ */
+class TiledImage
+{
+public:
+    TiledImage() = default;
+    ~TiledImage() { close(); }
+    TiledImage(const TiledImage &) = delete;
+    TiledImage &operator=(const TiledImage &) = delete;
+
+    /**
+     * Opens an existing tile store
+     * @param writable Also allow write_tile (in-place updates)
+     */
+    bool open(const std::string &path, bool writable = false)
+    {
+        close();
+        fd_ = ::open(path.c_str(), writable ? O_RDWR : O_RDONLY);
+        if (fd_ < 0)
+        {
+            std::cerr << "Error: Could not open tile store '" << path << "'!" << std::endl;
+            return false;
+        }
+        struct stat st;
+        if (!read_exact(&header_, sizeof(header_), 0) || ::fstat(fd_, &st) != 0 || !valid_header(st.st_size))
+        {
+            std::cerr << "Error: '" << path << "' is not a valid tile store!" << std::endl;
+            close();
+            return false;
+        }
+        index_.resize(tile_count());
+        if (!read_exact(index_.data(), index_.size() * sizeof(uint64_t), sizeof(header_)))
+        {
+            std::cerr << "Error: Tile index of '" << path << "' is truncated!" << std::endl;
+            close();
+            return false;
+        }
+        const uint64_t file_bytes = static_cast<uint64_t>(st.st_size);
+        for (uint64_t offset : index_)
+        {
+            if (offset > file_bytes || tile_bytes() > file_bytes - offset)
+            {
+                std::cerr << "Error: Tile index of '" << path << "' points past the end of the file!" << std::endl;
+                close();
+                return false;
+            }
+        }
+        return true;
+    }
+
+    /**
+     * Creates a new tile store (overwrites an existing file) and reserves space for every tile
+     */
+    bool create(const std::string &path, cv::Size size, int type,
+                cv::Size tile = cv::Size(TILE_DEFAULT_SIZE, TILE_DEFAULT_SIZE))
+    {
+        close();
+        if (size.width <= 0 || size.height <= 0 || tile.width <= 0 || tile.height <= 0)
+        {
+            std::cerr << "Error: Tile store size and tile size must be positive!" << std::endl;
+            return false;
+        }
+        fd_ = ::open(path.c_str(), O_RDWR | O_CREAT | O_TRUNC, 0644);
+        if (fd_ < 0)
+        {
+            std::cerr << "Error: Could not create tile store '" << path << "'!" << std::endl;
+            return false;
+        }
+        std::memcpy(header_.magic, TILE_STORE_MAGIC, sizeof(header_.magic));
+        header_.version = 1;
+        header_.width = size.width;
+        header_.height = size.height;
+        header_.type = type;
+        header_.tile_width = tile.width;
+        header_.tile_height = tile.height;
+
+        index_.resize(tile_count());
+        uint64_t offset = sizeof(header_) + index_.size() * sizeof(uint64_t);
+        for (uint64_t &entry : index_)
+        {
+            entry = offset;
+            offset += tile_bytes();
+        }
+        if (!write_exact(&header_, sizeof(header_), 0) ||
+            !write_exact(index_.data(), index_.size() * sizeof(uint64_t), sizeof(header_)) ||
+            ::ftruncate(fd_, static_cast<off_t>(offset)) != 0)
+        {
+            std::cerr << "Error: Could not write tile store '" << path << "'!" << std::endl;
+            close();
+            return false;
+        }
+        return true;
+    }
+
+    void close()
+    {
+        if (fd_ >= 0)
+        {
+            ::close(fd_);
+            fd_ = -1;
+        }
+        index_.clear();
+    }
+
+    bool is_open() const { return fd_ >= 0; }
+    cv::Size size() const { return cv::Size(header_.width, header_.height); }
+    int type() const { return header_.type; }
+    cv::Size tile_size() const { return cv::Size(header_.tile_width, header_.tile_height); }
+    int tiles_x() const
+    {
+        return static_cast<int>((int64_t(header_.width) + header_.tile_width - 1) / header_.tile_width);
+    }
+    int tiles_y() const
+    {
+        return static_cast<int>((int64_t(header_.height) + header_.tile_height - 1) / header_.tile_height);
+    }
+    size_t tile_count() const { return static_cast<size_t>(tiles_x()) * static_cast<size_t>(tiles_y()); }
+    size_t tile_bytes() const
+    {
+        return static_cast<size_t>(header_.tile_width) * header_.tile_height * CV_ELEM_SIZE(header_.type);
+    }
+
+    /**
+     * Part of the image covered by a tile (edge tiles are smaller than tile_size)
+     */
+    cv::Rect tile_rect(int tx, int ty) const
+    {
+        cv::Rect full(tx * header_.tile_width, ty * header_.tile_height, header_.tile_width, header_.tile_height);
+        return full & cv::Rect(0, 0, header_.width, header_.height);
+    }
+
+    /**
+     * Reads one tile, cropped to the valid part of the image
+     */
+    bool read_tile(int tx, int ty, cv::Mat &tile) const
+    {
+        if (!valid_tile(tx, ty))
+        {
+            return false;
+        }
+        INSTRUMENT_SCOPE("tiles.read");
+        cv::Mat full(header_.tile_height, header_.tile_width, header_.type);
+        if (!read_exact(full.data, tile_bytes(), index_[ty * tiles_x() + tx]))
+        {
+            std::cerr << "Error: Could not read tile (" << tx << ", " << ty << ")!" << std::endl;
+            return false;
+        }
+        cv::Rect r = tile_rect(tx, ty);
+        tile = full(cv::Rect(0, 0, r.width, r.height));
+        return true;
+    }
+
+    /**
+     * Writes one tile; tile must have the size of tile_rect(tx, ty) and the store type
+     */
+    bool write_tile(int tx, int ty, const cv::Mat &tile)
+    {
+        if (!valid_tile(tx, ty))
+        {
+            return false;
+        }
+        cv::Rect r = tile_rect(tx, ty);
+        if (tile.size() != r.size() || tile.type() != header_.type)
+        {
+            std::cerr << "Error: Tile (" << tx << ", " << ty << ") has the wrong size or type!" << std::endl;
+            return false;
+        }
+        INSTRUMENT_SCOPE("tiles.write");
+        cv::Mat full = tile;
+        if (tile.size() != tile_size() || !tile.isContinuous())
+        {
+            full = cv::Mat::zeros(header_.tile_height, header_.tile_width, header_.type);
+            tile.copyTo(full(cv::Rect(0, 0, r.width, r.height)));
+        }
+        if (!write_exact(full.data, tile_bytes(), index_[ty * tiles_x() + tx]))
+        {
+            std::cerr << "Error: Could not write tile (" << tx << ", " << ty << ")!" << std::endl;
+            return false;
+        }
+        return true;
+    }
+
+private:
+    /**
+     * True if the header read from a file of file_bytes describes a store that can be in that file:
+     * checked in 64-bit and against the file size, so a corrupt header is rejected instead of making
+     * open() allocate a huge index
+     */
+    bool valid_header(off_t file_bytes) const
+    {
+        if (std::memcmp(header_.magic, TILE_STORE_MAGIC, sizeof(header_.magic)) != 0 || header_.version != 1 ||
+            header_.width <= 0 || header_.height <= 0 || header_.tile_width <= 0 || header_.tile_height <= 0 ||
+            header_.type < 0 || CV_MAT_TYPE(header_.type) != header_.type ||
+            file_bytes < static_cast<off_t>(sizeof(header_)))
+        {
+            return false;
+        }
+        const uint64_t data_bytes = static_cast<uint64_t>(file_bytes) - sizeof(header_);
+        const uint64_t tile_pixels = static_cast<uint64_t>(header_.tile_width) * header_.tile_height;
+        return tile_count() <= data_bytes / sizeof(uint64_t) &&
+               tile_pixels <= data_bytes / CV_ELEM_SIZE(header_.type);
+    }
+
+    bool valid_tile(int tx, int ty) const
+    {
+        if (fd_ < 0 || tx < 0 || ty < 0 || tx >= tiles_x() || ty >= tiles_y())
+        {
+            std::cerr << "Error: Tile (" << tx << ", " << ty << ") does not exist!" << std::endl;
+            return false;
+        }
+        return true;
+    }
+
+    bool read_exact(void *dst, size_t bytes, uint64_t offset) const
+    {
+        char *p = static_cast<char *>(dst);
+        while (bytes > 0)
+        {
+            ssize_t n = ::pread(fd_, p, bytes, static_cast<off_t>(offset));
+            if (n <= 0)
+            {
+                return false;
+            }
+            p += n;
+            bytes -= static_cast<size_t>(n);
+            offset += static_cast<uint64_t>(n);
+        }
+        return true;
+    }
+
+    bool write_exact(const void *src, size_t bytes, uint64_t offset)
+    {
+        const char *p = static_cast<const char *>(src);
+        while (bytes > 0)
+        {
+            ssize_t n = ::pwrite(fd_, p, bytes, static_cast<off_t>(offset));
+            if (n <= 0)
+            {
+                return false;
+            }
+            p += n;
+            bytes -= static_cast<size_t>(n);
+            offset += static_cast<uint64_t>(n);
+        }
+        return true;
+    }
+
+    int fd_ = -1;
+    TileStoreHeader header_{};
+    std::vector<uint64_t> index_;
+};
+
+/**
+ * Least-recently-used tile cache with a memory ceiling, for random access (crops, viewers)
+ * Returned Mats share the cached pixels, evicting a tile does not invalidate them
+ */
+class TileCache
+{
+public:
+    explicit TileCache(const TiledImage &img, size_t max_bytes = TILE_CACHE_DEFAULT_BYTES)
+        : img_(img), max_bytes_(max_bytes)
+    {
+    }
+
+    /**
+     * Returns a tile from the cache, reading it from disk on a miss
+     */
+    cv::Mat get(int tx, int ty)
+    {
+        const int key = ty * img_.tiles_x() + tx;
+        std::lock_guard<std::mutex> lock(mutex_);
+        auto it = entries_.find(key);
+        if (it != entries_.end())
+        {
+            INSTRUMENT_COUNT("tiles.cache_hit", 1);
+            lru_.splice(lru_.begin(), lru_, it->second.position);
+            return it->second.tile;
+        }
+        INSTRUMENT_COUNT("tiles.cache_miss", 1);
+
+        cv::Mat tile;
+        if (!img_.read_tile(tx, ty, tile))
+        {
+            return cv::Mat();
+        }
+        const size_t bytes = img_.tile_bytes();
+        while (!lru_.empty() && bytes_ + bytes > max_bytes_)
+        {
+            entries_.erase(lru_.back());
+            lru_.pop_back();
+            bytes_ -= bytes;
+        }
+        lru_.push_front(key);
+        entries_[key] = {tile, lru_.begin()};
+        bytes_ += bytes;
+        return tile;
+    }
+
+    size_t bytes() const { return bytes_; }
+
+private:
+    struct Entry
+    {
+        cv::Mat tile;
+        std::list<int>::iterator position;
+    };
+
+    const TiledImage &img_;
+    size_t max_bytes_;
+    size_t bytes_ = 0;
+    std::list<int> lru_; // most recently used first
+    std::unordered_map<int, Entry> entries_;
+    std::mutex mutex_;
+};
+
+/**
+ * Crops a region out of a tile store, reading only the tiles that intersect it
+ * @param cache Optional tile cache shared between crops (nullptr reads straight from disk)
+ * @return The crop as a regular Mat, empty on error
+ */
+inline cv::Mat tiled_crop(const TiledImage &src, cv::Rect rect, TileCache *cache = nullptr)
+{
+    if (!src.is_open() || rect.empty() || (rect & cv::Rect(cv::Point(0, 0), src.size())) != rect)
+    {
+        std::cerr << "Error: Cropping rectangle is out of the tiled image bounds!" << std::endl;
+        return cv::Mat();
+    }
+    INSTRUMENT_SCOPE("tiles.crop");
+    cv::Mat result(rect.size(), src.type());
+    const cv::Size tile = src.tile_size();
+
+    for (int ty = rect.y / tile.height; ty <= (rect.y + rect.height - 1) / tile.height; ty++)
+    {
+        for (int tx = rect.x / tile.width; tx <= (rect.x + rect.width - 1) / tile.width; tx++)
+        {
+            cv::Mat pixels;
+            if (cache != nullptr)
+            {
+                pixels = cache->get(tx, ty);
+            }
+            else
+            {
+                src.read_tile(tx, ty, pixels);
+            }
+            if (pixels.empty())
+            {
+                return cv::Mat();
+            }
+            cv::Rect tile_area = src.tile_rect(tx, ty);
+            cv::Rect overlap = tile_area & rect;
+            pixels(overlap - tile_area.tl()).copyTo(result(overlap - rect.tl()));
+        }
+    }
+    return result;
+}
+
+/**
+ * Runs a per-tile operation over a whole store and writes the result to a new store
+ * Tiles are read in windows of prefetch + 1 with cv::parallel_for_ (on OpenCV's worker threads, so no
+ * thread is started per tile), then processed and written in order: at most prefetch + 2 tiles are in
+ * memory at any time.
+ * @param fn Operation `void(const cv::Mat &in, cv::Mat &out)`; out must have the input size and dst_type
+ */
+template <typename TileFn>
+bool tiled_map(const TiledImage &src, const std::string &dst_path, int dst_type, TileFn fn,
+               int prefetch = TILE_PREFETCH_DEPTH)
+{
+    if (!src.is_open())
+    {
+        std::cerr << "Error: Source tile store is not open!" << std::endl;
+        return false;
+    }
+    TiledImage dst;
+    if (!dst.create(dst_path, src.size(), dst_type, src.tile_size()))
+    {
+        return false;
+    }
+
+    const size_t count = src.tile_count();
+    const size_t tiles_x = static_cast<size_t>(src.tiles_x());
+    const size_t window = static_cast<size_t>(std::max(prefetch, 0)) + 1;
+    std::vector<cv::Mat> tiles(std::min(window, count));
+    for (size_t first = 0; first < count; first += window)
+    {
+        const int n = static_cast<int>(std::min(window, count - first));
+        cv::parallel_for_(cv::Range(0, n), [&](const cv::Range &range) {
+            for (int k = range.start; k < range.end; k++)
+            {
+                const size_t i = first + k;
+                tiles[k].release();
+                src.read_tile(static_cast<int>(i % tiles_x), static_cast<int>(i / tiles_x), tiles[k]);
+            }
+        });
+
+        for (int k = 0; k < n; k++)
+        {
+            const size_t i = first + k;
+            if (tiles[k].empty())
+            {
+                return false;
+            }
+            cv::Mat out;
+            {
+                INSTRUMENT_SCOPE("tiles.process");
+                fn(tiles[k], out);
+            }
+            tiles[k].release();
+            if (!dst.write_tile(static_cast<int>(i % tiles_x), static_cast<int>(i / tiles_x), out))
+            {
+                return false;
+            }
+        }
+    }
+    return true;
+}
+
+/**
+ * Writes an in-memory image as a tile store (for images that still fit, or to build test inputs)
+ */
+inline bool tile_from_image(const cv::Mat &img, const std::string &path,
+                            cv::Size tile = cv::Size(TILE_DEFAULT_SIZE, TILE_DEFAULT_SIZE))
+{
+    if (img.empty())
+    {
+        std::cerr << "Error: Input image is empty!" << std::endl;
+        return false;
+    }
+    TiledImage store;
+    if (!store.create(path, img.size(), img.type(), tile))
+    {
+        return false;
+    }
+    for (int ty = 0; ty < store.tiles_y(); ty++)
+    {
+        for (int tx = 0; tx < store.tiles_x(); tx++)
+        {
+            if (!store.write_tile(tx, ty, img(store.tile_rect(tx, ty))))
+            {
+                return false;
+            }
+        }
+    }
+    return true;
+}
+
+/**
+ * Tile-by-tile BGR to grayscale conversion (CV_8UC3 store to CV_8UC1 store)
+ */
+inline bool tiled_grayscale(const TiledImage &src, const std::string &dst_path)
+{
+    if (CV_MAT_CN(src.type()) != 3)
+    {
+        std::cerr << "Error: Input tile store must have 3 channels!" << std::endl;
+        return false;
+    }
+    return tiled_map(src, dst_path, CV_MAKETYPE(CV_MAT_DEPTH(src.type()), 1),
+                     [](const cv::Mat &in, cv::Mat &out) { cv::cvtColor(in, out, cv::COLOR_BGR2GRAY); });
+}
+
+/**
+ * Tile-by-tile gamma correction (same depths and formula as gammaCorrectionLUT)
+ */
+inline bool tiled_gamma(const TiledImage &src, const std::string &dst_path, double gamma, double max_value = 0.0)
+{
+    return tiled_map(src, dst_path, src.type(), [gamma, max_value](const cv::Mat &in, cv::Mat &out) {
+        out = gammaCorrectionLUT(in, gamma, max_value);
+    });
+}
+
+/**
+ * Tile-by-tile brightness/contrast adjustment (lesson 06)
+ */
+inline bool tiled_contrast(const TiledImage &src, const std::string &dst_path, double alpha, double beta)
+{
+    return tiled_map(src, dst_path, src.type(), [alpha, beta](const cv::Mat &in, cv::Mat &out) {
+        adjust_contrast_brightness(in, out, alpha, beta);
+    });
+}
+
+/**
+ * Tile-by-tile fixed threshold (lesson 09 types)
+ * THRESH_OTSU/THRESH_TRIANGLE are rejected: they need statistics of the whole image, not of one tile
+ */
+inline bool tiled_threshold(const TiledImage &src, const std::string &dst_path, double thresh, double max_value,
+                            int type)
+{
+    if ((type & (cv::THRESH_OTSU | cv::THRESH_TRIANGLE)) != 0)
+    {
+        std::cerr << "Error: Automatic thresholds are not supported tile by tile!" << std::endl;
+        return false;
+    }
+    return tiled_map(src, dst_path, src.type(), [=](const cv::Mat &in, cv::Mat &out) {
+        cv::threshold(in, out, thresh, max_value, type);
+    });
+}
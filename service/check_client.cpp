@@ -0,0 +1,130 @@
+#include <cstdint>
+#include <functional>
+#include <iostream>
+#include <string>
+#include <vector>
+#include <opencv2/opencv.hpp>
+#include "processing_service.hpp"
+#include "shared_memory.hpp"
+
+/*
+ * End-to-end check of a running processing service:
+ *
+ *   cv_lessons_service &
+ *   cv_lessons_service_check [--socket PATH]
+ *
+ * Sends a ping and a grayscale request over a shared image segment, then the same request with the
+ * segment header corrupted field by field (sizes that wrap around in 64-bit arithmetic, offsets past the
+ * mapping, unsupported types). Every corrupted request must be rejected with STATUS_NO_INPUT, and the
+ * service must still answer a valid request afterwards.
+ * Exit code 0 if everything behaved, 1 otherwise.
+ */
+
+#define CHECK_INPUT_SEGMENT "/cv_lessons_check_in"
+#define CHECK_OUTPUT_SEGMENT "/cv_lessons_check_out"
+
+struct MalformedHeader
+{
+    const char *name;
+    std::function<void(SharedImageHeader &)> corrupt;
+};
+
+static int failures = 0;
+
+void expect(bool ok, const std::string &what)
+{
+    std::cout << (ok ? "  ok    " : "  FAIL  ") << what << std::endl;
+    failures += ok ? 0 : 1;
+}
+
+/**
+ * Grayscale of the input segment into the output segment
+ * @return response status, -1 if the service did not answer
+ */
+int request_grayscale(ServiceClient &client, uint64_t id)
+{
+    ServiceRequest req = service_request(SERVICE_GRAYSCALE, CHECK_INPUT_SEGMENT, CHECK_OUTPUT_SEGMENT);
+    req.id = id;
+    ServiceResponse resp;
+    if (!client.send(req) || !client.receive(resp))
+    {
+        return -1;
+    }
+    return resp.id == id ? resp.status : -1;
+}
+
+int main(int argc, char const *argv[])
+{
+    std::string socket_path = SERVICE_SOCKET_PATH;
+    if (argc == 3 && std::string(argv[1]) == "--socket")
+    {
+        socket_path = argv[2];
+    }
+    else if (argc != 1)
+    {
+        std::cerr << "Usage: " << argv[0] << " [--socket PATH]" << std::endl;
+        return -1;
+    }
+
+    ServiceClient client;
+    if (!client.connect(socket_path))
+    {
+        return 1;
+    }
+
+    ServiceRequest ping;
+    ServiceResponse pong;
+    expect(client.call(ping, pong), "ping");
+
+    // A valid image, and the grayscale the service should make of it
+    cv::Mat img(64, 80, CV_8UC3);
+    cv::randu(img, cv::Scalar::all(0), cv::Scalar::all(256));
+    cv::Mat expected;
+    cv::cvtColor(img, expected, cv::COLOR_BGR2GRAY);
+    SharedMemory input;
+    if (!write_shared_image(input, CHECK_INPUT_SEGMENT, img))
+    {
+        return 1;
+    }
+    const SharedImageHeader valid = *reinterpret_cast<const SharedImageHeader *>(input.data());
+
+    uint64_t id = 1;
+    expect(request_grayscale(client, id++) == STATUS_OK, "grayscale of a valid segment");
+    SharedMemory output;
+    cv::Mat result = output.open(CHECK_OUTPUT_SEGMENT, false) ? shared_image_view(output) : cv::Mat();
+    expect(!result.empty() && result.size() == expected.size() && cv::norm(result, expected, cv::NORM_INF) <= 1.0,
+           "grayscale result matches cv::cvtColor");
+    output.close();
+
+    const uint64_t size = input.size();
+    const std::vector<MalformedHeader> cases = {
+        {"step that wraps step * rows to 0", [](SharedImageHeader &h) { h.step = uint64_t(1) << 63; h.rows = 2; }},
+        {"step past the mapping", [&](SharedImageHeader &h) { h.step = size; }},
+        {"data_offset that wraps the end", [](SharedImageHeader &h) { h.data_offset = UINT64_MAX - 16; }},
+        {"data_offset past the mapping", [&](SharedImageHeader &h) { h.data_offset = size + 64; }},
+        {"rows past the mapping", [](SharedImageHeader &h) { h.rows = 1 << 30; }},
+        {"step shorter than a row", [](SharedImageHeader &h) { h.step = 8; }},
+        {"negative type", [](SharedImageHeader &h) { h.type = -1; }},
+        {"type with flag bits", [](SharedImageHeader &h) { h.type = CV_8UC3 | (1 << 14); }},
+        {"depth above CV_64F", [](SharedImageHeader &h) { h.type = CV_MAKETYPE(7, 3); }},
+        {"more than 4 channels", [](SharedImageHeader &h) { h.type = CV_MAKETYPE(CV_8U, 5); }},
+        {"bad magic", [](SharedImageHeader &h) { h.magic = 0; }},
+    };
+    SharedImageHeader &header = *reinterpret_cast<SharedImageHeader *>(input.data());
+    for (const MalformedHeader &c : cases)
+    {
+        header = valid;
+        c.corrupt(header);
+        expect(request_grayscale(client, id++) == STATUS_NO_INPUT, std::string("rejects ") + c.name);
+    }
+
+    header = valid;
+    expect(request_grayscale(client, id++) == STATUS_OK, "service still answers after malformed requests");
+
+    input.close();
+    SharedMemory::unlink(CHECK_INPUT_SEGMENT);
+    SharedMemory::unlink(CHECK_OUTPUT_SEGMENT);
+    std::cout << (failures == 0 ? "All service checks passed" : std::to_string(failures) + " service check(s) failed")
+              << std::endl;
+    return failures == 0 ? 0 : 1;
+}
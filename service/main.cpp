@@ -0,0 +1,893 @@
+#include <algorithm>
+#include <chrono>
+#include <cmath>
+#include <cerrno>
+#include <csignal>
+#include <cstdlib>
+#include <cstring>
+#include <fcntl.h>
+#include <iostream>
+#include <list>
+#include <map>
+#include <memory>
+#include <mutex>
+#include <poll.h>
+#include <string>
+#include <sys/socket.h>
+#include <sys/stat.h>
+#include <sys/un.h>
+#include <tuple>
+#include <unistd.h>
+#include <unordered_map>
+#include <vector>
+#include <opencv2/opencv.hpp>
+#include "batch_ops.hpp"
+#include "contrast.hpp"
+#include "gamma_correction.hpp"
+#include "instrumentation.hpp"
+#include "processing_service.hpp"
+#include "shared_memory.hpp"
+#include "specialized_kernels.hpp"
+
+/*
+ * Processing service: one long-running process that runs the lesson operations (grayscale, crop,
+ * arithmetic, gamma, contrast, threshold) for other processes.
+ *
+ *   cv_lessons_service [--socket PATH] [--threads N] [--cache-mb N]
+ *
+ * Protocol and client: common/processing_service.hpp. State kept warm between requests:
+ *   - mappings of shared image segments (mapped again only when a segment is recreated or resized)
+ *   - decoded image files, least recently used first out beyond --cache-mb, reloaded when a file changes
+ *   - 8-bit gamma and contrast tables
+ *   - OpenCV's thread pool and lazily initialized code paths, warmed up once at startup
+ *
+ * Batching: every loop iteration takes the complete requests of all ready clients and runs them as one
+ * batch, one request per worker thread. Requests that depend on each other (the pipelined requests of
+ * one client, or requests sharing a segment one of them writes) run in order on the same thread. Under
+ * load, tiny jobs from many clients share one parallel dispatch instead of paying one each; a lone
+ * request runs immediately with all threads inside its operation, so batching never makes a request
+ * wait for others.
+ */
+
+#define DEFAULT_CACHE_MB 512
+#define MAX_BATCH 256
+#define SEGMENT_CACHE_SIZE 256
+#define LUT_CACHE_SIZE 1024
+#define OUTBOX_LIMIT (1 << 20) // stop reading from a client that does not read its responses
+#define POLL_TIMEOUT_MS 500
+
+struct ServiceOptions
+{
+    std::string socket_path = SERVICE_SOCKET_PATH;
+    int threads = 0; // 0 = OpenCV's default
+    size_t cache_bytes = static_cast<size_t>(DEFAULT_CACHE_MB) << 20;
+};
+
+/**
+ * Mappings of the shared image segments named in requests
+ */
+class SegmentCache
+{
+public:
+    /**
+     * Mapping of an existing segment, nullptr if it does not exist
+     */
+    std::shared_ptr<SharedMemory> get(const std::string &name)
+    {
+        std::lock_guard<std::mutex> lock(mutex_);
+        auto it = segments_.find(name);
+        if (it != segments_.end() && it->second->is_current())
+        {
+            return it->second;
+        }
+        auto shm = std::make_shared<SharedMemory>();
+        if (!shm->open(name, false))
+        {
+            segments_.erase(name);
+            return nullptr;
+        }
+        insert(name, shm);
+        return shm;
+    }
+
+    /**
+     * View of an output segment laid out for an image (created or grown if needed)
+     * @param keep Receives the mapping, which must stay alive while the view is used
+     */
+    cv::Mat output(const std::string &name, cv::Size size, int type, std::shared_ptr<SharedMemory> &keep)
+    {
+        std::lock_guard<std::mutex> lock(mutex_);
+        auto it = segments_.find(name);
+        if (it != segments_.end() && it->second->writable() && it->second->size() >= shared_image_bytes(size, type) &&
+            it->second->is_current())
+        {
+            keep = it->second;
+        }
+        else
+        {
+            // A new mapping: requests of the same batch may still use the old one
+            keep = std::make_shared<SharedMemory>();
+            insert(name, keep);
+        }
+        return format_shared_image(*keep, name, size, type);
+    }
+
+private:
+    void insert(const std::string &name, const std::shared_ptr<SharedMemory> &shm)
+    {
+        if (segments_.size() >= SEGMENT_CACHE_SIZE && segments_.count(name) == 0)
+        {
+            segments_.clear(); // clients cycle through many names: start over
+        }
+        segments_[name] = shm;
+    }
+
+    std::map<std::string, std::shared_ptr<SharedMemory>> segments_;
+    std::mutex mutex_;
+};
+
+/**
+ * Decoded image files, least recently used evicted first
+ */
+class ImageCache
+{
+public:
+    explicit ImageCache(size_t capacity) : capacity_(capacity) {}
+
+    /**
+     * Decoded image (cv::IMREAD_UNCHANGED keeps 16-bit and float files at their depth), empty on failure
+     * The file is decoded again when its size or modification time changed
+     */
+    cv::Mat get(const std::string &path)
+    {
+        struct stat st;
+        if (::stat(path.c_str(), &st) != 0)
+        {
+            return cv::Mat();
+        }
+        {
+            std::lock_guard<std::mutex> lock(mutex_);
+            auto it = index_.find(path);
+            if (it != index_.end() && it->second->mtime == st.st_mtime && it->second->file_size == st.st_size)
+            {
+                lru_.splice(lru_.begin(), lru_, it->second);
+                INSTRUMENT_COUNT("service.image_cache_hits", 1);
+                return it->second->image;
+            }
+        }
+
+        // Decode outside the lock so other requests of the batch keep going
+        cv::Mat img = cv::imread(path, cv::IMREAD_UNCHANGED);
+        if (img.empty())
+        {
+            return img;
+        }
+        INSTRUMENT_COUNT("service.image_decodes", 1);
+        std::lock_guard<std::mutex> lock(mutex_);
+        auto it = index_.find(path);
+        if (it != index_.end())
+        {
+            bytes_ -= it->second->bytes;
+            lru_.erase(it->second);
+        }
+        lru_.push_front(Entry{path, st.st_mtime, st.st_size, img, img.total() * img.elemSize()});
+        index_[path] = lru_.begin();
+        bytes_ += lru_.front().bytes;
+        while (bytes_ > capacity_ && lru_.size() > 1)
+        {
+            bytes_ -= lru_.back().bytes;
+            index_.erase(lru_.back().path);
+            lru_.pop_back();
+        }
+        return img;
+    }
+
+private:
+    struct Entry
+    {
+        std::string path;
+        time_t mtime;
+        off_t file_size;
+        cv::Mat image; // never written: every operation writes to an output segment
+        size_t bytes;
+    };
+
+    std::list<Entry> lru_;
+    std::unordered_map<std::string, std::list<Entry>::iterator> index_;
+    size_t bytes_ = 0;
+    size_t capacity_;
+    std::mutex mutex_;
+};
+
+/**
+ * 8-bit lookup tables of the point operations, built once per parameter set
+ */
+class LutCache
+{
+public:
+    cv::Mat gamma(double gamma)
+    {
+        return get(0, gamma, 0.0, [&]() { return gamma_table_8u(gamma); });
+    }
+
+    /**
+     * Same values as cv::convertScaleAbs(src, dst, alpha, beta) on 8-bit data
+     */
+    cv::Mat contrast(double alpha, double beta)
+    {
+        return get(1, alpha, beta, [&]() {
+            cv::Mat table(1, 256, CV_8U);
+            uchar *p = table.ptr();
+            for (int i = 0; i < 256; i++)
+            {
+                p[i] = cv::saturate_cast<uchar>(std::abs(i * alpha + beta));
+            }
+            return table;
+        });
+    }
+
+private:
+    template <class Build>
+    cv::Mat get(int kind, double a, double b, Build build)
+    {
+        const auto key = std::make_tuple(kind, a, b);
+        std::lock_guard<std::mutex> lock(mutex_);
+        auto it = tables_.find(key);
+        if (it != tables_.end())
+        {
+            return it->second;
+        }
+        if (tables_.size() >= LUT_CACHE_SIZE)
+        {
+            tables_.clear();
+        }
+        cv::Mat table = build();
+        tables_[key] = table;
+        return table;
+    }
+
+    std::map<std::tuple<int, double, double>, cv::Mat> tables_;
+    std::mutex mutex_;
+};
+
+struct ServiceState
+{
+    SegmentCache segments;
+    ImageCache images;
+    LutCache luts;
+
+    explicit ServiceState(size_t cache_bytes) : images(cache_bytes) {}
+};
+
+struct Client
+{
+    int fd = -1;
+    std::vector<char> inbox;  // bytes of a partially received request
+    std::vector<char> outbox; // responses not written yet
+    bool closed = false;
+};
+
+struct PendingRequest
+{
+    Client *client;
+    ServiceRequest request;
+};
+
+static volatile std::sig_atomic_t stop_requested = 0;
+
+void on_signal(int)
+{
+    stop_requested = 1;
+}
+
+/**
+ * NUL-terminated string of a fixed-size request field (an unterminated field gives an empty string)
+ */
+std::string field_string(const char (&field)[SERVICE_NAME_LEN])
+{
+    const size_t n = strnlen(field, SERVICE_NAME_LEN);
+    return n < SERVICE_NAME_LEN ? std::string(field, n) : std::string();
+}
+
+void set_message(ServiceResponse &resp, int32_t status, const std::string &message)
+{
+    resp.status = status;
+    std::strncpy(resp.message, message.c_str(), sizeof(resp.message) - 1);
+}
+
+bool is_arithmetic(int op)
+{
+    return op == SERVICE_ADD || op == SERVICE_SUBTRACT || op == SERVICE_MULTIPLY || op == SERVICE_DIVIDE;
+}
+
+/**
+ * Runs one request: resolves the input(s), lays out the output segment and writes the result straight into it
+ */
+void run_request(const ServiceRequest &req, ServiceResponse &resp, ServiceState &state)
+{
+    resp.id = req.id;
+    if (req.magic != SERVICE_MAGIC || req.op < 0 || req.op >= SERVICE_OP_COUNT)
+    {
+        set_message(resp, STATUS_BAD_REQUEST, "unknown operation");
+        return;
+    }
+    if (req.op == SERVICE_PING)
+    {
+        return;
+    }
+
+    const std::string input_name = field_string(req.input);
+    const std::string second_name = field_string(req.second);
+    const std::string output_name = field_string(req.output);
+    if (output_name.size() < 2 || output_name[0] != '/')
+    {
+        set_message(resp, STATUS_BAD_REQUEST, "output must be a segment name like /name");
+        return;
+    }
+
+    cv::Mat src;
+    std::shared_ptr<SharedMemory> input_shm;
+    if (req.source == SOURCE_FILE)
+    {
+        src = state.images.get(input_name);
+    }
+    else if ((input_shm = state.segments.get(input_name)) != nullptr)
+    {
+        src = shared_image_view(*input_shm);
+    }
+    if (src.empty())
+    {
+        set_message(resp, STATUS_NO_INPUT, "could not read input '" + input_name + "'");
+        return;
+    }
+
+    cv::Mat second;
+    std::shared_ptr<SharedMemory> second_shm;
+    if (is_arithmetic(req.op) && !second_name.empty())
+    {
+        if ((second_shm = state.segments.get(second_name)) != nullptr)
+        {
+            second = shared_image_view(*second_shm);
+        }
+        if (second.size() != src.size() || second.type() != src.type())
+        {
+            set_message(resp, STATUS_NO_INPUT, "second image missing or not the size and type of the input");
+            return;
+        }
+    }
+
+    // Output shape, then the view over the output segment that the operation writes into
+    cv::Size out_size = src.size();
+    int out_type = src.type();
+    cv::Rect rect(req.rect[0], req.rect[1], req.rect[2], req.rect[3]);
+    if (req.op == SERVICE_GRAYSCALE || req.op == SERVICE_CROP)
+    {
+        if (output_name == input_name && req.source == SOURCE_SHARED)
+        {
+            set_message(resp, STATUS_BAD_REQUEST, "grayscale and crop cannot write over their input");
+            return;
+        }
+        if (req.op == SERVICE_GRAYSCALE)
+        {
+            out_type = CV_MAKETYPE(src.depth(), 1);
+        }
+        else if (rect.width <= 0 || rect.height <= 0 || (rect & cv::Rect(0, 0, src.cols, src.rows)) != rect)
+        {
+            set_message(resp, STATUS_BAD_REQUEST, "crop rectangle is out of the image");
+            return;
+        }
+        else
+        {
+            out_size = rect.size();
+        }
+    }
+    std::shared_ptr<SharedMemory> output_shm;
+    cv::Mat dst = state.segments.output(output_name, out_size, out_type, output_shm);
+    if (dst.empty())
+    {
+        set_message(resp, STATUS_FAILED, "could not create output '" + output_name + "'");
+        return;
+    }
+    const uchar *target = dst.data;
+
+    const double p0 = req.params[0];
+    const double p1 = req.params[1];
+    try
+    {
+        switch (req.op)
+        {
+        case SERVICE_GRAYSCALE:
+            if (src.channels() == 1)
+            {
+                src.copyTo(dst);
+            }
+            else
+            {
+                fast_grayscale(src, dst);
+            }
+            break;
+        case SERVICE_CROP:
+            src(rect).copyTo(dst);
+            break;
+        case SERVICE_ADD:
+        case SERVICE_SUBTRACT:
+        case SERVICE_MULTIPLY:
+        case SERVICE_DIVIDE:
+            if (!second.empty())
+            {
+                if (req.op == SERVICE_ADD)
+                {
+                    cv::add(src, second, dst);
+                }
+                else if (req.op == SERVICE_SUBTRACT)
+                {
+                    cv::subtract(src, second, dst);
+                }
+                else if (req.op == SERVICE_MULTIPLY)
+                {
+                    cv::multiply(src, second, dst);
+                }
+                else
+                {
+                    cv::divide(src, second, dst);
+                }
+            }
+            else if (req.op == SERVICE_DIVIDE && p0 == 0.0)
+            {
+                set_message(resp, STATUS_BAD_REQUEST, "division by zero");
+                return;
+            }
+            else
+            {
+                // One saturating scale + offset pass, the same rounding as cv::add / cv::multiply with a scalar
+                const double scale = req.op == SERVICE_MULTIPLY ? p0 : req.op == SERVICE_DIVIDE ? 1.0 / p0 : 1.0;
+                const double offset = req.op == SERVICE_ADD ? p0 : req.op == SERVICE_SUBTRACT ? -p0 : 0.0;
+                src.convertTo(dst, -1, scale, offset);
+            }
+            break;
+        case SERVICE_GAMMA:
+            if (p0 <= 0.0)
+            {
+                set_message(resp, STATUS_BAD_REQUEST, "gamma must be > 0");
+                return;
+            }
+            if (src.depth() == CV_8U)
+            {
+                cv::LUT(src, state.luts.gamma(p0), dst);
+            }
+            else
+            {
+                gammaCorrectionLUT(src, p0).copyTo(dst);
+            }
+            break;
+        case SERVICE_CONTRAST:
+            if (src.depth() == CV_8U)
+            {
+                cv::LUT(src, state.luts.contrast(p0, p1), dst);
+            }
+            else if (!adjust_contrast_brightness(src, dst, p0, p1))
+            {
+                set_message(resp, STATUS_FAILED, "unsupported depth for contrast");
+                return;
+            }
+            break;
+        case SERVICE_THRESHOLD:
+            if ((static_cast<int>(req.params[2]) & cv::THRESH_MASK) > cv::THRESH_TOZERO_INV)
+            {
+                set_message(resp, STATUS_BAD_REQUEST, "unknown threshold type");
+                return;
+            }
+            resp.value = fast_threshold(src, dst, p0, p1, static_cast<int>(req.params[2]));
+            break;
+        }
+    }
+    catch (const cv::Exception &e)
+    {
+        // A bad request must not take the service down with it
+        set_message(resp, STATUS_FAILED, e.what());
+        return;
+    }
+    if (dst.data != target)
+    {
+        set_message(resp, STATUS_FAILED, "operation did not produce the expected output type");
+    }
+}
+
+bool same_name(const char *a, const char *b)
+{
+    return a[0] != '\0' && std::strncmp(a, b, SERVICE_NAME_LEN) == 0;
+}
+
+/**
+ * True if b has to run after a: same client (pipelined requests are answered and run in order), or one
+ * of them writes a segment the other reads or writes
+ */
+bool depends_on(const PendingRequest &a, const PendingRequest &b)
+{
+    const ServiceRequest &x = a.request;
+    const ServiceRequest &y = b.request;
+    return a.client == b.client || same_name(x.output, y.input) || same_name(x.output, y.second) ||
+           same_name(x.output, y.output) || same_name(y.output, x.input) || same_name(y.output, x.second);
+}
+
+/**
+ * Splits a batch into groups of dependent requests, each group in batch (arrival) order
+ */
+std::vector<std::vector<int>> independent_groups(const std::vector<PendingRequest> &batch)
+{
+    std::vector<int> parent(batch.size());
+    for (size_t i = 0; i < batch.size(); i++)
+    {
+        parent[i] = static_cast<int>(i);
+    }
+    auto root = [&](int i) {
+        while (parent[i] != i)
+        {
+            i = parent[i] = parent[parent[i]];
+        }
+        return i;
+    };
+    for (size_t i = 0; i < batch.size(); i++)
+    {
+        for (size_t j = i + 1; j < batch.size(); j++)
+        {
+            if (depends_on(batch[i], batch[j]))
+            {
+                parent[root(static_cast<int>(j))] = root(static_cast<int>(i));
+            }
+        }
+    }
+    std::vector<std::vector<int>> groups;
+    std::vector<int> group_of(batch.size(), -1);
+    for (size_t i = 0; i < batch.size(); i++)
+    {
+        const int r = root(static_cast<int>(i));
+        if (group_of[r] < 0)
+        {
+            group_of[r] = static_cast<int>(groups.size());
+            groups.emplace_back();
+        }
+        groups[group_of[r]].push_back(static_cast<int>(i));
+    }
+    return groups;
+}
+
+/**
+ * Runs a batch: independent groups of requests are spread over the pool (the operations then run
+ * single-threaded, OpenCV does not nest parallel loops), the requests of a group one after the other.
+ * A single group runs on this thread with every thread inside its operations
+ */
+void run_batch(std::vector<PendingRequest> &batch, ServiceState &state)
+{
+    INSTRUMENT_SCOPE("service.batch");
+    INSTRUMENT_COUNT("service.requests", batch.size());
+    const auto start = std::chrono::steady_clock::now();
+    std::vector<ServiceResponse> responses(batch.size());
+    const std::vector<std::vector<int>> groups = independent_groups(batch);
+    INSTRUMENT_COUNT("service.groups", groups.size());
+    auto run_group = [&](const std::vector<int> &group) {
+        for (int i : group)
+        {
+            run_request(batch[i].request, responses[i], state);
+        }
+    };
+    if (groups.size() == 1)
+    {
+        run_group(groups[0]);
+    }
+    else
+    {
+        cv::parallel_for_(cv::Range(0, static_cast<int>(groups.size())), [&](const cv::Range &range) {
+            for (int g = range.start; g < range.end; g++)
+            {
+                run_group(groups[g]);
+            }
+        });
+    }
+    const auto ns = std::chrono::duration_cast<std::chrono::nanoseconds>(std::chrono::steady_clock::now() - start);
+    for (size_t i = 0; i < batch.size(); i++)
+    {
+        responses[i].batch_size = static_cast<uint32_t>(batch.size());
+        responses[i].service_ns = static_cast<uint64_t>(ns.count());
+        const char *bytes = reinterpret_cast<const char *>(&responses[i]);
+        std::vector<char> &outbox = batch[i].client->outbox;
+        outbox.insert(outbox.end(), bytes, bytes + sizeof(ServiceResponse));
+    }
+}
+
+/**
+ * Moves every complete request of a client into the batch (up to MAX_BATCH in total)
+ */
+void take_requests(Client &client, std::vector<PendingRequest> &batch)
+{
+    size_t used = 0;
+    while (client.inbox.size() - used >= sizeof(ServiceRequest) && batch.size() < MAX_BATCH)
+    {
+        PendingRequest pending{&client, ServiceRequest()};
+        std::memcpy(&pending.request, client.inbox.data() + used, sizeof(ServiceRequest));
+        batch.push_back(pending);
+        used += sizeof(ServiceRequest);
+    }
+    client.inbox.erase(client.inbox.begin(), client.inbox.begin() + static_cast<std::ptrdiff_t>(used));
+}
+
+void read_client(Client &client)
+{
+    char buffer[16384];
+    while (true)
+    {
+        const ssize_t n = ::read(client.fd, buffer, sizeof(buffer));
+        if (n > 0)
+        {
+            client.inbox.insert(client.inbox.end(), buffer, buffer + n);
+            continue;
+        }
+        if (n < 0 && errno == EINTR)
+        {
+            continue;
+        }
+        if (n == 0 || (errno != EAGAIN && errno != EWOULDBLOCK))
+        {
+            client.closed = true;
+        }
+        return;
+    }
+}
+
+void write_client(Client &client)
+{
+    size_t written = 0;
+    while (written < client.outbox.size())
+    {
+        const ssize_t n = ::send(client.fd, client.outbox.data() + written, client.outbox.size() - written,
+                                 SERVICE_SEND_FLAGS);
+        if (n > 0)
+        {
+            written += static_cast<size_t>(n);
+            continue;
+        }
+        if (n < 0 && errno == EINTR)
+        {
+            continue;
+        }
+        if (n < 0 && errno != EAGAIN && errno != EWOULDBLOCK)
+        {
+            client.closed = true;
+        }
+        break;
+    }
+    client.outbox.erase(client.outbox.begin(), client.outbox.begin() + static_cast<std::ptrdiff_t>(written));
+}
+
+bool set_nonblocking(int fd)
+{
+    const int flags = ::fcntl(fd, F_GETFL, 0);
+    return flags >= 0 && ::fcntl(fd, F_SETFL, flags | O_NONBLOCK) == 0;
+}
+
+/**
+ * Binds the listening socket; a stale socket file is replaced, a live service is left alone
+ */
+int listen_unix_socket(const std::string &path)
+{
+    sockaddr_un addr{};
+    if (path.size() >= sizeof(addr.sun_path))
+    {
+        std::cerr << "Error: Socket path '" << path << "' is too long!" << std::endl;
+        return -1;
+    }
+    int running = connect_unix_socket(path);
+    if (running >= 0)
+    {
+        ::close(running);
+        std::cerr << "Error: A service is already listening on '" << path << "'!" << std::endl;
+        return -1;
+    }
+    ::unlink(path.c_str());
+
+    addr.sun_family = AF_UNIX;
+    std::memcpy(addr.sun_path, path.c_str(), path.size() + 1);
+    int fd = ::socket(AF_UNIX, SOCK_STREAM, 0);
+    if (fd < 0 || ::bind(fd, reinterpret_cast<const sockaddr *>(&addr), sizeof(addr)) != 0 || ::listen(fd, 64) != 0 ||
+        !set_nonblocking(fd))
+    {
+        std::cerr << "Error: Could not listen on '" << path << "'!" << std::endl;
+        if (fd >= 0)
+        {
+            ::close(fd);
+        }
+        return -1;
+    }
+    return fd;
+}
+
+/**
+ * Starts the thread pool and runs every operation once on a small image, so the first real request
+ * does not pay for lazy initialization (thread creation, codec loading, dispatch tables)
+ */
+void warm_up(ServiceState &state)
+{
+    cv::Mat bgr(64, 64, CV_8UC3, cv::Scalar(10, 120, 240));
+    cv::Mat gray, out;
+    cv::parallel_for_(cv::Range(0, std::max(1, cv::getNumThreads())), [](const cv::Range &) {});
+    fast_grayscale(bgr, gray);
+    fast_threshold(gray, out, 127, 255, cv::THRESH_BINARY);
+    cv::LUT(bgr, state.luts.gamma(2.2), out);
+    cv::LUT(bgr, state.luts.contrast(1.5, 20), out);
+    cv::add(bgr, bgr, out);
+    bgr.convertTo(out, -1, 0.5, 10);
+    std::vector<uchar> encoded;
+    cv::imencode(".png", bgr, encoded);
+    cv::imdecode(encoded, cv::IMREAD_UNCHANGED);
+    cv::imencode(".jpg", bgr, encoded);
+    cv::imdecode(encoded, cv::IMREAD_UNCHANGED);
+}
+
+/**
+ * Parses a non-negative integer option value
+ * @return false if text is not a number in [0, max_value]
+ */
+bool parse_count(const char *text, int max_value, int &value)
+{
+    char *end = nullptr;
+    errno = 0;
+    const long parsed = std::strtol(text, &end, 10);
+    if (end == text || *end != '\0' || errno == ERANGE || parsed < 0 || parsed > max_value)
+    {
+        return false;
+    }
+    value = static_cast<int>(parsed);
+    return true;
+}
+
+bool parse_options(int argc, char const *argv[], ServiceOptions &options)
+{
+    for (int i = 1; i < argc; i++)
+    {
+        std::string arg = argv[i];
+        bool has_value = i + 1 < argc;
+        if (arg == "--socket" && has_value)
+        {
+            options.socket_path = argv[++i];
+        }
+        else if (arg == "--threads" && has_value)
+        {
+            if (!parse_count(argv[++i], 1024, options.threads))
+            {
+                return false;
+            }
+        }
+        else if (arg == "--cache-mb" && has_value)
+        {
+            int megabytes = 0;
+            if (!parse_count(argv[++i], 1 << 20, megabytes))
+            {
+                return false;
+            }
+            options.cache_bytes = static_cast<size_t>(megabytes) << 20;
+        }
+        else
+        {
+            return false;
+        }
+    }
+    return true;
+}
+
+int main(int argc, char const *argv[])
+{
+    ServiceOptions options;
+    if (!parse_options(argc, argv, options))
+    {
+        std::cerr << "Usage: " << argv[0] << " [--socket PATH] [--threads N] [--cache-mb N]" << std::endl;
+        return -1;
+    }
+    if (options.threads > 0)
+    {
+        cv::setNumThreads(options.threads);
+    }
+    std::signal(SIGINT, on_signal);
+    std::signal(SIGTERM, on_signal);
+    std::signal(SIGPIPE, SIG_IGN);
+
+    ServiceState state(options.cache_bytes);
+    warm_up(state);
+    int listen_fd = listen_unix_socket(options.socket_path);
+    if (listen_fd < 0)
+    {
+        return -1;
+    }
+    std::cout << "Processing service on '" << options.socket_path << "' | OpenCV " << CV_VERSION
+              << " | Threads: " << cv::getNumThreads() << std::endl;
+
+    std::list<Client> clients;
+    std::vector<pollfd> fds;
+    std::vector<Client *> polled;
+    std::vector<PendingRequest> batch;
+    uint64_t served = 0, batches = 0;
+    size_t largest_batch = 0;
+    while (!stop_requested)
+    {
+        // Requests already received (left over from a full batch) must not wait for the next event
+        bool pending = false;
+        fds.assign(1, pollfd{listen_fd, POLLIN, 0});
+        polled.clear();
+        for (Client &client : clients)
+        {
+            short events = client.outbox.size() < OUTBOX_LIMIT ? POLLIN : 0;
+            if (!client.outbox.empty())
+            {
+                events |= POLLOUT;
+            }
+            pending = pending || client.inbox.size() >= sizeof(ServiceRequest);
+            fds.push_back(pollfd{client.fd, events, 0});
+            polled.push_back(&client);
+        }
+        if (::poll(fds.data(), fds.size(), pending ? 0 : POLL_TIMEOUT_MS) < 0 && errno != EINTR)
+        {
+            std::cerr << "Error: poll failed!" << std::endl;
+            break;
+        }
+
+        if (fds[0].revents & POLLIN)
+        {
+            int fd;
+            while ((fd = ::accept(listen_fd, nullptr, nullptr)) >= 0)
+            {
+                if (!set_nonblocking(fd))
+                {
+                    ::close(fd);
+                    continue;
+                }
+                clients.push_back(Client());
+                clients.back().fd = fd;
+            }
+        }
+
+        batch.clear();
+        for (size_t i = 0; i < polled.size(); i++)
+        {
+            Client &client = *polled[i];
+            if (fds[i + 1].revents & (POLLIN | POLLHUP | POLLERR))
+            {
+                read_client(client);
+            }
+            take_requests(client, batch);
+        }
+        if (!batch.empty())
+        {
+            run_batch(batch, state);
+            served += batch.size();
+            batches++;
+            largest_batch = std::max(largest_batch, batch.size());
+        }
+
+        for (auto it = clients.begin(); it != clients.end();)
+        {
+            if (!it->outbox.empty() && !it->closed)
+            {
+                write_client(*it);
+            }
+            if (it->closed)
+            {
+                ::close(it->fd);
+                it = clients.erase(it);
+            }
+            else
+            {
+                ++it;
+            }
+        }
+    }
+
+    for (Client &client : clients)
+    {
+        ::close(client.fd);
+    }
+    ::close(listen_fd);
+    ::unlink(options.socket_path.c_str());
+    std::cout << "\nServed " << served << " request(s) in " << batches << " batch(es), largest batch "
+              << largest_batch << std::endl;
+    INSTRUMENT_REPORT("service");
+    return 0;
+}